@@ -14,6 +14,21 @@
       "cflags_cc!": [ "-fno-exceptions" ],
       "sources": [
         "src/addon/native.cc",
+        "src/addon/composite.cc",
+        "src/addon/fill.cc",
+        "src/addon/scale.cc",
+        "src/addon/rasterize.cc",
+        "src/addon/tile_store.cc",
+        "src/addon/tile_cache.cc",
+        "src/addon/frame_scheduler.cc",
+        "src/addon/frame_stats.cc",
+        "src/addon/event_batch.cc",
+        "src/addon/gif_encode.cc",
+        "src/addon/gif_writer.cc",
+        "src/addon/png_encode.cc",
+        "src/addon/png_sink.cc",
+        "src/addon/video_stream.cc",
+        "src/addon/video_sink.cc",
         "src/addon/sdl_backend.cc",
         "src/addon/rpi_backend.cc",
         "src/addon/adafruithat_backend.cc",
@@ -31,6 +46,7 @@
         "ENABLE_IMAGE",
         "ENABLE_TTF",
         "NAPI_DISABLE_CPP_EXCEPTIONS",
+        "NAPI_VERSION=7",
         "<!(node ./tools/locate_sdl symbol)",
       ]
     }
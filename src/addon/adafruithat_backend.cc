@@ -5,7 +5,7 @@
 
 #include "adafruithat_backend.h"
 #include "type.h"
-#include "wait_frame_unix.h"
+#include "wait_frame.h"
 
 #define ALIGN64(n) ((n+63)&(~63))
 #define RGB_PIXEL_SIZE 4
@@ -39,6 +39,8 @@ void AdafruitHatBackend::InitClass(Napi::Env env, Napi::Object exports) {
        InstanceMethod("runAppLoop", &AdafruitHatBackend::RunAppLoop),
        InstanceMethod("insteadWriteBuffer", &AdafruitHatBackend::InsteadWriteBuffer),
        InstanceMethod("getFeatureList", &AdafruitHatBackend::GetFeatureList),
+       InstanceMethod("getStats", &AdafruitHatBackend::GetStats),
+       InstanceMethod("getTrace", &AdafruitHatBackend::GetTrace),
   });
   g_adafruitHatDisplayConstructor = Napi::Persistent(func);
   g_adafruitHatDisplayConstructor.SuppressDestruct();
@@ -76,7 +78,28 @@ Napi::Value AdafruitHatBackend::BeginRender(const Napi::CallbackInfo& info) {
 }
 
 Napi::Value AdafruitHatBackend::Config(const Napi::CallbackInfo& info) {
-  return info.Env().Null();
+  Napi::Env env = info.Env();
+  if (info.Length() < 2) {
+    printf("Config needs two parameters\n");
+    return env.Null();
+  }
+
+  std::string field = info[0].ToString().Utf8Value();
+  if (field == std::string("rate")) {
+    // config('rate', hz)
+    this->scheduler.setRate(info[1].ToNumber().Int32Value());
+
+  } else if (field == std::string("pacing")) {
+    // config('pacing', 'catchup' or 'skip')
+    std::string policy = info[1].ToString().Utf8Value();
+    if (policy == std::string("skip")) {
+      this->scheduler.setPolicy(PACING_SKIP);
+    } else {
+      this->scheduler.setPolicy(PACING_CATCH_UP);
+    }
+
+  }
+  return env.Null();
 }
 
 Napi::Value AdafruitHatBackend::EventReceiver(const Napi::CallbackInfo& info) {
@@ -88,6 +111,8 @@ Napi::Value AdafruitHatBackend::RunAppLoop(const Napi::CallbackInfo& info) {
 
   Napi::Value runIDVal = info[0];
   this->execNextFrame = Napi::Persistent(info[1].As<Napi::Function>());
+  this->scheduler.start();
+  this->stats.setPeriodUs(1000000 / this->scheduler.rate());
   this->execOneFrame(info);
   return env.Null();
 }
@@ -95,6 +120,7 @@ Napi::Value AdafruitHatBackend::RunAppLoop(const Napi::CallbackInfo& info) {
 
 void AdafruitHatBackend::execOneFrame(const Napi::CallbackInfo& info) {
   Napi::Env env = info.Env();
+  this->stats.beginFrame();
 
   if (interrupt_received) {
     delete matrix;
@@ -114,13 +140,16 @@ void AdafruitHatBackend::execOneFrame(const Napi::CallbackInfo& info) {
     return;
   }
 
-  // call the executor
+  // call the executor, with the number of frames the scheduler dropped
   napi_value needRenderVal;
-  needRenderVal = this->execNextFrame.Call(self, 0, NULL);
+  int missed = this->scheduler.takeMissed();
+  needRenderVal = this->execNextFrame.Call(self,
+                                           {Napi::Number::New(env, missed)});
   if (env.IsExceptionPending()) {
     printf("exception!!\n");
     return;
   }
+  this->stats.mark(PHASE_EXEC);
 
   // Call the render function.
   napi_value resVal;
@@ -136,6 +165,7 @@ void AdafruitHatBackend::execOneFrame(const Napi::CallbackInfo& info) {
   if (env.IsExceptionPending()) {
     return;
   }
+  this->stats.mark(PHASE_RENDER);
 
   // Get the pitch of the first layer, assume it is constant.
   // TODO: Fix this assumption
@@ -156,6 +186,7 @@ void AdafruitHatBackend::execOneFrame(const Napi::CallbackInfo& info) {
 
 
   this->displayFrameOnHardware();
+  this->stats.mark(PHASE_PRESENT);
   this->next(env);
 }
 
@@ -168,7 +199,7 @@ static void BeginNextFrame(const Napi::CallbackInfo& info) {
 void AdafruitHatBackend::next(Napi::Env env) {
   Napi::Function cont = Napi::Function::New(env, BeginNextFrame,
                                             "<unknown>", this);
-  WaitFrame* w = new WaitFrame(cont, 16);
+  WaitFrame* w = new WaitFrame(cont, &this->scheduler, &this->stats);
   w->Queue();
 }
 
@@ -176,6 +207,16 @@ Napi::Value AdafruitHatBackend::InsteadWriteBuffer(const Napi::CallbackInfo& inf
   return info.Env().Null();
 }
 
+// Timing of recent frames, split into phases, see frame_stats.h
+Napi::Value AdafruitHatBackend::GetStats(const Napi::CallbackInfo& info) {
+  return frameStatsToValue(info.Env(), &this->stats);
+}
+
+// Recent frames as Chrome trace-event JSON
+Napi::Value AdafruitHatBackend::GetTrace(const Napi::CallbackInfo& info) {
+  return Napi::String::New(info.Env(), this->stats.traceJSON());
+}
+
 Napi::Value AdafruitHatBackend::GetFeatureList(const Napi::CallbackInfo& info) {
   Napi::Env env = info.Env();
   Napi::Array features = Napi::Array::New(env);
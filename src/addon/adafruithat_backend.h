@@ -2,6 +2,9 @@
 
 #include <napi.h>
 
+#include "frame_scheduler.h"
+#include "frame_stats.h"
+
 class AdafruitHatBackend : public Napi::ObjectWrap<AdafruitHatBackend> {
  public:
   static void InitClass(Napi::Env env, Napi::Object exports);
@@ -18,6 +21,8 @@ class AdafruitHatBackend : public Napi::ObjectWrap<AdafruitHatBackend> {
   Napi::Value RunAppLoop(const Napi::CallbackInfo& info);
   Napi::Value InsteadWriteBuffer(const Napi::CallbackInfo& info);
   Napi::Value GetFeatureList(const Napi::CallbackInfo& info);
+  Napi::Value GetStats(const Napi::CallbackInfo& info);
+  Napi::Value GetTrace(const Napi::CallbackInfo& info);
   void next(Napi::Env env);
   void displayFrameOnHardware();
 
@@ -25,6 +30,8 @@ class AdafruitHatBackend : public Napi::ObjectWrap<AdafruitHatBackend> {
   int viewHeight;
   int datasourcePitch;
   unsigned char* dataSource;
+  FrameScheduler scheduler;
+  FrameStats stats;
   napi_ref rendererRef;
   Napi::FunctionReference renderFunc;
   Napi::FunctionReference execNextFrame;
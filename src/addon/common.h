@@ -1,3 +1,15 @@
 #include "napi.h"
+#include <vector>
+
+#include "frame_stats.h"
+#include "rasterize.h"
 
 unsigned char* surfaceToRawBuffer(Napi::Value surfaceVal);
+unsigned char* typedArrayToRawBuffer(Napi::Value typedArrayVal);
+bool bufferFits(Napi::Value typedArrayVal, int pitch, int width, int height,
+                int bytesPerPixel);
+Napi::Value frameStatsToValue(Napi::Env env, FrameStats* stats);
+bool cellAttrsFromValue(Napi::Value cellsVal, CellAttrs* cells);
+void tileListFromValue(Napi::Array tileList, std::vector<const uint8_t*>* tiles,
+                       std::vector<int>* tilePitches);
+bool tileListFits(Napi::Array tileList, int tileWidth, int tileHeight);
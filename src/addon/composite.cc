@@ -0,0 +1,186 @@
+#include "composite.h"
+
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define COMPOSITE_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define COMPOSITE_NEON
+#endif
+
+#define RGB_PIXEL_SIZE 4
+#define ALPHA_OFFSET 3
+#define PIXELS_PER_VECTOR 4
+
+
+// floor(x / 255) for 0 <= x <= 255*255, without a division
+static inline int div_255(int x) {
+  return (x + 1 + (x >> 8)) >> 8;
+}
+
+static inline void blend_pixel(uint8_t* dest, const uint8_t* source) {
+  int alpha = source[ALPHA_OFFSET];
+  if (alpha == 0x00) {
+    return;
+  }
+  if (alpha == 0xff) {
+    memcpy(dest, source, RGB_PIXEL_SIZE);
+    return;
+  }
+  int inverse = 0xff - alpha;
+  dest[0] = div_255(dest[0] * inverse + source[0] * alpha);
+  dest[1] = div_255(dest[1] * inverse + source[1] * alpha);
+  dest[2] = div_255(dest[2] * inverse + source[2] * alpha);
+}
+
+#if defined(COMPOSITE_SSE2)
+
+// Blend 4 pixels at once, skipping the math if they are all transparent,
+// or all opaque
+static inline __m128i blend_vector(__m128i dest, __m128i source) {
+  const __m128i alphaMask = _mm_set1_epi32((int)0xff000000);
+  const __m128i zero = _mm_setzero_si128();
+  __m128i alpha = _mm_and_si128(source, alphaMask);
+  if (_mm_movemask_epi8(_mm_cmpeq_epi32(alpha, zero)) == 0xffff) {
+    return dest;
+  }
+  if (_mm_movemask_epi8(_mm_cmpeq_epi32(alpha, alphaMask)) == 0xffff) {
+    return source;
+  }
+
+  // Copy each alpha value into every channel of its pixel
+  __m128i a = _mm_srli_epi32(source, 24);
+  a = _mm_or_si128(a, _mm_slli_epi32(a, 8));
+  a = _mm_or_si128(a, _mm_slli_epi32(a, 16));
+
+  const __m128i full = _mm_set1_epi16(0xff);
+  const __m128i one = _mm_set1_epi16(1);
+
+  __m128i aLo = _mm_unpacklo_epi8(a, zero);
+  __m128i aHi = _mm_unpackhi_epi8(a, zero);
+  __m128i lo = _mm_add_epi16(
+      _mm_mullo_epi16(_mm_unpacklo_epi8(dest, zero), _mm_sub_epi16(full, aLo)),
+      _mm_mullo_epi16(_mm_unpacklo_epi8(source, zero), aLo));
+  __m128i hi = _mm_add_epi16(
+      _mm_mullo_epi16(_mm_unpackhi_epi8(dest, zero), _mm_sub_epi16(full, aHi)),
+      _mm_mullo_epi16(_mm_unpackhi_epi8(source, zero), aHi));
+
+  lo = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(lo, one),
+                                    _mm_srli_epi16(lo, 8)), 8);
+  hi = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(hi, one),
+                                    _mm_srli_epi16(hi, 8)), 8);
+  return _mm_packus_epi16(lo, hi);
+}
+
+static int composite_row(uint8_t* dest, const uint8_t* const* sources,
+                         int numSources, int width) {
+  const __m128i alphaMask = _mm_set1_epi32((int)0xff000000);
+  int x = 0;
+  for (; x + PIXELS_PER_VECTOR <= width; x += PIXELS_PER_VECTOR) {
+    int offset = x * RGB_PIXEL_SIZE;
+    __m128i d = _mm_loadu_si128((const __m128i*)(dest + offset));
+    for (int n = 0; n < numSources; n++) {
+      __m128i s = _mm_loadu_si128((const __m128i*)(sources[n] + offset));
+      d = blend_vector(d, s);
+    }
+    d = _mm_or_si128(d, alphaMask);
+    _mm_storeu_si128((__m128i*)(dest + offset), d);
+  }
+  return x;
+}
+
+#elif defined(COMPOSITE_NEON)
+
+static inline bool all_lanes_set(uint32x4_t mask) {
+  uint64x2_t m = vreinterpretq_u64_u32(mask);
+  return (vgetq_lane_u64(m, 0) & vgetq_lane_u64(m, 1)) == ~0ULL;
+}
+
+// Blend 4 pixels at once, skipping the math if they are all transparent,
+// or all opaque
+static inline uint8x16_t blend_vector(uint8x16_t dest, uint8x16_t source) {
+  uint32x4_t alpha = vshrq_n_u32(vreinterpretq_u32_u8(source), 24);
+  if (all_lanes_set(vceqq_u32(alpha, vdupq_n_u32(0x00)))) {
+    return dest;
+  }
+  if (all_lanes_set(vceqq_u32(alpha, vdupq_n_u32(0xff)))) {
+    return source;
+  }
+
+  // Copy each alpha value into every channel of its pixel
+  uint8x16_t a = vreinterpretq_u8_u32(vmulq_n_u32(alpha, 0x01010101));
+  uint8x16_t inverse = vmvnq_u8(a);
+  const uint16x8_t one = vdupq_n_u16(1);
+
+  uint16x8_t lo = vmull_u8(vget_low_u8(dest), vget_low_u8(inverse));
+  lo = vmlal_u8(lo, vget_low_u8(source), vget_low_u8(a));
+  uint16x8_t hi = vmull_u8(vget_high_u8(dest), vget_high_u8(inverse));
+  hi = vmlal_u8(hi, vget_high_u8(source), vget_high_u8(a));
+
+  lo = vshrq_n_u16(vaddq_u16(vaddq_u16(lo, one), vshrq_n_u16(lo, 8)), 8);
+  hi = vshrq_n_u16(vaddq_u16(vaddq_u16(hi, one), vshrq_n_u16(hi, 8)), 8);
+  return vcombine_u8(vmovn_u16(lo), vmovn_u16(hi));
+}
+
+static int composite_row(uint8_t* dest, const uint8_t* const* sources,
+                         int numSources, int width) {
+  const uint8x16_t alphaMask = vreinterpretq_u8_u32(vdupq_n_u32(0xff000000));
+  int x = 0;
+  for (; x + PIXELS_PER_VECTOR <= width; x += PIXELS_PER_VECTOR) {
+    int offset = x * RGB_PIXEL_SIZE;
+    uint8x16_t d = vld1q_u8(dest + offset);
+    for (int n = 0; n < numSources; n++) {
+      d = blend_vector(d, vld1q_u8(sources[n] + offset));
+    }
+    d = vorrq_u8(d, alphaMask);
+    vst1q_u8(dest + offset, d);
+  }
+  return x;
+}
+
+#else
+
+static int composite_row(uint8_t* dest, const uint8_t* const* sources,
+                         int numSources, int width) {
+  return 0;
+}
+
+#endif
+
+void composite_surfaces(uint8_t* dest, int destPitch, int width, int height,
+                        const uint8_t* const* sources, const int* sourcePitches,
+                        int numSources) {
+  if (numSources <= 0) {
+    return;
+  }
+  const int maxRowSources = 16;
+  const uint8_t* row[maxRowSources];
+
+  // Too many layers to hold row pointers for at once, do them in batches
+  if (numSources > maxRowSources) {
+    composite_surfaces(dest, destPitch, width, height,
+                       sources, sourcePitches, maxRowSources);
+    composite_surfaces(dest, destPitch, width, height,
+                       sources + maxRowSources, sourcePitches + maxRowSources,
+                       numSources - maxRowSources);
+    return;
+  }
+
+  for (int y = 0; y < height; y++) {
+    uint8_t* out = dest + y * destPitch;
+    for (int n = 0; n < numSources; n++) {
+      row[n] = sources[n] + y * sourcePitches[n];
+    }
+    // Vectorized part of the row, then the remaining pixels one at a time
+    int x = composite_row(out, row, numSources, width);
+    for (; x < width; x++) {
+      uint8_t* pixel = out + x * RGB_PIXEL_SIZE;
+      for (int n = 0; n < numSources; n++) {
+        blend_pixel(pixel, row[n] + x * RGB_PIXEL_SIZE);
+      }
+      pixel[ALPHA_OFFSET] = 0xff;
+    }
+  }
+}
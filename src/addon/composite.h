@@ -0,0 +1,14 @@
+#ifndef COMPOSITE_H
+#define COMPOSITE_H
+
+#include <stdint.h>
+
+// Blend a list of RGBA surfaces, in order, onto dest. Every surface has the
+// same width and height as dest. Each channel becomes
+// floor((dest * (255 - alpha) + source * alpha) / 255), and the alpha of dest
+// becomes opaque. Uses SSE2 or NEON when the compiler targets them.
+void composite_surfaces(uint8_t* dest, int destPitch, int width, int height,
+                        const uint8_t* const* sources, const int* sourcePitches,
+                        int numSources);
+
+#endif
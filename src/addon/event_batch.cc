@@ -0,0 +1,27 @@
+#include "event_batch.h"
+
+void EventBatch::add(int type, int code, int x, int y, uint32_t timestamp) {
+  size_t size = this->values.size();
+  if (type == EVENT_MOUSE_MOVE && size >= EVENT_FIELDS &&
+      this->values[size - EVENT_FIELDS] == EVENT_MOUSE_MOVE) {
+    size -= EVENT_FIELDS;
+    this->values.resize(size);
+  }
+  this->values.push_back(type);
+  this->values.push_back(code);
+  this->values.push_back(x);
+  this->values.push_back(y);
+  this->values.push_back((int32_t)timestamp);
+}
+
+void EventBatch::clear() {
+  this->values.clear();
+}
+
+int EventBatch::count() const {
+  return this->values.size() / EVENT_FIELDS;
+}
+
+const int32_t* EventBatch::data() const {
+  return this->values.data();
+}
@@ -0,0 +1,34 @@
+#ifndef EVENT_BATCH_H
+#define EVENT_BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Event types, see EventManager.getNativeBatch in event_manager.js
+#define EVENT_KEY_DOWN 1
+#define EVENT_KEY_UP 2
+#define EVENT_MOUSE_DOWN 3
+#define EVENT_MOUSE_UP 4
+#define EVENT_MOUSE_MOVE 5
+
+// Values for each event: type, code, x, y, timestamp
+#define EVENT_FIELDS 5
+
+// Input events gathered over one frame, packed so that they reach js all at
+// once. The code is the key for key events, or the mouse button. Mouse
+// motion that follows other motion only updates its position, since only
+// the latest one matters by the time js sees them.
+class EventBatch {
+ public:
+  void add(int type, int code, int x, int y, uint32_t timestamp);
+  void clear();
+  int count() const;
+  // count() * EVENT_FIELDS values
+  const int32_t* data() const;
+
+ private:
+  std::vector<int32_t> values;
+};
+
+#endif
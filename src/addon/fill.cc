@@ -0,0 +1,119 @@
+#include "fill.h"
+
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+
+static void reset_bounds(int width, int height, int32_t* bounds) {
+  bounds[0] = width;
+  bounds[1] = height;
+  bounds[2] = -1;
+  bounds[3] = -1;
+}
+
+static void grow_bounds(int x0, int y0, int x1, int y1, int32_t* bounds) {
+  bounds[0] = std::min(bounds[0], x0);
+  bounds[1] = std::min(bounds[1], y0);
+  bounds[2] = std::max(bounds[2], x1);
+  bounds[3] = std::max(bounds[3], y1);
+}
+
+void flood_fill(uint8_t* data, int pitch, int width, int height,
+                int x, int y, uint8_t color, int32_t* bounds) {
+  reset_bounds(width, height, bounds);
+  if (x < 0 || x >= width || y < 0 || y >= height) {
+    return;
+  }
+  uint8_t target = data[y * pitch + x];
+  if (target == color) {
+    return;
+  }
+
+  // Seeds of spans, kept between calls so that filling doesn't allocate
+  static std::vector<int32_t> stack;
+  stack.clear();
+  stack.push_back(x);
+  stack.push_back(y);
+  while (!stack.empty()) {
+    int sy = stack.back();
+    stack.pop_back();
+    int sx = stack.back();
+    stack.pop_back();
+    uint8_t* row = data + sy * pitch;
+    if (row[sx] != target) {
+      continue;
+    }
+    // Extend the span in both directions, then fill it
+    int x0 = sx;
+    int x1 = sx;
+    while (x0 > 0 && row[x0 - 1] == target) {
+      x0--;
+    }
+    while (x1 < width - 1 && row[x1 + 1] == target) {
+      x1++;
+    }
+    memset(row + x0, color, x1 - x0 + 1);
+    grow_bounds(x0, sy, x1, sy, bounds);
+    // Seed each run of matching pixels in the rows above and below
+    for (int ny = sy - 1; ny <= sy + 1; ny += 2) {
+      if (ny < 0 || ny >= height) {
+        continue;
+      }
+      const uint8_t* nrow = data + ny * pitch;
+      bool inRun = false;
+      for (int nx = x0; nx <= x1; nx++) {
+        bool match = nrow[nx] == target;
+        if (match && !inRun) {
+          stack.push_back(nx);
+          stack.push_back(ny);
+        }
+        inRun = match;
+      }
+    }
+  }
+}
+
+void fill_ranges(uint8_t* data, int pitch, int width, int height,
+                 const int32_t* ranges, int numRanges, uint8_t color,
+                 int32_t* bounds) {
+  reset_bounds(width, height, bounds);
+  for (int n = 0; n < numRanges; n++) {
+    int x0 = ranges[n*4+0];
+    int x1 = ranges[n*4+1];
+    int y0 = ranges[n*4+2];
+    int y1 = ranges[n*4+3];
+    if (x0 > x1) {
+      std::swap(x0, x1);
+    }
+    if (y0 > y1) {
+      std::swap(y0, y1);
+    }
+    if (x0 == x1) {
+      // Vertical
+      if (x0 < 0 || x0 >= width) {
+        continue;
+      }
+      y0 = std::max(y0, 0);
+      y1 = std::min(y1, height - 1);
+      for (int y = y0; y <= y1; y++) {
+        data[y * pitch + x0] = color;
+      }
+    } else if (y0 == y1) {
+      // Horizontal
+      if (y0 < 0 || y0 >= height) {
+        continue;
+      }
+      x0 = std::max(x0, 0);
+      x1 = std::min(x1, width - 1);
+      if (x0 <= x1) {
+        memset(data + y0 * pitch + x0, color, x1 - x0 + 1);
+      }
+    } else {
+      continue;
+    }
+    if (x0 <= x1 && y0 <= y1) {
+      grow_bounds(x0, y0, x1, y1, bounds);
+    }
+  }
+}
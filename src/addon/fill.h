@@ -0,0 +1,22 @@
+#ifndef FILL_H
+#define FILL_H
+
+#include <stdint.h>
+
+// Drawing kernels that write a color index straight into a field's data.
+// The data pointer is the field's upper-left pixel, and bounds is set to
+// {minX, minY, maxX, maxY} of the pixels written, with maxX < minX if there
+// were none.
+
+// Fill the 4-connected area that has the same value as x,y with color, one
+// horizontal span at a time.
+void flood_fill(uint8_t* data, int pitch, int width, int height,
+                int x, int y, uint8_t color, int32_t* bounds);
+
+// Write color to each range, a row of {x0, x1, y0, y1} that is either
+// vertical or horizontal and includes both ends, clipped to the field.
+void fill_ranges(uint8_t* data, int pitch, int width, int height,
+                 const int32_t* ranges, int numRanges, uint8_t color,
+                 int32_t* bounds);
+
+#endif
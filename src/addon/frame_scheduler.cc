@@ -0,0 +1,110 @@
+#include "frame_scheduler.h"
+
+#include <chrono>
+#include <thread>
+
+#if defined(__linux__)
+#include <errno.h>
+#include <time.h>
+#endif
+
+#define DEFAULT_RATE 60
+#define MAX_RATE 240
+#define NANOS_PER_SEC 1000000000LL
+
+// Late frames beyond this many periods are dropped, even when catching up
+#define MAX_CATCH_UP 4
+
+
+// Current time of the monotonic clock, in nanoseconds
+static int64_t now_ns() {
+#if defined(__linux__)
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * NANOS_PER_SEC + ts.tv_nsec;
+#else
+  auto since = std::chrono::steady_clock::now().time_since_epoch();
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(since).count();
+#endif
+}
+
+static void sleep_until_ns(int64_t deadline) {
+#if defined(__linux__)
+  timespec ts;
+  ts.tv_sec = deadline / NANOS_PER_SEC;
+  ts.tv_nsec = deadline % NANOS_PER_SEC;
+  // Absolute deadlines can simply be retried if a signal interrupts
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+  }
+#else
+  std::chrono::steady_clock::time_point when{std::chrono::nanoseconds(deadline)};
+  std::this_thread::sleep_until(when);
+#endif
+}
+
+FrameScheduler::FrameScheduler() {
+  this->policy = PACING_CATCH_UP;
+  this->missed = 0;
+  this->deadlineNs = 0;
+  this->setRate(DEFAULT_RATE);
+}
+
+void FrameScheduler::setRate(int hz) {
+  if (hz <= 0 || hz > MAX_RATE) {
+    hz = DEFAULT_RATE;
+  }
+  this->hz = hz;
+  this->periodNs = NANOS_PER_SEC / hz;
+}
+
+void FrameScheduler::setPolicy(int policy) {
+  this->policy = policy;
+}
+
+void FrameScheduler::start() {
+  this->deadlineNs = now_ns();
+  this->missed = 0;
+}
+
+void FrameScheduler::waitNext() {
+  this->advance(true);
+}
+
+void FrameScheduler::markFrame() {
+  this->advance(false);
+}
+
+int FrameScheduler::takeMissed() {
+  return this->missed.exchange(0);
+}
+
+int FrameScheduler::rate() {
+  return this->hz;
+}
+
+void FrameScheduler::advance(bool shouldSleep) {
+  if (this->deadlineNs == 0) {
+    this->start();
+  }
+  this->deadlineNs += this->periodNs;
+
+  int64_t now = now_ns();
+  if (now < this->deadlineNs) {
+    if (shouldSleep) {
+      sleep_until_ns(this->deadlineNs);
+    }
+    return;
+  }
+
+  // Less than a whole period late runs right away, and keeps the deadline
+  int64_t behind = (now - this->deadlineNs) / this->periodNs;
+  if (behind == 0) {
+    return;
+  }
+  if (this->policy == PACING_CATCH_UP && behind <= MAX_CATCH_UP) {
+    // Keep the deadline, the next frames return at once until caught up
+    return;
+  }
+  this->deadlineNs += behind * this->periodNs;
+  this->missed += (int)behind;
+}
@@ -0,0 +1,44 @@
+#ifndef FRAME_SCHEDULER_H
+#define FRAME_SCHEDULER_H
+
+#include <stdint.h>
+#include <atomic>
+
+#define PACING_CATCH_UP 0
+#define PACING_SKIP 1
+
+// Paces frames against absolute deadlines on the monotonic clock, so that
+// time spent running a frame does not push back the frames after it.
+//
+// When a frame starts a whole period or more after its deadline, the
+// catch-up policy runs the late frames back to back, up to a limit, while
+// the skip policy drops them. Dropped deadlines are counted until taken by
+// the main thread, which may happen while a worker is waiting.
+class FrameScheduler {
+ public:
+  FrameScheduler();
+  // Frames per second, 30, 50, 60 and 120 are typical
+  void setRate(int hz);
+  void setPolicy(int policy);
+  // Begin counting deadlines from now
+  void start();
+  // Block until the next deadline, call from a worker thread
+  void waitNext();
+  // Move the deadline forward without sleeping, for frames paced by
+  // something else, like vsync
+  void markFrame();
+  // Number of deadlines dropped since the last call
+  int takeMissed();
+  int rate();
+
+ private:
+  void advance(bool shouldSleep);
+
+  int hz;
+  int policy;
+  int64_t periodNs;
+  int64_t deadlineNs;
+  std::atomic<int> missed;
+};
+
+#endif
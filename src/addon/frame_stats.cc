@@ -0,0 +1,173 @@
+#include "frame_stats.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+static const char* g_phaseNames[NUM_PHASES] = {
+  "exec", "render", "upload", "present", "idle"};
+
+static const int g_jitterEdgesUs[NUM_JITTER_BUCKETS - 1] = {
+  -4000, -2000, -1000, -250, 250, 1000, 2000, 4000};
+
+
+FrameStats::FrameStats() {
+  this->numRecords = 0;
+  this->next = 0;
+  this->periodUs = 16667;
+  this->isOpen = false;
+  this->lastMarkNs = 0;
+  memset(&this->current, 0, sizeof(this->current));
+  memset(this->workerStartNs, 0, sizeof(this->workerStartNs));
+  memset(this->workerNs, 0, sizeof(this->workerNs));
+}
+
+int64_t FrameStats::now() {
+  auto since = std::chrono::steady_clock::now().time_since_epoch();
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(since).count();
+}
+
+const char* FrameStats::phaseName(int phase) {
+  return g_phaseNames[phase];
+}
+
+void FrameStats::setPeriodUs(int periodUs) {
+  this->periodUs = periodUs;
+}
+
+void FrameStats::beginFrame() {
+  int64_t t = FrameStats::now();
+  if (this->isOpen) {
+    this->closeFrame(t);
+  }
+  memset(&this->current, 0, sizeof(this->current));
+  this->current.startNs = t;
+  this->lastMarkNs = t;
+  this->isOpen = true;
+}
+
+void FrameStats::mark(int phase) {
+  if (!this->isOpen) {
+    return;
+  }
+  int64_t t = FrameStats::now();
+  if (this->current.phaseNs[phase] == 0) {
+    this->current.phaseStartNs[phase] = this->lastMarkNs;
+  }
+  this->current.phaseNs[phase] += t - this->lastMarkNs;
+  this->lastMarkNs = t;
+}
+
+void FrameStats::addPhase(int phase, int64_t startNs, int64_t lengthNs) {
+  std::lock_guard<std::mutex> guard(this->workerLock);
+  if (this->workerNs[phase] == 0) {
+    this->workerStartNs[phase] = startNs;
+  }
+  this->workerNs[phase] += lengthNs;
+}
+
+void FrameStats::closeFrame(int64_t endNs) {
+  FrameRecord* rec = &this->current;
+  rec->lengthNs = endNs - rec->startNs;
+  {
+    std::lock_guard<std::mutex> guard(this->workerLock);
+    for (int p = 0; p < NUM_PHASES; p++) {
+      if (this->workerNs[p] == 0) {
+        continue;
+      }
+      if (rec->phaseNs[p] == 0) {
+        rec->phaseStartNs[p] = this->workerStartNs[p];
+      }
+      rec->phaseNs[p] += this->workerNs[p];
+      this->workerNs[p] = 0;
+    }
+  }
+  this->records[this->next] = *rec;
+  this->next = (this->next + 1) % STATS_CAPACITY;
+  if (this->numRecords < STATS_CAPACITY) {
+    this->numRecords++;
+  }
+}
+
+static Percentiles percentiles_of(std::vector<int64_t>* values) {
+  Percentiles res;
+  memset(&res, 0, sizeof(res));
+  int count = values->size();
+  if (count == 0) {
+    return res;
+  }
+  std::sort(values->begin(), values->end());
+  // nearest-rank percentiles
+  res.p50 = (*values)[(count * 50 + 99) / 100 - 1];
+  res.p95 = (*values)[(count * 95 + 99) / 100 - 1];
+  res.p99 = (*values)[(count * 99 + 99) / 100 - 1];
+  res.max = (*values)[count - 1];
+  return res;
+}
+
+void FrameStats::summarize(StatsSummary* out) {
+  memset(out, 0, sizeof(*out));
+  int count = this->numRecords;
+  out->numFrames = count;
+  int first = (this->next - count + STATS_CAPACITY) % STATS_CAPACITY;
+
+  std::vector<int64_t> values(count);
+  for (int k = 0; k < count; k++) {
+    values[k] = this->records[(first + k) % STATS_CAPACITY].lengthNs;
+  }
+  out->frame = percentiles_of(&values);
+  for (int p = 0; p < NUM_PHASES; p++) {
+    for (int k = 0; k < count; k++) {
+      values[k] = this->records[(first + k) % STATS_CAPACITY].phaseNs[p];
+    }
+    out->phases[p] = percentiles_of(&values);
+  }
+
+  // Jitter is how far each frame's length is from the target period
+  memcpy(out->jitterEdgesUs, g_jitterEdgesUs, sizeof(g_jitterEdgesUs));
+  for (int k = 0; k < count; k++) {
+    const FrameRecord* rec = &this->records[(first + k) % STATS_CAPACITY];
+    int deltaUs = rec->lengthNs / 1000 - this->periodUs;
+    int b = 0;
+    while (b < NUM_JITTER_BUCKETS - 1 && deltaUs > g_jitterEdgesUs[b]) {
+      b++;
+    }
+    out->jitterCounts[b]++;
+  }
+}
+
+std::string FrameStats::traceJSON() {
+  std::string res = "{\"traceEvents\":[";
+  char buff[160];
+  bool isFirst = true;
+  int count = this->numRecords;
+  int first = (this->next - count + STATS_CAPACITY) % STATS_CAPACITY;
+  for (int k = 0; k < count; k++) {
+    const FrameRecord* rec = &this->records[(first + k) % STATS_CAPACITY];
+    snprintf(buff, sizeof(buff),
+             "%s{\"name\":\"frame\",\"ph\":\"X\",\"pid\":1,\"tid\":1,"
+             "\"ts\":%lld,\"dur\":%lld}",
+             isFirst ? "" : ",",
+             (long long)(rec->startNs / 1000), (long long)(rec->lengthNs / 1000));
+    res += buff;
+    isFirst = false;
+    for (int p = 0; p < NUM_PHASES; p++) {
+      if (rec->phaseNs[p] == 0) {
+        continue;
+      }
+      // Phases run by workers go on their own track
+      int tid = (p == PHASE_PRESENT || p == PHASE_IDLE) ? 3 : 2;
+      snprintf(buff, sizeof(buff),
+               ",{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+               "\"ts\":%lld,\"dur\":%lld}",
+               g_phaseNames[p], tid,
+               (long long)(rec->phaseStartNs[p] / 1000),
+               (long long)(rec->phaseNs[p] / 1000));
+      res += buff;
+    }
+  }
+  res += "],\"displayTimeUnit\":\"ms\"}";
+  return res;
+}
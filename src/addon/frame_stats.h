@@ -0,0 +1,82 @@
+#ifndef FRAME_STATS_H
+#define FRAME_STATS_H
+
+#include <stdint.h>
+#include <mutex>
+#include <string>
+
+#define PHASE_EXEC 0
+#define PHASE_RENDER 1
+#define PHASE_UPLOAD 2
+#define PHASE_PRESENT 3
+#define PHASE_IDLE 4
+#define NUM_PHASES 5
+
+// Frames kept for statistics, 10 seconds at 60 frames a second
+#define STATS_CAPACITY 600
+
+#define NUM_JITTER_BUCKETS 9
+
+struct FrameRecord {
+  int64_t startNs;
+  int64_t lengthNs;
+  int64_t phaseStartNs[NUM_PHASES];
+  int64_t phaseNs[NUM_PHASES];
+};
+
+struct Percentiles {
+  int64_t p50;
+  int64_t p95;
+  int64_t p99;
+  int64_t max;
+};
+
+struct StatsSummary {
+  int numFrames;
+  Percentiles frame;
+  Percentiles phases[NUM_PHASES];
+  // Upper bound of each bucket, in microseconds from the frame period. The
+  // last bucket holds everything above the final edge
+  int jitterEdgesUs[NUM_JITTER_BUCKETS - 1];
+  int jitterCounts[NUM_JITTER_BUCKETS];
+};
+
+// Records how long each frame spends in each phase, in a ring buffer of the
+// most recent frames.
+//
+// The main thread begins each frame, then marks the end of each phase it
+// runs, which covers the time since the previous mark. Workers that present
+// or wait add their phases directly, and these are folded into the frame
+// that is open when the next frame begins.
+class FrameStats {
+ public:
+  FrameStats();
+  void setPeriodUs(int periodUs);
+  void beginFrame();
+  void mark(int phase);
+  // Safe to call from a worker thread
+  void addPhase(int phase, int64_t startNs, int64_t lengthNs);
+  void summarize(StatsSummary* out);
+  // Chrome trace-event JSON, one complete event per phase of every frame
+  std::string traceJSON();
+
+  static int64_t now();
+  static const char* phaseName(int phase);
+
+ private:
+  void closeFrame(int64_t endNs);
+
+  FrameRecord records[STATS_CAPACITY];
+  int numRecords;
+  int next;
+  int periodUs;
+  bool isOpen;
+  FrameRecord current;
+  int64_t lastMarkNs;
+
+  std::mutex workerLock;
+  int64_t workerStartNs[NUM_PHASES];
+  int64_t workerNs[NUM_PHASES];
+};
+
+#endif
@@ -0,0 +1,334 @@
+#include "gif_encode.h"
+
+#include <string.h>
+
+#define RGB_PIXEL_SIZE 4
+#define MAX_COLORS 256
+#define MAX_CODES 4096
+#define MAX_SUBBLOCK 255
+
+
+GifColorTable::GifColorTable() {
+}
+
+void GifColorTable::add(uint32_t color) {
+  if (this->index.find(color) == this->index.end()) {
+    this->index[color] = this->colors.size();
+    this->colors.push_back(color);
+  }
+}
+
+bool GifColorTable::addAll(const uint32_t* rgb, int left, int top, int width,
+                           int height, int pitch) {
+  for (int y = top; y < top + height; y++) {
+    for (int x = left; x < left + width; x++) {
+      uint32_t c = rgb[y * pitch + x];
+      if (this->index.find(c) != this->index.end()) {
+        continue;
+      }
+      if (this->colors.size() == MAX_COLORS) {
+        return false;
+      }
+      this->add(c);
+    }
+  }
+  return true;
+}
+
+bool GifColorTable::hasAll(const uint32_t* rgb, int left, int top, int width,
+                           int height, int pitch) {
+  for (int y = top; y < top + height; y++) {
+    for (int x = left; x < left + width; x++) {
+      if (this->index.find(rgb[y * pitch + x]) == this->index.end()) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+int GifColorTable::lookup(uint32_t color) {
+  auto it = this->index.find(color);
+  if (it != this->index.end()) {
+    return it->second;
+  }
+  int best = 0;
+  int bestDist = -1;
+  for (size_t i = 0; i < this->colors.size(); i++) {
+    uint32_t other = this->colors[i];
+    int dr = (int)((color >> 16) & 0xff) - (int)((other >> 16) & 0xff);
+    int dg = (int)((color >> 8) & 0xff) - (int)((other >> 8) & 0xff);
+    int db = (int)(color & 0xff) - (int)(other & 0xff);
+    int dist = dr*dr + dg*dg + db*db;
+    if (bestDist < 0 || dist < bestDist) {
+      best = i;
+      bestDist = dist;
+    }
+  }
+  return best;
+}
+
+int GifColorTable::size() {
+  return this->colors.size();
+}
+
+int GifColorTable::bits() {
+  int need = this->colors.size() + 1;
+  if (need > MAX_COLORS) {
+    need = MAX_COLORS;
+  }
+  int bits = 1;
+  while ((1 << bits) < need) {
+    bits++;
+  }
+  return bits;
+}
+
+void GifColorTable::serialize(std::vector<uint8_t>* out) {
+  int count = 1 << this->bits();
+  for (int i = 0; i < count; i++) {
+    uint32_t c = i < (int)this->colors.size() ? this->colors[i] : 0;
+    out->push_back((c >> 16) & 0xff);
+    out->push_back((c >> 8) & 0xff);
+    out->push_back(c & 0xff);
+  }
+}
+
+
+GifEncoder::GifEncoder(int width, int height,
+                       const std::vector<uint32_t>& seed, int delayCs) {
+  this->width = width;
+  this->height = height;
+  this->delayCs = delayCs;
+  this->hasHeader = false;
+  for (size_t i = 0; i < seed.size(); i++) {
+    this->seed.push_back(seed[i] & 0xffffff);
+  }
+}
+
+void GifEncoder::addSeed() {
+  for (size_t i = 0; i < this->seed.size(); i++) {
+    if (this->global.size() == MAX_COLORS) {
+      break;
+    }
+    this->global.add(this->seed[i]);
+  }
+}
+
+static void put_u16(std::vector<uint8_t>* out, int n) {
+  out->push_back(n & 0xff);
+  out->push_back((n >> 8) & 0xff);
+}
+
+void GifEncoder::writeHeader(std::vector<uint8_t>* out) {
+  static const char* signature = "GIF89a";
+  out->insert(out->end(), signature, signature + 6);
+  put_u16(out, this->width);
+  put_u16(out, this->height);
+  out->push_back(0x80 | (7 << 4) | (this->global.bits() - 1));
+  out->push_back(0x00);
+  out->push_back(0x00);
+  this->global.serialize(out);
+  // loop forever
+  static const uint8_t loop[19] = {
+    0x21, 0xff, 0x0b, 'N', 'E', 'T', 'S', 'C', 'A', 'P', 'E', '2', '.', '0',
+    0x03, 0x01, 0x00, 0x00, 0x00};
+  out->insert(out->end(), loop, loop + sizeof(loop));
+  this->hasHeader = true;
+}
+
+void GifEncoder::addFrame(const uint8_t* rgba, int pitch,
+                          std::vector<uint8_t>* out) {
+  int width = this->width;
+  int height = this->height;
+  this->curr.resize((size_t)width * height);
+  uint32_t* rgb = this->curr.data();
+  for (int y = 0; y < height; y++) {
+    const uint8_t* row = rgba + (size_t)y * pitch;
+    for (int x = 0; x < width; x++) {
+      const uint8_t* p = row + x * RGB_PIXEL_SIZE;
+      rgb[y * width + x] = (p[0] << 16) | (p[1] << 8) | p[2];
+    }
+  }
+
+  if (!this->hasHeader) {
+    this->addSeed();
+    this->global.addAll(rgb, 0, 0, width, height, width);
+    this->writeHeader(out);
+  }
+
+  // Find the rect that changed, a frame with no changes still takes up
+  // time, so it draws a single pixel
+  bool hasPrev = !this->prev.empty();
+  int left = 0, top = 0, right = width - 1, bottom = height - 1;
+  if (hasPrev) {
+    const uint32_t* prev = this->prev.data();
+    left = width;
+    top = height;
+    right = -1;
+    bottom = -1;
+    for (int y = 0; y < height; y++) {
+      for (int x = 0; x < width; x++) {
+        int n = y * width + x;
+        if (prev[n] != rgb[n]) {
+          if (x < left) { left = x; }
+          if (x > right) { right = x; }
+          if (y < top) { top = y; }
+          if (y > bottom) { bottom = y; }
+        }
+      }
+    }
+    if (right < 0) {
+      left = top = right = bottom = 0;
+    }
+  }
+  int rectW = right - left + 1;
+  int rectH = bottom - top + 1;
+
+  GifColorTable* table = &this->global;
+  GifColorTable local;
+  bool isLocal = false;
+  if (!table->hasAll(rgb, left, top, rectW, rectH, width)) {
+    if (local.addAll(rgb, left, top, rectW, rectH, width)) {
+      table = &local;
+      isLocal = true;
+    }
+  }
+  int transIndex = -1;
+  if (hasPrev && table->size() < MAX_COLORS) {
+    transIndex = table->size();
+  }
+
+  this->indexes.resize((size_t)rectW * rectH);
+  uint8_t* indexes = this->indexes.data();
+  int k = 0;
+  for (int y = top; y <= bottom; y++) {
+    for (int x = left; x <= right; x++) {
+      int n = y * width + x;
+      if (transIndex >= 0 && this->prev[n] == rgb[n]) {
+        indexes[k++] = transIndex;
+      } else {
+        indexes[k++] = table->lookup(rgb[n]);
+      }
+    }
+  }
+
+  // graphic control extension, leave the frame in place when done
+  out->push_back(0x21);
+  out->push_back(0xf9);
+  out->push_back(0x04);
+  out->push_back((1 << 2) | (transIndex >= 0 ? 1 : 0));
+  put_u16(out, this->delayCs);
+  out->push_back(transIndex >= 0 ? transIndex : 0);
+  out->push_back(0x00);
+  // image descriptor
+  int bits = table->bits();
+  out->push_back(0x2c);
+  put_u16(out, left);
+  put_u16(out, top);
+  put_u16(out, rectW);
+  put_u16(out, rectH);
+  out->push_back(isLocal ? (0x80 | (bits - 1)) : 0x00);
+  if (isLocal) {
+    table->serialize(out);
+  }
+  gif_lzw_encode(indexes, rectW * rectH, bits < 2 ? 2 : bits, out);
+
+  this->prev.swap(this->curr);
+}
+
+void GifEncoder::finish(std::vector<uint8_t>* out) {
+  if (!this->hasHeader) {
+    this->addSeed();
+    this->writeHeader(out);
+  }
+  out->push_back(0x3b);
+}
+
+
+// Packs codes least significant bit first, into sub-blocks
+struct CodeWriter {
+  std::vector<uint8_t>* out;
+  uint8_t block[MAX_SUBBLOCK];
+  int blockLen;
+  uint32_t accum;
+  int numBits;
+
+  void emit(int code, int size) {
+    this->accum |= (uint32_t)code << this->numBits;
+    this->numBits += size;
+    while (this->numBits >= 8) {
+      this->block[this->blockLen++] = this->accum & 0xff;
+      this->accum >>= 8;
+      this->numBits -= 8;
+      if (this->blockLen == MAX_SUBBLOCK) {
+        this->flush();
+      }
+    }
+  }
+
+  void flush() {
+    this->out->push_back(this->blockLen);
+    this->out->insert(this->out->end(), this->block,
+                      this->block + this->blockLen);
+    this->blockLen = 0;
+  }
+};
+
+void gif_lzw_encode(const uint8_t* indexes, int count, int minCodeSize,
+                    std::vector<uint8_t>* out) {
+  out->push_back(minCodeSize);
+  CodeWriter writer;
+  writer.out = out;
+  writer.blockLen = 0;
+  writer.accum = 0;
+  writer.numBits = 0;
+
+  int clearCode = 1 << minCodeSize;
+  int eoiCode = clearCode + 1;
+  int nextCode = eoiCode + 1;
+  int codeSize = minCodeSize + 1;
+  // Code for each (prefix, index) pair, 0 when not present. Codes that are
+  // added are always above eoiCode, so 0 is never a real entry
+  std::vector<uint16_t> table((size_t)MAX_CODES << 8, 0);
+
+  writer.emit(clearCode, codeSize);
+  int prefix = indexes[0];
+  for (int i = 1; i < count; i++) {
+    int k = indexes[i];
+    size_t key = ((size_t)prefix << 8) | k;
+    int code = table[key];
+    if (code != 0) {
+      prefix = code;
+      continue;
+    }
+    writer.emit(prefix, codeSize);
+    if (nextCode == MAX_CODES) {
+      // Table is full, start over
+      writer.emit(clearCode, codeSize);
+      nextCode = eoiCode + 1;
+      codeSize = minCodeSize + 1;
+      memset(table.data(), 0, table.size() * sizeof(uint16_t));
+    } else {
+      if (nextCode >= (1 << codeSize)) {
+        codeSize++;
+      }
+      table[key] = nextCode++;
+    }
+    prefix = k;
+  }
+  writer.emit(prefix, codeSize);
+  // The decoder adds its last entry upon reading that code, which may widen
+  // the code that follows
+  if (nextCode == (1 << codeSize) && codeSize < 12) {
+    codeSize++;
+  }
+  writer.emit(eoiCode, codeSize);
+  if (writer.numBits > 0) {
+    writer.emit(0, 8 - writer.numBits);
+  }
+  if (writer.blockLen > 0) {
+    writer.flush();
+  }
+  out->push_back(0x00);
+}
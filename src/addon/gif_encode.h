@@ -0,0 +1,67 @@
+#ifndef GIF_ENCODE_H
+#define GIF_ENCODE_H
+
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+// Colors of a gif color table, in the order they were added
+class GifColorTable {
+ public:
+  GifColorTable();
+  // Add colors of the rect in scan order, returns false if they did not fit
+  bool addAll(const uint32_t* rgb, int left, int top, int width, int height,
+              int pitch);
+  bool hasAll(const uint32_t* rgb, int left, int top, int width, int height,
+              int pitch);
+  // Exact index of the color, otherwise the nearest one
+  int lookup(uint32_t color);
+  int size();
+  // Bits per index, with room for a transparent index after the colors
+  int bits();
+  void serialize(std::vector<uint8_t>* out);
+
+  void add(uint32_t color);
+
+ private:
+  std::vector<uint32_t> colors;
+  std::unordered_map<uint32_t, int> index;
+};
+
+// Encodes RGBA frames as an animated gif, without quantizing them. Produces
+// the same bytes as GifEncoder in src/gif_writer.js.
+//
+// The global color table starts with the seed colors, normally the scene's
+// palette, so that indexed scenes map each pixel straight to its entry.
+// Colors of the first frame not in the seed are appended. A frame with other
+// colors gets a local table, or the nearest global colors if it has over 256.
+// After the first frame, only the rect that changed is encoded, and pixels
+// that did not change inside of it are transparent.
+class GifEncoder {
+ public:
+  GifEncoder(int width, int height, const std::vector<uint32_t>& seed,
+             int delayCs);
+  void addFrame(const uint8_t* rgba, int pitch, std::vector<uint8_t>* out);
+  void finish(std::vector<uint8_t>* out);
+
+ private:
+  void addSeed();
+  void writeHeader(std::vector<uint8_t>* out);
+
+  int width;
+  int height;
+  int delayCs;
+  std::vector<uint32_t> seed;
+  GifColorTable global;
+  bool hasHeader;
+  std::vector<uint32_t> curr;
+  std::vector<uint32_t> prev;
+  std::vector<uint8_t> indexes;
+};
+
+// Compress indexes with gif's variable-width LZW, appending the minimum code
+// size and the data sub-blocks
+void gif_lzw_encode(const uint8_t* indexes, int count, int minCodeSize,
+                    std::vector<uint8_t>* out);
+
+#endif
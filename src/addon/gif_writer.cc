@@ -0,0 +1,204 @@
+#include "gif_writer.h"
+#include "common.h"
+
+#include <string.h>
+
+#define RGB_PIXEL_SIZE 4
+#define MAX_QUEUED_FRAMES 4
+
+Napi::FunctionReference g_gifWriterConstructor;
+
+
+void GifWriter::InitClass(Napi::Env env, Napi::Object exports) {
+  Napi::Function func = DefineClass(
+      env,
+      "GifWriter",
+      {InstanceMethod("addFrame", &GifWriter::AddFrame),
+       InstanceMethod("finish", &GifWriter::Finish),
+  });
+  g_gifWriterConstructor = Napi::Persistent(func);
+  g_gifWriterConstructor.SuppressDestruct();
+  exports.Set("GifWriter", func);
+}
+
+GifWriter::GifWriter(const Napi::CallbackInfo& info)
+    : Napi::ObjectWrap<GifWriter>(info) {
+  Napi::Env env = info.Env();
+  this->encoder = NULL;
+  this->fp = NULL;
+  this->numInFlight = 0;
+  this->maxQueued = MAX_QUEUED_FRAMES;
+  this->isStopping = false;
+  if (info.Length() < 3 || !info[0].IsString() || !info[1].IsNumber() ||
+      !info[2].IsNumber()) {
+    Napi::TypeError::New(env, "GifWriter needs filename, width, height")
+        .ThrowAsJavaScriptException();
+    return;
+  }
+  std::string filename = info[0].As<Napi::String>().Utf8Value();
+  this->width = info[1].As<Napi::Number>().Int32Value();
+  this->height = info[2].As<Napi::Number>().Int32Value();
+
+  std::vector<uint32_t> seed;
+  if (info.Length() > 3 && info[3].IsArray()) {
+    Napi::Array list = info[3].As<Napi::Array>();
+    for (uint32_t i = 0; i < list.Length(); i++) {
+      seed.push_back(list.Get(i).As<Napi::Number>().Uint32Value());
+    }
+  }
+  int delayCs = 0;
+  if (info.Length() > 4 && info[4].IsNumber()) {
+    delayCs = info[4].As<Napi::Number>().Int32Value();
+  }
+
+  this->fp = fopen(filename.c_str(), "wb");
+  if (this->fp == NULL) {
+    Napi::Error::New(env, "could not open " + filename)
+        .ThrowAsJavaScriptException();
+    return;
+  }
+  this->encoder = new GifEncoder(this->width, this->height, seed, delayCs);
+  this->worker = std::thread(&GifWriter::workerLoop, this);
+}
+
+GifWriter::~GifWriter() {
+  this->stop();
+  if (this->fp) {
+    fclose(this->fp);
+  }
+  delete this->encoder;
+  for (size_t n = 0; n < this->queue.size(); n++) {
+    delete this->queue[n];
+  }
+  for (size_t n = 0; n < this->freeList.size(); n++) {
+    delete this->freeList[n];
+  }
+}
+
+void GifWriter::stop() {
+  {
+    std::lock_guard<std::mutex> guard(this->lock);
+    this->isStopping = true;
+  }
+  this->hasWork.notify_all();
+  if (this->worker.joinable()) {
+    this->worker.join();
+  }
+}
+
+Napi::Value GifWriter::AddFrame(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  if (info.Length() < 1 || !info[0].IsObject()) {
+    Napi::TypeError::New(env, "addFrame needs surface")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  if (this->encoder == NULL || this->isStopping) {
+    Napi::Error::New(env, "addFrame after gif was finished")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  Napi::Object surfaceObj = info[0].As<Napi::Object>();
+  unsigned char* buff = typedArrayToRawBuffer(surfaceObj.Get("buff"));
+  if (buff == NULL) {
+    Napi::TypeError::New(env, "addFrame needs surface.buff")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  int sourcePitch = surfaceObj.Get("pitch").As<Napi::Number>().Int32Value();
+  int rowSize = this->width * RGB_PIXEL_SIZE;
+
+  // Wait for room, then copy the rows into a recycled buffer
+  std::unique_lock<std::mutex> guard(this->lock);
+  while (this->numInFlight >= this->maxQueued) {
+    this->hasChanged.wait(guard);
+  }
+  std::vector<uint8_t>* frame = NULL;
+  if (!this->freeList.empty()) {
+    frame = this->freeList.back();
+    this->freeList.pop_back();
+  }
+  this->numInFlight++;
+  guard.unlock();
+
+  if (frame == NULL) {
+    frame = new std::vector<uint8_t>();
+  }
+  frame->resize((size_t)rowSize * this->height);
+  for (int y = 0; y < this->height; y++) {
+    memcpy(frame->data() + (size_t)y * rowSize,
+           buff + (size_t)y * sourcePitch, rowSize);
+  }
+
+  guard.lock();
+  this->queue.push_back(frame);
+  guard.unlock();
+  this->hasWork.notify_one();
+  return env.Null();
+}
+
+Napi::Value GifWriter::Finish(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  if (this->encoder == NULL) {
+    return Napi::String::New(env, "gif was not opened");
+  }
+  {
+    std::unique_lock<std::mutex> guard(this->lock);
+    while (this->numInFlight > 0) {
+      this->hasChanged.wait(guard);
+    }
+  }
+  this->stop();
+
+  std::vector<uint8_t> bytes;
+  this->encoder->finish(&bytes);
+  this->writeBytes(&bytes);
+  if (fclose(this->fp) != 0 && this->error.empty()) {
+    this->error = "could not write gif";
+  }
+  this->fp = NULL;
+  delete this->encoder;
+  this->encoder = NULL;
+
+  if (this->error.empty()) {
+    return env.Null();
+  }
+  return Napi::String::New(env, this->error);
+}
+
+void GifWriter::writeBytes(std::vector<uint8_t>* bytes) {
+  if (!this->error.empty() || bytes->empty()) {
+    return;
+  }
+  if (fwrite(bytes->data(), 1, bytes->size(), this->fp) != bytes->size()) {
+    this->error = "could not write gif";
+  }
+}
+
+// Frames are encoded in the order they arrive, since each one is encoded as
+// the difference from the one before it
+void GifWriter::workerLoop() {
+  std::vector<uint8_t> bytes;
+  while (true) {
+    std::unique_lock<std::mutex> guard(this->lock);
+    while (this->queue.empty() && !this->isStopping) {
+      this->hasWork.wait(guard);
+    }
+    if (this->queue.empty()) {
+      return;
+    }
+    std::vector<uint8_t>* frame = this->queue.front();
+    this->queue.pop_front();
+    guard.unlock();
+
+    bytes.clear();
+    this->encoder->addFrame(frame->data(), this->width * RGB_PIXEL_SIZE,
+                            &bytes);
+    this->writeBytes(&bytes);
+
+    guard.lock();
+    this->freeList.push_back(frame);
+    this->numInFlight--;
+    this->hasChanged.notify_all();
+  }
+}
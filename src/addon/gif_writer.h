@@ -0,0 +1,53 @@
+#ifndef GIF_WRITER_H
+#define GIF_WRITER_H
+
+#include <napi.h>
+#include <stdio.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gif_encode.h"
+
+// Writes an animated gif one frame at a time. Frames are copied when added,
+// then encoded and written by a background thread, in order. No more than
+// maxQueued frames wait at once, addFrame() blocks until there is room, so
+// memory stays bounded no matter how long the animation is.
+class GifWriter : public Napi::ObjectWrap<GifWriter> {
+ public:
+  static void InitClass(Napi::Env env, Napi::Object exports);
+  // (filename, width, height, seedColors, delayCs)
+  GifWriter(const Napi::CallbackInfo& info);
+  ~GifWriter();
+
+ private:
+  // (surface)
+  Napi::Value AddFrame(const Napi::CallbackInfo& info);
+  // Write the rest of the frames and close the file, returns an error
+  // message or null
+  Napi::Value Finish(const Napi::CallbackInfo& info);
+
+  void workerLoop();
+  void writeBytes(std::vector<uint8_t>* bytes);
+  void stop();
+
+  GifEncoder* encoder;
+  FILE* fp;
+  std::thread worker;
+  std::mutex lock;
+  std::condition_variable hasWork;
+  std::condition_variable hasChanged;
+  std::deque<std::vector<uint8_t>*> queue;
+  std::vector<std::vector<uint8_t>*> freeList;
+  int width;
+  int height;
+  int numInFlight;
+  int maxQueued;
+  bool isStopping;
+  std::string error;
+};
+
+#endif
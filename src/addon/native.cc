@@ -1,4 +1,5 @@
 #include <napi.h>
+#include <vector>
 
 #ifdef SDL_ENABLED
 #include "sdl_backend.h"
@@ -13,6 +14,14 @@
 #endif
 
 #include "common.h"
+#include "composite.h"
+#include "fill.h"
+#include "gif_writer.h"
+#include "png_sink.h"
+#include "rasterize.h"
+#include "scale.h"
+#include "tile_cache.h"
+#include "video_sink.h"
 
 
 unsigned char* surfaceToRawBuffer(Napi::Value surfaceVal) {
@@ -40,7 +49,527 @@ unsigned char* surfaceToRawBuffer(Napi::Value surfaceVal) {
 }
 
 
+unsigned char* typedArrayToRawBuffer(Napi::Value typedArrayVal) {
+  if (!typedArrayVal.IsTypedArray()) {
+    return NULL;
+  }
+  Napi::TypedArray typeArr = typedArrayVal.As<Napi::TypedArray>();
+  Napi::ArrayBuffer arrBuff = typeArr.ArrayBuffer();
+  return (unsigned char*)arrBuff.Data() + typeArr.ByteOffset();
+}
+
+
+// Whether the typed array holds height rows that are pitch bytes apart, each
+// with width pixels. Empty sizes always fit
+bool bufferFits(Napi::Value typedArrayVal, int pitch, int width, int height,
+                int bytesPerPixel) {
+  if (!typedArrayVal.IsTypedArray()) {
+    return false;
+  }
+  if (width <= 0 || height <= 0) {
+    return true;
+  }
+  if (pitch < width * bytesPerPixel) {
+    return false;
+  }
+  size_t need = (size_t)(height - 1) * pitch + (size_t)width * bytesPerPixel;
+  return typedArrayVal.As<Napi::TypedArray>().ByteLength() >= need;
+}
+
+
+// Fill cells from the result of Colorspace.compile(), false if it is missing
+// any of its tables
+bool cellAttrsFromValue(Napi::Value cellsVal, CellAttrs* cells) {
+  if (!cellsVal.IsObject()) {
+    return false;
+  }
+  Napi::Object cellsObj = cellsVal.As<Napi::Object>();
+  unsigned char* attrs = typedArrayToRawBuffer(cellsObj.Get("attrs"));
+  unsigned char* lists = typedArrayToRawBuffer(cellsObj.Get("lists"));
+  unsigned char* listStarts = typedArrayToRawBuffer(
+      cellsObj.Get("listStarts"));
+  // lists may be empty, which has no data
+  if (attrs == NULL || listStarts == NULL) {
+    return false;
+  }
+  cells->attrs = (const int32_t*)attrs;
+  cells->pitch = cellsObj.Get("pitch").As<Napi::Number>().Int32Value();
+  cells->height = cellsObj.Get("height").As<Napi::Number>().Int32Value();
+  cells->cellWidth =
+      cellsObj.Get("cellWidth").As<Napi::Number>().Int32Value();
+  cells->cellHeight =
+      cellsObj.Get("cellHeight").As<Napi::Number>().Int32Value();
+  cells->pieceSize =
+      cellsObj.Get("pieceSize").As<Napi::Number>().Int32Value();
+  cells->lists = (const int32_t*)lists;
+  cells->listStarts = (const int32_t*)listStarts;
+  return true;
+}
+
+
+// Data and pitch of each tile in the list, tiles that are missing or have
+// no data are left NULL
+void tileListFromValue(Napi::Array tileList, std::vector<const uint8_t*>* tiles,
+                       std::vector<int>* tilePitches) {
+  tiles->assign(tileList.Length(), NULL);
+  tilePitches->assign(tileList.Length(), 0);
+  for (uint32_t i = 0; i < tileList.Length(); i++) {
+    Napi::Value elem = tileList.Get(i);
+    if (!elem.IsObject()) {
+      continue;
+    }
+    Napi::Object tileObj = elem.As<Napi::Object>();
+    (*tiles)[i] = typedArrayToRawBuffer(tileObj.Get("data"));
+    (*tilePitches)[i] = tileObj.Get("pitch").As<Napi::Number>().Int32Value();
+  }
+}
+
+
+// Whether every tile in the list that has data holds tileWidth by tileHeight
+// pixels, the size that tiles are read at no matter their own size
+bool tileListFits(Napi::Array tileList, int tileWidth, int tileHeight) {
+  for (uint32_t i = 0; i < tileList.Length(); i++) {
+    Napi::Value elem = tileList.Get(i);
+    if (!elem.IsObject()) {
+      continue;
+    }
+    Napi::Object tileObj = elem.As<Napi::Object>();
+    Napi::Value data = tileObj.Get("data");
+    if (!data.IsTypedArray()) {
+      continue;
+    }
+    int pitch = tileObj.Get("pitch").As<Napi::Number>().Int32Value();
+    if (!bufferFits(data, pitch, tileWidth, tileHeight, 1)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+static Napi::Object percentilesToObject(Napi::Env env, const Percentiles& p) {
+  Napi::Object obj = Napi::Object::New(env);
+  obj["p50"] = Napi::Number::New(env, p.p50 / 1000);
+  obj["p95"] = Napi::Number::New(env, p.p95 / 1000);
+  obj["p99"] = Napi::Number::New(env, p.p99 / 1000);
+  obj["max"] = Napi::Number::New(env, p.max / 1000);
+  return obj;
+}
+
+
+// Summary of recent frames for getStats(), all times in microseconds
+Napi::Value frameStatsToValue(Napi::Env env, FrameStats* stats) {
+  StatsSummary summary;
+  stats->summarize(&summary);
+
+  Napi::Object res = Napi::Object::New(env);
+  res["frames"] = Napi::Number::New(env, summary.numFrames);
+  res["frameUs"] = percentilesToObject(env, summary.frame);
+
+  Napi::Object phases = Napi::Object::New(env);
+  for (int p = 0; p < NUM_PHASES; p++) {
+    phases[FrameStats::phaseName(p)] =
+        percentilesToObject(env, summary.phases[p]);
+  }
+  res["phasesUs"] = phases;
+
+  Napi::Object jitter = Napi::Object::New(env);
+  Napi::Array edges = Napi::Array::New(env, NUM_JITTER_BUCKETS - 1);
+  for (int b = 0; b < NUM_JITTER_BUCKETS - 1; b++) {
+    edges.Set((uint32_t)b, Napi::Number::New(env, summary.jitterEdgesUs[b]));
+  }
+  Napi::Array counts = Napi::Array::New(env, NUM_JITTER_BUCKETS);
+  for (int b = 0; b < NUM_JITTER_BUCKETS; b++) {
+    counts.Set((uint32_t)b, Napi::Number::New(env, summary.jitterCounts[b]));
+  }
+  jitter["edgesUs"] = edges;
+  jitter["counts"] = counts;
+  res["jitter"] = jitter;
+  return res;
+}
+
+
+// (source, sourcePitch, sourceWidth, sourceHeight, scrollX, scrollY,
+//  isWrapped, isBg, lut, target, targetPitch, left, top, right, bottom)
+Napi::Value RasterizeLayer(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  if (info.Length() < 15) {
+    Napi::TypeError::New(env, "rasterizeLayer needs 15 arguments")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  unsigned char* source = typedArrayToRawBuffer(info[0]);
+  unsigned char* lut = typedArrayToRawBuffer(info[8]);
+  unsigned char* target = typedArrayToRawBuffer(info[9]);
+  if (source == NULL || lut == NULL || target == NULL) {
+    Napi::TypeError::New(env, "rasterizeLayer needs typed arrays")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  rasterize_layer(source,
+                  info[1].As<Napi::Number>().Int32Value(),
+                  info[2].As<Napi::Number>().Int32Value(),
+                  info[3].As<Napi::Number>().Int32Value(),
+                  info[4].As<Napi::Number>().Int32Value(),
+                  info[5].As<Napi::Number>().Int32Value(),
+                  info[6].ToBoolean(),
+                  info[7].ToBoolean(),
+                  (const uint32_t*)lut,
+                  target,
+                  info[10].As<Napi::Number>().Int32Value(),
+                  info[11].As<Napi::Number>().Int32Value(),
+                  info[12].As<Napi::Number>().Int32Value(),
+                  info[13].As<Napi::Number>().Int32Value(),
+                  info[14].As<Napi::Number>().Int32Value());
+  return env.Null();
+}
+
+
+// (source, sourcePitch, sourceWidth, sourceHeight, scrollX, scrollY,
+//  isWrapped, isBg, lut, cells, target, targetPitch, left, top, right, bottom)
+Napi::Value RasterizeCells(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  if (info.Length() < 16 || !info[9].IsObject()) {
+    Napi::TypeError::New(env, "rasterizeCells needs 16 arguments")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  unsigned char* source = typedArrayToRawBuffer(info[0]);
+  unsigned char* lut = typedArrayToRawBuffer(info[8]);
+  unsigned char* target = typedArrayToRawBuffer(info[10]);
+  CellAttrs cells;
+  if (source == NULL || lut == NULL || target == NULL ||
+      !cellAttrsFromValue(info[9], &cells)) {
+    Napi::TypeError::New(env, "rasterizeCells needs typed arrays")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  rasterize_cells(source,
+                  info[1].As<Napi::Number>().Int32Value(),
+                  info[2].As<Napi::Number>().Int32Value(),
+                  info[3].As<Napi::Number>().Int32Value(),
+                  info[4].As<Napi::Number>().Int32Value(),
+                  info[5].As<Napi::Number>().Int32Value(),
+                  info[6].ToBoolean(),
+                  info[7].ToBoolean(),
+                  (const uint32_t*)lut,
+                  cells,
+                  target,
+                  info[11].As<Napi::Number>().Int32Value(),
+                  info[12].As<Napi::Number>().Int32Value(),
+                  info[13].As<Napi::Number>().Int32Value(),
+                  info[14].As<Napi::Number>().Int32Value(),
+                  info[15].As<Napi::Number>().Int32Value());
+  return env.Null();
+}
+
+
+// (tiles, tilemap, mapPitch, mapWidth, mapHeight, flips, flipsPitch,
+//  tileWidth, tileHeight, scrollX, scrollY, isWrapped, isBg, lut,
+//  target, targetPitch, left, top, right, bottom)
+Napi::Value RasterizeTiles(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  if (info.Length() < 20 || !info[0].IsArray()) {
+    Napi::TypeError::New(env, "rasterizeTiles needs 20 arguments")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  unsigned char* tilemap = typedArrayToRawBuffer(info[1]);
+  unsigned char* lut = typedArrayToRawBuffer(info[13]);
+  unsigned char* target = typedArrayToRawBuffer(info[14]);
+  if (tilemap == NULL || lut == NULL || target == NULL) {
+    Napi::TypeError::New(env, "rasterizeTiles needs typed arrays")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  // No flips unless given
+  unsigned char* flips = NULL;
+  if (!info[5].IsNull() && !info[5].IsUndefined()) {
+    flips = typedArrayToRawBuffer(info[5]);
+  }
+
+  int mapPitch = info[2].As<Napi::Number>().Int32Value();
+  int mapWidth = info[3].As<Napi::Number>().Int32Value();
+  int mapHeight = info[4].As<Napi::Number>().Int32Value();
+  int flipsPitch = info[6].As<Napi::Number>().Int32Value();
+  if (!bufferFits(info[1], mapPitch, mapWidth, mapHeight, 1) ||
+      (flips && !bufferFits(info[5], flipsPitch, mapWidth, mapHeight, 1))) {
+    Napi::TypeError::New(env, "rasterizeTiles tilemap or flips is too small")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  if (!tileListFits(info[0].As<Napi::Array>(),
+                    info[7].As<Napi::Number>().Int32Value(),
+                    info[8].As<Napi::Number>().Int32Value())) {
+    Napi::TypeError::New(env, "rasterizeTiles has a tile that is too small")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  std::vector<const uint8_t*> tiles;
+  std::vector<int> tilePitches;
+  tileListFromValue(info[0].As<Napi::Array>(), &tiles, &tilePitches);
+
+  rasterize_tiles(tiles.data(), tilePitches.data(), tiles.size(),
+                  tilemap,
+                  info[2].As<Napi::Number>().Int32Value(),
+                  info[3].As<Napi::Number>().Int32Value(),
+                  info[4].As<Napi::Number>().Int32Value(),
+                  flips,
+                  info[6].As<Napi::Number>().Int32Value(),
+                  info[7].As<Napi::Number>().Int32Value(),
+                  info[8].As<Napi::Number>().Int32Value(),
+                  info[9].As<Napi::Number>().Int32Value(),
+                  info[10].As<Napi::Number>().Int32Value(),
+                  info[11].ToBoolean(),
+                  info[12].ToBoolean(),
+                  (const uint32_t*)lut,
+                  target,
+                  info[15].As<Napi::Number>().Int32Value(),
+                  info[16].As<Napi::Number>().Int32Value(),
+                  info[17].As<Napi::Number>().Int32Value(),
+                  info[18].As<Napi::Number>().Int32Value(),
+                  info[19].As<Napi::Number>().Int32Value());
+  return env.Null();
+}
+
+
+// (dest, surfaceList)
+Napi::Value CompositeSurfaces(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  if (info.Length() < 2 || !info[0].IsObject() || !info[1].IsArray()) {
+    Napi::TypeError::New(env, "compositeSurfaces needs dest and surface list")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  Napi::Object destObj = info[0].As<Napi::Object>();
+  unsigned char* dest = typedArrayToRawBuffer(destObj.Get("buff"));
+  if (dest == NULL) {
+    Napi::TypeError::New(env, "compositeSurfaces needs dest.buff")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  int destPitch = destObj.Get("pitch").As<Napi::Number>().Int32Value();
+  int width = destObj.Get("width").As<Napi::Number>().Int32Value();
+  int height = destObj.Get("height").As<Napi::Number>().Int32Value();
+
+  Napi::Array surfaceList = info[1].As<Napi::Array>();
+  std::vector<const uint8_t*> sources;
+  std::vector<int> sourcePitches;
+  for (uint32_t i = 0; i < surfaceList.Length(); i++) {
+    Napi::Value elem = surfaceList.Get(i);
+    if (!elem.IsObject()) {
+      continue;
+    }
+    Napi::Object surfaceObj = elem.As<Napi::Object>();
+    unsigned char* buff = typedArrayToRawBuffer(surfaceObj.Get("buff"));
+    if (buff == NULL) {
+      Napi::TypeError::New(env, "compositeSurfaces needs surface.buff")
+          .ThrowAsJavaScriptException();
+      return env.Null();
+    }
+    sources.push_back(buff);
+    sourcePitches.push_back(
+        surfaceObj.Get("pitch").As<Napi::Number>().Int32Value());
+  }
+
+  composite_surfaces(dest, destPitch, width, height,
+                     sources.data(), sourcePitches.data(), sources.size());
+  return env.Null();
+}
+
+
+// (data, pitch, offset, width, height, x, y, color, bounds)
+Napi::Value FloodFill(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  if (info.Length() < 9) {
+    Napi::TypeError::New(env, "floodFill needs 9 arguments")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  unsigned char* data = typedArrayToRawBuffer(info[0]);
+  unsigned char* bounds = typedArrayToRawBuffer(info[8]);
+  if (data == NULL || bounds == NULL) {
+    Napi::TypeError::New(env, "floodFill needs typed arrays")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  flood_fill(data + info[2].As<Napi::Number>().Int32Value(),
+             info[1].As<Napi::Number>().Int32Value(),
+             info[3].As<Napi::Number>().Int32Value(),
+             info[4].As<Napi::Number>().Int32Value(),
+             info[5].As<Napi::Number>().Int32Value(),
+             info[6].As<Napi::Number>().Int32Value(),
+             (uint8_t)info[7].As<Napi::Number>().Int32Value(),
+             (int32_t*)bounds);
+  return env.Null();
+}
+
+
+// (data, pitch, offset, width, height, ranges, numRanges, color, bounds)
+Napi::Value FillRanges(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  if (info.Length() < 9 || !info[5].IsTypedArray()) {
+    Napi::TypeError::New(env, "fillRanges needs 9 arguments")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  unsigned char* data = typedArrayToRawBuffer(info[0]);
+  unsigned char* ranges = typedArrayToRawBuffer(info[5]);
+  unsigned char* bounds = typedArrayToRawBuffer(info[8]);
+  if (data == NULL || ranges == NULL || bounds == NULL) {
+    Napi::TypeError::New(env, "fillRanges needs typed arrays")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  int numRanges = info[6].As<Napi::Number>().Int32Value();
+  size_t maxRanges = info[5].As<Napi::TypedArray>().ElementLength() / 4;
+  if (numRanges < 0 || (size_t)numRanges > maxRanges) {
+    Napi::TypeError::New(env, "fillRanges has fewer ranges than numRanges")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  fill_ranges(data + info[2].As<Napi::Number>().Int32Value(),
+              info[1].As<Napi::Number>().Int32Value(),
+              info[3].As<Napi::Number>().Int32Value(),
+              info[4].As<Napi::Number>().Int32Value(),
+              (const int32_t*)ranges, numRanges,
+              (uint8_t)info[7].As<Napi::Number>().Int32Value(),
+              (int32_t*)bounds);
+  return env.Null();
+}
+
+
+// Whether the typed array holds height rows of pitch bytes, the last of
+// which needs only width pixels
+static bool surfaceFits(const Napi::Value& value, int pitch, int width,
+                        int height) {
+  if (pitch <= 0 || width <= 0 || height <= 0 || pitch < width * 4) {
+    return false;
+  }
+  size_t need = (size_t)(height - 1) * pitch + (size_t)width * 4;
+  return value.As<Napi::TypedArray>().ByteLength() >= need;
+}
+
+
+// (source, sourcePitch, width, height, target, targetPitch, zoom)
+Napi::Value ScaleNearest(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  if (info.Length() < 7) {
+    Napi::TypeError::New(env, "scaleNearest needs 7 arguments")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  unsigned char* source = typedArrayToRawBuffer(info[0]);
+  unsigned char* target = typedArrayToRawBuffer(info[4]);
+  if (source == NULL || target == NULL) {
+    Napi::TypeError::New(env, "scaleNearest needs typed arrays")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  int sourcePitch = info[1].As<Napi::Number>().Int32Value();
+  int width = info[2].As<Napi::Number>().Int32Value();
+  int height = info[3].As<Napi::Number>().Int32Value();
+  int targetPitch = info[5].As<Napi::Number>().Int32Value();
+  int zoom = info[6].As<Napi::Number>().Int32Value();
+  if (zoom < 1 || !surfaceFits(info[0], sourcePitch, width, height) ||
+      !surfaceFits(info[4], targetPitch, width * zoom, height * zoom)) {
+    Napi::TypeError::New(env, "scaleNearest surface is too small")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  scale_nearest(source, sourcePitch, width, height, target, targetPitch, zoom);
+  return env.Null();
+}
+
+
+// (source, sourcePitch, width, height, target, targetPitch, zoom, shadowMask)
+Napi::Value ScaleScanlines(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  if (info.Length() < 8) {
+    Napi::TypeError::New(env, "scaleScanlines needs 8 arguments")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  unsigned char* source = typedArrayToRawBuffer(info[0]);
+  unsigned char* target = typedArrayToRawBuffer(info[4]);
+  if (source == NULL || target == NULL) {
+    Napi::TypeError::New(env, "scaleScanlines needs typed arrays")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  int sourcePitch = info[1].As<Napi::Number>().Int32Value();
+  int width = info[2].As<Napi::Number>().Int32Value();
+  int height = info[3].As<Napi::Number>().Int32Value();
+  int targetPitch = info[5].As<Napi::Number>().Int32Value();
+  int zoom = info[6].As<Napi::Number>().Int32Value();
+  if (zoom < 1 || !surfaceFits(info[0], sourcePitch, width, height) ||
+      !surfaceFits(info[4], targetPitch, width * zoom, height * zoom)) {
+    Napi::TypeError::New(env, "scaleScanlines surface is too small")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  scale_scanlines(source, sourcePitch, width, height, target, targetPitch,
+                  zoom, info[7].ToBoolean());
+  return env.Null();
+}
+
+
+// (source, sourcePitch, sourceWidth, sourceHeight,
+//  target, targetPitch, targetWidth, targetHeight)
+Napi::Value ScaleSharpBilinear(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  if (info.Length() < 8) {
+    Napi::TypeError::New(env, "scaleSharpBilinear needs 8 arguments")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  unsigned char* source = typedArrayToRawBuffer(info[0]);
+  unsigned char* target = typedArrayToRawBuffer(info[4]);
+  if (source == NULL || target == NULL) {
+    Napi::TypeError::New(env, "scaleSharpBilinear needs typed arrays")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  int sourcePitch = info[1].As<Napi::Number>().Int32Value();
+  int sourceWidth = info[2].As<Napi::Number>().Int32Value();
+  int sourceHeight = info[3].As<Napi::Number>().Int32Value();
+  int targetPitch = info[5].As<Napi::Number>().Int32Value();
+  int targetWidth = info[6].As<Napi::Number>().Int32Value();
+  int targetHeight = info[7].As<Napi::Number>().Int32Value();
+  if (!surfaceFits(info[0], sourcePitch, sourceWidth, sourceHeight) ||
+      !surfaceFits(info[4], targetPitch, targetWidth, targetHeight)) {
+    Napi::TypeError::New(env, "scaleSharpBilinear surface is too small")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  scale_sharp_bilinear(source, sourcePitch, sourceWidth, sourceHeight,
+                       target, targetPitch, targetWidth, targetHeight);
+  return env.Null();
+}
+
+
 void initialize(Napi::Env env, Napi::Object exports) {
+  PngSink::InitClass(env, exports);
+  GifWriter::InitClass(env, exports);
+  TileCache::InitClass(env, exports);
+  VideoSink::InitClass(env, exports);
 
   #ifdef SDL_ENABLED
   SDLBackend::InitClass(env, exports);
@@ -107,6 +636,24 @@ Napi::Object InitAll(Napi::Env env, Napi::Object exports) {
       Napi::Function::New(env, MakeBackend, "MakeBackend"));
   exports.Set("supports",
       Napi::Function::New(env, Supports, "Supports"));
+  exports.Set("rasterizeLayer",
+      Napi::Function::New(env, RasterizeLayer, "RasterizeLayer"));
+  exports.Set("rasterizeCells",
+      Napi::Function::New(env, RasterizeCells, "RasterizeCells"));
+  exports.Set("rasterizeTiles",
+      Napi::Function::New(env, RasterizeTiles, "RasterizeTiles"));
+  exports.Set("compositeSurfaces",
+      Napi::Function::New(env, CompositeSurfaces, "CompositeSurfaces"));
+  exports.Set("floodFill",
+      Napi::Function::New(env, FloodFill, "FloodFill"));
+  exports.Set("fillRanges",
+      Napi::Function::New(env, FillRanges, "FillRanges"));
+  exports.Set("scaleNearest",
+      Napi::Function::New(env, ScaleNearest, "ScaleNearest"));
+  exports.Set("scaleScanlines",
+      Napi::Function::New(env, ScaleScanlines, "ScaleScanlines"));
+  exports.Set("scaleSharpBilinear",
+      Napi::Function::New(env, ScaleSharpBilinear, "ScaleSharpBilinear"));
   Napi::HandleScope scope(env);
   initialize(env, exports);
   return exports;
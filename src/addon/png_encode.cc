@@ -0,0 +1,135 @@
+#include "png_encode.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#define RGB_PIXEL_SIZE 4
+#define NUM_FILTERS 5
+
+static const uint8_t g_signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+
+
+static void put_u32(std::vector<uint8_t>* out, uint32_t n) {
+  out->push_back(n >> 24);
+  out->push_back(n >> 16);
+  out->push_back(n >> 8);
+  out->push_back(n);
+}
+
+static void put_chunk(std::vector<uint8_t>* out, const char* type,
+                      const uint8_t* data, uint32_t length) {
+  put_u32(out, length);
+  size_t start = out->size();
+  out->insert(out->end(), type, type + 4);
+  if (length > 0) {
+    out->insert(out->end(), data, data + length);
+  }
+  uint32_t crc = crc32(0L, out->data() + start, length + 4);
+  put_u32(out, crc);
+}
+
+static inline uint8_t paeth(int a, int b, int c) {
+  int p = a + b - c;
+  int pa = abs(p - a);
+  int pb = abs(p - b);
+  int pc = abs(p - c);
+  if (pa <= pb && pa <= pc) {
+    return a;
+  }
+  return pb <= pc ? b : c;
+}
+
+// Write one filtered row, the filter type byte followed by the filtered
+// bytes. prev is NULL for the first row
+static void filter_row(const uint8_t* row, const uint8_t* prev, int rowBytes,
+                       int filter, uint8_t* target) {
+  target[0] = filter;
+  uint8_t* out = target + 1;
+  for (int i = 0; i < rowBytes; i++) {
+    int left = i >= RGB_PIXEL_SIZE ? row[i - RGB_PIXEL_SIZE] : 0;
+    int up = prev ? prev[i] : 0;
+    int upLeft = (prev && i >= RGB_PIXEL_SIZE) ? prev[i - RGB_PIXEL_SIZE] : 0;
+    switch (filter) {
+    case 0:
+      out[i] = row[i];
+      break;
+    case 1:
+      out[i] = row[i] - left;
+      break;
+    case 2:
+      out[i] = row[i] - up;
+      break;
+    case 3:
+      out[i] = row[i] - ((left + up) >> 1);
+      break;
+    case 4:
+      out[i] = row[i] - paeth(left, up, upLeft);
+      break;
+    }
+  }
+}
+
+static uint32_t filter_cost(const uint8_t* filtered, int rowBytes) {
+  uint32_t sum = 0;
+  for (int i = 0; i < rowBytes; i++) {
+    // bytes are differences, so treat them as signed
+    sum += abs((int8_t)filtered[i]);
+  }
+  return sum;
+}
+
+bool encode_png(const uint8_t* rgba, int width, int height, int pitch,
+                int level, std::vector<uint8_t>* out) {
+  int rowBytes = width * RGB_PIXEL_SIZE;
+  int stride = rowBytes + 1;
+
+  // Filter each row with the cheapest filter
+  std::vector<uint8_t> filtered((size_t)stride * height);
+  std::vector<uint8_t> candidate(stride);
+  for (int y = 0; y < height; y++) {
+    const uint8_t* row = rgba + (size_t)y * pitch;
+    const uint8_t* prev = y > 0 ? row - pitch : NULL;
+    uint8_t* target = filtered.data() + (size_t)y * stride;
+    uint32_t bestCost = 0xffffffff;
+    for (int f = 0; f < NUM_FILTERS; f++) {
+      filter_row(row, prev, rowBytes, f, candidate.data());
+      uint32_t cost = filter_cost(candidate.data() + 1, rowBytes);
+      if (cost < bestCost) {
+        bestCost = cost;
+        memcpy(target, candidate.data(), stride);
+      }
+    }
+  }
+
+  uLongf compressedSize = compressBound(filtered.size());
+  std::vector<uint8_t> compressed(compressedSize);
+  int res = compress2(compressed.data(), &compressedSize,
+                      filtered.data(), filtered.size(), level);
+  if (res != Z_OK) {
+    return false;
+  }
+
+  uint8_t header[13];
+  header[0] = width >> 24;
+  header[1] = width >> 16;
+  header[2] = width >> 8;
+  header[3] = width;
+  header[4] = height >> 24;
+  header[5] = height >> 16;
+  header[6] = height >> 8;
+  header[7] = height;
+  header[8] = 8;  // bit depth
+  header[9] = 6;  // truecolor with alpha
+  header[10] = 0; // deflate
+  header[11] = 0; // adaptive filtering
+  header[12] = 0; // no interlace
+
+  out->clear();
+  out->reserve(compressedSize + 64);
+  out->insert(out->end(), g_signature, g_signature + 8);
+  put_chunk(out, "IHDR", header, sizeof(header));
+  put_chunk(out, "IDAT", compressed.data(), compressedSize);
+  put_chunk(out, "IEND", NULL, 0);
+  return true;
+}
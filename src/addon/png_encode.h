@@ -0,0 +1,14 @@
+#ifndef PNG_ENCODE_H
+#define PNG_ENCODE_H
+
+#include <stdint.h>
+#include <vector>
+
+// Encode an RGBA surface as an 8-bit truecolor png with alpha. Each row gets
+// whichever filter gives the smallest sum of absolute differences, then the
+// rows are compressed with zlib at the given level. Returns false if zlib
+// fails.
+bool encode_png(const uint8_t* rgba, int width, int height, int pitch,
+                int level, std::vector<uint8_t>* out);
+
+#endif
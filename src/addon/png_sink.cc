@@ -0,0 +1,189 @@
+#include "png_sink.h"
+#include "png_encode.h"
+#include "common.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define RGB_PIXEL_SIZE 4
+#define COMPRESSION_LEVEL 6
+
+Napi::FunctionReference g_pngSinkConstructor;
+
+
+void PngSink::InitClass(Napi::Env env, Napi::Object exports) {
+  Napi::Function func = DefineClass(
+      env,
+      "PngSink",
+      {InstanceMethod("write", &PngSink::Write),
+       InstanceMethod("finish", &PngSink::Finish),
+  });
+  g_pngSinkConstructor = Napi::Persistent(func);
+  g_pngSinkConstructor.SuppressDestruct();
+  exports.Set("PngSink", func);
+}
+
+PngSink::PngSink(const Napi::CallbackInfo& info)
+    : Napi::ObjectWrap<PngSink>(info) {
+  int numWorkers = 0;
+  int maxInFlight = 0;
+  if (info.Length() > 0 && info[0].IsNumber()) {
+    numWorkers = info[0].As<Napi::Number>().Int32Value();
+  }
+  if (info.Length() > 1 && info[1].IsNumber()) {
+    maxInFlight = info[1].As<Napi::Number>().Int32Value();
+  }
+  if (numWorkers <= 0) {
+    numWorkers = std::thread::hardware_concurrency();
+    if (numWorkers <= 0) {
+      numWorkers = 1;
+    }
+  }
+  if (maxInFlight <= 0) {
+    maxInFlight = numWorkers * 2;
+  }
+
+  this->nextIndex = 0;
+  this->nextToWrite = 0;
+  this->numInFlight = 0;
+  this->maxInFlight = maxInFlight;
+  this->isWriting = false;
+  this->isStopping = false;
+  for (int n = 0; n < numWorkers; n++) {
+    this->workers.push_back(std::thread(&PngSink::workerLoop, this));
+  }
+}
+
+PngSink::~PngSink() {
+  {
+    std::lock_guard<std::mutex> guard(this->lock);
+    this->isStopping = true;
+  }
+  this->hasWork.notify_all();
+  for (size_t n = 0; n < this->workers.size(); n++) {
+    this->workers[n].join();
+  }
+  for (size_t n = 0; n < this->queue.size(); n++) {
+    delete this->queue[n];
+  }
+  for (auto it = this->encoded.begin(); it != this->encoded.end(); it++) {
+    delete it->second;
+  }
+}
+
+Napi::Value PngSink::Write(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  if (info.Length() < 2 || !info[0].IsString() || !info[1].IsObject()) {
+    Napi::TypeError::New(env, "write needs filename and surface")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  Napi::Object surfaceObj = info[1].As<Napi::Object>();
+  unsigned char* buff = typedArrayToRawBuffer(surfaceObj.Get("buff"));
+  if (buff == NULL) {
+    Napi::TypeError::New(env, "write needs surface.buff")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  // Copy the rows, the surface belongs to the caller again once this returns
+  PngJob* job = new PngJob();
+  job->filename = info[0].As<Napi::String>().Utf8Value();
+  job->width = surfaceObj.Get("width").As<Napi::Number>().Int32Value();
+  job->height = surfaceObj.Get("height").As<Napi::Number>().Int32Value();
+  int sourcePitch = surfaceObj.Get("pitch").As<Napi::Number>().Int32Value();
+  job->pitch = job->width * RGB_PIXEL_SIZE;
+  job->pixels.resize((size_t)job->pitch * job->height);
+  for (int y = 0; y < job->height; y++) {
+    memcpy(job->pixels.data() + (size_t)y * job->pitch,
+           buff + (size_t)y * sourcePitch, job->pitch);
+  }
+  job->isEncoded = false;
+
+  std::unique_lock<std::mutex> guard(this->lock);
+  while (this->numInFlight >= this->maxInFlight) {
+    this->hasChanged.wait(guard);
+  }
+  job->index = this->nextIndex++;
+  this->numInFlight++;
+  this->queue.push_back(job);
+  guard.unlock();
+  this->hasWork.notify_one();
+  return env.Null();
+}
+
+Napi::Value PngSink::Finish(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  std::unique_lock<std::mutex> guard(this->lock);
+  while (this->numInFlight > 0) {
+    this->hasChanged.wait(guard);
+  }
+  if (this->error.empty()) {
+    return env.Null();
+  }
+  std::string message = this->error;
+  this->error.clear();
+  return Napi::String::New(env, message);
+}
+
+void PngSink::workerLoop() {
+  while (true) {
+    std::unique_lock<std::mutex> guard(this->lock);
+    while (this->queue.empty() && !this->isStopping) {
+      this->hasWork.wait(guard);
+    }
+    if (this->isStopping) {
+      return;
+    }
+    PngJob* job = this->queue.front();
+    this->queue.pop_front();
+    guard.unlock();
+
+    job->isEncoded = encode_png(job->pixels.data(), job->width, job->height,
+                                job->pitch, COMPRESSION_LEVEL, &job->encoded);
+    std::vector<uint8_t>().swap(job->pixels);
+    this->completeJob(job);
+  }
+}
+
+// Frames finish encoding in any order, but are written in the order they
+// arrived. Whichever worker finds the next frame ready writes it, along with
+// any frames after it that are also ready
+void PngSink::completeJob(PngJob* job) {
+  std::unique_lock<std::mutex> guard(this->lock);
+  this->encoded[job->index] = job;
+  if (this->isWriting) {
+    return;
+  }
+  this->isWriting = true;
+  while (true) {
+    auto it = this->encoded.find(this->nextToWrite);
+    if (it == this->encoded.end()) {
+      break;
+    }
+    PngJob* ready = it->second;
+    this->encoded.erase(it);
+    guard.unlock();
+
+    bool isOK = ready->isEncoded;
+    if (isOK) {
+      FILE* fp = fopen(ready->filename.c_str(), "wb");
+      isOK = fp != NULL;
+      if (fp) {
+        size_t size = ready->encoded.size();
+        isOK = fwrite(ready->encoded.data(), 1, size, fp) == size;
+        isOK = fclose(fp) == 0 && isOK;
+      }
+    }
+
+    guard.lock();
+    if (!isOK && this->error.empty()) {
+      this->error = "could not write " + ready->filename;
+    }
+    delete ready;
+    this->nextToWrite++;
+    this->numInFlight--;
+    this->hasChanged.notify_all();
+  }
+  this->isWriting = false;
+}
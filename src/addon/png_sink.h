@@ -0,0 +1,60 @@
+#ifndef PNG_SINK_H
+#define PNG_SINK_H
+
+#include <napi.h>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// A frame waiting to be encoded, then waiting to be written
+struct PngJob {
+  int index;
+  std::string filename;
+  std::vector<uint8_t> pixels;
+  int width;
+  int height;
+  int pitch;
+  std::vector<uint8_t> encoded;
+  bool isEncoded;
+};
+
+// Encodes frames as png files on a pool of worker threads. Frames are
+// copied when written, so the caller can reuse its surface right away.
+// Files are written in the order that frames arrive, and no more than
+// maxInFlight frames are held at once, write() blocks until there is room.
+class PngSink : public Napi::ObjectWrap<PngSink> {
+ public:
+  static void InitClass(Napi::Env env, Napi::Object exports);
+  // (numWorkers, maxInFlight), 0 for either picks a default
+  PngSink(const Napi::CallbackInfo& info);
+  ~PngSink();
+
+ private:
+  // (filename, surface)
+  Napi::Value Write(const Napi::CallbackInfo& info);
+  // Wait for every frame to be written, returns an error message or null
+  Napi::Value Finish(const Napi::CallbackInfo& info);
+
+  void workerLoop();
+  void completeJob(PngJob* job);
+
+  std::mutex lock;
+  std::condition_variable hasWork;
+  std::condition_variable hasChanged;
+  std::deque<PngJob*> queue;
+  std::map<int, PngJob*> encoded;
+  std::vector<std::thread> workers;
+  int nextIndex;
+  int nextToWrite;
+  int numInFlight;
+  int maxInFlight;
+  bool isWriting;
+  bool isStopping;
+  std::string error;
+};
+
+#endif
@@ -3,17 +3,35 @@
 
 #include <SDL.h>
 
+#include "frame_scheduler.h"
+#include "frame_stats.h"
+
 using namespace Napi;
 
 class PresentFrame : public AsyncWorker {
   public:
-    PresentFrame(Function& callback, SDL_Renderer* h)
-        : AsyncWorker(callback), rendererHandle(h) {}
+    // With shouldWait, also sleep until the scheduler's next deadline,
+    // otherwise presenting is assumed to wait for vsync
+    PresentFrame(Function& callback, SDL_Renderer* h,
+                 FrameScheduler* scheduler, bool shouldWait,
+                 FrameStats* stats)
+        : AsyncWorker(callback), rendererHandle(h), scheduler(scheduler),
+          shouldWait(shouldWait), stats(stats) {}
 
     ~PresentFrame() {}
 
     void Execute() override {
+        int64_t start = FrameStats::now();
         SDL_RenderPresent(this->rendererHandle);
+        int64_t presented = FrameStats::now();
+        this->stats->addPhase(PHASE_PRESENT, start, presented - start);
+        if (this->shouldWait) {
+            this->scheduler->waitNext();
+            this->stats->addPhase(PHASE_IDLE, presented,
+                                  FrameStats::now() - presented);
+        } else {
+            this->scheduler->markFrame();
+        }
     }
 
     void OnOK() override {
@@ -23,5 +41,8 @@ class PresentFrame : public AsyncWorker {
 
   private:
     SDL_Renderer* rendererHandle;
+    FrameScheduler* scheduler;
+    bool shouldWait;
+    FrameStats* stats;
 
 };
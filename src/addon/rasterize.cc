@@ -0,0 +1,338 @@
+#include "rasterize.h"
+
+#include <string.h>
+
+#define RGB_PIXEL_SIZE 4
+#define ALPHA_OFFSET 3
+
+
+static inline void put_pixel(uint8_t* target, uint32_t rgba) {
+  memcpy(target, &rgba, sizeof(rgba));
+}
+
+static inline int wrap_value(int n, int size) {
+  return ((n % size) + size) % size;
+}
+
+void rasterize_layer(const uint8_t* source, int sourcePitch,
+                     int sourceWidth, int sourceHeight,
+                     int scrollX, int scrollY, bool isWrapped, bool isBg,
+                     const uint32_t* lut,
+                     uint8_t* target, int targetPitch,
+                     int left, int top, int right, int bottom) {
+  if (sourceWidth <= 0 || sourceHeight <= 0) {
+    return;
+  }
+
+  // Upper layers treat index 0 as transparent, but keep its rgb value
+  uint32_t palette[256];
+  memcpy(palette, lut, sizeof(palette));
+  if (!isBg) {
+    uint8_t* zero = (uint8_t*)&palette[0];
+    zero[ALPHA_OFFSET] = 0x00;
+  }
+
+  if (left < 0) {
+    left = 0;
+  }
+
+  if (isWrapped) {
+    // Every pixel of the region is covered, wrapping around the source
+    scrollX = wrap_value(scrollX, sourceWidth);
+    scrollY = wrap_value(scrollY, sourceHeight);
+    for (int i = top; i < bottom; i++) {
+      const uint8_t* row = source + ((i + scrollY) % sourceHeight) * sourcePitch;
+      uint8_t* out = target + i * targetPitch + left * RGB_PIXEL_SIZE;
+      int x = (left + scrollX) % sourceWidth;
+      for (int j = left; j < right; j++) {
+        put_pixel(out, palette[row[x]]);
+        out += RGB_PIXEL_SIZE;
+        x++;
+        if (x == sourceWidth) {
+          x = 0;
+        }
+      }
+    }
+    return;
+  }
+
+  // Single placement, offset by scroll. Rows above the source have no data
+  // so they only become transparent
+  int rowEnd = bottom;
+  if (sourceHeight - scrollY < rowEnd) {
+    rowEnd = sourceHeight - scrollY;
+  }
+  int colBegin = left + scrollX;
+  if (colBegin < 0) {
+    colBegin = 0;
+  }
+  int colEnd = right + scrollX;
+  if (sourceWidth < colEnd) {
+    colEnd = sourceWidth;
+  }
+  if (right < colEnd) {
+    colEnd = right;
+  }
+
+  for (int i = top; i < rowEnd; i++) {
+    int y = i + scrollY;
+    uint8_t* out = target + i * targetPitch;
+    if (y < 0) {
+      for (int x = colBegin; x < colEnd; x++) {
+        out[(x - scrollX) * RGB_PIXEL_SIZE + ALPHA_OFFSET] = 0x00;
+      }
+      continue;
+    }
+    const uint8_t* row = source + y * sourcePitch;
+    for (int x = colBegin; x < colEnd; x++) {
+      put_pixel(out + (x - scrollX) * RGB_PIXEL_SIZE, palette[row[x]]);
+    }
+  }
+}
+
+Placement place_region(int sourceWidth, int sourceHeight,
+                       int scrollX, int scrollY, bool isWrapped,
+                       uint8_t* target, int targetPitch,
+                       int left, int top, int right, int bottom) {
+  if (left < 0) {
+    left = 0;
+  }
+  Placement place;
+  place.scrollX = scrollX;
+  place.scrollY = scrollY;
+  place.rowBegin = top;
+  place.rowEnd = bottom;
+  place.colBegin = left;
+  place.colEnd = right;
+  if (isWrapped) {
+    place.scrollX = wrap_value(scrollX, sourceWidth);
+    place.scrollY = wrap_value(scrollY, sourceHeight);
+    return place;
+  }
+  if (sourceHeight - scrollY < place.rowEnd) {
+    place.rowEnd = sourceHeight - scrollY;
+  }
+  int colBegin = left + scrollX;
+  if (colBegin < 0) {
+    colBegin = 0;
+  }
+  int colEnd = right + scrollX;
+  if (sourceWidth < colEnd) {
+    colEnd = sourceWidth;
+  }
+  if (right < colEnd) {
+    colEnd = right;
+  }
+  place.colBegin = colBegin - scrollX;
+  place.colEnd = colEnd - scrollX;
+  for (; place.rowBegin < place.rowEnd && place.rowBegin < -scrollY;
+       place.rowBegin++) {
+    uint8_t* out = target + place.rowBegin * targetPitch;
+    for (int j = place.colBegin; j < place.colEnd; j++) {
+      out[j * RGB_PIXEL_SIZE + ALPHA_OFFSET] = 0x00;
+    }
+  }
+  return place;
+}
+
+void rasterize_cells(const uint8_t* source, int sourcePitch,
+                     int sourceWidth, int sourceHeight,
+                     int scrollX, int scrollY, bool isWrapped, bool isBg,
+                     const uint32_t* lut, const CellAttrs& cells,
+                     uint8_t* target, int targetPitch,
+                     int left, int top, int right, int bottom) {
+  if (sourceWidth <= 0 || sourceHeight <= 0 ||
+      cells.cellWidth <= 0 || cells.cellHeight <= 0) {
+    return;
+  }
+
+  Placement place = place_region(sourceWidth, sourceHeight, scrollX, scrollY,
+                                 isWrapped, target, targetPitch,
+                                 left, top, right, bottom);
+  scrollX = place.scrollX;
+  scrollY = place.scrollY;
+
+  uint32_t cellColors[256];
+
+  // Walk the region one block at a time, each block is the part of a single
+  // cell that is inside of the region, and does not wrap around the source
+  int rowEnd = place.rowEnd, colEnd = place.colEnd;
+  int i = place.rowBegin;
+  while (i < rowEnd) {
+    int y = (i + scrollY) % sourceHeight;
+    int cellY = y / cells.cellHeight;
+    int numRows = rowEnd - i;
+    if (cells.cellHeight - y % cells.cellHeight < numRows) {
+      numRows = cells.cellHeight - y % cells.cellHeight;
+    }
+    if (sourceHeight - y < numRows) {
+      numRows = sourceHeight - y;
+    }
+    int j = place.colBegin;
+    while (j < colEnd) {
+      int x = (j + scrollX) % sourceWidth;
+      int cellX = x / cells.cellWidth;
+      int numCols = colEnd - j;
+      if (cells.cellWidth - x % cells.cellWidth < numCols) {
+        numCols = cells.cellWidth - x % cells.cellWidth;
+      }
+      if (sourceWidth - x < numCols) {
+        numCols = sourceWidth - x;
+      }
+
+      // Resolve the attribute into the colors of the cell
+      int size = 0;
+      if (cellX < cells.pitch && cellY < cells.height) {
+        int attr = cells.attrs[cellY * cells.pitch + cellX];
+        // Colors outside of the lut leave the cell without any
+        if (attr >= 0) {
+          if ((attr + 1) * cells.pieceSize <= 256) {
+            size = cells.pieceSize;
+            const uint32_t* piece = lut + attr * cells.pieceSize;
+            memcpy(cellColors, piece, size * sizeof(uint32_t));
+          }
+        } else {
+          int start = cells.listStarts[-1 - attr];
+          size = cells.listStarts[-attr] - start;
+          if (size > 256) {
+            size = 0;
+          }
+          for (int m = 0; m < size; m++) {
+            int e = cells.lists[start + m];
+            if (e < 0 || e >= 256) {
+              size = 0;
+              break;
+            }
+            cellColors[m] = lut[e];
+          }
+        }
+      }
+
+      if (size == 0) {
+        // Cell has no attribute, so it has no colors
+        for (int r = 0; r < numRows; r++) {
+          uint8_t* out = target + (i + r) * targetPitch + j * RGB_PIXEL_SIZE;
+          for (int k = 0; k < numCols; k++) {
+            out[k * RGB_PIXEL_SIZE + ALPHA_OFFSET] = 0x00;
+          }
+        }
+      } else {
+        // Upper layers treat index 0 as transparent, keeping its rgb value.
+        // Other indexes that resolve to the same color stay opaque
+        uint32_t zero = cellColors[0];
+        if (!isBg) {
+          ((uint8_t*)&zero)[ALPHA_OFFSET] = 0x00;
+        }
+        for (int r = 0; r < numRows; r++) {
+          const uint8_t* row = source + (y + r) * sourcePitch + x;
+          uint8_t* out = target + (i + r) * targetPitch + j * RGB_PIXEL_SIZE;
+          for (int k = 0; k < numCols; k++) {
+            uint8_t c = row[k];
+            put_pixel(out, c == 0 ? zero : cellColors[c % size]);
+            out += RGB_PIXEL_SIZE;
+          }
+        }
+      }
+      j += numCols;
+    }
+    i += numRows;
+  }
+}
+
+void rasterize_tiles(const uint8_t* const* tiles, const int* tilePitches,
+                     int numTiles, const uint8_t* tilemap, int mapPitch,
+                     int mapWidth, int mapHeight,
+                     const uint8_t* flips, int flipsPitch,
+                     int tileWidth, int tileHeight,
+                     int scrollX, int scrollY, bool isWrapped, bool isBg,
+                     const uint32_t* lut,
+                     uint8_t* target, int targetPitch,
+                     int left, int top, int right, int bottom) {
+  int sourceWidth = mapWidth * tileWidth;
+  int sourceHeight = mapHeight * tileHeight;
+  if (sourceWidth <= 0 || sourceHeight <= 0) {
+    return;
+  }
+
+  // Upper layers treat index 0 as transparent, but keep its rgb value
+  uint32_t palette[256];
+  memcpy(palette, lut, sizeof(palette));
+  if (!isBg) {
+    uint8_t* zero = (uint8_t*)&palette[0];
+    zero[ALPHA_OFFSET] = 0x00;
+  }
+
+  Placement place = place_region(sourceWidth, sourceHeight, scrollX, scrollY,
+                                 isWrapped, target, targetPitch,
+                                 left, top, right, bottom);
+  scrollX = place.scrollX;
+  scrollY = place.scrollY;
+
+  // Walk the region one block at a time, each block is the part of a single
+  // tile that is inside of the region
+  int i = place.rowBegin;
+  while (i < place.rowEnd) {
+    int y = (i + scrollY) % sourceHeight;
+    int mapY = y / tileHeight;
+    int innerY = y % tileHeight;
+    int numRows = place.rowEnd - i;
+    if (tileHeight - innerY < numRows) {
+      numRows = tileHeight - innerY;
+    }
+    int j = place.colBegin;
+    while (j < place.colEnd) {
+      int x = (j + scrollX) % sourceWidth;
+      int mapX = x / tileWidth;
+      int innerX = x % tileWidth;
+      int numCols = place.colEnd - j;
+      if (tileWidth - innerX < numCols) {
+        numCols = tileWidth - innerX;
+      }
+
+      int id = tilemap[mapY * mapPitch + mapX];
+      const uint8_t* tile = id < numTiles ? tiles[id] : NULL;
+      int flip = flips ? flips[mapY * flipsPitch + mapX] : 0;
+      for (int r = 0; r < numRows; r++) {
+        uint8_t* out = target + (i + r) * targetPitch + j * RGB_PIXEL_SIZE;
+        if (tile == NULL) {
+          // Missing tiles are index 0
+          for (int k = 0; k < numCols; k++) {
+            put_pixel(out + k * RGB_PIXEL_SIZE, palette[0]);
+          }
+          continue;
+        }
+        int ty = innerY + r;
+        if (flip & TILE_FLIP_V) {
+          ty = tileHeight - 1 - ty;
+        }
+        const uint8_t* row = tile + ty * tilePitches[id];
+        if (flip & TILE_FLIP_H) {
+          row += tileWidth - 1 - innerX;
+          for (int k = 0; k < numCols; k++) {
+            put_pixel(out + k * RGB_PIXEL_SIZE, palette[row[-k]]);
+          }
+        } else {
+          row += innerX;
+          for (int k = 0; k < numCols; k++) {
+            put_pixel(out + k * RGB_PIXEL_SIZE, palette[row[k]]);
+          }
+        }
+      }
+      j += numCols;
+    }
+    i += numRows;
+  }
+}
+
+void expand_indexed(const uint8_t* source, int sourcePitch,
+                    const uint32_t* lut,
+                    uint8_t* target, int targetPitch,
+                    int width, int height) {
+  for (int i = 0; i < height; i++) {
+    const uint8_t* row = source + i * sourcePitch;
+    uint8_t* out = target + i * targetPitch;
+    for (int j = 0; j < width; j++) {
+      put_pixel(out + j * RGB_PIXEL_SIZE, lut[row[j]]);
+    }
+  }
+}
@@ -0,0 +1,87 @@
+#ifndef RASTERIZE_H
+#define RASTERIZE_H
+
+#include <stdint.h>
+
+// Convert a region of a layer's indexed pixels into an RGBA surface.
+//
+// The lut has 256 entries, one per color index, each holding r,g,b,a bytes
+// in memory order. Scroll is applied by the rasterizer. A wrapped layer
+// repeats in both directions, otherwise the source is placed once, offset by
+// scroll. For any layer other than the bottom one, index 0 is transparent.
+void rasterize_layer(const uint8_t* source, int sourcePitch,
+                     int sourceWidth, int sourceHeight,
+                     int scrollX, int scrollY, bool isWrapped, bool isBg,
+                     const uint32_t* lut,
+                     uint8_t* target, int targetPitch,
+                     int left, int top, int right, int bottom);
+
+// Where the source lands in the region of the target, in the same way as
+// rasterize_layer
+struct Placement {
+  int scrollX;
+  int scrollY;
+  // Range of target rows and columns that have a source pixel
+  int rowBegin;
+  int rowEnd;
+  int colBegin;
+  int colEnd;
+};
+
+// When not wrapped, rows above the source have no data so they only become
+// transparent
+Placement place_region(int sourceWidth, int sourceHeight,
+                       int scrollX, int scrollY, bool isWrapped,
+                       uint8_t* target, int targetPitch,
+                       int left, int top, int right, int bottom);
+
+// Attribute table of a colorspace, see Colorspace.compile. Each cell's
+// attribute is a piece number if >= 0, otherwise -1 - the index of a list of
+// palette entries, which are lists[listStarts[n]] to lists[listStarts[n+1]].
+struct CellAttrs {
+  const int32_t* attrs;
+  int pitch;
+  int height;
+  int cellWidth;
+  int cellHeight;
+  int pieceSize;
+  const int32_t* lists;
+  const int32_t* listStarts;
+};
+
+// Same as rasterize_layer, except that each pixel's index is first resolved
+// by the attribute of its cell. Attributes are resolved once per cell, every
+// color they produce must be an index of the lut.
+void rasterize_cells(const uint8_t* source, int sourcePitch,
+                     int sourceWidth, int sourceHeight,
+                     int scrollX, int scrollY, bool isWrapped, bool isBg,
+                     const uint32_t* lut, const CellAttrs& cells,
+                     uint8_t* target, int targetPitch,
+                     int left, int top, int right, int bottom);
+
+#define TILE_FLIP_H 1
+#define TILE_FLIP_V 2
+
+// Convert a region of a tiled layer into an RGBA surface, reading the rows of
+// only the tiles in view. The tilemap holds tile ids, a tile that is NULL or
+// beyond numTiles is all index 0. Flips, if not NULL, has TILE_FLIP_H and
+// TILE_FLIP_V bits per map entry. Otherwise the same as rasterize_layer.
+void rasterize_tiles(const uint8_t* const* tiles, const int* tilePitches,
+                     int numTiles, const uint8_t* tilemap, int mapPitch,
+                     int mapWidth, int mapHeight,
+                     const uint8_t* flips, int flipsPitch,
+                     int tileWidth, int tileHeight,
+                     int scrollX, int scrollY, bool isWrapped, bool isBg,
+                     const uint32_t* lut,
+                     uint8_t* target, int targetPitch,
+                     int left, int top, int right, int bottom);
+
+// Expand a region of an indexed surface, a byte per pixel, into RGBA using
+// the lut. The region starts at source and target, which have their own
+// pitches.
+void expand_indexed(const uint8_t* source, int sourcePitch,
+                    const uint32_t* lut,
+                    uint8_t* target, int targetPitch,
+                    int width, int height);
+
+#endif
@@ -5,7 +5,7 @@
 #include "common.h"
 #include "type.h"
 #include "bcm_host.h"
-#include "wait_frame_unix.h"
+#include "wait_frame.h"
 
 
 #define ALIGN64(n) ((n+63)&(~63))
@@ -292,6 +292,8 @@ void RPIBackend::InitClass(Napi::Env env, Napi::Object exports) {
        InstanceMethod("eventReceiver", &RPIBackend::EventReceiver),
        InstanceMethod("runAppLoop", &RPIBackend::RunAppLoop),
        InstanceMethod("insteadWriteBuffer", &RPIBackend::InsteadWriteBuffer),
+       InstanceMethod("getStats", &RPIBackend::GetStats),
+       InstanceMethod("getTrace", &RPIBackend::GetTrace),
   });
   g_rpiDisplayConstructor = Napi::Persistent(func);
   g_rpiDisplayConstructor.SuppressDestruct();
@@ -331,7 +333,28 @@ Napi::Value RPIBackend::BeginRender(const Napi::CallbackInfo& info) {
 }
 
 Napi::Value RPIBackend::Config(const Napi::CallbackInfo& info) {
-  return info.Env().Null();
+  Napi::Env env = info.Env();
+  if (info.Length() < 2) {
+    printf("Config needs two parameters\n");
+    return env.Null();
+  }
+
+  std::string field = info[0].ToString().Utf8Value();
+  if (field == std::string("rate")) {
+    // config('rate', hz)
+    this->scheduler.setRate(info[1].ToNumber().Int32Value());
+
+  } else if (field == std::string("pacing")) {
+    // config('pacing', 'catchup' or 'skip')
+    std::string policy = info[1].ToString().Utf8Value();
+    if (policy == std::string("skip")) {
+      this->scheduler.setPolicy(PACING_SKIP);
+    } else {
+      this->scheduler.setPolicy(PACING_CATCH_UP);
+    }
+
+  }
+  return env.Null();
 }
 
 Napi::Value RPIBackend::EventReceiver(const Napi::CallbackInfo& info) {
@@ -351,6 +374,8 @@ Napi::Value RPIBackend::RunAppLoop(const Napi::CallbackInfo& info) {
 
   Napi::Value runIDVal = info[0];
   this->execNextFrame = Napi::Persistent(info[1].As<Napi::Function>());
+  this->scheduler.start();
+  this->stats.setPeriodUs(1000000 / this->scheduler.rate());
   this->execOneFrame(info);
   return env.Null();
 }
@@ -358,6 +383,7 @@ Napi::Value RPIBackend::RunAppLoop(const Napi::CallbackInfo& info) {
 
 void RPIBackend::execOneFrame(const Napi::CallbackInfo& info) {
   Napi::Env env = info.Env();
+  this->stats.beginFrame();
 
   // TODO: poll for events
   // TODO: isRunning
@@ -371,13 +397,16 @@ void RPIBackend::execOneFrame(const Napi::CallbackInfo& info) {
     return;
   }
 
-  // call the executor
+  // call the executor, with the number of frames the scheduler dropped
   napi_value needRenderVal;
-  needRenderVal = this->execNextFrame.Call(self, 0, NULL);
+  int missed = this->scheduler.takeMissed();
+  needRenderVal = this->execNextFrame.Call(self,
+                                           {Napi::Number::New(env, missed)});
   if (env.IsExceptionPending()) {
     printf("exception!!\n");
     return;
   }
+  this->stats.mark(PHASE_EXEC);
 
   // Call the render function.
   napi_value resVal;
@@ -393,6 +422,7 @@ void RPIBackend::execOneFrame(const Napi::CallbackInfo& info) {
   if (env.IsExceptionPending()) {
     return;
   }
+  this->stats.mark(PHASE_RENDER);
 
   // Get the pitch of the first layer, assume it is constant.
   // TODO: Fix this assumption
@@ -434,8 +464,11 @@ void RPIBackend::execOneFrame(const Napi::CallbackInfo& info) {
     }
   }
 
+  this->stats.mark(PHASE_UPLOAD);
+
   UpdateSync upsync;
   display_frame_swap(this->gfx, &upsync);
+  this->stats.mark(PHASE_PRESENT);
   this->next(env);
 }
 
@@ -448,7 +481,7 @@ static void BeginNextFrame(const Napi::CallbackInfo& info) {
 void RPIBackend::next(Napi::Env env) {
   Napi::Function cont = Napi::Function::New(env, BeginNextFrame,
                                             "<unknown>", this);
-  WaitFrame* w = new WaitFrame(cont, 16);
+  WaitFrame* w = new WaitFrame(cont, &this->scheduler, &this->stats);
   w->Queue();
 }
 
@@ -456,6 +489,16 @@ Napi::Value RPIBackend::InsteadWriteBuffer(const Napi::CallbackInfo& info) {
   return info.Env().Null();
 }
 
+// Timing of recent frames, split into phases, see frame_stats.h
+Napi::Value RPIBackend::GetStats(const Napi::CallbackInfo& info) {
+  return frameStatsToValue(info.Env(), &this->stats);
+}
+
+// Recent frames as Chrome trace-event JSON
+Napi::Value RPIBackend::GetTrace(const Napi::CallbackInfo& info) {
+  return Napi::String::New(info.Env(), this->stats.traceJSON());
+}
+
 Napi::Value RPIBackend::GetFeatureList(const Napi::CallbackInfo& info) {
   Napi::Env env = info.Env();
   Napi::Array features;
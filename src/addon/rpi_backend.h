@@ -2,6 +2,9 @@
 
 #include <napi.h>
 
+#include "frame_scheduler.h"
+#include "frame_stats.h"
+
 struct RPIGraphicsData;
 
 class RPIBackend : public Napi::ObjectWrap<RPIBackend> {
@@ -19,6 +22,8 @@ class RPIBackend : public Napi::ObjectWrap<RPIBackend> {
   Napi::Value EventReceiver(const Napi::CallbackInfo& info);
   Napi::Value RunAppLoop(const Napi::CallbackInfo& info);
   Napi::Value GetFeatureList(const Napi::CallbackInfo& info);
+  Napi::Value GetStats(const Napi::CallbackInfo& info);
+  Napi::Value GetTrace(const Napi::CallbackInfo& info);
   Napi::Value InsteadWriteBuffer(const Napi::CallbackInfo& info);
   void next(Napi::Env env);
 
@@ -28,6 +33,8 @@ class RPIBackend : public Napi::ObjectWrap<RPIBackend> {
   int viewHeight;
   int datasourcePitch;
   unsigned char* dataSource;
+  FrameScheduler scheduler;
+  FrameStats stats;
   napi_ref rendererRef;
   Napi::FunctionReference renderFunc;
   Napi::FunctionReference execNextFrame;
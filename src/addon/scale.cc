@@ -0,0 +1,213 @@
+#include "scale.h"
+
+#include <string.h>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define SCALE_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SCALE_NEON
+#endif
+
+#define RGB_PIXEL_SIZE 4
+#define PIXELS_PER_VECTOR 4
+
+// Fixed point of the sharp bilinear scaler, positions are 16.16 and weights
+// are out of 256
+#define POS_ONE 65536
+#define POS_HALF 32768
+#define WEIGHT_ONE 256
+
+
+// Widen a row so each pixel repeats zoom times. Returns how many pixels of
+// the source were done with vectors
+#if defined(SCALE_SSE2)
+
+static int widen_row_vector(const uint8_t* source, uint8_t* out, int width,
+                            int zoom) {
+  if (zoom != 2 && zoom != 4) {
+    return 0;
+  }
+  int x = 0;
+  for (; x + PIXELS_PER_VECTOR <= width; x += PIXELS_PER_VECTOR) {
+    __m128i p = _mm_loadu_si128((const __m128i*)(source + x * RGB_PIXEL_SIZE));
+    __m128i lo = _mm_unpacklo_epi32(p, p);
+    __m128i hi = _mm_unpackhi_epi32(p, p);
+    uint8_t* dest = out + x * zoom * RGB_PIXEL_SIZE;
+    if (zoom == 2) {
+      _mm_storeu_si128((__m128i*)dest, lo);
+      _mm_storeu_si128((__m128i*)(dest + 16), hi);
+    } else {
+      _mm_storeu_si128((__m128i*)dest, _mm_unpacklo_epi64(lo, lo));
+      _mm_storeu_si128((__m128i*)(dest + 16), _mm_unpackhi_epi64(lo, lo));
+      _mm_storeu_si128((__m128i*)(dest + 32), _mm_unpacklo_epi64(hi, hi));
+      _mm_storeu_si128((__m128i*)(dest + 48), _mm_unpackhi_epi64(hi, hi));
+    }
+  }
+  return x;
+}
+
+#elif defined(SCALE_NEON)
+
+static int widen_row_vector(const uint8_t* source, uint8_t* out, int width,
+                            int zoom) {
+  if (zoom != 2 && zoom != 4) {
+    return 0;
+  }
+  int x = 0;
+  for (; x + PIXELS_PER_VECTOR <= width; x += PIXELS_PER_VECTOR) {
+    uint32x4_t p = vld1q_u32((const uint32_t*)(source + x * RGB_PIXEL_SIZE));
+    uint32x4x2_t twice = vzipq_u32(p, p);
+    uint32_t* dest = (uint32_t*)(out + x * zoom * RGB_PIXEL_SIZE);
+    if (zoom == 2) {
+      vst1q_u32(dest, twice.val[0]);
+      vst1q_u32(dest + 4, twice.val[1]);
+    } else {
+      uint32x4x2_t lo = vzipq_u32(twice.val[0], twice.val[0]);
+      uint32x4x2_t hi = vzipq_u32(twice.val[1], twice.val[1]);
+      vst1q_u32(dest, lo.val[0]);
+      vst1q_u32(dest + 4, lo.val[1]);
+      vst1q_u32(dest + 8, hi.val[0]);
+      vst1q_u32(dest + 12, hi.val[1]);
+    }
+  }
+  return x;
+}
+
+#else
+
+static int widen_row_vector(const uint8_t* source, uint8_t* out, int width,
+                            int zoom) {
+  return 0;
+}
+
+#endif
+
+static void widen_row(const uint8_t* source, uint8_t* out, int width,
+                      int zoom) {
+  int x = widen_row_vector(source, out, width, zoom);
+  for (; x < width; x++) {
+    uint32_t pixel;
+    memcpy(&pixel, source + x * RGB_PIXEL_SIZE, RGB_PIXEL_SIZE);
+    uint8_t* dest = out + x * zoom * RGB_PIXEL_SIZE;
+    for (int j = 0; j < zoom; j++) {
+      memcpy(dest + j * RGB_PIXEL_SIZE, &pixel, RGB_PIXEL_SIZE);
+    }
+  }
+}
+
+void scale_nearest(const uint8_t* source, int sourcePitch,
+                   int width, int height,
+                   uint8_t* target, int targetPitch, int zoom) {
+  if (zoom < 1) {
+    return;
+  }
+  size_t rowBytes = (size_t)width * zoom * RGB_PIXEL_SIZE;
+  for (int y = 0; y < height; y++) {
+    uint8_t* first = target + (size_t)y * zoom * targetPitch;
+    widen_row(source + (size_t)y * sourcePitch, first, width, zoom);
+    for (int i = 1; i < zoom; i++) {
+      memcpy(first + (size_t)i * targetPitch, first, rowBytes);
+    }
+  }
+}
+
+void scale_scanlines(const uint8_t* source, int sourcePitch,
+                     int width, int height,
+                     uint8_t* target, int targetPitch, int zoom,
+                     bool shadowMask) {
+  scale_nearest(source, sourcePitch, width, height, target, targetPitch, zoom);
+  int targetWidth = width * zoom;
+  for (int y = 0; y < height * zoom; y++) {
+    bool isScanline = zoom >= 2 && y % zoom == zoom - 1;
+    if (!isScanline && !shadowMask) {
+      continue;
+    }
+    uint8_t* row = target + (size_t)y * targetPitch;
+    for (int x = 0; x < targetWidth; x++) {
+      uint8_t* pixel = row + x * RGB_PIXEL_SIZE;
+      for (int k = 0; k < 3; k++) {
+        int c = pixel[k];
+        if (shadowMask && k != x % 3) {
+          c -= c >> 2;
+        }
+        if (isScanline) {
+          c >>= 1;
+        }
+        pixel[k] = c;
+      }
+    }
+  }
+}
+
+// For each target column or row, the two source pixels it is between, and
+// the weight of the second one
+struct SharpAxis {
+  std::vector<int> first;
+  std::vector<int> second;
+  std::vector<int> weight;
+};
+
+static void build_sharp_axis(SharpAxis* axis, int sourceSize,
+                             int targetSize) {
+  int sharpness = targetSize / sourceSize;
+  if (sharpness < 1) {
+    sharpness = 1;
+  }
+  axis->first.resize(targetSize);
+  axis->second.resize(targetSize);
+  axis->weight.resize(targetSize);
+  for (int t = 0; t < targetSize; t++) {
+    // Center of the target pixel, in source pixels, less half a pixel
+    int64_t pos = (int64_t)(2 * t + 1) * sourceSize * POS_ONE /
+                  (2 * (int64_t)targetSize) - POS_HALF;
+    int64_t base = pos >= 0 ? pos / POS_ONE : -((-pos + POS_ONE - 1) / POS_ONE);
+    int64_t frac = pos - base * POS_ONE;
+    // Blend across a span that is 1/sharpness of a source pixel
+    frac = (frac - POS_HALF) * sharpness + POS_HALF;
+    if (frac < 0) {
+      frac = 0;
+    } else if (frac > POS_ONE) {
+      frac = POS_ONE;
+    }
+    int a = (int)base;
+    int b = a + 1;
+    a = a < 0 ? 0 : (a >= sourceSize ? sourceSize - 1 : a);
+    b = b < 0 ? 0 : (b >= sourceSize ? sourceSize - 1 : b);
+    axis->first[t] = a;
+    axis->second[t] = b;
+    axis->weight[t] = (int)((frac + WEIGHT_ONE / 2) >> 8);
+  }
+}
+
+void scale_sharp_bilinear(const uint8_t* source, int sourcePitch,
+                          int sourceWidth, int sourceHeight,
+                          uint8_t* target, int targetPitch,
+                          int targetWidth, int targetHeight) {
+  if (sourceWidth <= 0 || sourceHeight <= 0) {
+    return;
+  }
+  SharpAxis cols;
+  SharpAxis rows;
+  build_sharp_axis(&cols, sourceWidth, targetWidth);
+  build_sharp_axis(&rows, sourceHeight, targetHeight);
+  for (int y = 0; y < targetHeight; y++) {
+    const uint8_t* upper = source + (size_t)rows.first[y] * sourcePitch;
+    const uint8_t* lower = source + (size_t)rows.second[y] * sourcePitch;
+    int wy = rows.weight[y];
+    uint8_t* out = target + (size_t)y * targetPitch;
+    for (int x = 0; x < targetWidth; x++) {
+      int a = cols.first[x] * RGB_PIXEL_SIZE;
+      int b = cols.second[x] * RGB_PIXEL_SIZE;
+      int wx = cols.weight[x];
+      for (int k = 0; k < RGB_PIXEL_SIZE; k++) {
+        int top = upper[a + k] * (WEIGHT_ONE - wx) + upper[b + k] * wx;
+        int bottom = lower[a + k] * (WEIGHT_ONE - wx) + lower[b + k] * wx;
+        out[x * RGB_PIXEL_SIZE + k] =
+            (top * (WEIGHT_ONE - wy) + bottom * wy + POS_HALF) >> 16;
+      }
+    }
+  }
+}
@@ -0,0 +1,33 @@
+#ifndef SCALE_H
+#define SCALE_H
+
+#include <stdint.h>
+
+// Scalers that enlarge an RGBA surface into a preallocated target, for
+// displays that zoom in software. The target is zoom times the size of the
+// source for the integer scalers, and any size for sharp bilinear.
+
+// Each source pixel becomes a zoom by zoom block of the same color. Rows are
+// widened once, using SSE2 or NEON for 2x and 4x, then copied for the rest
+// of the block.
+void scale_nearest(const uint8_t* source, int sourcePitch,
+                   int width, int height,
+                   uint8_t* target, int targetPitch, int zoom);
+
+// Nearest scaling like a CRT. The last row of each block is a scanline at
+// half brightness. With shadowMask, each target column also keeps one of
+// red, green, or blue in turn, and the other two lose a quarter.
+void scale_scanlines(const uint8_t* source, int sourcePitch,
+                     int width, int height,
+                     uint8_t* target, int targetPitch, int zoom,
+                     bool shadowMask);
+
+// Bilinear filtering that only blends at the edges between source pixels,
+// so pixels stay sharp at sizes that are not a whole multiple. Positions
+// and weights are fixed point, matching the js kernel exactly.
+void scale_sharp_bilinear(const uint8_t* source, int sourcePitch,
+                          int sourceWidth, int sourceHeight,
+                          uint8_t* target, int targetPitch,
+                          int targetWidth, int targetHeight);
+
+#endif
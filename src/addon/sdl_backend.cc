@@ -1,12 +1,18 @@
 #ifdef SDL_ENABLED
 
 #include "sdl_backend.h"
+#include "rasterize.h"
 #include "type.h"
 #include "present_frame.h"
 #include "wait_frame.h"
 #include <SDL.h>
+#include <algorithm>
 #include "common.h"
 
+#if NAPI_VERSION < 7
+#error "zero-copy rendering needs napi_detach_arraybuffer, from NAPI_VERSION 7"
+#endif
+
 using namespace Napi;
 
 Napi::FunctionReference g_sdlDisplayConstructor;
@@ -26,8 +32,12 @@ void SDLBackend::InitClass(Napi::Env env, Napi::Object exports) {
        InstanceMethod("config", &SDLBackend::Config),
        InstanceMethod("eventReceiver", &SDLBackend::EventReceiver),
        InstanceMethod("runAppLoop", &SDLBackend::RunAppLoop),
+       InstanceMethod("registerSurfaces", &SDLBackend::RegisterSurfaces),
        InstanceMethod("insteadWriteBuffer", &SDLBackend::InsteadWriteBuffer),
+       InstanceMethod("streamTo", &SDLBackend::StreamTo),
        InstanceMethod("getFeatureList", &SDLBackend::GetFeatureList),
+       InstanceMethod("getStats", &SDLBackend::GetStats),
+       InstanceMethod("getTrace", &SDLBackend::GetTrace),
        InstanceMethod("testOnlyHook", &SDLBackend::TestOnlyHook),
   });
   g_sdlDisplayConstructor = Napi::Persistent(func);
@@ -39,18 +49,24 @@ SDLBackend::SDLBackend(const Napi::CallbackInfo& info)
   this->sdlInitialized = 0;
   this->zoomLevel = 1;
   this->hasWriteBuffer = 0;
+  this->streamSink = NULL;
   this->softwareTarget = NULL;
   this->windowHandle = NULL;
   this->rendererHandle = NULL;
-  this->mainLayer0 = NULL;
-  this->mainLayer1 = NULL;
-  this->mainLayer2 = NULL;
-  this->mainLayer3 = NULL;
   this->gridLayer = NULL;
   this->gridWidth = 0;
   this->gridHeight = 0;
   this->gridRawBuff = NULL;
-  this->dataSources = NULL;
+  for (int k = 0; k < MAX_SURFACE_SETS; k++) {
+    SurfaceSet* surfaceSet = &this->sets[k];
+    surfaceSet->state = SET_FREE;
+  }
+  this->needFullUpload = true;
+  this->pipelineDepth = 1;
+  this->numPending = 0;
+  this->zeroCopy = false;
+  this->indexedOutput = false;
+  this->hardwareScroll = false;
   // TODO: properties instead of setters
   this->instrumentation = false;
   this->veryVerboseTiming = false;
@@ -58,7 +74,6 @@ SDLBackend::SDLBackend(const Napi::CallbackInfo& info)
   this->tookTimeUs = 0;
   this->maxDelta = -9999999;
   this->minDelta = 9999999;
-  // TODO: allow caller to access performance
 };
 
 Napi::Object SDLBackend::NewInstance(Napi::Env env, Napi::Value arg) {
@@ -100,6 +115,14 @@ Napi::Value SDLBackend::BeginRender(const Napi::CallbackInfo& info) {
   Napi::Object rendererObj = info[2].As<Napi::Object>();
   napi_create_reference(env, rendererObj, 1, &this->rendererRef);
 
+  // Look up the render method once, instead of every frame
+  Napi::Value renderFuncVal = rendererObj.Get("render");
+  if (!renderFuncVal.IsFunction()) {
+    printf("renderer.render() not found\n");
+    exit(1);
+  }
+  this->renderFunc = Napi::Persistent(renderFuncVal.As<Napi::Function>());
+
   return Napi::Number::New(env, 0);
 }
 
@@ -139,7 +162,43 @@ Napi::Value SDLBackend::Config(const Napi::CallbackInfo& info) {
     // config('grid', state)
     this->veryVerboseTiming = info[1].ToNumber().Int32Value();
 
+  } else if (fieldStr.Utf8Value() == std::string("pipeline")) {
+    // config('pipeline', depth)
+    int depth = info[1].ToNumber().Int32Value();
+    if (depth < 1) {
+      depth = 1;
+    } else if (depth > MAX_SURFACE_SETS) {
+      depth = MAX_SURFACE_SETS;
+    }
+    this->pipelineDepth = depth;
+
+  } else if (fieldStr.Utf8Value() == std::string("zerocopy")) {
+    // config('zerocopy', state)
+    this->zeroCopy = info[1].ToBoolean();
+
+  } else if (fieldStr.Utf8Value() == std::string("indexed")) {
+    // config('indexed', state)
+    this->indexedOutput = info[1].ToBoolean();
+
+  } else if (fieldStr.Utf8Value() == std::string("hwscroll")) {
+    // config('hwscroll', state)
+    this->hardwareScroll = info[1].ToBoolean();
+
+  } else if (fieldStr.Utf8Value() == std::string("rate")) {
+    // config('rate', hz)
+    this->scheduler.setRate(info[1].ToNumber().Int32Value());
+
+  } else if (fieldStr.Utf8Value() == std::string("pacing")) {
+    // config('pacing', 'catchup' or 'skip')
+    std::string policy = info[1].ToString().Utf8Value();
+    if (policy == std::string("skip")) {
+      this->scheduler.setPolicy(PACING_SKIP);
+    } else {
+      this->scheduler.setPolicy(PACING_CATCH_UP);
+    }
+
   }
+  return env.Null();
 }
 
 Napi::Value SDLBackend::EventReceiver(const Napi::CallbackInfo& info) {
@@ -166,18 +225,140 @@ Napi::Value SDLBackend::InsteadWriteBuffer(const Napi::CallbackInfo& info) {
   return Napi::Number::New(env, 0);
 }
 
-Napi::Value SDLBackend::GetFeatureList(const Napi::CallbackInfo& info) {
+Napi::Value SDLBackend::StreamTo(const Napi::CallbackInfo& info) {
   Napi::Env env = info.Env();
-  Napi::Array features;
+  if (info.Length() < 1 || !info[0].IsObject()) {
+    Napi::TypeError::New(env, "streamTo needs a VideoSink")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  Napi::Object obj = info[0].As<Napi::Object>();
+  this->streamSink = VideoSink::Unwrap(obj);
+  this->streamRef = Napi::Persistent(obj);
   return env.Null();
 }
 
+Napi::Value SDLBackend::GetFeatureList(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  Napi::Array features = Napi::Array::New(env);
+  features[uint32_t(0)] = "indexedOutput";
+  features[uint32_t(1)] = "hardwareScroll";
+  return features;
+}
+
+// Timing of recent frames, split into phases, see frame_stats.h
+Napi::Value SDLBackend::GetStats(const Napi::CallbackInfo& info) {
+  return frameStatsToValue(info.Env(), &this->stats);
+}
+
+// Recent frames as Chrome trace-event JSON
+Napi::Value SDLBackend::GetTrace(const Napi::CallbackInfo& info) {
+  return Napi::String::New(info.Env(), this->stats.traceJSON());
+}
+
 Napi::Value SDLBackend::TestOnlyHook(const Napi::CallbackInfo& info) {
   Napi::Env env = info.Env();
   Napi::Object param = info[0].As<Napi::Object>();
   Napi::Number x = param.Get("x").As<Napi::Number>();
   Napi::Number y = param.Get("y").As<Napi::Number>();
-  this->sendMouseEvent(env, "click", x.Int32Value(), y.Int32Value());
+  this->eventBatch.add(EVENT_MOUSE_DOWN, SDL_BUTTON_LEFT, x.Int32Value(),
+                       y.Int32Value(), SDL_GetTicks());
+  this->sendEventBatch(env);
+  return env.Null();
+}
+
+// (surfaceList), called by the renderer whenever it allocates surfaces.
+// Holds a reference to each buffer so their memory stays valid. The list's
+// setIndex says which surface set it replaces.
+Napi::Value SDLBackend::RegisterSurfaces(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  if (info.Length() < 1 || !info[0].IsArray()) {
+    printf("RegisterSurfaces needs a list of surfaces\n");
+    return env.Null();
+  }
+  Napi::Array surfaceList = info[0].As<Napi::Array>();
+
+  int setIndex = 0;
+  Napi::Value setIndexVal = surfaceList.Get("setIndex");
+  if (setIndexVal.IsNumber()) {
+    setIndex = setIndexVal.As<Napi::Number>().Int32Value();
+  }
+  if (setIndex < 0 || setIndex >= MAX_SURFACE_SETS) {
+    printf("RegisterSurfaces got invalid set index %d\n", setIndex);
+    return env.Null();
+  }
+  SurfaceSet* surfaceSet = &this->sets[setIndex];
+  // Registered during a zero-copy render, so the locked textures were for
+  // the previous surfaces. The renderer has copied the frame into these
+  // surfaces, which are uploaded in full instead
+  this->unlockLayerTextures();
+
+  // Each layer has its own size and pitch, and a texture to match
+  int numLayers = surfaceList.Length();
+  for (size_t n = numLayers; n < this->layerTextures.size(); n++) {
+    if (this->layerTextures[n].texture) {
+      SDL_DestroyTexture(this->layerTextures[n].texture);
+    }
+  }
+  if (this->layerTextures.size() > (size_t)numLayers) {
+    this->layerTextures.resize(numLayers);
+  }
+  surfaceSet->layers.clear();
+  surfaceSet->layers.resize(numLayers);
+  for (int n = 0; n < numLayers; n++) {
+    LayerSurface* layer = &surfaceSet->layers[n];
+    layer->buff = NULL;
+    layer->dirty = NULL;
+    layer->palette = NULL;
+    layer->pan = NULL;
+    layer->visible = true;
+    layer->blend = SDL_BLENDMODE_BLEND;
+    Napi::Object surfaceObj = surfaceList.Get(n).As<Napi::Object>();
+    Napi::Value buffVal = surfaceObj.Get("buff");
+    layer->buff = typedArrayToRawBuffer(buffVal);
+    if (layer->buff == NULL) {
+      printf("surface.buff expected a TypedArray, did not get one!\n");
+      continue;
+    }
+    layer->buffRef = Napi::Persistent(buffVal);
+    layer->width = surfaceObj.Get("width").As<Napi::Number>().Int32Value();
+    layer->height = surfaceObj.Get("height").As<Napi::Number>().Int32Value();
+    layer->pitch = surfaceObj.Get("pitch").As<Napi::Number>().Int32Value();
+    Napi::Value dirtyVal = surfaceObj.Get("dirtyPacked");
+    if (dirtyVal.IsTypedArray()) {
+      layer->dirty = (int32_t*)typedArrayToRawBuffer(dirtyVal);
+      layer->dirtyRef = Napi::Persistent(dirtyVal);
+    }
+    Napi::Value formatVal = surfaceObj.Get("format");
+    Napi::Value paletteVal = surfaceObj.Get("palette");
+    if (formatVal.IsString() &&
+        formatVal.As<Napi::String>().Utf8Value() == std::string("index8") &&
+        paletteVal.IsTypedArray()) {
+      layer->palette = (uint32_t*)typedArrayToRawBuffer(paletteVal);
+      layer->paletteRef = Napi::Persistent(paletteVal);
+    }
+    Napi::Value panVal = surfaceObj.Get("pan");
+    if (panVal.IsTypedArray()) {
+      layer->pan = (int32_t*)typedArrayToRawBuffer(panVal);
+      layer->panRef = Napi::Persistent(panVal);
+    }
+  }
+
+  this->gridRawBuff = NULL;
+  this->gridRef.Reset();
+  Napi::Value surfaceVal = surfaceList.Get("grid");
+  if (surfaceVal.IsObject()) {
+    Napi::Object surfaceObj = surfaceVal.As<Napi::Object>();
+    Napi::Value buffVal = surfaceObj.Get("buff");
+    this->gridWidth = surfaceObj.Get("width").As<Napi::Number>().Int32Value();
+    this->gridHeight = surfaceObj.Get("height").As<Napi::Number>().Int32Value();
+    this->gridPitch = surfaceObj.Get("pitch").As<Napi::Number>().Int32Value();
+    this->gridRawBuff = typedArrayToRawBuffer(buffVal);
+    this->gridRef = Napi::Persistent(buffVal);
+  }
+
+  // Buffers are new, so textures need everything uploaded
+  this->needFullUpload = true;
   return env.Null();
 }
 
@@ -192,52 +373,18 @@ Napi::Value SDLBackend::RunAppLoop(const Napi::CallbackInfo& info) {
   // track the first few frames
   this->startupFrameCount = 0;
 
-  // Get the stored plane object, retrieve its basic data.
-  napi_value rendererVal;
-  napi_get_reference_value(env, this->rendererRef, &rendererVal);
-  Napi::Object rendererObj = Napi::Object(env, rendererVal);
-  Napi::Value renderFuncVal = rendererObj.Get("render");
-  if (!renderFuncVal.IsFunction()) {
-    printf("renderer.render() not found\n");
-    exit(1);
+  // Reading back pixels needs each frame drawn before the next one starts
+  if (this->hasWriteBuffer) {
+    this->pipelineDepth = 1;
   }
 
-  // Call `renderer.render()`
-  Napi::Function renderFunc = renderFuncVal.As<Napi::Function>();
-  Napi::Value resVal = renderFunc.Call(rendererObj, 0, NULL);
-  if (env.IsExceptionPending()) {
+  // Call `renderer.render()`, the renderer registers its surfaces
+  if (!this->callRender(env, 0)) {
     return info.Env().Null();
   }
-
-  int numDataSources = 0;
-  this->dataSources = (unsigned char**)malloc(sizeof(unsigned char*)*4);
-  this->dataSources[0] = NULL;
-  this->dataSources[1] = NULL;
-  this->dataSources[2] = NULL;
-  this->dataSources[3] = NULL;
-  // TODO: Ensure layers are same size.
-  // TODO: Ensure layers use same pitch.
-
-  Napi::Object resObj = Napi::Object(env, resVal);
-  numDataSources = resObj.Get("length").ToNumber().Int32Value();
-
-  // For now, only handle up to 4 sources
-  if (numDataSources > 4) {
-    numDataSources = 4;
-  }
-
-  // Collect all data sources
-  for (int n = 0; n < numDataSources; n++) {
-    Napi::Value surfaceVal = resObj.As<Napi::Array>()[uint32_t(n)];
-    dataSources[n] = surfaceToRawBuffer(surfaceVal);
-  }
-  Napi::Value surfaceVal = resObj.Get("grid");
-  if (!surfaceVal.IsNull()) {
-    Napi::Object surfaceObj = surfaceVal.As<Napi::Object>();
-    this->gridWidth = surfaceObj.Get("width").As<Napi::Number>().Int32Value();
-    this->gridHeight = surfaceObj.Get("height").As<Napi::Number>().Int32Value();
-    this->gridPitch = surfaceObj.Get("pitch").As<Napi::Number>().Int32Value();
-    this->gridRawBuff = surfaceToRawBuffer(surfaceVal);
+  if (this->sets[0].layers.empty()) {
+    printf("renderer has not registered any surfaces\n");
+    return Napi::Number::New(env, -1);
   }
 
   // Calculate texture and window size.
@@ -289,41 +436,30 @@ Napi::Value SDLBackend::RunAppLoop(const Napi::CallbackInfo& info) {
     return Napi::Number::New(env, -1);
   }
 
-  // Create the texture for layer 0 (bottom-most)
-  this->mainLayer0 = SDL_CreateTexture(
-      this->rendererHandle,
-      SDL_PIXELFORMAT_ABGR8888,
-      SDL_TEXTUREACCESS_STREAMING,
-      viewWidth,
-      viewHeight);
-  SDL_SetTextureBlendMode(this->mainLayer0, SDL_BLENDMODE_BLEND);
-
-  // Create the texture for layer 1 (near-bottom)
-  this->mainLayer1 = SDL_CreateTexture(
-      this->rendererHandle,
-      SDL_PIXELFORMAT_ABGR8888,
-      SDL_TEXTUREACCESS_STREAMING,
-      viewWidth,
-      viewHeight);
-  SDL_SetTextureBlendMode(this->mainLayer1, SDL_BLENDMODE_BLEND);
-
-  // Create the texture for layer 2 (near-top)
-  this->mainLayer2 = SDL_CreateTexture(
-      this->rendererHandle,
-      SDL_PIXELFORMAT_ABGR8888,
-      SDL_TEXTUREACCESS_STREAMING,
-      viewWidth,
-      viewHeight);
-  SDL_SetTextureBlendMode(this->mainLayer2, SDL_BLENDMODE_BLEND);
-
-  // Create the texture for layer 3 (top-most)
-  this->mainLayer3 = SDL_CreateTexture(
-      this->rendererHandle,
-      SDL_PIXELFORMAT_ABGR8888,
-      SDL_TEXTUREACCESS_STREAMING,
-      viewWidth,
-      viewHeight);
-  SDL_SetTextureBlendMode(this->mainLayer3, SDL_BLENDMODE_BLEND);
+  // Layer textures are created as the layers are drawn, each at the size
+  // of its surface. New textures are empty, so they need everything
+  // uploaded once
+  this->needFullUpload = true;
+
+  // Presenting waits for vsync, which paces frames well enough unless the
+  // target rate is below the display's refresh rate
+  int refreshRate = 0;
+  SDL_DisplayMode mode;
+  if (this->windowHandle &&
+      SDL_GetWindowDisplayMode(this->windowHandle, &mode) == 0) {
+    refreshRate = mode.refresh_rate;
+  }
+  this->waitAfterPresent = refreshRate <= 0 ||
+                           this->scheduler.rate() < refreshRate;
+  this->scheduler.start();
+  this->stats.setPeriodUs(1000000 / this->scheduler.rate());
+
+  // When pipelined, that first render is also the first frame drawn
+  if (this->pipelineDepth > 1) {
+    this->sets[0].state = SET_PENDING;
+    this->pendingSets[0] = 0;
+    this->numPending = 1;
+  }
 
   this->execOneFrame(info);
   return info.Env().Null();
@@ -356,7 +492,7 @@ void SDLBackend::frameInstrumentation() {
   }
 
   // very verbose timing
-  int deltaUs = frameLengthUs - 16667;
+  int deltaUs = frameLengthUs - 1000000 / this->scheduler.rate();
   if (deltaUs > this->maxDelta) {
     this->maxDelta = deltaUs;
   }
@@ -380,123 +516,386 @@ void SDLBackend::execOneFrame(const CallbackInfo& info) {
   if (this->instrumentation) {
     this->frameInstrumentation();
   }
+  this->stats.beginFrame();
+
+  if (!this->pollEvents(env)) {
+    // exit render loop!
+    this->endStream();
+    return;
+  }
+
+  if (this->pipelineDepth > 1) {
+    this->execPipelinedFrame(env);
+    return;
+  }
+
+  int needRender = this->runFrameLogic(env);
+  if (needRender < 0) {
+    this->endStream();
+    return;
+  }
+
+  // if no need to render, exit early
+  if (!needRender) {
+    this->nextWithoutPresent(env);
+    return;
+  }
+
+  // Call the render function. If it allocates new surfaces, it registers
+  // them before returning, so the layers always point at live buffers
+  if (!this->callRender(env, 0)) {
+    this->endStream();
+    return;
+  }
+
+  // present the raw data from the plane's buffer to the texture
+  if (!this->sets[0].layers[0].buff) {
+    printf("no data buffer!\n");
+    this->endStream();
+    return;
+  }
+  this->drawSurfaceSet(&this->sets[0]);
+
+  if (this->hasWriteBuffer) {
+    // TODO: 2 is only true if high dpi is enabled
+    int width = this->displayWidth * this->zoomLevel * 2;
+    int height = this->displayHeight * this->zoomLevel * 2;
+    SDL_Rect rect;
+    rect.x = rect.y = 0;
+    rect.w = width;
+    rect.h = height;
+    int savePitch = width * 4;
+    size_t saveSize = (size_t)width * height * 4;
+    Napi::Value bufferVal = this->writeBuffer.Value();
+    Napi::TypedArray typeArr = bufferVal.As<Napi::TypedArray>();
+    unsigned char* rawBuff = typedArrayToRawBuffer(bufferVal);
+    size_t rawSize = typeArr.ByteLength();
+    if (rawSize >= saveSize) {
+      // Read straight into the hook buffer
+      SDL_RenderReadPixels(this->rendererHandle, &rect,
+                           SDL_PIXELFORMAT_ABGR8888, rawBuff, savePitch);
+    } else {
+      this->readBuff.resize(saveSize);
+      SDL_RenderReadPixels(this->rendererHandle, &rect,
+                           SDL_PIXELFORMAT_ABGR8888, this->readBuff.data(),
+                           savePitch);
+      memcpy(rawBuff, this->readBuff.data(), rawSize);
+    }
+    this->endStream();
+    return;
+  }
+
+  this->next(env);
+}
+
+
+// Runs when the previous present has finished, so the renderer handle is
+// free to use again. Draws the oldest pending frame and presents it on a
+// worker thread, then renders the next frame while that present waits.
+void SDLBackend::execPipelinedFrame(Napi::Env env) {
+  if (this->numPending == 0) {
+    // Nothing is ready to show, so this frame cannot overlap a present
+    int rendered = this->renderAhead(env);
+    if (rendered < 0) {
+      this->endStream();
+      return;
+    }
+    if (!rendered) {
+      this->nextWithoutPresent(env);
+      return;
+    }
+  }
 
-  // Get OS events, such as exiting app, and keyboard input
+  // Hand the oldest set back to the renderer once the textures hold a copy
+  int setIndex = this->pendingSets[0];
+  for (int k = 1; k < this->numPending; k++) {
+    this->pendingSets[k - 1] = this->pendingSets[k];
+  }
+  this->numPending--;
+  SurfaceSet* surfaceSet = &this->sets[setIndex];
+  this->drawSurfaceSet(surfaceSet);
+  surfaceSet->state = SET_FREE;
+  this->next(env);
+
+  // The renderer handle belongs to the present until its callback, only
+  // js work and rasterization happen here
+  if (this->numPending < this->pipelineDepth - 1) {
+    if (this->renderAhead(env) < 0) {
+      // The present already queued the next frame, which has to exit
+      // instead of running the app again
+      this->isRunning = false;
+      this->endStream();
+    }
+  }
+}
+
+
+// Run the frame logic, and if it needs a render, rasterize into a free set
+// and queue that set to be drawn. Returns 1 if a frame was rendered, 0 if
+// not, or -1 if js threw.
+int SDLBackend::renderAhead(Napi::Env env) {
+  int setIndex = -1;
+  for (int k = 0; k < this->pipelineDepth; k++) {
+    if (this->sets[k].state == SET_FREE) {
+      setIndex = k;
+      break;
+    }
+  }
+  if (setIndex < 0) {
+    return 0;
+  }
+
+  int needRender = this->runFrameLogic(env);
+  if (needRender <= 0) {
+    return needRender;
+  }
+  if (!this->callRender(env, setIndex)) {
+    return -1;
+  }
+  if (!this->sets[setIndex].layers[0].buff) {
+    printf("no data buffer!\n");
+    return -1;
+  }
+  this->sets[setIndex].state = SET_PENDING;
+  this->pendingSets[this->numPending++] = setIndex;
+  return 1;
+}
+
+
+// Get OS events, such as exiting app, and keyboard input. Returns whether
+// the app is still running.
+bool SDLBackend::pollEvents(Napi::Env env) {
   SDL_Event event;
-  if (SDL_PollEvent(&event)) {
+  // Drain the whole queue, so input never waits more than a frame. Stop at
+  // a quit, but still send what came before it
+  this->eventBatch.clear();
+  while (this->isRunning && SDL_PollEvent(&event)) {
     switch (event.type) {
     case SDL_QUIT:
       this->isRunning = false;
       break;
 
-    case SDL_MOUSEBUTTONDOWN: {
-      int x = event.button.x / this->zoomLevel;
-      int y = event.button.y / this->zoomLevel;
-      this->sendMouseEvent(env, "click", x, y);
+    case SDL_MOUSEBUTTONDOWN:
+    case SDL_MOUSEBUTTONUP:
+      this->eventBatch.add(event.type == SDL_MOUSEBUTTONDOWN ?
+                               EVENT_MOUSE_DOWN : EVENT_MOUSE_UP,
+                           event.button.button,
+                           event.button.x / this->zoomLevel,
+                           event.button.y / this->zoomLevel,
+                           event.button.timestamp);
+      break;
+
+    case SDL_MOUSEMOTION:
+      this->eventBatch.add(EVENT_MOUSE_MOVE, 0,
+                           event.motion.x / this->zoomLevel,
+                           event.motion.y / this->zoomLevel,
+                           event.motion.timestamp);
       break;
-    }
 
     case SDL_KEYDOWN:
-      if (event.key.keysym.sym == SDLK_ESCAPE) {
+    case SDL_KEYUP: {
+      int code = event.key.keysym.sym;
+      if (code == SDLK_ESCAPE && event.type == SDL_KEYDOWN) {
         this->isRunning = false;
-        return;
+        break;
       }
-      this->sendKeyEvent(env, "keydown", event.key.keysym.sym);
-      if (env.IsExceptionPending()) {
-        return;
+      // Keys without a character have bit 30 set, move it to bit 15
+      if (code & 0x40000000) {
+        code = (code & 0xff) | 0x8000;
+      } else {
+        code = code & 0xff;
       }
+      this->eventBatch.add(event.type == SDL_KEYDOWN ?
+                               EVENT_KEY_DOWN : EVENT_KEY_UP,
+                           code, 0, 0, event.key.timestamp);
       break;
+    }
 
-    case SDL_KEYUP:
-      this->sendKeyEvent(env, "keyup", event.key.keysym.sym);
-      if (env.IsExceptionPending()) {
-        return;
+    case SDL_WINDOWEVENT:
+      if (event.window.event == SDL_WINDOWEVENT_CLOSE) {
+        this->isRunning = false;
       }
       break;
-
-    case SDL_WINDOWEVENT_CLOSE:
-      this->isRunning = false;
-      return;
     }
   }
-
-  if (!this->isRunning) {
-    // exit render loop!
-    return;
+  this->sendEventBatch(env);
+  if (env.IsExceptionPending()) {
+    return false;
   }
+  return this->isRunning;
+}
+
 
+// Call the executor, which runs one frame of the app's logic, and tell it
+// how many frames the scheduler dropped. Returns 1 if the frame needs to
+// render, 0 if not, or -1 if js threw.
+int SDLBackend::runFrameLogic(Napi::Env env) {
   // create an empty object for js function calls
   napi_value self;
   napi_status status;
   status = napi_create_object(env, &self);
   if (status != napi_ok) {
     printf("napi_create_object(self) failed to create\n");
-    return;
+    return -1;
   }
 
-  // call the executor
   napi_value needRenderVal;
-  needRenderVal = this->execNextFrame.Call(self, 0, NULL);
+  int missed = this->scheduler.takeMissed();
+  needRenderVal = this->execNextFrame.Call(self,
+                                           {Napi::Number::New(env, missed)});
   if (env.IsExceptionPending()) {
-    return;
+    return -1;
   }
+  this->stats.mark(PHASE_EXEC);
 
   Napi::Value needRenderObj = Napi::Value(env, needRenderVal);
-  Napi::Boolean needRender = needRenderObj.ToBoolean();
-
-  // if no need to render, exit early
-  if (!needRender) {
-    this->nextWithoutPresent(env);
-    return;
-  }
+  return needRenderObj.ToBoolean() ? 1 : 0;
+}
 
-  SDL_RenderClear(this->rendererHandle);
 
-  // Call the render function.
-  napi_value resVal;
-  napi_get_reference_value(env, this->rendererRef, &resVal);
-  Napi::Object rendererObj = Napi::Object(env, resVal);
-  Napi::Value renderFuncVal = rendererObj.Get("render");
-  if (!renderFuncVal.IsFunction()) {
-    printf("renderer.render() not found\n");
-    exit(1);
+// Call `renderer.render(setIndex)`. Returns false if js threw.
+bool SDLBackend::callRender(Napi::Env env, int setIndex) {
+  napi_value rendererVal;
+  napi_get_reference_value(env, this->rendererRef, &rendererVal);
+  Napi::Value surfaceList;
+  if (this->pipelineDepth > 1) {
+    surfaceList = this->renderFunc.Call(rendererVal,
+                                        {Napi::Number::New(env, setIndex)});
+  } else if (this->zeroCopy && !this->indexedOutput &&
+             !this->hardwareScroll && this->rendererHandle) {
+    // renderer.render(null, targets), rasterizing into the textures. Not
+    // when pipelined, since locked textures belong to the renderer handle,
+    // which a pipelined frame does not own while it renders. Indexed
+    // surfaces are already expanded straight into locked textures, and
+    // surfaces of entire fields are larger than the display. Checked every
+    // frame, since either can be turned on while the app runs
+    Napi::Value targets = this->lockLayerTextures(env);
+    surfaceList = this->renderFunc.Call(rendererVal, {env.Null(), targets});
+    // The memory is only valid until the textures are unlocked, so take it
+    // away from js now, even if render threw
+    this->detachLockedBuffers();
+    if (env.IsExceptionPending()) {
+      this->unlockLayerTextures();
+    }
+  } else {
+    surfaceList = this->renderFunc.Call(rendererVal, 0, NULL);
   }
-  Napi::Function renderFunc = renderFuncVal.As<Napi::Function>();
-  resVal = renderFunc.Call(rendererObj, 0, NULL);
+  this->stats.mark(PHASE_RENDER);
   if (env.IsExceptionPending()) {
-    return;
+    return false;
   }
+  this->readLayerAppearance(surfaceList, setIndex);
+  return true;
+}
 
-  // Get the pitch of the first layer, assume it is constant.
-  // TODO: Fix this assumption
-  Napi::Object resObj = Napi::Object(env, resVal);
-  Napi::Value surfaceVal = resObj.As<Napi::Array>()[uint32_t(0)];
-  Napi::Object surfaceObj = surfaceVal.As<Napi::Object>();
-  Napi::Value realPitchNum = surfaceObj.Get("pitch");
 
-  int viewHeight = this->displayHeight;
-  int viewWidth = this->displayWidth;
-  int viewPitch = viewWidth * RGB_PIXEL_SIZE;
-  if (realPitchNum.IsNumber()) {
-    viewPitch = realPitchNum.As<Napi::Number>().Int32Value();
+// Visibility and blend mode can change on any frame, without the renderer
+// registering its surfaces again, so read them from what render() returned
+void SDLBackend::readLayerAppearance(Napi::Value surfaceList, int setIndex) {
+  if (!surfaceList.IsArray()) {
+    return;
+  }
+  Napi::Array list = surfaceList.As<Napi::Array>();
+  std::vector<LayerSurface>& layers = this->sets[setIndex].layers;
+  for (uint32_t n = 0; n < list.Length() && n < layers.size(); n++) {
+    Napi::Object surfaceObj = list.Get(n).As<Napi::Object>();
+    Napi::Value visibleVal = surfaceObj.Get("visible");
+    layers[n].visible = !visibleVal.IsBoolean() || visibleVal.ToBoolean();
+    std::string blend;
+    Napi::Value blendVal = surfaceObj.Get("blend");
+    if (blendVal.IsString()) {
+      blend = blendVal.As<Napi::String>().Utf8Value();
+    }
+    if (blend == std::string("add")) {
+      layers[n].blend = SDL_BLENDMODE_ADD;
+    } else if (blend == std::string("multiply")) {
+      layers[n].blend = SDL_BLENDMODE_MOD;
+    } else if (blend == std::string("none")) {
+      layers[n].blend = SDL_BLENDMODE_NONE;
+    } else {
+      layers[n].blend = SDL_BLENDMODE_BLEND;
+    }
   }
+}
 
-  // present the raw data from the plane's buffer to the texture
-  if (this->dataSources[0]) {
-    SDL_UpdateTexture(this->mainLayer0, NULL, this->dataSources[0], viewPitch);
-  } else {
-    printf("no data buffer!\n");
-    return;
+
+// Lock the texture of each registered layer, and wrap the pixels of each
+// in a {buff, pitch} target for the renderer. A locked texture's contents
+// are undefined, the renderer draws all of it.
+Napi::Value SDLBackend::lockLayerTextures(Napi::Env env) {
+  Napi::Array targets = Napi::Array::New(env);
+  this->unlockLayerTextures();
+  std::vector<LayerSurface>& layers = this->sets[0].layers;
+  for (size_t n = 0; n < layers.size(); n++) {
+    bool created = false;
+    SDL_Texture* texture = this->ensureLayerTexture(n, &layers[n], &created);
+    void* pixels = NULL;
+    int pitch = 0;
+    if (!texture || SDL_LockTexture(texture, NULL, &pixels, &pitch) != 0) {
+      printf("SDL_LockTexture failed: %s\n", SDL_GetError());
+      break;
+    }
+    this->lockedTextures.push_back(texture);
+    size_t size = (size_t)pitch * layers[n].height;
+    Napi::ArrayBuffer arrayBuff = Napi::ArrayBuffer::New(env, pixels, size);
+    this->lockedBuffers.push_back(Napi::Persistent(arrayBuff));
+    Napi::Object target = Napi::Object::New(env);
+    target["buff"] = Napi::Uint8Array::New(env, size, arrayBuff, 0);
+    target["pitch"] = Napi::Number::New(env, pitch);
+    targets.Set((uint32_t)n, target);
   }
-  if (this->dataSources[1]) {
-    SDL_UpdateTexture(this->mainLayer1, NULL, this->dataSources[1], viewPitch);
+  return targets;
+}
+
+
+void SDLBackend::unlockLayerTextures() {
+  this->detachLockedBuffers();
+  for (SDL_Texture* texture : this->lockedTextures) {
+    SDL_UnlockTexture(texture);
   }
-  if (this->dataSources[2]) {
-    SDL_UpdateTexture(this->mainLayer2, NULL, this->dataSources[2], viewPitch);
+  this->lockedTextures.clear();
+}
+
+
+// Detach the array buffers that js was given for the locked textures. Uses
+// napi_detach_arraybuffer directly, which works with an exception pending,
+// and needs NAPI_VERSION 7, see binding.gyp
+void SDLBackend::detachLockedBuffers() {
+  for (Napi::Reference<Napi::ArrayBuffer>& ref : this->lockedBuffers) {
+    if (!ref.IsEmpty()) {
+      napi_detach_arraybuffer(ref.Env(), ref.Value());
+    }
   }
-  if (this->dataSources[3]) {
-    SDL_UpdateTexture(this->mainLayer3, NULL, this->dataSources[3], viewPitch);
+  this->lockedBuffers.clear();
+}
+
+
+// Upload a set's surfaces to the textures, and copy them to the renderer.
+// Hidden layers are neither uploaded nor copied, the renderer sends all of
+// a layer again when it is shown.
+void SDLBackend::drawSurfaceSet(SurfaceSet* surfaceSet) {
+  SDL_RenderClear(this->rendererHandle);
+
+  std::vector<LayerSurface>& layers = surfaceSet->layers;
+  size_t numLocked = this->lockedTextures.size();
+  for (size_t n = 0; n < layers.size(); n++) {
+    LayerSurface* layer = &layers[n];
+    if (n < numLocked) {
+      // Already holds the frame, the renderer drew into it
+      continue;
+    }
+    if (!layer->buff || !layer->visible) {
+      continue;
+    }
+    bool created = false;
+    SDL_Texture* texture = this->ensureLayerTexture(n, layer, &created);
+    if (texture) {
+      this->updateLayerTexture(texture, layer, this->layerTextures[n].palette,
+                               this->needFullUpload || created);
+    }
   }
+  this->unlockLayerTextures();
+  this->needFullUpload = false;
 
   // create grid if renderer returns one
   if (this->gridRawBuff) {
@@ -513,84 +912,209 @@ void SDLBackend::execOneFrame(const CallbackInfo& info) {
     SDL_UpdateTexture(this->gridLayer, NULL, this->gridRawBuff, this->gridPitch);
   }
 
-  SDL_RenderCopy(this->rendererHandle, this->mainLayer0, NULL, NULL);
-  if (this->mainLayer1 && this->dataSources[1]) {
-    SDL_RenderCopy(this->rendererHandle, this->mainLayer1, NULL, NULL);
-  }
-  if (this->mainLayer2 && this->dataSources[2]) {
-    SDL_RenderCopy(this->rendererHandle, this->mainLayer2, NULL, NULL);
-  }
-  if (this->mainLayer3 && this->dataSources[3]) {
-    SDL_RenderCopy(this->rendererHandle, this->mainLayer3, NULL, NULL);
+  for (size_t n = 0; n < layers.size() && n < this->layerTextures.size();
+       n++) {
+    LayerSurface* layer = &layers[n];
+    LayerTexture* layerTexture = &this->layerTextures[n];
+    if (!layer->buff || !layer->visible || !layerTexture->texture) {
+      continue;
+    }
+    if (layerTexture->blend != layer->blend) {
+      SDL_SetTextureBlendMode(layerTexture->texture,
+                              (SDL_BlendMode)layer->blend);
+      layerTexture->blend = layer->blend;
+    }
+    if (layer->pan) {
+      this->copyPanned(layerTexture->texture, layer);
+    } else {
+      SDL_RenderCopy(this->rendererHandle, layerTexture->texture, NULL, NULL);
+    }
   }
   if (this->gridLayer) {
     SDL_RenderCopy(this->rendererHandle, this->gridLayer, NULL, NULL);
   }
+  if (this->streamSink) {
+    this->captureFrame();
+  }
+  this->stats.mark(PHASE_UPLOAD);
+}
 
-  if (this->hasWriteBuffer) {
-    // TODO: 2 is only true if high dpi is enabled
-    int width = this->displayWidth * this->zoomLevel * 2;
-    int height = this->displayHeight * this->zoomLevel * 2;
+
+// Read back the drawn frame into the stream's next buffer. Blocks if the
+// stream's writer has fallen behind, which slows the app to its pace
+void SDLBackend::captureFrame() {
+  int width = 0;
+  int height = 0;
+  SDL_GetRendererOutputSize(this->rendererHandle, &width, &height);
+  int bpp = this->streamSink->bytesPerPixel();
+  VideoStream* stream = this->streamSink->stream();
+  uint8_t* frame = stream->acquire((size_t)width * height * bpp);
+  if (frame == NULL) {
+    return;
+  }
+  Uint32 format = SDL_PIXELFORMAT_ABGR8888;
+  if (this->streamSink->format() == VIDEO_FORMAT_RGB24) {
+    format = SDL_PIXELFORMAT_RGB24;
+  }
+  SDL_RenderReadPixels(this->rendererHandle, NULL, format, frame,
+                       width * bpp);
+  stream->submit(frame);
+}
+
+
+// Write the frames still queued for the stream, when the app loop ends
+void SDLBackend::endStream() {
+  if (!this->streamSink) {
+    return;
+  }
+  std::string error = this->streamSink->stream()->finish();
+  if (!error.empty()) {
+    printf("video stream failed: %s\n", error.c_str());
+  }
+  this->streamSink = NULL;
+  this->streamRef.Reset();
+}
+
+
+// Upload only the rects of the surface that the renderer says have changed.
+// The packed list starts with the number of rects, -1 means everything.
+// An indexed surface with a new palette changes everywhere in the texture.
+void SDLBackend::updateLayerTexture(SDL_Texture* texture, LayerSurface* layer,
+                                    uint32_t* texturePalette, bool full) {
+  const int32_t* dirty = layer->dirty;
+  full = full || dirty == NULL || dirty[0] < 0;
+  if (layer->palette &&
+      memcmp(texturePalette, layer->palette, 256 * sizeof(uint32_t)) != 0) {
+    memcpy(texturePalette, layer->palette, 256 * sizeof(uint32_t));
+    full = true;
+  }
+  if (full) {
+    this->uploadRect(texture, layer, NULL);
+    return;
+  }
+
+  int numRects = dirty[0];
+  for (int i = 0; i < numRects; i++) {
     SDL_Rect rect;
-    rect.x = rect.y = 0;
-    rect.w = width;
-    rect.h = height;
-    int savePitch = width * 4;
-    int saveSize = width * height * 4;
-    u8* saveBuff = (u8*)malloc(saveSize);
-    SDL_RenderReadPixels(this->rendererHandle,
-                         &rect,
-                         SDL_PIXELFORMAT_ABGR8888,
-                         saveBuff,
-                         savePitch);
-    // Copy the result into the hook buffer.
-    Napi::Value bufferVal = this->writeBuffer.Value();
-    Napi::TypedArray typeArr = bufferVal.As<Napi::TypedArray>();
-    Napi::ArrayBuffer arrBuff = typeArr.ArrayBuffer();
-    void* untypedData = arrBuff.Data();
-    unsigned char* rawBuff = (unsigned char*)untypedData;
-    for (size_t k = 0; k < arrBuff.ByteLength(); k++) {
-      rawBuff[k] = saveBuff[k];
+    rect.x = dirty[1 + i*4 + 0];
+    rect.y = dirty[1 + i*4 + 1];
+    rect.w = dirty[1 + i*4 + 2];
+    rect.h = dirty[1 + i*4 + 3];
+    this->uploadRect(texture, layer, &rect);
+  }
+}
+
+
+// Texture of the nth layer, created again whenever the size of its surface
+// changes. A layer that scrolls in hardware has a texture of its entire
+// field, and only uploads the parts of it that changed, regardless of
+// scrolling.
+SDL_Texture* SDLBackend::ensureLayerTexture(int n, LayerSurface* layer,
+                                            bool* created) {
+  if ((size_t)n >= this->layerTextures.size()) {
+    this->layerTextures.resize(n + 1, LayerTexture());
+  }
+  LayerTexture* layerTexture = &this->layerTextures[n];
+  if (layerTexture->texture) {
+    if (layerTexture->width == layer->width &&
+        layerTexture->height == layer->height) {
+      return layerTexture->texture;
     }
-    free(saveBuff);
-    return;
+    SDL_DestroyTexture(layerTexture->texture);
   }
+  SDL_Texture* texture = SDL_CreateTexture(
+      this->rendererHandle,
+      SDL_PIXELFORMAT_ABGR8888,
+      SDL_TEXTUREACCESS_STREAMING,
+      layer->width,
+      layer->height);
+  if (!texture) {
+    printf("SDL_CreateTexture failed: %s\n", SDL_GetError());
+  }
+  layerTexture->texture = texture;
+  layerTexture->width = layer->width;
+  layerTexture->height = layer->height;
+  // Not a valid SDL_BlendMode, so the layer's is always set
+  layerTexture->blend = -1;
+  memset(layerTexture->palette, 0, sizeof(layerTexture->palette));
+  *created = true;
+  return texture;
+}
 
-  this->next(env);
+
+// Copy the part of the field that is in view, starting at the layer's pan.
+// Where the view crosses the field's right or bottom edge it wraps around,
+// so it takes up to four copies. The field is at least as large as the
+// display, see renderer.js
+void SDLBackend::copyPanned(SDL_Texture* texture, LayerSurface* layer) {
+  int outWidth = 0;
+  int outHeight = 0;
+  SDL_GetRendererOutputSize(this->rendererHandle, &outWidth, &outHeight);
+  int viewWidth = this->displayWidth;
+  int viewHeight = this->displayHeight;
+  int y = 0;
+  while (y < viewHeight) {
+    int srcY = (layer->pan[1] + y) % layer->height;
+    int h = std::min(layer->height - srcY, viewHeight - y);
+    int x = 0;
+    while (x < viewWidth) {
+      int srcX = (layer->pan[0] + x) % layer->width;
+      int w = std::min(layer->width - srcX, viewWidth - x);
+      SDL_Rect src = {srcX, srcY, w, h};
+      // Scale edges rather than sizes, so neighboring copies don't leave gaps
+      SDL_Rect dst;
+      dst.x = x * outWidth / viewWidth;
+      dst.y = y * outHeight / viewHeight;
+      dst.w = (x + w) * outWidth / viewWidth - dst.x;
+      dst.h = (y + h) * outHeight / viewHeight - dst.y;
+      SDL_RenderCopy(this->rendererHandle, texture, &src, &dst);
+      x += w;
+    }
+    y += h;
+  }
 }
 
 
-void SDLBackend::sendKeyEvent(Napi::Env env, const std::string& msg, int code) {
-  if (this->eventReceiverFunc.IsEmpty()) {
+// Copy a rect of the surface to the texture, or all of it if rect is NULL.
+// Indexed surfaces are expanded through their palette, straight into the
+// locked texture.
+void SDLBackend::uploadRect(SDL_Texture* texture, LayerSurface* layer,
+                            const SDL_Rect* rect) {
+  int x = rect ? rect->x : 0;
+  int y = rect ? rect->y : 0;
+  int w = rect ? rect->w : layer->width;
+  int h = rect ? rect->h : layer->height;
+  if (!layer->palette) {
+    unsigned char* start = layer->buff + y * layer->pitch +
+                           x * RGB_PIXEL_SIZE;
+    SDL_UpdateTexture(texture, rect, start, layer->pitch);
     return;
   }
-  if (code & 0x40000000) {
-    code = (code & 0xff) | 0x8000;
-  } else {
-    code = code & 0xff;
+  void* pixels = NULL;
+  int pitch = 0;
+  if (SDL_LockTexture(texture, rect, &pixels, &pitch) != 0) {
+    printf("SDL_LockTexture failed: %s\n", SDL_GetError());
+    return;
   }
-  Napi::Object obj = Napi::Object::New(env);
-  Napi::Number codeNum = Napi::Number::New(env, code);
-  obj["code"] = codeNum;
-  napi_value val = obj;
-  Napi::String eventName = Napi::String::New(env, msg);
-  this->eventReceiverFunc.Call({eventName, val});
+  expand_indexed(layer->buff + y * layer->pitch + x, layer->pitch,
+                 layer->palette, (uint8_t*)pixels, pitch, w, h);
+  SDL_UnlockTexture(texture);
 }
 
 
-void SDLBackend::sendMouseEvent(Napi::Env env, const std::string& msg,
-                                int x, int y) {
-  if (this->eventReceiverFunc.IsEmpty()) {
+// Send the frame's events to js in one call, as an Int32Array of
+// EVENT_FIELDS values for each event
+void SDLBackend::sendEventBatch(Napi::Env env) {
+  int count = this->eventBatch.count();
+  if (count == 0 || this->eventReceiverFunc.IsEmpty()) {
     return;
   }
-  Napi::Object obj = Napi::Object::New(env);
-  Napi::Number xNum = Napi::Number::New(env, x);
-  Napi::Number yNum = Napi::Number::New(env, y);
-  obj["basex"] = xNum;
-  obj["basey"] = yNum;
-  napi_value val = obj;
-  Napi::String eventName = Napi::String::New(env, msg);
-  this->eventReceiverFunc.Call({eventName, val});
+  size_t length = (size_t)count * EVENT_FIELDS;
+  Napi::Int32Array batch = Napi::Int32Array::New(env, length);
+  memcpy(batch.Data(), this->eventBatch.data(), length * sizeof(int32_t));
+  Napi::String eventName = Napi::String::New(env, "batch");
+  this->eventReceiverFunc.Call({eventName, batch});
+  this->eventBatch.clear();
 }
 
 
@@ -610,14 +1134,16 @@ void SDLBackend::next(Napi::Env env) {
   long durationNano = std::chrono::duration_cast<std::chrono::nanoseconds>(finishTime - this->frameStartTime).count();
   this->tookTimeUs = (durationNano / 1000);
   // asynchronously present the frame to SDL
-  PresentFrame* w = new PresentFrame(cont, this->rendererHandle);
+  PresentFrame* w = new PresentFrame(cont, this->rendererHandle,
+                                     &this->scheduler, this->waitAfterPresent,
+                                     &this->stats);
   w->Queue();
 }
 
 void SDLBackend::nextWithoutPresent(Napi::Env env) {
   Napi::Function cont = Napi::Function::New(env, BeginNextFrame,
                                             "<unknown>", this);
-  WaitFrame* w = new WaitFrame(cont, 16);
+  WaitFrame* w = new WaitFrame(cont, &this->scheduler, &this->stats);
   w->Queue();
 }
 
@@ -3,6 +3,12 @@
 
 #include <napi.h>
 #include <chrono>
+#include <vector>
+
+#include "event_batch.h"
+#include "frame_scheduler.h"
+#include "frame_stats.h"
+#include "video_sink.h"
 
 struct GfxTarget;
 struct Image;
@@ -12,6 +18,55 @@ struct SDL_Window;
 struct SDL_Renderer;
 struct SDL_Texture;
 struct SDL_Surface;
+struct SDL_Rect;
+
+#define MAX_SURFACE_SETS 3
+
+// A surface registered by the renderer, along with references that keep
+// its buffers alive until the renderer registers new ones
+struct LayerSurface {
+  unsigned char* buff;
+  int width;
+  int height;
+  int pitch;
+  // number of dirty rects, then x,y,w,h for each, see renderer.js
+  int32_t* dirty;
+  // If not NULL, buff is indexed, a byte per pixel, and these are the 256
+  // rgba colors to expand it with
+  uint32_t* palette;
+  // If not NULL, buff holds the layer's entire field, and the display shows
+  // it starting at these x,y, wrapping around its edges
+  int32_t* pan;
+  // Whether the layer is shown, and the SDL_BlendMode that it is copied with,
+  // read from the surface each frame
+  bool visible;
+  int blend;
+  Napi::Reference<Napi::Value> buffRef;
+  Napi::Reference<Napi::Value> dirtyRef;
+  Napi::Reference<Napi::Value> paletteRef;
+  Napi::Reference<Napi::Value> panRef;
+};
+
+#define SET_FREE 0
+#define SET_PENDING 1
+
+// One frame's worth of surfaces. The renderer owns a FREE set and may
+// render into it. Once rendered, the set is PENDING and belongs to the
+// backend, until its buffers have been uploaded to the textures
+struct SurfaceSet {
+  std::vector<LayerSurface> layers;
+  int state;
+};
+
+// The texture that a layer is uploaded to, created at the size of the
+// layer's surface, and the palette it was last expanded with if indexed
+struct LayerTexture {
+  SDL_Texture* texture;
+  int width;
+  int height;
+  int blend;
+  uint32_t palette[256];
+};
 
 class SDLBackend : public Napi::ObjectWrap<SDLBackend> {
  public:
@@ -25,17 +80,41 @@ class SDLBackend : public Napi::ObjectWrap<SDLBackend> {
   Napi::Value Name(const Napi::CallbackInfo& info);
   // (width, height, renderer)
   Napi::Value BeginRender(const Napi::CallbackInfo& info);
-  // (['zoom', 'grid', 'instrumentation', 'vv', 'running'], value)
+  // (['zoom', 'grid', 'instrumentation', 'vv', 'pipeline', 'rate',
+  //   'pacing', 'zerocopy', 'indexed', 'hwscroll'], value)
   Napi::Value Config(const Napi::CallbackInfo& info);
-  // ((msg, event)=>{})
+  // ((msg, batch)=>{}), msg is 'batch', see event_batch.h
   Napi::Value EventReceiver(const Napi::CallbackInfo& info);
   Napi::Value RunAppLoop(const Napi::CallbackInfo& info);
+  // (surfaceList)
+  Napi::Value RegisterSurfaces(const Napi::CallbackInfo& info);
   Napi::Value InsteadWriteBuffer(const Napi::CallbackInfo& info);
+  // (videoSink), also send every presented frame to the sink
+  Napi::Value StreamTo(const Napi::CallbackInfo& info);
   Napi::Value GetFeatureList(const Napi::CallbackInfo& info);
+  Napi::Value GetStats(const Napi::CallbackInfo& info);
+  Napi::Value GetTrace(const Napi::CallbackInfo& info);
   Napi::Value TestOnlyHook(const Napi::CallbackInfo& info);
 
-  void sendKeyEvent(Napi::Env env, const std::string& msg, int code);
-  void sendMouseEvent(Napi::Env env, const std::string& msg, int x, int y);
+  bool pollEvents(Napi::Env env);
+  int runFrameLogic(Napi::Env env);
+  bool callRender(Napi::Env env, int setIndex);
+  void readLayerAppearance(Napi::Value surfaceList, int setIndex);
+  Napi::Value lockLayerTextures(Napi::Env env);
+  void unlockLayerTextures();
+  void detachLockedBuffers();
+  void drawSurfaceSet(SurfaceSet* surfaceSet);
+  void captureFrame();
+  void endStream();
+  void execPipelinedFrame(Napi::Env env);
+  int renderAhead(Napi::Env env);
+  void updateLayerTexture(SDL_Texture* texture, LayerSurface* layer,
+                          uint32_t* texturePalette, bool full);
+  SDL_Texture* ensureLayerTexture(int n, LayerSurface* layer, bool* created);
+  void copyPanned(SDL_Texture* texture, LayerSurface* layer);
+  void uploadRect(SDL_Texture* texture, LayerSurface* layer,
+                  const SDL_Rect* rect);
+  void sendEventBatch(Napi::Env env);
   void frameInstrumentation();
   void next(Napi::Env env);
   void nextWithoutPresent(Napi::Env env);
@@ -47,14 +126,23 @@ class SDLBackend : public Napi::ObjectWrap<SDLBackend> {
 
   bool hasWriteBuffer;
   Napi::Reference<Napi::Value> writeBuffer;
+  std::vector<unsigned char> readBuff;
+
+  VideoSink* streamSink;
+  Napi::ObjectReference streamRef;
 
   Napi::FunctionReference eventReceiverFunc;
+  EventBatch eventBatch;
   int sdlInitialized;
   int zoomLevel;
 
   int instrumentation;
   int veryVerboseTiming;
 
+  FrameScheduler scheduler;
+  bool waitAfterPresent;
+  FrameStats stats;
+
   int startupFrameCount;
   std::chrono::time_point<std::chrono::high_resolution_clock> frameStartTime;
   int tookTimeUs;
@@ -66,18 +154,33 @@ class SDLBackend : public Napi::ObjectWrap<SDLBackend> {
   int gridHeight;
   int gridPitch;
   unsigned char* gridRawBuff;
+  Napi::Reference<Napi::Value> gridRef;
 
-  unsigned char** dataSources;
+  SurfaceSet sets[MAX_SURFACE_SETS];
+  bool needFullUpload;
+  // Number of surface sets, more than 1 renders the next frame while the
+  // previous one presents. Pending sets are uploaded in the order rendered
+  int pipelineDepth;
+  int pendingSets[MAX_SURFACE_SETS];
+  int numPending;
+  // Render straight into the locked textures, instead of uploading the
+  // renderer's surfaces. Only without pipelining, see callRender
+  bool zeroCopy;
+  std::vector<SDL_Texture*> lockedTextures;
+  // The memory of each locked texture, as given to js
+  std::vector<Napi::Reference<Napi::ArrayBuffer>> lockedBuffers;
+  // Whether the renderer may output indexed surfaces
+  bool indexedOutput;
+  // Whether the renderer may give layers surfaces of their entire field
+  bool hardwareScroll;
+  // One for each layer, bottom-most first
+  std::vector<LayerTexture> layerTextures;
   int displayWidth;
   int displayHeight;
 
   SDL_Surface* softwareTarget;
   SDL_Window* windowHandle;
   SDL_Renderer* rendererHandle;
-  SDL_Texture* mainLayer0;
-  SDL_Texture* mainLayer1;
-  SDL_Texture* mainLayer2;
-  SDL_Texture* mainLayer3;
   SDL_Texture* gridLayer;
 };
 
@@ -0,0 +1,126 @@
+#include "tile_cache.h"
+#include "common.h"
+
+#include <vector>
+
+Napi::FunctionReference g_tileCacheConstructor;
+
+
+void TileCache::InitClass(Napi::Env env, Napi::Object exports) {
+  Napi::Function func = DefineClass(
+      env,
+      "TileCache",
+      {InstanceMethod("render", &TileCache::Render),
+       InstanceMethod("clear", &TileCache::Clear),
+       InstanceMethod("removeTile", &TileCache::RemoveTile),
+       InstanceMethod("stats", &TileCache::Stats),
+  });
+  g_tileCacheConstructor = Napi::Persistent(func);
+  g_tileCacheConstructor.SuppressDestruct();
+  exports.Set("TileCache", func);
+}
+
+TileCache::TileCache(const Napi::CallbackInfo& info)
+    : Napi::ObjectWrap<TileCache>(info) {
+}
+
+Napi::Value TileCache::Render(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  if (info.Length() < 21 || !info[0].IsArray()) {
+    Napi::TypeError::New(env, "render needs 21 arguments")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  unsigned char* tilemap = typedArrayToRawBuffer(info[1]);
+  unsigned char* lut = typedArrayToRawBuffer(info[14]);
+  unsigned char* target = typedArrayToRawBuffer(info[15]);
+  if (tilemap == NULL || lut == NULL || target == NULL) {
+    Napi::TypeError::New(env, "render needs typed arrays")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  // No flips or cells unless given
+  unsigned char* flips = NULL;
+  if (!info[5].IsNull() && !info[5].IsUndefined()) {
+    flips = typedArrayToRawBuffer(info[5]);
+  }
+  CellAttrs cells;
+  bool hasCells = !info[9].IsNull() && !info[9].IsUndefined();
+  if (hasCells && !cellAttrsFromValue(info[9], &cells)) {
+    Napi::TypeError::New(env, "render needs cells with typed arrays")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  TileLayer layer;
+  layer.mapPitch = info[2].As<Napi::Number>().Int32Value();
+  layer.mapWidth = info[3].As<Napi::Number>().Int32Value();
+  layer.mapHeight = info[4].As<Napi::Number>().Int32Value();
+  layer.flipsPitch = info[6].As<Napi::Number>().Int32Value();
+  layer.tileWidth = info[7].As<Napi::Number>().Int32Value();
+  layer.tileHeight = info[8].As<Napi::Number>().Int32Value();
+  if (!bufferFits(info[1], layer.mapPitch, layer.mapWidth, layer.mapHeight,
+                  1) ||
+      (flips && !bufferFits(info[5], layer.flipsPitch, layer.mapWidth,
+                            layer.mapHeight, 1))) {
+    Napi::TypeError::New(env, "render tilemap or flips is too small")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  if (!tileListFits(info[0].As<Napi::Array>(), layer.tileWidth,
+                    layer.tileHeight)) {
+    Napi::TypeError::New(env, "render has a tile that is too small")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  std::vector<const uint8_t*> tiles;
+  std::vector<int> tilePitches;
+  tileListFromValue(info[0].As<Napi::Array>(), &tiles, &tilePitches);
+  layer.tiles = tiles.data();
+  layer.tilePitches = tilePitches.data();
+  layer.numTiles = tiles.size();
+  layer.tilemap = tilemap;
+  layer.flips = flips;
+  layer.cells = hasCells ? &cells : NULL;
+  layer.isBg = info[13].ToBoolean();
+  layer.lut = (const uint32_t*)lut;
+
+  this->store.render(layer,
+                     info[10].As<Napi::Number>().Int32Value(),
+                     info[11].As<Napi::Number>().Int32Value(),
+                     info[12].ToBoolean(),
+                     target,
+                     info[16].As<Napi::Number>().Int32Value(),
+                     info[17].As<Napi::Number>().Int32Value(),
+                     info[18].As<Napi::Number>().Int32Value(),
+                     info[19].As<Napi::Number>().Int32Value(),
+                     info[20].As<Napi::Number>().Int32Value());
+  return env.Null();
+}
+
+Napi::Value TileCache::Clear(const Napi::CallbackInfo& info) {
+  this->store.clear();
+  return info.Env().Null();
+}
+
+Napi::Value TileCache::RemoveTile(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  if (info.Length() < 1 || !info[0].IsNumber()) {
+    Napi::TypeError::New(env, "removeTile needs id")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  this->store.removeTile(info[0].As<Napi::Number>().Int32Value());
+  return env.Null();
+}
+
+Napi::Value TileCache::Stats(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  Napi::Object res = Napi::Object::New(env);
+  res["hits"] = Napi::Number::New(env, this->store.hits());
+  res["misses"] = Napi::Number::New(env, this->store.misses());
+  res["entries"] = Napi::Number::New(env, this->store.size());
+  return res;
+}
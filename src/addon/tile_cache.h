@@ -0,0 +1,29 @@
+#ifndef TILE_CACHE_H
+#define TILE_CACHE_H
+
+#include <napi.h>
+
+#include "tile_store.h"
+
+// A layer's tiles converted to RGBA, see TileStore. The JS side decides when
+// entries go stale and calls clear() or removeTile() before rendering.
+class TileCache : public Napi::ObjectWrap<TileCache> {
+ public:
+  static void InitClass(Napi::Env env, Napi::Object exports);
+  TileCache(const Napi::CallbackInfo& info);
+
+ private:
+  // (tiles, tilemap, mapPitch, mapWidth, mapHeight, flips, flipsPitch,
+  //  tileWidth, tileHeight, cells, scrollX, scrollY, isWrapped, isBg, lut,
+  //  target, targetPitch, left, top, right, bottom)
+  Napi::Value Render(const Napi::CallbackInfo& info);
+  Napi::Value Clear(const Napi::CallbackInfo& info);
+  // (id)
+  Napi::Value RemoveTile(const Napi::CallbackInfo& info);
+  // Returns {hits, misses, entries}
+  Napi::Value Stats(const Napi::CallbackInfo& info);
+
+  TileStore store;
+};
+
+#endif
@@ -0,0 +1,180 @@
+#include "tile_store.h"
+
+#include <string.h>
+
+#define RGB_PIXEL_SIZE 4
+#define ALPHA_OFFSET 3
+
+
+TileStore::TileStore() {
+  this->numHits = 0;
+  this->numMisses = 0;
+}
+
+void TileStore::clear() {
+  this->entries.clear();
+}
+
+void TileStore::removeTile(int id) {
+  for (auto it = this->entries.begin(); it != this->entries.end(); ) {
+    if ((int)(it->first >> 32) == id) {
+      it = this->entries.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+int64_t TileStore::hits() {
+  return this->numHits;
+}
+
+int64_t TileStore::misses() {
+  return this->numMisses;
+}
+
+int TileStore::size() {
+  return this->entries.size();
+}
+
+const uint32_t* TileStore::lookup(const TileLayer& layer, int id,
+                                  int32_t attr) {
+  uint64_t key = ((uint64_t)(uint32_t)id << 32) | (uint32_t)attr;
+  auto it = this->entries.find(key);
+  if (it != this->entries.end()) {
+    this->numHits++;
+    return it->second.data();
+  }
+  this->numMisses++;
+
+  // Colors of the tile, as in rasterize_cells
+  uint32_t colors[256];
+  int size = 256;
+  if (layer.cells == NULL) {
+    memcpy(colors, layer.lut, sizeof(colors));
+  } else if (attr >= 0) {
+    size = layer.cells->pieceSize;
+    if (size <= 0 || (attr + 1) * size > 256) {
+      return NULL;
+    }
+    memcpy(colors, layer.lut + attr * size, size * sizeof(uint32_t));
+  } else {
+    int start = layer.cells->listStarts[-1 - attr];
+    size = layer.cells->listStarts[-attr] - start;
+    if (size <= 0 || size > 256) {
+      return NULL;
+    }
+    for (int m = 0; m < size; m++) {
+      int e = layer.cells->lists[start + m];
+      if (e < 0 || e >= 256) {
+        return NULL;
+      }
+      colors[m] = layer.lut[e];
+    }
+  }
+  // Upper layers treat index 0 as transparent, keeping its rgb value
+  uint32_t zero = colors[0];
+  if (!layer.isBg) {
+    ((uint8_t*)&zero)[ALPHA_OFFSET] = 0x00;
+  }
+
+  std::vector<uint32_t>& pixels = this->entries[key];
+  pixels.resize(layer.tileWidth * layer.tileHeight);
+  const uint8_t* tile = id < layer.numTiles ? layer.tiles[id] : NULL;
+  for (int y = 0; y < layer.tileHeight; y++) {
+    uint32_t* out = pixels.data() + y * layer.tileWidth;
+    if (tile == NULL) {
+      // Missing tiles are index 0
+      for (int x = 0; x < layer.tileWidth; x++) {
+        out[x] = zero;
+      }
+      continue;
+    }
+    const uint8_t* row = tile + y * layer.tilePitches[id];
+    for (int x = 0; x < layer.tileWidth; x++) {
+      uint8_t c = row[x];
+      out[x] = c == 0 ? zero : colors[c % size];
+    }
+  }
+  return pixels.data();
+}
+
+void TileStore::render(const TileLayer& layer, int scrollX, int scrollY,
+                       bool isWrapped, uint8_t* target, int targetPitch,
+                       int left, int top, int right, int bottom) {
+  int tileWidth = layer.tileWidth;
+  int tileHeight = layer.tileHeight;
+  int sourceWidth = layer.mapWidth * tileWidth;
+  int sourceHeight = layer.mapHeight * tileHeight;
+  if (sourceWidth <= 0 || sourceHeight <= 0) {
+    return;
+  }
+
+  Placement place = place_region(sourceWidth, sourceHeight, scrollX, scrollY,
+                                 isWrapped, target, targetPitch,
+                                 left, top, right, bottom);
+  scrollX = place.scrollX;
+  scrollY = place.scrollY;
+
+  // Walk the region one block at a time, each block is the part of a single
+  // tile that is inside of the region
+  int i = place.rowBegin;
+  while (i < place.rowEnd) {
+    int y = (i + scrollY) % sourceHeight;
+    int mapY = y / tileHeight;
+    int innerY = y % tileHeight;
+    int numRows = place.rowEnd - i;
+    if (tileHeight - innerY < numRows) {
+      numRows = tileHeight - innerY;
+    }
+    int j = place.colBegin;
+    while (j < place.colEnd) {
+      int x = (j + scrollX) % sourceWidth;
+      int mapX = x / tileWidth;
+      int innerX = x % tileWidth;
+      int numCols = place.colEnd - j;
+      if (tileWidth - innerX < numCols) {
+        numCols = tileWidth - innerX;
+      }
+
+      int id = layer.tilemap[mapY * layer.mapPitch + mapX];
+      const uint32_t* pixels = NULL;
+      const CellAttrs* cells = layer.cells;
+      if (cells == NULL) {
+        pixels = this->lookup(layer, id, 0);
+      } else if (mapX < cells->pitch && mapY < cells->height) {
+        pixels = this->lookup(layer, id,
+                              cells->attrs[mapY * cells->pitch + mapX]);
+      }
+      int flip = 0;
+      if (layer.flips) {
+        flip = layer.flips[mapY * layer.flipsPitch + mapX];
+      }
+      for (int r = 0; r < numRows; r++) {
+        uint8_t* out = target + (i + r) * targetPitch + j * RGB_PIXEL_SIZE;
+        if (pixels == NULL) {
+          // Tile has no colors
+          for (int k = 0; k < numCols; k++) {
+            out[k * RGB_PIXEL_SIZE + ALPHA_OFFSET] = 0x00;
+          }
+          continue;
+        }
+        int ty = innerY + r;
+        if (flip & TILE_FLIP_V) {
+          ty = tileHeight - 1 - ty;
+        }
+        const uint32_t* row = pixels + ty * tileWidth;
+        if (flip & TILE_FLIP_H) {
+          row += tileWidth - 1 - innerX;
+          for (int k = 0; k < numCols; k++) {
+            memcpy(out + k * RGB_PIXEL_SIZE, row - k, sizeof(uint32_t));
+          }
+        } else {
+          memcpy(out, row + innerX, numCols * sizeof(uint32_t));
+        }
+      }
+      j += numCols;
+    }
+    i += numRows;
+  }
+}
@@ -0,0 +1,57 @@
+#ifndef TILE_STORE_H
+#define TILE_STORE_H
+
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+#include "rasterize.h"
+
+// A tiled layer, as given to rasterize_tiles. If cells is not NULL, it has
+// one attribute per map entry, which resolves the colors of that tile.
+struct TileLayer {
+  const uint8_t* const* tiles;
+  const int* tilePitches;
+  int numTiles;
+  const uint8_t* tilemap;
+  int mapPitch;
+  int mapWidth;
+  int mapHeight;
+  const uint8_t* flips;
+  int flipsPitch;
+  int tileWidth;
+  int tileHeight;
+  const uint32_t* lut;
+  bool isBg;
+  const CellAttrs* cells;
+};
+
+// Tiles that have already been converted to RGBA, keyed by tile id and the
+// attribute that resolved their colors. Rendering copies the rows of these
+// instead of looking up each pixel. The owner has to clear the store when
+// the palette, the colorspace's lists, or the layer's size change, and
+// remove a tile when its pixels change.
+class TileStore {
+ public:
+  TileStore();
+  void clear();
+  void removeTile(int id);
+  // Same output as rasterize_tiles, or rasterize_cells on the expanded map
+  void render(const TileLayer& layer, int scrollX, int scrollY,
+              bool isWrapped, uint8_t* target, int targetPitch,
+              int left, int top, int right, int bottom);
+
+  int64_t hits();
+  int64_t misses();
+  int size();
+
+ private:
+  // RGBA pixels of the tile, or NULL if the attribute has no colors
+  const uint32_t* lookup(const TileLayer& layer, int id, int32_t attr);
+
+  std::unordered_map<uint64_t, std::vector<uint32_t>> entries;
+  int64_t numHits;
+  int64_t numMisses;
+};
+
+#endif
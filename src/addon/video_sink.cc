@@ -0,0 +1,138 @@
+#include "video_sink.h"
+#include "common.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+
+#define RGB_PIXEL_SIZE 4
+
+Napi::FunctionReference g_videoSinkConstructor;
+
+
+void VideoSink::InitClass(Napi::Env env, Napi::Object exports) {
+  Napi::Function func = DefineClass(
+      env,
+      "VideoSink",
+      {InstanceMethod("write", &VideoSink::Write),
+       InstanceMethod("finish", &VideoSink::Finish),
+       InstanceMethod("stats", &VideoSink::Stats),
+  });
+  g_videoSinkConstructor = Napi::Persistent(func);
+  g_videoSinkConstructor.SuppressDestruct();
+  exports.Set("VideoSink", func);
+}
+
+VideoSink::VideoSink(const Napi::CallbackInfo& info)
+    : Napi::ObjectWrap<VideoSink>(info) {
+  Napi::Env env = info.Env();
+  this->videoStream = NULL;
+  this->pixelFormat = VIDEO_FORMAT_RGBA;
+
+  if (info.Length() > 1 && info[1].IsString()) {
+    std::string name = info[1].As<Napi::String>().Utf8Value();
+    if (name == "rgb24") {
+      this->pixelFormat = VIDEO_FORMAT_RGB24;
+    } else if (name != "rgba") {
+      Napi::TypeError::New(env, "unknown video format " + name)
+          .ThrowAsJavaScriptException();
+      return;
+    }
+  }
+  int numBuffers = 0;
+  if (info.Length() > 2 && info[2].IsNumber()) {
+    numBuffers = info[2].As<Napi::Number>().Int32Value();
+  }
+
+  if (info.Length() > 0 && info[0].IsNumber()) {
+    int fd = info[0].As<Napi::Number>().Int32Value();
+    this->videoStream = new VideoStream(fd, false, numBuffers);
+  } else if (info.Length() > 0 && info[0].IsString()) {
+    // Opening a named pipe waits here until something reads from it
+    std::string path = info[0].As<Napi::String>().Utf8Value();
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+      Napi::Error::New(env, "could not open " + path + ": " + strerror(errno))
+          .ThrowAsJavaScriptException();
+      return;
+    }
+    this->videoStream = new VideoStream(fd, true, numBuffers);
+  } else {
+    Napi::TypeError::New(env, "VideoSink needs a path or fd")
+        .ThrowAsJavaScriptException();
+  }
+}
+
+VideoSink::~VideoSink() {
+  delete this->videoStream;
+}
+
+VideoStream* VideoSink::stream() {
+  return this->videoStream;
+}
+
+int VideoSink::format() {
+  return this->pixelFormat;
+}
+
+int VideoSink::bytesPerPixel() {
+  return this->pixelFormat == VIDEO_FORMAT_RGB24 ? 3 : 4;
+}
+
+Napi::Value VideoSink::Write(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  if (info.Length() < 1 || !info[0].IsObject()) {
+    Napi::TypeError::New(env, "write needs surface")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  Napi::Object surfaceObj = info[0].As<Napi::Object>();
+  unsigned char* buff = typedArrayToRawBuffer(surfaceObj.Get("buff"));
+  if (buff == NULL) {
+    Napi::TypeError::New(env, "write needs surface.buff")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  int width = surfaceObj.Get("width").As<Napi::Number>().Int32Value();
+  int height = surfaceObj.Get("height").As<Napi::Number>().Int32Value();
+  int pitch = surfaceObj.Get("pitch").As<Napi::Number>().Int32Value();
+
+  int bpp = this->bytesPerPixel();
+  size_t rowSize = (size_t)width * bpp;
+  uint8_t* frame = this->videoStream->acquire(rowSize * height);
+  if (frame == NULL) {
+    return Napi::Boolean::New(env, false);
+  }
+  for (int y = 0; y < height; y++) {
+    const uint8_t* source = buff + (size_t)y * pitch;
+    uint8_t* target = frame + y * rowSize;
+    if (this->pixelFormat == VIDEO_FORMAT_RGBA) {
+      memcpy(target, source, rowSize);
+      continue;
+    }
+    for (int x = 0; x < width; x++) {
+      target[x*3 + 0] = source[x*RGB_PIXEL_SIZE + 0];
+      target[x*3 + 1] = source[x*RGB_PIXEL_SIZE + 1];
+      target[x*3 + 2] = source[x*RGB_PIXEL_SIZE + 2];
+    }
+  }
+  this->videoStream->submit(frame);
+  return Napi::Boolean::New(env, true);
+}
+
+Napi::Value VideoSink::Finish(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  std::string error = this->videoStream->finish();
+  if (error.empty()) {
+    return env.Null();
+  }
+  return Napi::String::New(env, error);
+}
+
+Napi::Value VideoSink::Stats(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  Napi::Object obj = Napi::Object::New(env);
+  obj["frames"] = Napi::Number::New(env, this->videoStream->framesWritten());
+  obj["stalls"] = Napi::Number::New(env, this->videoStream->stalls());
+  return obj;
+}
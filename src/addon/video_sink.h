@@ -0,0 +1,38 @@
+#ifndef VIDEO_SINK_H
+#define VIDEO_SINK_H
+
+#include <napi.h>
+#include <stdint.h>
+
+#include "video_stream.h"
+
+#define VIDEO_FORMAT_RGBA 0
+#define VIDEO_FORMAT_RGB24 1
+
+// Streams raw video frames to a path or file descriptor, see video_stream.h.
+// Frames come either from write() with a surface, or from a backend that
+// reads them back from its renderer after streamTo() is given this sink.
+class VideoSink : public Napi::ObjectWrap<VideoSink> {
+ public:
+  static void InitClass(Napi::Env env, Napi::Object exports);
+  // (path or fd, format, numBuffers), format is 'rgba' or 'rgb24'
+  VideoSink(const Napi::CallbackInfo& info);
+  ~VideoSink();
+
+  VideoStream* stream();
+  int format();
+  int bytesPerPixel();
+
+ private:
+  // (surface), returns false if the frame could not be written
+  Napi::Value Write(const Napi::CallbackInfo& info);
+  // Write the queued frames and close, returns an error message or null
+  Napi::Value Finish(const Napi::CallbackInfo& info);
+  // {frames, stalls}
+  Napi::Value Stats(const Napi::CallbackInfo& info);
+
+  VideoStream* videoStream;
+  int pixelFormat;
+};
+
+#endif
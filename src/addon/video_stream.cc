@@ -0,0 +1,141 @@
+#include "video_stream.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DEFAULT_NUM_BUFFERS 4
+
+
+VideoStream::VideoStream(int fd, bool ownsFd, int numBuffers) {
+  this->fd = fd;
+  this->ownsFd = ownsFd;
+  this->numBuffers = numBuffers > 0 ? numBuffers : DEFAULT_NUM_BUFFERS;
+  this->frameSize = 0;
+  this->isStopping = false;
+  this->isFinished = false;
+  this->numWritten = 0;
+  this->numStalls = 0;
+  this->writer = std::thread(&VideoStream::writerLoop, this);
+}
+
+VideoStream::~VideoStream() {
+  this->finish();
+}
+
+uint8_t* VideoStream::acquire(size_t frameSize) {
+  std::unique_lock<std::mutex> guard(this->lock);
+  if (this->isStopping || !this->error.empty()) {
+    return NULL;
+  }
+  if (this->pool.empty()) {
+    // The first frame decides the size of every buffer
+    this->frameSize = frameSize;
+    this->pool.resize(this->numBuffers);
+    for (int n = 0; n < this->numBuffers; n++) {
+      this->pool[n].resize(frameSize);
+      this->freeList.push_back(this->pool[n].data());
+    }
+  }
+  if (frameSize != this->frameSize) {
+    this->error = "frame size changed from " +
+                  std::to_string(this->frameSize) + " to " +
+                  std::to_string(frameSize);
+    return NULL;
+  }
+  if (this->freeList.empty()) {
+    this->numStalls++;
+    while (this->freeList.empty() && this->error.empty()) {
+      this->hasFree.wait(guard);
+    }
+    if (!this->error.empty()) {
+      return NULL;
+    }
+  }
+  uint8_t* buffer = this->freeList.back();
+  this->freeList.pop_back();
+  return buffer;
+}
+
+void VideoStream::submit(uint8_t* buffer) {
+  {
+    std::lock_guard<std::mutex> guard(this->lock);
+    this->queue.push_back(buffer);
+  }
+  this->hasWork.notify_one();
+}
+
+std::string VideoStream::finish() {
+  {
+    std::lock_guard<std::mutex> guard(this->lock);
+    if (this->isFinished) {
+      return this->error;
+    }
+    this->isStopping = true;
+  }
+  this->hasWork.notify_all();
+  this->writer.join();
+  if (this->ownsFd && close(this->fd) != 0 && this->error.empty()) {
+    this->error = std::string("close failed: ") + strerror(errno);
+  }
+  std::lock_guard<std::mutex> guard(this->lock);
+  this->isFinished = true;
+  return this->error;
+}
+
+int64_t VideoStream::framesWritten() {
+  std::lock_guard<std::mutex> guard(this->lock);
+  return this->numWritten;
+}
+
+int64_t VideoStream::stalls() {
+  std::lock_guard<std::mutex> guard(this->lock);
+  return this->numStalls;
+}
+
+// Runs on the writer thread. Frames queued before finish() are written, and
+// once writing fails the rest are dropped.
+void VideoStream::writerLoop() {
+  while (true) {
+    std::unique_lock<std::mutex> guard(this->lock);
+    while (this->queue.empty() && !this->isStopping) {
+      this->hasWork.wait(guard);
+    }
+    if (this->queue.empty()) {
+      return;
+    }
+    uint8_t* buffer = this->queue.front();
+    this->queue.pop_front();
+    bool hasError = !this->error.empty();
+    guard.unlock();
+
+    bool isOK = !hasError && this->writeAll(buffer, this->frameSize);
+
+    guard.lock();
+    if (isOK) {
+      this->numWritten++;
+    }
+    this->freeList.push_back(buffer);
+    guard.unlock();
+    this->hasFree.notify_one();
+  }
+}
+
+// Pipes may take part of a frame at a time
+bool VideoStream::writeAll(const uint8_t* data, size_t size) {
+  while (size > 0) {
+    ssize_t n = write(this->fd, data, size);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      std::lock_guard<std::mutex> guard(this->lock);
+      this->error = std::string("write failed: ") + strerror(errno);
+      this->hasFree.notify_all();
+      return false;
+    }
+    data += n;
+    size -= n;
+  }
+  return true;
+}
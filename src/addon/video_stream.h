@@ -0,0 +1,59 @@
+#ifndef VIDEO_STREAM_H
+#define VIDEO_STREAM_H
+
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Writes raw video frames to a file descriptor, such as a file, a named
+// pipe or stdin of an encoder process. Frames are filled into a small pool
+// of reusable buffers and written by a background thread. When every buffer
+// is waiting to be written, acquire() blocks until the writer catches up, so
+// a slow reader slows down the caller instead of using more memory.
+class VideoStream {
+ public:
+  // Closes the fd when finished if ownsFd is true
+  VideoStream(int fd, bool ownsFd, int numBuffers);
+  ~VideoStream();
+
+  // Get an unused buffer to fill with the next frame. Every frame must have
+  // the same size as the first one. Returns NULL after an error, or after
+  // the stream is finished
+  uint8_t* acquire(size_t frameSize);
+  // Queue a buffer from acquire() to be written
+  void submit(uint8_t* buffer);
+  // Write the queued frames, then stop. Returns an error message, or an
+  // empty string. Safe to call more than once
+  std::string finish();
+
+  int64_t framesWritten();
+  // Number of times acquire() had to wait for the writer
+  int64_t stalls();
+
+ private:
+  void writerLoop();
+  bool writeAll(const uint8_t* data, size_t size);
+
+  int fd;
+  bool ownsFd;
+  int numBuffers;
+  size_t frameSize;
+  std::vector<std::vector<uint8_t> > pool;
+  std::vector<uint8_t*> freeList;
+  std::deque<uint8_t*> queue;
+  std::thread writer;
+  std::mutex lock;
+  std::condition_variable hasWork;
+  std::condition_variable hasFree;
+  bool isStopping;
+  bool isFinished;
+  int64_t numWritten;
+  int64_t numStalls;
+  std::string error;
+};
+
+#endif
@@ -1,20 +1,20 @@
-#include <SDL.h>
+#include "frame_scheduler.h"
+#include "frame_stats.h"
 
 using namespace Napi;
 
 class WaitFrame : public AsyncWorker {
   public:
-    WaitFrame(Function& callback, int millisec)
-        : AsyncWorker(callback), _millisec(millisec) {
-      if (!this->_millisec) {
-        this->_millisec = 16;
-      }
-    }
+    WaitFrame(Function& callback, FrameScheduler* scheduler,
+              FrameStats* stats)
+        : AsyncWorker(callback), _scheduler(scheduler), _stats(stats) {}
 
     ~WaitFrame() {}
 
     void Execute() override {
-        SDL_Delay(this->_millisec);
+        int64_t start = FrameStats::now();
+        this->_scheduler->waitNext();
+        this->_stats->addPhase(PHASE_IDLE, start, FrameStats::now() - start);
     }
 
     void OnOK() override {
@@ -23,5 +23,6 @@ class WaitFrame : public AsyncWorker {
     }
 
   private:
-    int _millisec;
+    FrameScheduler* _scheduler;
+    FrameStats* _stats;
 };
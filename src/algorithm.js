@@ -1,6 +1,7 @@
 const palette = require('./palette.js');
 const rgbColor = require('./rgb_color.js');
 const types = require('./types.js');
+const kernels = require('./kernels.js');
 
 function midpointCircleRasterize(r) {
   if (!r) {
@@ -120,39 +121,61 @@ function sortByHSV(items) {
 }
 
 function flood(pl, initX, initY, color) {
-  let top = pl.offsetTop || 0;
-  let left = pl.offsetLeft || 0;
-  let target = pl.data[(top+initY)*pl.pitch+(left+initX)];
-  let queue = [{x:initX,y:initY}];
-  let i = 0;
-  while (queue.length > 0) {
-    let node = queue.shift();
-    // Inside?
-    let value = pl.data[(top+node.y)*pl.pitch+(left+node.x)];
-    if (value != target) {
-      continue;
-    }
-    pl.data[(top+node.y)*pl.pitch+(left+node.x)] = color;
-    // West
-    if (node.x > 0) {
-      queue.push({x:node.x-1, y:node.y});
-    }
-    // North
-    if (node.y > 0) {
-      queue.push({x:node.x, y:node.y-1});
-    }
-    // East
-    if (node.x < pl.width - 1) {
-      queue.push({x:node.x+1, y:node.y});
-    }
-    // South
-    if (node.y < pl.height - 1) {
-      queue.push({x:node.x, y:node.y+1});
-    }
+  let offset = (pl.offsetTop || 0) * pl.pitch + (pl.offsetLeft || 0);
+  let bounds = g_ranges.bounds;
+  kernels.floodFill(pl.data, pl.pitch, offset, pl.width, pl.height,
+                    Math.floor(initX), Math.floor(initY), color, bounds);
+  if (pl.addDamage && bounds[2] >= bounds[0]) {
+    pl.addDamage(bounds[0], bounds[1],
+                 bounds[2] - bounds[0] + 1, bounds[3] - bounds[1] + 1);
   }
 }
 
 
+// Ranges collects the points and straight lines of pixels that make up a
+// shape, as rows of [x0, x1, y0, y1] in an Int32Array, so that drawing a
+// shape doesn't allocate an array per point. See kernels.fillRanges
+class Ranges {
+  constructor() {
+    this.data = new Int32Array(256);
+    this.length = 0;
+    // [minX, minY, maxX, maxY] of the pixels written by fillRanges
+    this.bounds = new Int32Array(4);
+  }
+
+  clear() {
+    this.length = 0;
+    return this;
+  }
+
+  point(x, y) {
+    this.range(x, x, y, y);
+  }
+
+  // A range only goes straight horizontal or straight vertical
+  range(x0, x1, y0, y1) {
+    let k = this.length * 4;
+    if (k + 4 > this.data.length) {
+      let grow = new Int32Array(this.data.length * 2);
+      grow.set(this.data);
+      this.data = grow;
+    }
+    this.data[k+0] = Math.floor(x0);
+    this.data[k+1] = Math.floor(x1);
+    this.data[k+2] = Math.floor(y0);
+    this.data[k+3] = Math.floor(y1);
+    this.length++;
+  }
+}
+
+// Shared by the drawing functions, which each use it up before returning
+const g_ranges = new Ranges();
+
+function sharedRanges() {
+  return g_ranges.clear();
+}
+
+
 function nearestNeighbor(input, scaleX, scaleY) {
   if (!types.isField(input)) {
     throw new Error(`input must be a Field`);
@@ -186,22 +209,49 @@ function nearestNeighborSurface(input, zoomLevel) {
 
   // Allocate the surface scaled to its new size
   let make = makeSurface(input.width * zoomLevel, input.height * zoomLevel);
-  for (let y = 0; y < input.height; y++) {
-    for (let x = 0; x < input.width; x++) {
-      // Read value
-      let rgba = readRGBAColor(input, x, y);
-      for (let i = 0; i < zoomLevel; i++) {
-        for (let j = 0; j < zoomLevel; j++) {
-          // Write value
-          writeRGBAColor(make, x*zoomLevel+j, y*zoomLevel+i, rgba);
-        }
-      }
-    }
-  }
+  kernels.scaleNearest(input.buff, input.pitch, input.width, input.height,
+                       make.buff, make.pitch, zoomLevel);
   return make;
 }
 
 
+const ZOOM_FILTERS = ['nearest', 'scanlines', 'crt', 'sharp'];
+
+function isZoomFilter(filter) {
+  return ZOOM_FILTERS.indexOf(filter) != -1;
+}
+
+// Scale a surface to fill a target surface that was allocated ahead of
+// time. 'nearest' repeats pixels, 'scanlines' darkens the last row of each
+// pixel, 'crt' adds a shadow mask to that, and 'sharp' is bilinear only at
+// the edges between pixels. Sizes that are not a whole multiple of the
+// source are always 'sharp'
+function scaleSurface(source, target, filter) {
+  filter = filter || 'nearest';
+  if (!isZoomFilter(filter)) {
+    throw new Error(`unknown zoom filter: ${filter}`);
+  }
+  let zoom = Math.floor(target.width / source.width);
+  if (filter == 'sharp' || !(zoom >= 1) ||
+      target.width != source.width * zoom ||
+      target.height != source.height * zoom) {
+    kernels.scaleSharpBilinear(source.buff, source.pitch,
+                               source.width, source.height,
+                               target.buff, target.pitch,
+                               target.width, target.height);
+  } else if (filter == 'nearest') {
+    kernels.scaleNearest(source.buff, source.pitch,
+                         source.width, source.height,
+                         target.buff, target.pitch, zoom);
+  } else {
+    kernels.scaleScanlines(source.buff, source.pitch,
+                           source.width, source.height,
+                           target.buff, target.pitch, zoom, filter == 'crt');
+  }
+  return target;
+}
+
+
 function makeSurface(width, height) {
   width = Math.floor(width);
   height = Math.floor(height);
@@ -249,33 +299,13 @@ function _blend(mine, their, opacity) {
 }
 
 
-function readRGBAColor(surface, x, y) {
-  let k = y*surface.pitch + x*4;
-  let r = surface.buff[k+0];
-  let g = surface.buff[k+1];
-  let b = surface.buff[k+2];
-  let a = surface.buff[k+3];
-  return [r, g, b, a];
-}
-
-
-function writeRGBAColor(surface, x, y, rgba) {
-  let k = y*surface.pitch + x*4;
-  surface.buff[k+0] = rgba[0];
-  surface.buff[k+1] = rgba[1];
-  surface.buff[k+2] = rgba[2];
-  surface.buff[k+3] = rgba[3];
-}
-
-
-function renderLine(field, x0, y0, x1, y1, connectCorners) {
+function renderLine(field, x0, y0, x1, y1, connectCorners, put) {
   if (!types.isInteger(x0) || !types.isInteger(y0) ||
       !types.isInteger(x1) || !types.isInteger(y1)) {
-    return renderLineFloat(field, x0, y0, x1, y1);
+    return renderLineFloat(field, x0, y0, x1, y1, put);
   }
 
   // Integer based line drawing
-  let put = [];
   let deltax = x1 - x0;
   let deltay = y1 - y0;
 
@@ -305,7 +335,7 @@ function renderLine(field, x0, y0, x1, y1, connectCorners) {
     for (let x = x0; x <= x1; x++) {
       // Draw a pixel
       if (x >= 0 && x < field.width && y >= 0 && y < field.height) {
-        put.push([x, y]);
+        put.point(x, y);
       }
 
       if (dist > 0) {
@@ -343,7 +373,7 @@ function renderLine(field, x0, y0, x1, y1, connectCorners) {
     for (let y = y0; y <= y1; y++) {
       // Draw a pixel
       if (x >= 0 && x < field.width && y >= 0 && y < field.height) {
-        put.push([x, y]);
+        put.point(x, y);
       }
 
       if (dist > 0) {
@@ -361,8 +391,7 @@ function renderLine(field, x0, y0, x1, y1, connectCorners) {
   return put;
 }
 
-function renderLineFloat(field, x0, y0, x1, y1) {
-  let put = [];
+function renderLineFloat(field, x0, y0, x1, y1, put) {
   let deltax = x1 - x0;
   let deltay = y1 - y0;
   let slope = deltay / deltax;
@@ -398,7 +427,7 @@ function renderLineFloat(field, x0, y0, x1, y1) {
         // Handle rounding depending on the torque of the line draw.
         y -= 1;
       }
-      put.push([x, y]);
+      put.point(x, y);
     }
   } else {
     if (deltay < 0) {
@@ -429,7 +458,7 @@ function renderLineFloat(field, x0, y0, x1, y1) {
         // Handle rounding depending on the torque of the line draw.
         x -= 1;
       }
-      put.push([x, y]);
+      put.point(x, y);
     }
   }
 
@@ -440,7 +469,7 @@ function fract(n) {
   return n - Math.floor(n);
 }
 
-function renderPolygon(field, baseX, baseY, inPoints, fill) {
+function renderPolygon(field, baseX, baseY, inPoints, fill, put) {
   let isPixelPoly = types.isInteger(baseX) && types.isInteger(baseY);
   let points = [];
   for (let p of inPoints) {
@@ -450,9 +479,9 @@ function renderPolygon(field, baseX, baseY, inPoints, fill) {
     points.push({x: p[0] + baseX, y: p[1] + baseY});
   }
   if (fill) {
-    return renderPolygonFill(field, points, isPixelPoly);
+    return renderPolygonFill(field, points, isPixelPoly, put);
   } else {
-    return renderPolygonOutline(field, points, isPixelPoly);
+    return renderPolygonOutline(field, points, put);
   }
 }
 
@@ -464,8 +493,7 @@ function asFloats(points) {
   return result;
 }
 
-function renderPolygonFill(field, inPoints, isPixelPoly) {
-  let put = [];
+function renderPolygonFill(field, inPoints, isPixelPoly, put) {
   let edgeX = [];
   let edgeDir = [];
   let pixelX, pixelY;
@@ -580,8 +608,8 @@ function renderPolygonFill(field, inPoints, isPixelPoly) {
       }
     }
 
-    // Fill the pixels between the edges.
-    for (i = 0; i < edgeX.length; i += 2) {
+    // Fill the pixels between the edges. An odd edge out has no pair.
+    for (i = 0; i + 1 < edgeX.length; i += 2) {
       let x0 = Math.floor(edgeX[i]);
       let x1 = Math.floor(edgeX[i+1]);
       if (x0 < 0) {
@@ -591,18 +619,15 @@ function renderPolygonFill(field, inPoints, isPixelPoly) {
         x1 = field.width - 1;
       }
       let y = Math.floor(pixelY);
-      put.push([x0, x1, y, y]);
+      put.range(x0, x1, y, y);
     }
   }
 
   // TODO: Handle fractional edges such that this call isn't needed.
-  let res = renderPolygonOutline(field, inPoints);
-  put = put.concat(res);
-  return put;
+  return renderPolygonOutline(field, inPoints, put);
 }
 
-function renderPolygonOutline(field, points) {
-  let put = [];
+function renderPolygonOutline(field, points, put) {
   let i, j;
 
   for (i = 0; i < points.length; i++) {
@@ -613,15 +638,13 @@ function renderPolygonOutline(field, points) {
     }
     let p = points[i];
     let q = points[j];
-    let res = renderLine(field, p.x, p.y, q.x, q.y, false);
-    put = put.concat(res);
+    renderLine(field, p.x, p.y, q.x, q.y, false, put);
   }
 
   return put;
 }
 
-function renderCircle(x, y, points, inner, fill, half) {
-  let put = [];
+function renderCircle(x, y, points, inner, fill, half, put) {
 
   // Num points will always be assigned, but num inner is optional.
   let numInner = inner ? inner.length : -1;
@@ -717,16 +740,16 @@ function renderCircle(x, y, points, inner, fill, half) {
     //             /   |   \
     //            5    |    6
 
-    put.push([x + fars,  x + farl,  y + nearc, y + nearc]); // 0
-    put.push([x + fars,  x + farl,  y + farc , y + farc ]); // 7
-    put.push([x + nears, x + nearl, y + nearc, y + nearc]); // 3
-    put.push([x + nears, x + nearl, y + farc , y + farc ]); // 4
+    put.range(x + fars,  x + farl,  y + nearc, y + nearc); // 0
+    put.range(x + fars,  x + farl,  y + farc , y + farc ); // 7
+    put.range(x + nears, x + nearl, y + nearc, y + nearc); // 3
+    put.range(x + nears, x + nearl, y + farc , y + farc ); // 4
 
     // The octants with x-crosses and y-stretchs
-    put.push([x + farc,  x + farc,  y + nears, y + nearl]); // 1
-    put.push([x + nearc, x + nearc, y + nears, y + nearl]); // 2
-    put.push([x + farc,  x + farc,  y + fars,  y + farl ]); // 6
-    put.push([x + nearc, x + nearc, y + fars,  y + farl ]); // 5
+    put.range(x + farc,  x + farc,  y + nears, y + nearl); // 1
+    put.range(x + nearc, x + nearc, y + nears, y + nearl); // 2
+    put.range(x + farc,  x + farc,  y + fars,  y + farl ); // 6
+    put.range(x + nearc, x + nearc, y + fars,  y + farl ); // 5
   }
   return put;
 }
@@ -738,8 +761,12 @@ module.exports.midpointCircleRasterize = midpointCircleRasterize;
 module.exports.sortByHSV = sortByHSV;
 module.exports.isHalfwayValue = isHalfwayValue;
 module.exports.flood = flood;
+module.exports.Ranges = Ranges;
+module.exports.sharedRanges = sharedRanges;
 module.exports.nearestNeighbor = nearestNeighbor;
 module.exports.nearestNeighborSurface = nearestNeighborSurface;
+module.exports.scaleSurface = scaleSurface;
+module.exports.isZoomFilter = isZoomFilter;
 module.exports.makeSurface = makeSurface;
 module.exports.mergeIntoSurface = mergeIntoSurface;
 module.exports.rgbToHSV = rgbToHSV;
@@ -28,6 +28,12 @@ class BaseDisplay {
     this._zoomLevel = zoomLevel;
   }
 
+  // How displays that zoom in software scale each frame, see
+  // algorithm.scaleSurface
+  setZoomFilter(filter) {
+    this._zoomFilter = filter;
+  }
+
   setGrid(unit) {
     this._gridUnit = unit;
   }
@@ -43,21 +43,30 @@ class Colorspace extends component.Component {
       throw new Error(`Colorspace's cell_height must be > 0`);
     }
 
+    let rows;
     if (types.isField(source)) {
       this.pitch = source.pitch;
-      this._table = source.toArrays();
+      rows = source.toArrays();
       this.width = source.width;
       this.height = source.height;
     } else if (types.isArray(source)) {
       let res = makeColorspaceContent(source);
       this.pitch = res.pitch;
-      this._table = res.table;
+      rows = res.table;
       this.width = res.width;
       this.height = res.height;
     } else {
       throw new Error(`Colorspace expects a Field as an argument`);
     }
 
+    // Attribute of each cell, row by row. A value >= 0 is a palette piece,
+    // otherwise the cell has its own palette entries, at `_lists[-1 - v]`
+    this._attrs = new Int32Array(this.pitch * this.height);
+    this._lists = [];
+    this._version = 0;
+    this._compiled = null;
+    this.fillPattern(rows);
+
     this._sizeInfo = sizeInfo;
     return this;
   }
@@ -80,22 +89,33 @@ class Colorspace extends component.Component {
   }
 
   get(x, y) {
-    return this._table[y][x];
+    let v = this._attrs[y*this.pitch + x];
+    if (v < 0) {
+      return this._lists[-1 - v];
+    }
+    return v;
   }
 
   put(x, y, v) {
-    this._table[y][x] = v;
+    let k = y*this.pitch + x;
+    if (types.isArray(v)) {
+      // Reuse the cell's list if it already has one
+      let prev = this._attrs[k];
+      let n = prev < 0 ? -1 - prev : this._lists.length;
+      this._lists[n] = v.slice();
+      this._attrs[k] = -1 - n;
+    } else {
+      this._attrs[k] = v || 0;
+    }
+    this._version++;
   }
 
   fill(v) {
     if (!types.isNumber(v)) { throw new Error(`fill needs number`); }
     v = Math.floor(v);
-    for (let y = 0; y < this.height; y++) {
-      let row = this._table[y];
-      for (let x = 0; x < row.length; x++) {
-        row[x] = v;
-      }
-    }
+    this._attrs.fill(v);
+    this._lists = [];
+    this._version++;
   }
 
   fillPattern(args) {
@@ -262,14 +282,79 @@ class Colorspace extends component.Component {
         tile.data[k] = palette.relocateColorTo(c, pieceNum, pieceSize)
       }
     }
+    tile.addDamage(0, 0, tile.width, tile.height);
   }
 
   realizeIndexedColor(c, x, y) {
     let cellX = Math.floor(x / this._sizeInfo.cell_width);
     let cellY = Math.floor(y / this._sizeInfo.cell_height);
-    let pieceSize = this._sizeInfo.piece_size;
-    let choice = this.get(cellX, cellY);
-    return (c % pieceSize) + (choice * pieceSize);
+    let v = this._attrs[cellY*this.pitch + cellX];
+    if (v < 0) {
+      let entries = this._lists[-1 - v];
+      return entries[c % entries.length];
+    }
+    let pieceSize = this._getPieceSize();
+    return (c % pieceSize) + (v * pieceSize);
+  }
+
+  /**
+   * compile the attribute table into the flat form used by the
+   * rasterizeCells kernel. Only rebuilt after the colorspace changes
+   * @returns {object} attrs, an Int32Array of each cell's attribute, a piece
+   *     number if >= 0, otherwise -1 - the index of its palette entries.
+   *     The entries of list n are lists[listStarts[n]..listStarts[n+1]].
+   *     fitsLUT is true if every color it produces is in 0..255
+   */
+  compile() {
+    let compiled = this._compiled;
+    if (compiled && compiled.version == this._version) {
+      return compiled;
+    }
+    let pieceSize = this._getPieceSize();
+    let listStarts = new Int32Array(this._lists.length + 1);
+    let total = 0;
+    for (let n = 0; n < this._lists.length; n++) {
+      listStarts[n] = total;
+      total += this._lists[n].length;
+    }
+    listStarts[this._lists.length] = total;
+    let lists = new Int32Array(total);
+    let fitsLUT = true;
+    for (let n = 0; n < this._lists.length; n++) {
+      let entries = this._lists[n];
+      if (entries.length == 0) {
+        fitsLUT = false;
+      }
+      for (let i = 0; i < entries.length; i++) {
+        let e = entries[i];
+        if (!(e >= 0 && e < 256)) {
+          fitsLUT = false;
+        }
+        lists[listStarts[n] + i] = e;
+      }
+    }
+    let maxPiece = 0;
+    for (let k = 0; k < this._attrs.length; k++) {
+      maxPiece = Math.max(maxPiece, this._attrs[k]);
+    }
+    if ((maxPiece + 1) * pieceSize > 256) {
+      fitsLUT = false;
+    }
+    compiled = {
+      attrs: this._attrs,
+      pitch: this.pitch,
+      width: this.width,
+      height: this.height,
+      cellWidth: this._sizeInfo.cell_width,
+      cellHeight: this._sizeInfo.cell_height,
+      pieceSize: pieceSize,
+      lists: lists,
+      listStarts: listStarts,
+      fitsLUT: fitsLUT,
+      version: this._version,
+    };
+    this._compiled = compiled;
+    return compiled;
   }
 
   visualize() {
@@ -1,34 +1,70 @@
 const algorithm = require('./algorithm');
+const kernels = require('./kernels.js');
 
 
+// Blends the layers of a frame into one surface, for displays that have no
+// way to layer them. With a zoom, the layers are blended at their own size
+// and the result is scaled once, into a surface that is kept between frames
 class Compositor {
   constructor() {
     this._create = null;
+    this._base = null;
   }
 
-  combine(surfaceList, width, height, zoomLevel) {
-    let totalWidth = width * zoomLevel;
-    let totalHeight = height * zoomLevel;
-    if (this._create == null) {
-      this._create = algorithm.makeSurface(totalWidth, totalHeight);
-    }
+  combine(surfaceList, width, height, zoomLevel, filter) {
+    zoomLevel = zoomLevel || 1;
+    this._create = this._ensureSize(this._create, width * zoomLevel,
+                                    height * zoomLevel);
 
+    let layers = [];
     for (let i = 0; i < surfaceList.length; i++) {
       let surface = surfaceList[i];
-      if (surface == null) {
+      if (surface == null || surface.visible === false) {
         continue;
-      } else if (zoomLevel > 1) {
-        surface = algorithm.nearestNeighborSurface(surface, zoomLevel);
       }
-      algorithm.mergeIntoSurface(this._create, surface);
+      layers.push(surface);
+    }
+
+    if (zoomLevel == 1) {
+      this._blend(this._create, layers);
+    } else {
+      this._base = this._ensureSize(this._base, width, height);
+      this._blend(this._base, layers);
+      algorithm.scaleSurface(this._base, this._create, filter);
     }
-    let surface = surfaceList.grid;
-    if (surface) {
-      algorithm.mergeIntoSurface(this._create, surface);
+
+    // The grid is drawn at the final size, so it stays thin
+    let grid = surfaceList.grid;
+    if (grid) {
+      this._blend(this._create, [grid]);
     }
 
     return [this._create];
   }
+
+  _ensureSize(surface, width, height) {
+    if (surface == null || surface.width != width ||
+        surface.height != height) {
+      surface = algorithm.makeSurface(width, height);
+    }
+    return surface;
+  }
+
+  _blend(dest, layers) {
+    for (let layer of layers) {
+      this._ensureCompatible(dest, layer);
+    }
+    kernels.compositeSurfaces(dest, layers);
+  }
+
+  _ensureCompatible(dest, sour) {
+    if (dest.width != sour.width) {
+      throw new Error(`cannot merge incompatible layers, dest.width=${dest.width} <> source.width=${sour.width}`);
+    }
+    if (dest.height != sour.height) {
+      throw new Error(`cannot merge incompatible layers, dest.height=${dest.height} <> source.height=${sour.height}`);
+    }
+  }
 }
 
 
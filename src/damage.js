@@ -0,0 +1,88 @@
+// After this many separate rects, merge them all into their bounding box
+const MAX_RECTS = 16;
+
+// Source of serials, unique across every Damage
+let g_serial = 0;
+
+// Damage collects the rectangles of a field that have been modified since
+// the renderer last took them, so only those need to be rasterized again.
+//
+// The serial changes with every modification, and is not reset by take, so
+// any number of readers can each tell whether the field changed since they
+// last looked, without taking the rects from one another.
+class Damage {
+  constructor() {
+    this.serial = ++g_serial;
+    this.clear();
+  }
+
+  clear() {
+    this.rects = [];
+    this.isFull = false;
+  }
+
+  addAll() {
+    this.rects = [];
+    this.isFull = true;
+    this.serial = ++g_serial;
+  }
+
+  add(x, y, w, h) {
+    if (w <= 0 || h <= 0) {
+      return;
+    }
+    this.serial = ++g_serial;
+    if (this.isFull) {
+      return;
+    }
+    let rect = {x: x, y: y, w: w, h: h};
+    // Grow a rect that overlaps or is adjacent, instead of adding another
+    for (let r of this.rects) {
+      if (touches(r, rect)) {
+        unionInto(r, rect);
+        return;
+      }
+    }
+    this.rects.push(rect);
+    if (this.rects.length > MAX_RECTS) {
+      let bounds = this.rects[0];
+      for (let r of this.rects) {
+        unionInto(bounds, r);
+      }
+      this.rects = [bounds];
+    }
+  }
+
+  isEmpty() {
+    return !this.isFull && this.rects.length == 0;
+  }
+
+  take() {
+    let result = {rects: this.rects, isFull: this.isFull};
+    this.clear();
+    return result;
+  }
+}
+
+// Serial of the most recent modification to any Damage. While it stays the
+// same, no field has been modified
+function latestSerial() {
+  return g_serial;
+}
+
+function touches(a, b) {
+  return (a.x <= b.x + b.w && b.x <= a.x + a.w &&
+          a.y <= b.y + b.h && b.y <= a.y + a.h);
+}
+
+function unionInto(dest, other) {
+  let right = Math.max(dest.x + dest.w, other.x + other.w);
+  let bottom = Math.max(dest.y + dest.h, other.y + other.h);
+  dest.x = Math.min(dest.x, other.x);
+  dest.y = Math.min(dest.y, other.y);
+  dest.w = right - dest.x;
+  dest.h = bottom - dest.y;
+}
+
+module.exports.Damage = Damage;
+module.exports.latestSerial = latestSerial;
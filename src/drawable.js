@@ -53,8 +53,9 @@ class Drawable {
   drawLine(x0, y0, x1, y1, cc) {
     this._prepare();
     cc = cc ? 1 : 0;
-    let res = algorithm.renderLine(this, x0, y0, x1, y1, cc);
-    this.putSequence(res);
+    let res = algorithm.renderLine(this, x0, y0, x1, y1, cc,
+                                   algorithm.sharedRanges());
+    this.putRanges(res);
   }
 
   drawDot_params() { return ['x:i', 'y:i'] }
@@ -83,6 +84,7 @@ class Drawable {
         buffer[(y+top)*this.pitch+(x+left)] = dots[i][j];
       }
     }
+    this.addDamage(0, 0, this.width, this.height);
   }
 
   fillSquare_params() { return ['x:i', 'y:i', 'size:i'] }
@@ -129,8 +131,9 @@ class Drawable {
     let centerY = y + r;
     let arc = algorithm.midpointCircleRasterize(r);
     let half = algorithm.isHalfwayValue(r);
-    let put = algorithm.renderCircle(centerX, centerY, arc, null, true, half);
-    this.putSequence(put);
+    let put = algorithm.renderCircle(centerX, centerY, arc, null, true, half,
+                                     algorithm.sharedRanges());
+    this.putRanges(put);
   }
 
   drawCircle_params() { return ['x:i', 'y:i', 'r:n', 'thick?i', '||',
@@ -147,8 +150,9 @@ class Drawable {
       inner = algorithm.midpointCircleRasterize(r - thick + 1);
     }
     let half = algorithm.isHalfwayValue(r);
-    let put = algorithm.renderCircle(centerX, centerY, arc, inner, false, half);
-    this.putSequence(put);
+    let put = algorithm.renderCircle(centerX, centerY, arc, inner, false, half,
+                                     algorithm.sharedRanges());
+    this.putRanges(put);
   }
 
   fillPolygon_params() { return ['polygon:ps', 'x?i', 'y?i']; }
@@ -156,8 +160,9 @@ class Drawable {
     x = x || 0;
     y = y || 0;
     let points = geometry.convertToPoints(polygon);
-    let res = algorithm.renderPolygon(this, x, y, points, true);
-    this.putSequence(res);
+    let res = algorithm.renderPolygon(this, x, y, points, true,
+                                      algorithm.sharedRanges());
+    this.putRanges(res);
   }
 
   drawPolygon_params() { return ['polygon:ps', 'x?i', 'y?i'] }
@@ -165,8 +170,9 @@ class Drawable {
     x = x || 0;
     y = y || 0;
     let points = geometry.convertToPoints(polygon);
-    let res = algorithm.renderPolygon(this, x, y, points, false);
-    this.putSequence(res);
+    let res = algorithm.renderPolygon(this, x, y, points, false,
+                                      algorithm.sharedRanges());
+    this.putRanges(res);
   }
 
   fillFlood_params() { return ['x:i', 'y:i'] }
@@ -200,6 +206,7 @@ class Drawable {
     }
 
     this._prepare();
+    this.addDamage(0, 0, this.width, this.height);
     let buffer = this.data;
     let _replaceBuffer = null;
 
@@ -321,20 +328,20 @@ function _renderRect(self, x, y, w, h, fill) {
     y1 = tmp;
   }
 
-  let put = [];
+  let put = algorithm.sharedRanges();
   if (fill) {
     for (let n = y; n <= y1; n++) {
-      put.push([x, x1, n, n]);
+      put.range(x, x1, n, n);
     }
-    self.putSequence(put);
+    self.putRanges(put);
     return;
   }
 
-  put.push([ x, x1,  y,  y]); // top
-  put.push([ x, x1, y1, y1]); // bottom
-  put.push([ x,  x,  y, y1]); // left
-  put.push([x1, x1,  y, y1]); // right
-  self.putSequence(put);
+  put.range( x, x1,  y,  y); // top
+  put.range( x, x1, y1, y1); // bottom
+  put.range( x,  x,  y, y1); // left
+  put.range(x1, x1,  y, y1); // right
+  self.putRanges(put);
 }
 
 function newDrawableField(opt) {
@@ -1,7 +1,14 @@
 let listenableEvents = ['keypress', 'keydown', 'keyup', 'click',
+                        'mouseup', 'mousemove',
                         'ready', 'render', 'message', 'dipchange'];
 let generalEvents = ['ready', 'render', 'message', 'dipchange'];
 
+// Batches of native events hold these many values for each event: type,
+// code, x, y, timestamp. Types index into this list, see event_batch.h
+const NATIVE_EVENT_FIELDS = 5;
+const nativeEventNames = [null, 'keydown', 'keyup', 'click', 'mouseup',
+                          'mousemove'];
+
 
 class EventManager {
   constructor() {
@@ -9,15 +16,39 @@ class EventManager {
     this._pressKeys = {};
   }
 
+  // Dispatch each event of a batch from NativeDisplay, in the order they
+  // happened
+  getNativeBatch(batch) {
+    for (let k = 0; k + NATIVE_EVENT_FIELDS <= batch.length;
+         k += NATIVE_EVENT_FIELDS) {
+      let name = nativeEventNames[batch[k]];
+      let code = batch[k + 1];
+      let timestamp = batch[k + 4];
+      if (name == 'keydown' || name == 'keyup') {
+        this.getNativeKey(name, {code: code, timestamp: timestamp});
+      } else if (name) {
+        this.getNativeMouse(name, {basex: batch[k + 2], basey: batch[k + 3],
+                                   button: code, timestamp: timestamp});
+      } else {
+        throw new Error(`unknown native event type ${batch[k]}`);
+      }
+    }
+  }
+
   getNativeKey(name, event) {
     // called when an incoming key event has been generated by NativeDisplay
-    if (!event.code || Object.keys(event).length != 1) {
-      throw new Error(`native event should only have 'code' field`);
+    if (!event.code || !Object.keys(event).every(
+        (k) => k == 'code' || k == 'timestamp')) {
+      throw new Error(`native event should only have 'code' and ` +
+                      `'timestamp' fields`);
     }
     let e = {
       code: event.code,
       key: this.lookupKeyFromCode(event.code),
     };
+    if (event.timestamp != null) {
+      e.timestamp = event.timestamp;
+    }
     if (!e.key && e.code >= 0x20 && e.code < 0x80) {
       // Convert low codes into key characters.
       e.key = String.fromCharCode(e.code);
@@ -34,8 +65,9 @@ class EventManager {
     this._dispatch(name, e);
   }
 
-  getNativeClick(name, event) {
-    let handlerList = this._handlers['click'];
+  // Mouse events go to the first handler whose region they are inside
+  getNativeMouse(name, event) {
+    let handlerList = this._handlers[name];
     if (!handlerList) { return; }
     for (let handler of handlerList) {
       let [region, callback] = [handler.region, handler.callback];
@@ -54,7 +86,14 @@ class EventManager {
       if (posx < 0 || posy < 0 || posx >= width || posy >= height) {
         continue;
       }
-      callback({x: posx, y: posy});
+      let e = {x: posx, y: posy};
+      if (event.button != null) {
+        e.button = event.button;
+      }
+      if (event.timestamp != null) {
+        e.timestamp = event.timestamp;
+      }
+      callback(e);
       return;
     }
   }
@@ -1,3 +1,4 @@
+const types = require('./types.js');
 const weak = require('./weak.js');
 
 
@@ -16,6 +17,9 @@ class Executor {
     this.tick = 0;
     this._fpsPrevTime = null;
     this._lockTime = true; // TODO: fix me!
+    this._frameRate = 60;
+    this._pacing = 'catchup';
+    this.missedFrames = 0;
   }
 
   clear() {
@@ -27,7 +31,16 @@ class Executor {
     this.display.beginExec(new weak.Ref(this));
     let execNextFrame = this._execNextFrame.bind(this);
     this.display.beginLoop(renderID);
-    this.display.appLoop(renderID, ()=>{ return execNextFrame(drawFunc); });
+    this.display.appLoop(renderID, (missed)=>{
+      return execNextFrame(drawFunc, missed);
+    });
+  }
+
+  // Frames per second, and what to do with frames that miss their deadline,
+  // either 'catchup' to run them late, or 'skip' to drop them
+  setFrameRate(rate, pacing) {
+    this._frameRate = rate;
+    this._pacing = pacing || 'catchup';
   }
 
   setLockTime(state) {
@@ -47,13 +60,16 @@ class Executor {
     this.isPaused = !!state;
   }
 
-  _execNextFrame(drawFunc) {
+  _execNextFrame(drawFunc, missed) {
     if (this.isPaused && !this._forceRender) {
       return false;
     }
 
-    // frame skipping, allows us to lock the framerate at 60fps
-    if (!this._isReadyForNextFrame()) {
+    // A display that paces frames natively passes the number of frames it
+    // dropped. Otherwise, frame skipping locks the framerate
+    if (types.isNumber(missed)) {
+      this._dropFrames(missed);
+    } else if (!this._isReadyForNextFrame()) {
       return false;
     }
 
@@ -76,6 +92,19 @@ class Executor {
     return false;
   }
 
+  _dropFrames(missed) {
+    if (missed <= 0) {
+      return;
+    }
+    this.missedFrames += missed;
+    // Skipped frames still pass time, so that the app keeps up
+    if (this._pacing == 'skip' && !this.isPaused) {
+      for (let k = 0; k < missed; k++) {
+        this.advanceTick(1);
+      }
+    }
+  }
+
   _isReadyForNextFrame() {
     // if the display is not real-time, always ready for next frame
     if (!this.display.isRealTime()) {
@@ -86,9 +115,10 @@ class Executor {
     if (this._fpsPrevTime == null) {
       this._fpsPrevTime = this._startTime;
     }
+    let periodMs = 1000 / this._frameRate;
     let deltaMs = new Date() - this._fpsPrevTime;
-    if (deltaMs >= 13) {
-      this._fpsPrevTime = new Date(this._fpsPrevTime.getTime() + 16);
+    if (deltaMs >= periodMs * 0.8) {
+      this._fpsPrevTime = new Date(this._fpsPrevTime.getTime() + periodMs);
       return true;
     } else {
       return false;
@@ -110,7 +140,7 @@ class Executor {
     }
     this.tick += delta;
     if (this._lockTime) {
-      this.time = this.tick / 60.0;
+      this.time = this.tick / this._frameRate;
       // TODO: always lock the first N frames, to account for uncertainty
       // in start-up performance
     } else {
@@ -124,6 +154,7 @@ class Executor {
     let slowdown = scene.slowdown ?? 1.0;
     scene.time = this.time / slowdown;
     scene.tick = Math.floor(this.tick / slowdown);
+    scene.missedFrames = this.missedFrames;
     // TODO: allow period to be assigned
     scene.period = 60.0;
     scene.theta = (scene.tick % scene.period) / scene.period;
@@ -1,7 +1,9 @@
 const algorithm = require('./algorithm.js');
 const component = require('./component.js');
+const damage = require('./damage.js');
 const drawable = require('./drawable.js');
 const destructure = require('./destructure.js');
+const kernels = require('./kernels.js');
 const types = require('./types.js');
 
 class Field extends component.Component {
@@ -22,6 +24,7 @@ class Field extends component.Component {
     this.data = null;
     this.bgColor = 0;
     this.frontColor = 7;
+    this._damage = new damage.Damage();
   }
 
   clone() {
@@ -33,6 +36,8 @@ class Field extends component.Component {
     make.data = this.data;
     make.bgColor = this.bgColor;
     make.frontColor = this.frontColor;
+    // Clones share data, so writes to either one damage the same buffer
+    make._damage = this._damage;
     if (this.cloneHook) {
       this.cloneHook(make);
     }
@@ -71,6 +76,30 @@ class Field extends component.Component {
     this._prepare();
   }
 
+  // Record that a rect of the field has been modified. Anything that writes
+  // to `data` directly needs to call this, so the renderer can see it
+  addDamage(x, y, w, h) {
+    let left = this.offsetLeft || 0;
+    let top = this.offsetTop || 0;
+    this._damage.add(left + x, top + y, w, h);
+  }
+
+  // Get the rects modified since the last call, in data coordinates, and
+  // clear them. Returns null if the modifications can't be tracked
+  takeDamage() {
+    return this._damage.take();
+  }
+
+  hasDamage() {
+    return !this._damage.isEmpty();
+  }
+
+  // Changes whenever the field is modified, and is left as is by
+  // takeDamage, see Damage.serial
+  damageSerial() {
+    return this._damage.serial;
+  }
+
   setSize(w, h) {
     // TODO: use destructure.from
     if (h === undefined) {
@@ -105,6 +134,7 @@ class Field extends component.Component {
       this.data[k] = c;
     }
     this._needErase = false;
+    this._damage.addAll();
   }
 
   get(x, y) {
@@ -133,6 +163,7 @@ class Field extends component.Component {
     }
     let k = y * this.pitch + x;
     this.data[this._offs + k] = Math.floor(v);
+    this.addDamage(x, y, 1, 1);
   }
 
   fill(v) {
@@ -151,6 +182,7 @@ class Field extends component.Component {
       for (let k = 0; k < this.data.length; k++) {
         this.data[k] = Math.floor(v);
       }
+      this._damage.addAll();
       return;
     }
     throw new Error(`field.fill needs array or number, got ${v}`);
@@ -223,6 +255,8 @@ class Field extends component.Component {
     this._offs = this.offsetTop * this.pitch + this.offsetLeft || 0;
     // Get the current color
     let c = this.frontColor;
+    // Bounding box of everything put
+    let minX = this.width, minY = this.height, maxX = -1, maxY = -1;
     // Each sequence
     for (let i = 0; i < seq.length; i++) {
       let elem = seq[i];
@@ -236,6 +270,10 @@ class Field extends component.Component {
         let k = y * this.pitch + x;
         // TODO: Add offsets
         this.data[this._offs + k] = c;
+        minX = Math.min(minX, x);
+        maxX = Math.max(maxX, x);
+        minY = Math.min(minY, y);
+        maxY = Math.max(maxY, y);
       } else if (elem.length == 4) {
         // Sequnce of length 4 is a range
         let x0 = Math.floor(elem[0]);
@@ -270,6 +308,10 @@ class Field extends component.Component {
             // TODO: Add offsets
             this.data[this._offs + k] = c;
           }
+          minX = Math.min(minX, x0);
+          maxX = Math.max(maxX, x0);
+          minY = Math.min(minY, y0);
+          maxY = Math.max(maxY, y1);
         } else if (y0 == y1) {
           if (y0 < 0 || y1 >= this.height) {
             continue;
@@ -286,9 +328,26 @@ class Field extends component.Component {
             // TODO: Add offsets
             this.data[this._offs + k] = c;
           }
+          minX = Math.min(minX, x0);
+          maxX = Math.max(maxX, x1);
+          minY = Math.min(minY, y0);
+          maxY = Math.max(maxY, y0);
         }
       }
     }
+    this.addDamage(minX, minY, maxX - minX + 1, maxY - minY + 1);
+  }
+
+  // Write the current color to the ranges collected by an algorithm.Ranges
+  putRanges(ranges) {
+    this._prepare();
+    let offs = this.offsetTop * this.pitch + this.offsetLeft || 0;
+    let b = ranges.bounds;
+    kernels.fillRanges(this.data, this.pitch, offs, this.width, this.height,
+                       ranges.data, ranges.length, this.frontColor, b);
+    if (b[2] >= b[0]) {
+      this.addDamage(b[0], b[1], b[2] - b[0] + 1, b[3] - b[1] + 1);
+    }
   }
 
   putBlit(img, baseX, baseY) {
@@ -325,6 +384,8 @@ class Field extends component.Component {
         }
       }
     }
+    // baseX and baseY already include the offset
+    this._damage.add(baseX, baseY, imageWidth, imageHeight);
   }
 
   select(x, y, w, h, name) {
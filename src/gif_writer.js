@@ -0,0 +1,364 @@
+const fs = require('fs');
+const nativeAddon = require('./native_addon.js');
+
+const RGB_PIXEL_SIZE = 4;
+const MAX_COLORS = 256;
+const MAX_CODES = 4096;
+const MAX_SUBBLOCK = 255;
+
+// Encodes RGBA frames as an animated gif, without quantizing them.
+//
+// The global color table starts with the seed colors, normally the scene's
+// palette, then gets any other colors of the first frame. A frame whose
+// colors are not all in that table gets a local table of its own colors,
+// or when it has over 256, the nearest colors of the global table.
+//
+// After the first frame, only the rect that changed since the previous frame
+// is encoded, and pixels inside of it that did not change are transparent,
+// as long as the table has room for a transparent index.
+//
+// The native addon's GifWriter uses the same format byte for byte.
+class GifEncoder {
+  constructor(width, height, seedColors, delayCs, writeFunc) {
+    this.width = width;
+    this.height = height;
+    this._seed = seedColors || [];
+    this._delayCs = delayCs;
+    this._write = writeFunc;
+    this._global = null;
+    this._prev = null;
+  }
+
+  addFrame(surface) {
+    let rgb = toRGBList(surface, this.width, this.height);
+    if (this._global == null) {
+      this._global = new ColorTable(this._seed);
+      this._global.addAll(rgb, 0, 0, this.width, this.height, this.width);
+      this._writeHeader();
+    }
+
+    // Find the rect that changed, a frame with no changes still takes up
+    // time, so it draws a single pixel
+    let rect = {x: 0, y: 0, w: this.width, h: this.height};
+    if (this._prev) {
+      rect = changedRect(this._prev, rgb, this.width, this.height);
+      if (rect == null) {
+        rect = {x: 0, y: 0, w: 1, h: 1};
+      }
+    }
+
+    let table = this._global;
+    let isLocal = false;
+    if (!table.hasAll(rgb, rect, this.width)) {
+      let local = new ColorTable([]);
+      if (local.addAll(rgb, rect.x, rect.y, rect.w, rect.h, this.width)) {
+        table = local;
+        isLocal = true;
+      }
+    }
+    let transIndex = -1;
+    if (this._prev && table.size() < MAX_COLORS) {
+      transIndex = table.size();
+    }
+
+    let indexes = new Uint8Array(rect.w * rect.h);
+    let k = 0;
+    for (let y = rect.y; y < rect.y + rect.h; y++) {
+      for (let x = rect.x; x < rect.x + rect.w; x++) {
+        let n = y * this.width + x;
+        if (transIndex >= 0 && this._prev[n] == rgb[n]) {
+          indexes[k++] = transIndex;
+        } else {
+          indexes[k++] = table.lookup(rgb[n]);
+        }
+      }
+    }
+
+    // graphic control extension, leave the frame in place when done
+    let packed = (1 << 2) | (transIndex >= 0 ? 1 : 0);
+    this._write([0x21, 0xf9, 0x04, packed,
+                 this._delayCs & 0xff, (this._delayCs >> 8) & 0xff,
+                 transIndex >= 0 ? transIndex : 0, 0x00]);
+    // image descriptor
+    let bits = table.bits();
+    this._write([0x2c,
+                 rect.x & 0xff, rect.x >> 8, rect.y & 0xff, rect.y >> 8,
+                 rect.w & 0xff, rect.w >> 8, rect.h & 0xff, rect.h >> 8,
+                 isLocal ? (0x80 | (bits - 1)) : 0x00]);
+    if (isLocal) {
+      this._write(table.serialize());
+    }
+    this._write(lzwEncode(indexes, Math.max(2, bits)));
+    this._prev = rgb;
+  }
+
+  finish() {
+    if (this._global == null) {
+      this._global = new ColorTable(this._seed);
+      this._writeHeader();
+    }
+    this._write([0x3b]);
+  }
+
+  _writeHeader() {
+    let bits = this._global.bits();
+    this._write([0x47, 0x49, 0x46, 0x38, 0x39, 0x61, // GIF89a
+                 this.width & 0xff, this.width >> 8,
+                 this.height & 0xff, this.height >> 8,
+                 0x80 | (7 << 4) | (bits - 1), 0x00, 0x00]);
+    this._write(this._global.serialize());
+    // loop forever
+    this._write([0x21, 0xff, 0x0b,
+                 0x4e, 0x45, 0x54, 0x53, 0x43, 0x41, 0x50, 0x45, // NETSCAPE
+                 0x32, 0x2e, 0x30, // 2.0
+                 0x03, 0x01, 0x00, 0x00, 0x00]);
+  }
+}
+
+
+class ColorTable {
+  constructor(colors) {
+    this._colors = [];
+    this._index = new Map();
+    for (let c of colors) {
+      if (this._colors.length == MAX_COLORS) {
+        break;
+      }
+      this._add(c & 0xffffff);
+    }
+  }
+
+  _add(c) {
+    if (!this._index.has(c)) {
+      this._index.set(c, this._colors.length);
+      this._colors.push(c);
+    }
+  }
+
+  // Add colors of the rect in order, returns false if they did not all fit
+  addAll(rgb, left, top, width, height, pitch) {
+    for (let y = top; y < top + height; y++) {
+      for (let x = left; x < left + width; x++) {
+        let c = rgb[y * pitch + x];
+        if (this._index.has(c)) {
+          continue;
+        }
+        if (this._colors.length == MAX_COLORS) {
+          return false;
+        }
+        this._add(c);
+      }
+    }
+    return true;
+  }
+
+  hasAll(rgb, rect, pitch) {
+    for (let y = rect.y; y < rect.y + rect.h; y++) {
+      for (let x = rect.x; x < rect.x + rect.w; x++) {
+        if (!this._index.has(rgb[y * pitch + x])) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  size() {
+    return this._colors.length;
+  }
+
+  // Exact index of the color, otherwise the nearest one
+  lookup(c) {
+    let n = this._index.get(c);
+    if (n !== undefined) {
+      return n;
+    }
+    let best = 0;
+    let bestDist = Infinity;
+    for (let i = 0; i < this._colors.length; i++) {
+      let dist = colorDistance(c, this._colors[i]);
+      if (dist < bestDist) {
+        best = i;
+        bestDist = dist;
+      }
+    }
+    return best;
+  }
+
+  // Bits per index, with room for a transparent index after the colors
+  bits() {
+    let need = Math.min(MAX_COLORS, this._colors.length + 1);
+    let bits = 1;
+    while ((1 << bits) < need) {
+      bits++;
+    }
+    return bits;
+  }
+
+  serialize() {
+    let count = 1 << this.bits();
+    let bytes = new Uint8Array(count * 3);
+    for (let i = 0; i < this._colors.length; i++) {
+      bytes[i*3+0] = (this._colors[i] >> 16) & 0xff;
+      bytes[i*3+1] = (this._colors[i] >> 8) & 0xff;
+      bytes[i*3+2] = this._colors[i] & 0xff;
+    }
+    return bytes;
+  }
+}
+
+
+function toRGBList(surface, width, height) {
+  let rgb = new Int32Array(width * height);
+  let buff = surface.buff;
+  for (let y = 0; y < height; y++) {
+    let s = y * surface.pitch;
+    for (let x = 0; x < width; x++) {
+      let k = s + x * RGB_PIXEL_SIZE;
+      rgb[y * width + x] = (buff[k] << 16) | (buff[k+1] << 8) | buff[k+2];
+    }
+  }
+  return rgb;
+}
+
+
+function changedRect(prev, rgb, width, height) {
+  let left = width, top = height, right = -1, bottom = -1;
+  for (let y = 0; y < height; y++) {
+    for (let x = 0; x < width; x++) {
+      let n = y * width + x;
+      if (prev[n] != rgb[n]) {
+        left = Math.min(left, x);
+        right = Math.max(right, x);
+        top = Math.min(top, y);
+        bottom = Math.max(bottom, y);
+      }
+    }
+  }
+  if (right < 0) {
+    return null;
+  }
+  return {x: left, y: top, w: right - left + 1, h: bottom - top + 1};
+}
+
+
+function colorDistance(a, b) {
+  let dr = ((a >> 16) & 0xff) - ((b >> 16) & 0xff);
+  let dg = ((a >> 8) & 0xff) - ((b >> 8) & 0xff);
+  let db = (a & 0xff) - (b & 0xff);
+  return dr*dr + dg*dg + db*db;
+}
+
+
+// Compress indexes with gif's variable-width LZW, as data sub-blocks,
+// preceded by the minimum code size
+function lzwEncode(indexes, minCodeSize) {
+  let out = [minCodeSize];
+  let block = [];
+  let accum = 0;
+  let numBits = 0;
+  let emit = (code, size) => {
+    accum |= code << numBits;
+    numBits += size;
+    while (numBits >= 8) {
+      block.push(accum & 0xff);
+      accum >>= 8;
+      numBits -= 8;
+      if (block.length == MAX_SUBBLOCK) {
+        out.push(MAX_SUBBLOCK, ...block);
+        block = [];
+      }
+    }
+  };
+
+  let clearCode = 1 << minCodeSize;
+  let eoiCode = clearCode + 1;
+  let nextCode = eoiCode + 1;
+  let codeSize = minCodeSize + 1;
+  let table = new Map();
+
+  emit(clearCode, codeSize);
+  let prefix = indexes[0];
+  for (let i = 1; i < indexes.length; i++) {
+    let k = indexes[i];
+    let key = (prefix << 8) | k;
+    let code = table.get(key);
+    if (code !== undefined) {
+      prefix = code;
+      continue;
+    }
+    emit(prefix, codeSize);
+    if (nextCode == MAX_CODES) {
+      // Table is full, start over
+      emit(clearCode, codeSize);
+      nextCode = eoiCode + 1;
+      codeSize = minCodeSize + 1;
+      table.clear();
+    } else {
+      if (nextCode >= (1 << codeSize)) {
+        codeSize++;
+      }
+      table.set(key, nextCode++);
+    }
+    prefix = k;
+  }
+  emit(prefix, codeSize);
+  // The decoder adds its last entry upon reading that code, which may widen
+  // the code that follows
+  if (nextCode == (1 << codeSize) && codeSize < 12) {
+    codeSize++;
+  }
+  emit(eoiCode, codeSize);
+  if (numBits > 0) {
+    emit(0, 8 - numBits);
+  }
+  if (block.length > 0) {
+    out.push(block.length, ...block);
+  }
+  out.push(0);
+  return out;
+}
+
+
+// Writes an animated gif to a file, one frame at a time. The native addon
+// encodes and writes on a background thread, otherwise each frame is
+// written before addFrame returns.
+class GifWriter {
+  constructor(filename, width, height, seedColors, delayCs) {
+    this._native = null;
+    if (nativeAddon && nativeAddon.GifWriter) {
+      this._native = new nativeAddon.GifWriter(filename, width, height,
+                                               seedColors, delayCs);
+      return;
+    }
+    this._fd = fs.openSync(filename, 'w');
+    this._enc = new GifEncoder(width, height, seedColors, delayCs, (bytes) => {
+      fs.writeSync(this._fd, Uint8Array.from(bytes));
+    });
+  }
+
+  // The surface can be reused as soon as this returns
+  addFrame(surface) {
+    if (this._native) {
+      this._native.addFrame(surface);
+      return;
+    }
+    this._enc.addFrame(surface);
+  }
+
+  finish() {
+    if (this._native) {
+      let error = this._native.finish();
+      if (error) {
+        throw new Error(`saving gif failed: ${error}`);
+      }
+      return;
+    }
+    this._enc.finish();
+    fs.closeSync(this._fd);
+  }
+}
+
+
+module.exports.GifEncoder = GifEncoder;
+module.exports.GifWriter = GifWriter;
@@ -1,4 +1,5 @@
 const baseDisplay = require('./base_display.js');
+const compositor = require('./compositor.js');
 const http = require('http');
 const PNG = require('pngjs').PNG;
 const PORT = 8444;
@@ -11,6 +12,7 @@ class HTTPDisplay extends baseDisplay.BaseDisplay {
 
   initialize() {
     this._image = null;
+    this._comp = new compositor.Compositor();
   }
 
   name() {
@@ -34,7 +36,9 @@ class HTTPDisplay extends baseDisplay.BaseDisplay {
     if (!this._image) {
       this.nextFrame();
       let renderedLayers = this.renderer.render();
-      let surf = renderedLayers[0];
+      let zoom = this._zoomLevel || 1;
+      let surf = this._comp.combine(renderedLayers, this._width, this._height,
+                                    zoom, this._zoomFilter)[0];
       this._image = {
         width: surf.width,
         height: surf.height,
@@ -51,6 +51,11 @@ class ImageField extends field.Field {
     this.fillData();
   }
 
+  takeDamage() {
+    // Data is filled again each time it is resolved, so it is all modified
+    return null;
+  }
+
   select(x, y, w, h) {
     let make = new ImageField();
     make.refLoader = this.refLoader;
@@ -10,17 +10,32 @@ const types = require('./types.js');
 // By default, regions are stacked vertically, and scanlines are equivalent
 // to the y-position. If a scanline is a range, the irq is called for each
 // scanline in that range, passing the scanline number as the argument.
+//
+// The renderer walks a compiled schedule, with one entry per scanline that
+// has an irq. It is built again only after `arr` is assigned, shiftDown is
+// called, or an element's scanline or irq is changed.
 class Interrupts extends component.Component {
   constructor(arr, refScene) {
     super();
+    this._version = 0;
+    this._schedule = null;
     this.arr = arr;
     this.xposTrack = null;
-    this.length = this.arr.length;
     this.refScene = refScene;
     this._assertInterruptFields();
     return this;
   }
 
+  get arr() {
+    return this._arr;
+  }
+
+  set arr(arr) {
+    this._arr = arr;
+    this.length = arr.length;
+    this._version++;
+  }
+
   kind() {
     return 'interrupts';
   }
@@ -53,6 +68,7 @@ class Interrupts extends component.Component {
   }
 
   shiftDown(line, obj) {
+    this._version++;
     let startIndex = obj.startIndex;
     let endIndex = obj.endIndex || this.arr.length;
     let deltaValue = null;
@@ -75,6 +91,82 @@ class Interrupts extends component.Component {
   get(i) {
     return this.arr[i];
   }
+
+  /**
+   * compile the interrupts into a schedule, in the order they run
+   * @returns {object} count, the number of entries, lines, a Float64Array of
+   *     the scanline of each entry, as given, and irqs, the function of each
+   *     entry
+   */
+  compile() {
+    let schedule = this._schedule;
+    if (schedule && schedule.version == this._version &&
+        this._sameElements(schedule.from)) {
+      return schedule;
+    }
+    let count = 0;
+    let from = new Array(this.arr.length * 3);
+    for (let k = 0; k < this.arr.length; k++) {
+      let row = this.arr[k];
+      if (types.isArray(row.scanline)) {
+        // TODO: Asset it is a pair of integers
+        from[k*3+0] = row.scanline[0];
+        from[k*3+1] = row.scanline[1];
+        count += Math.max(0, row.scanline[1] - row.scanline[0] + 1);
+      } else if (types.isNumber(row.scanline)) {
+        from[k*3+0] = row.scanline;
+        from[k*3+1] = null;
+        count++;
+      } else {
+        throw new Error(`invalid scanline number: ${row.scanline}`);
+      }
+      from[k*3+2] = row.irq;
+    }
+
+    // Scanlines are not rounded or clamped, the same as when irqs were
+    // called straight from the array
+    let lines = new Float64Array(count);
+    let irqs = new Array(count);
+    let n = 0;
+    for (let k = 0; k < this.arr.length; k++) {
+      let first = from[k*3+0];
+      let last = from[k*3+1] == null ? first : from[k*3+1];
+      for (let j = first; j < last + 1; j++) {
+        lines[n] = j;
+        irqs[n] = from[k*3+2];
+        n++;
+      }
+    }
+    this._schedule = {
+      count: count,
+      lines: lines,
+      irqs: irqs,
+      version: this._version,
+      from: from,
+    };
+    return this._schedule;
+  }
+
+  // Whether the elements still have the scanlines and irqs they were
+  // compiled from
+  _sameElements(from) {
+    if (from.length != this.arr.length * 3) {
+      return false;
+    }
+    for (let k = 0; k < this.arr.length; k++) {
+      let row = this.arr[k];
+      let first = row.scanline, last = null;
+      if (types.isArray(row.scanline)) {
+        first = row.scanline[0];
+        last = row.scanline[1];
+      }
+      if (from[k*3+0] !== first || from[k*3+1] !== last ||
+          from[k*3+2] !== row.irq) {
+        return false;
+      }
+    }
+    return true;
+  }
 }
 
 
@@ -0,0 +1,866 @@
+const nativeAddon = require('./native_addon.js');
+
+const RGB_PIXEL_SIZE = 4;
+const ALPHA_OFFSET = 3;
+const TILE_FLIP_H = 1;
+const TILE_FLIP_V = 2;
+
+// Kernels are the inner loops of rendering and drawing, run once or more
+// per frame.
+// Each one has a js implementation, which is replaced by the native addon's
+// version when the addon has been built.
+
+// Scratch state kept between calls, since a frame with interrupts calls
+// the rasterize kernels once for every region between them
+let g_pixelView = null;
+let g_transparentLUT = new Uint32Array(256);
+let g_cellColors = new Uint32Array(256);
+let g_cellAlpha = new Uint8Array(g_cellColors.buffer, 0, RGB_PIXEL_SIZE);
+
+// The target as packed rgba pixels, reusing the last view of the same buffer
+function pixelView(target) {
+  let view = g_pixelView;
+  if (view == null || view.buffer !== target.buffer ||
+      view.byteOffset != target.byteOffset ||
+      view.length != target.byteLength / RGB_PIXEL_SIZE) {
+    view = new Uint32Array(target.buffer, target.byteOffset,
+                           target.byteLength / RGB_PIXEL_SIZE);
+    g_pixelView = view;
+  }
+  return view;
+}
+
+// Copy of lut where index 0 is transparent but keeps its rgb value, as
+// upper layers use
+function transparentLUT(lut) {
+  if (lut.length > g_transparentLUT.length) {
+    g_transparentLUT = new Uint32Array(lut.length);
+  }
+  g_transparentLUT.set(lut);
+  new Uint8Array(g_transparentLUT.buffer, 0, RGB_PIXEL_SIZE)[ALPHA_OFFSET] =
+      0x00;
+  return g_transparentLUT;
+}
+
+/**
+ * convert a region of a layer's indexed pixels into an RGBA surface
+ * @param {Uint8Array} source - indexed pixel data
+ * @param {Number} sourcePitch - bytes per row of source
+ * @param {Number} sourceWidth - width of source, in pixels
+ * @param {Number} sourceHeight - height of source, in pixels
+ * @param {Number} scrollX - horizontal scroll, integer
+ * @param {Number} scrollY - vertical scroll, integer
+ * @param {boolean} isWrapped - whether the source repeats in both directions
+ * @param {boolean} isBg - if false, index 0 is transparent
+ * @param {Uint32Array} lut - 256 packed rgba values, see buildPaletteLUT
+ * @param {Uint8Array} target - RGBA surface buffer to write to
+ * @param {Number} targetPitch - bytes per row of target
+ * @param {Number} left, top, right, bottom - region of target to render
+ */
+function rasterizeLayer(source, sourcePitch, sourceWidth, sourceHeight,
+                        scrollX, scrollY, isWrapped, isBg, lut,
+                        target, targetPitch, left, top, right, bottom) {
+  if (sourceWidth <= 0 || sourceHeight <= 0) {
+    return;
+  }
+
+  // Upper layers treat index 0 as transparent, but keep its rgb value
+  let palette = isBg ? lut : transparentLUT(lut);
+
+  let dest = pixelView(target);
+  let destPitch = targetPitch / RGB_PIXEL_SIZE;
+  left = Math.max(left, 0);
+
+  if (isWrapped) {
+    // Every pixel of the region is covered, wrapping around the source
+    scrollX = ((scrollX % sourceWidth) + sourceWidth) % sourceWidth;
+    scrollY = ((scrollY % sourceHeight) + sourceHeight) % sourceHeight;
+    for (let i = top; i < bottom; i++) {
+      let s = ((i + scrollY) % sourceHeight) * sourcePitch;
+      let t = i * destPitch;
+      let x = (left + scrollX) % sourceWidth;
+      for (let j = left; j < right; j++) {
+        dest[t + j] = palette[source[s + x]];
+        x++;
+        if (x == sourceWidth) {
+          x = 0;
+        }
+      }
+    }
+    return;
+  }
+
+  // Single placement, offset by scroll. Rows above the source have no data
+  // so they only become transparent
+  let rowEnd = Math.min(bottom, sourceHeight - scrollY);
+  let colBegin = Math.max(0, left + scrollX);
+  let colEnd = Math.min(sourceWidth, right, right + scrollX);
+
+  for (let i = top; i < rowEnd; i++) {
+    let y = i + scrollY;
+    if (y < 0) {
+      for (let x = colBegin; x < colEnd; x++) {
+        target[i * targetPitch + (x - scrollX) * RGB_PIXEL_SIZE +
+               ALPHA_OFFSET] = 0x00;
+      }
+      continue;
+    }
+    let s = y * sourcePitch;
+    let t = i * destPitch - scrollX;
+    for (let x = colBegin; x < colEnd; x++) {
+      dest[t + x] = palette[source[s + x]];
+    }
+  }
+}
+
+/**
+ * convert a region of a layer's indexed pixels into an RGBA surface, where
+ * the color of each pixel also depends upon the attribute of its cell. The
+ * attribute is resolved once for each cell, then its pixels are filled
+ * @param {Uint8Array} source - indexed pixel data
+ * @param {Number} sourcePitch - bytes per row of source
+ * @param {Number} sourceWidth - width of source, in pixels
+ * @param {Number} sourceHeight - height of source, in pixels
+ * @param {Number} scrollX - horizontal scroll, integer
+ * @param {Number} scrollY - vertical scroll, integer
+ * @param {boolean} isWrapped - whether the source repeats in both directions
+ * @param {boolean} isBg - if false, index 0 is transparent
+ * @param {Uint32Array} lut - 256 packed rgba values, see buildPaletteLUT
+ * @param {object} cells - attribute table, see Colorspace.compile
+ * @param {Uint8Array} target - RGBA surface buffer to write to
+ * @param {Number} targetPitch - bytes per row of target
+ * @param {Number} left, top, right, bottom - region of target to render
+ */
+function rasterizeCells(source, sourcePitch, sourceWidth, sourceHeight,
+                        scrollX, scrollY, isWrapped, isBg, lut, cells,
+                        target, targetPitch, left, top, right, bottom) {
+  if (sourceWidth <= 0 || sourceHeight <= 0) {
+    return;
+  }
+
+  let dest = pixelView(target);
+  let destPitch = targetPitch / RGB_PIXEL_SIZE;
+  let place = placeRegion(sourceWidth, sourceHeight, scrollX, scrollY,
+                          isWrapped, target, targetPitch,
+                          left, top, right, bottom);
+  scrollX = place.scrollX;
+  scrollY = place.scrollY;
+
+  let cellColors = g_cellColors;
+  let cellAlpha = g_cellAlpha;
+  let cellWidth = cells.cellWidth;
+  let cellHeight = cells.cellHeight;
+  let pieceSize = cells.pieceSize;
+
+  // Walk the region one block at a time, each block is the part of a single
+  // cell that is inside of the region, and does not wrap around the source
+  let rowEnd = place.rowEnd, colEnd = place.colEnd;
+  let i = place.rowBegin;
+  while (i < rowEnd) {
+    let y = (i + scrollY) % sourceHeight;
+    let cellY = Math.floor(y / cellHeight);
+    let numRows = Math.min(rowEnd - i, cellHeight - y % cellHeight,
+                           sourceHeight - y);
+    let j = place.colBegin;
+    while (j < colEnd) {
+      let x = (j + scrollX) % sourceWidth;
+      let cellX = Math.floor(x / cellWidth);
+      let numCols = Math.min(colEnd - j, cellWidth - x % cellWidth,
+                             sourceWidth - x);
+
+      // Resolve the attribute into the colors of the cell
+      let size = 0;
+      if (cellX < cells.pitch && cellY < cells.height) {
+        let attr = cells.attrs[cellY * cells.pitch + cellX];
+        if (attr >= 0) {
+          size = pieceSize;
+          let base = attr * pieceSize;
+          for (let m = 0; m < size; m++) {
+            cellColors[m] = lut[base + m];
+          }
+        } else {
+          let start = cells.listStarts[-1 - attr];
+          size = cells.listStarts[-attr] - start;
+          for (let m = 0; m < size; m++) {
+            cellColors[m] = lut[cells.lists[start + m]];
+          }
+        }
+      }
+
+      if (size == 0) {
+        // Cell has no attribute, so it has no colors
+        for (let r = 0; r < numRows; r++) {
+          let t = (i + r) * targetPitch + j * RGB_PIXEL_SIZE + ALPHA_OFFSET;
+          for (let k = 0; k < numCols; k++) {
+            target[t + k * RGB_PIXEL_SIZE] = 0x00;
+          }
+        }
+      } else {
+        // Upper layers treat index 0 as transparent, keeping its rgb value.
+        // Other indexes that resolve to the same color stay opaque
+        let opaque = cellColors[0];
+        if (!isBg) {
+          cellAlpha[ALPHA_OFFSET] = 0x00;
+        }
+        let zero = cellColors[0];
+        cellColors[0] = opaque;
+        for (let r = 0; r < numRows; r++) {
+          let s = (y + r) * sourcePitch + x;
+          let t = (i + r) * destPitch + j;
+          for (let k = 0; k < numCols; k++) {
+            let c = source[s + k];
+            dest[t + k] = c == 0 ? zero : cellColors[c % size];
+          }
+        }
+      }
+      j += numCols;
+    }
+    i += numRows;
+  }
+}
+
+/**
+ * convert a region of a tiled layer into an RGBA surface, reading each
+ * visible tile's rows directly instead of expanding the whole tilemap
+ * @param {Array} tiles - Tile objects with data and pitch, by tile id
+ * @param {Uint8Array} tilemap - tile id of each map cell
+ * @param {Number} mapPitch - entries per row of tilemap
+ * @param {Number} mapWidth - width of tilemap, in tiles
+ * @param {Number} mapHeight - height of tilemap, in tiles
+ * @param {Uint8Array} flips - optional, per map cell, 1 = horizontal flip,
+ *     2 = vertical flip
+ * @param {Number} flipsPitch - entries per row of flips
+ * @param {Number} tileWidth - width of each tile, in pixels
+ * @param {Number} tileHeight - height of each tile, in pixels
+ * @param {Number} scrollX - horizontal scroll, integer
+ * @param {Number} scrollY - vertical scroll, integer
+ * @param {boolean} isWrapped - whether the map repeats in both directions
+ * @param {boolean} isBg - if false, index 0 is transparent
+ * @param {Uint32Array} lut - 256 packed rgba values, see buildPaletteLUT
+ * @param {Uint8Array} target - RGBA surface buffer to write to
+ * @param {Number} targetPitch - bytes per row of target
+ * @param {Number} left, top, right, bottom - region of target to render
+ */
+function rasterizeTiles(tiles, tilemap, mapPitch, mapWidth, mapHeight,
+                        flips, flipsPitch, tileWidth, tileHeight,
+                        scrollX, scrollY, isWrapped, isBg, lut,
+                        target, targetPitch, left, top, right, bottom) {
+  let sourceWidth = mapWidth * tileWidth;
+  let sourceHeight = mapHeight * tileHeight;
+  if (sourceWidth <= 0 || sourceHeight <= 0) {
+    return;
+  }
+
+  // Upper layers treat index 0 as transparent, but keep its rgb value
+  let palette = isBg ? lut : transparentLUT(lut);
+
+  let dest = pixelView(target);
+  let destPitch = targetPitch / RGB_PIXEL_SIZE;
+  let place = placeRegion(sourceWidth, sourceHeight, scrollX, scrollY,
+                          isWrapped, target, targetPitch,
+                          left, top, right, bottom);
+  scrollX = place.scrollX;
+  scrollY = place.scrollY;
+
+  // Walk the region one block at a time, each block is the part of a single
+  // tile that is inside of the region
+  let rowEnd = place.rowEnd, colEnd = place.colEnd;
+  let i = place.rowBegin;
+  while (i < rowEnd) {
+    let y = (i + scrollY) % sourceHeight;
+    let mapY = Math.floor(y / tileHeight);
+    let innerY = y % tileHeight;
+    let numRows = Math.min(rowEnd - i, tileHeight - innerY);
+    let j = place.colBegin;
+    while (j < colEnd) {
+      let x = (j + scrollX) % sourceWidth;
+      let mapX = Math.floor(x / tileWidth);
+      let innerX = x % tileWidth;
+      let numCols = Math.min(colEnd - j, tileWidth - innerX);
+
+      let tile = tiles[tilemap[mapY * mapPitch + mapX]];
+      let flip = flips ? flips[mapY * flipsPitch + mapX] : 0;
+      for (let r = 0; r < numRows; r++) {
+        let t = (i + r) * destPitch + j;
+        if (!tile || !tile.data) {
+          // Missing tiles are index 0
+          for (let k = 0; k < numCols; k++) {
+            dest[t + k] = palette[0];
+          }
+          continue;
+        }
+        let ty = innerY + r;
+        if (flip & TILE_FLIP_V) {
+          ty = tileHeight - 1 - ty;
+        }
+        let s = ty * tile.pitch;
+        let data = tile.data;
+        if (flip & TILE_FLIP_H) {
+          s += tileWidth - 1 - innerX;
+          for (let k = 0; k < numCols; k++) {
+            dest[t + k] = palette[data[s - k]];
+          }
+        } else {
+          s += innerX;
+          for (let k = 0; k < numCols; k++) {
+            dest[t + k] = palette[data[s + k]];
+          }
+        }
+      }
+      j += numCols;
+    }
+    i += numRows;
+  }
+}
+
+/**
+ * copy a region of a layer's indexed pixels into an indexed surface, placed
+ * in the same way as rasterizeLayer. Indexes are kept as they are, so the
+ * surface's palette decides the colors, and whether index 0 is transparent.
+ * Rows above an unwrapped source become index 0
+ * @param {Uint8Array} target - indexed surface buffer, a byte per pixel
+ * @param {Number} targetPitch - bytes per row of target
+ * other params are the same as rasterizeLayer
+ */
+function indexLayer(source, sourcePitch, sourceWidth, sourceHeight,
+                    scrollX, scrollY, isWrapped,
+                    target, targetPitch, left, top, right, bottom) {
+  if (sourceWidth <= 0 || sourceHeight <= 0) {
+    return;
+  }
+  left = Math.max(left, 0);
+
+  if (isWrapped) {
+    scrollX = ((scrollX % sourceWidth) + sourceWidth) % sourceWidth;
+    scrollY = ((scrollY % sourceHeight) + sourceHeight) % sourceHeight;
+    for (let i = top; i < bottom; i++) {
+      let s = ((i + scrollY) % sourceHeight) * sourcePitch;
+      let t = i * targetPitch;
+      let x = (left + scrollX) % sourceWidth;
+      for (let j = left; j < right; j++) {
+        target[t + j] = source[s + x];
+        x++;
+        if (x == sourceWidth) {
+          x = 0;
+        }
+      }
+    }
+    return;
+  }
+
+  let rowEnd = Math.min(bottom, sourceHeight - scrollY);
+  let colBegin = Math.max(0, left + scrollX);
+  let colEnd = Math.min(sourceWidth, right, right + scrollX);
+  for (let i = top; i < rowEnd; i++) {
+    let y = i + scrollY;
+    let t = i * targetPitch - scrollX;
+    if (y < 0) {
+      for (let x = colBegin; x < colEnd; x++) {
+        target[t + x] = 0;
+      }
+      continue;
+    }
+    let s = y * sourcePitch;
+    for (let x = colBegin; x < colEnd; x++) {
+      target[t + x] = source[s + x];
+    }
+  }
+}
+
+/**
+ * copy a region of a tiled layer into an indexed surface, the same as
+ * rasterizeTiles except that indexes are kept as they are, see indexLayer
+ */
+function indexTiles(tiles, tilemap, mapPitch, mapWidth, mapHeight,
+                    flips, flipsPitch, tileWidth, tileHeight,
+                    scrollX, scrollY, isWrapped,
+                    target, targetPitch, left, top, right, bottom) {
+  let sourceWidth = mapWidth * tileWidth;
+  let sourceHeight = mapHeight * tileHeight;
+  if (sourceWidth <= 0 || sourceHeight <= 0) {
+    return;
+  }
+  left = Math.max(left, 0);
+  let rowBegin = top, rowEnd = bottom, colBegin = left, colEnd = right;
+  if (isWrapped) {
+    scrollX = ((scrollX % sourceWidth) + sourceWidth) % sourceWidth;
+    scrollY = ((scrollY % sourceHeight) + sourceHeight) % sourceHeight;
+  } else {
+    rowEnd = Math.min(bottom, sourceHeight - scrollY);
+    colBegin = Math.max(0, left + scrollX) - scrollX;
+    colEnd = Math.min(sourceWidth, right, right + scrollX) - scrollX;
+    for (; rowBegin < Math.min(rowEnd, -scrollY); rowBegin++) {
+      for (let j = colBegin; j < colEnd; j++) {
+        target[rowBegin * targetPitch + j] = 0;
+      }
+    }
+  }
+
+  let i = rowBegin;
+  while (i < rowEnd) {
+    let y = (i + scrollY) % sourceHeight;
+    let mapY = Math.floor(y / tileHeight);
+    let innerY = y % tileHeight;
+    let numRows = Math.min(rowEnd - i, tileHeight - innerY);
+    let j = colBegin;
+    while (j < colEnd) {
+      let x = (j + scrollX) % sourceWidth;
+      let mapX = Math.floor(x / tileWidth);
+      let innerX = x % tileWidth;
+      let numCols = Math.min(colEnd - j, tileWidth - innerX);
+
+      let tile = tiles[tilemap[mapY * mapPitch + mapX]];
+      let flip = flips ? flips[mapY * flipsPitch + mapX] : 0;
+      for (let r = 0; r < numRows; r++) {
+        let t = (i + r) * targetPitch + j;
+        if (!tile || !tile.data) {
+          for (let k = 0; k < numCols; k++) {
+            target[t + k] = 0;
+          }
+          continue;
+        }
+        let ty = innerY + r;
+        if (flip & TILE_FLIP_V) {
+          ty = tileHeight - 1 - ty;
+        }
+        let s = ty * tile.pitch;
+        let data = tile.data;
+        if (flip & TILE_FLIP_H) {
+          s += tileWidth - 1 - innerX;
+          for (let k = 0; k < numCols; k++) {
+            target[t + k] = data[s - k];
+          }
+        } else {
+          s += innerX;
+          for (let k = 0; k < numCols; k++) {
+            target[t + k] = data[s + k];
+          }
+        }
+      }
+      j += numCols;
+    }
+    i += numRows;
+  }
+}
+
+// Where the source lands in the region of the target, in the same way as
+// rasterizeLayer. Returns the range of target rows and columns that have a
+// source pixel, and the scroll to use for them. When not wrapped, rows above
+// the source have no data so they only become transparent
+function placeRegion(sourceWidth, sourceHeight, scrollX, scrollY, isWrapped,
+                     target, targetPitch, left, top, right, bottom) {
+  left = Math.max(left, 0);
+  if (isWrapped) {
+    return {
+      scrollX: ((scrollX % sourceWidth) + sourceWidth) % sourceWidth,
+      scrollY: ((scrollY % sourceHeight) + sourceHeight) % sourceHeight,
+      rowBegin: top, rowEnd: bottom, colBegin: left, colEnd: right,
+    };
+  }
+  let rowBegin = top;
+  let rowEnd = Math.min(bottom, sourceHeight - scrollY);
+  let colBegin = Math.max(0, left + scrollX) - scrollX;
+  let colEnd = Math.min(sourceWidth, right, right + scrollX) - scrollX;
+  for (; rowBegin < Math.min(rowEnd, -scrollY); rowBegin++) {
+    for (let j = colBegin; j < colEnd; j++) {
+      target[rowBegin * targetPitch + j * RGB_PIXEL_SIZE +
+             ALPHA_OFFSET] = 0x00;
+    }
+  }
+  return {
+    scrollX: scrollX, scrollY: scrollY,
+    rowBegin: rowBegin, rowEnd: rowEnd, colBegin: colBegin, colEnd: colEnd,
+  };
+}
+
+/**
+ * build the lookup table used by rasterizeLayer, mapping each of the
+ * 256 color indexes to packed rgba, in memory order
+ * @param {function} getRGB - (index, outtuple) => void, fills r,g,b
+ * @param {Uint32Array} optLUT - table to fill, otherwise one is allocated
+ */
+function buildPaletteLUT(getRGB, optLUT) {
+  let lut = optLUT || new Uint32Array(256);
+  let bytes = new Uint8Array(lut.buffer, lut.byteOffset, lut.byteLength);
+  let rgbtuple = new Uint8Array(4);
+  for (let c = 0; c < 256; c++) {
+    getRGB(c, rgbtuple);
+    let k = c * RGB_PIXEL_SIZE;
+    bytes[k+0] = rgbtuple[0];
+    bytes[k+1] = rgbtuple[1];
+    bytes[k+2] = rgbtuple[2];
+    bytes[k+3] = 0xff;
+  }
+  return lut;
+}
+
+/**
+ * blend each surface in the list, in order, onto dest
+ * @param {Surface} dest - surface to blend onto, its alpha becomes opaque
+ * @param {Array} surfaceList - surfaces of the same size as dest
+ */
+function compositeSurfaces(dest, surfaceList) {
+  for (let sour of surfaceList) {
+    for (let y = 0; y < sour.height; y++) {
+      let k = y * sour.pitch;
+      let j = y * dest.pitch;
+      for (let x = 0; x < sour.width; x++) {
+        let a = sour.buff[k+3];
+        if (a == 0xff) {
+          dest.buff[j+0] = sour.buff[k+0];
+          dest.buff[j+1] = sour.buff[k+1];
+          dest.buff[j+2] = sour.buff[k+2];
+        } else if (a != 0x00) {
+          let inv = 0xff - a;
+          dest.buff[j+0] = div255(dest.buff[j+0] * inv + sour.buff[k+0] * a);
+          dest.buff[j+1] = div255(dest.buff[j+1] * inv + sour.buff[k+1] * a);
+          dest.buff[j+2] = div255(dest.buff[j+2] * inv + sour.buff[k+2] * a);
+        }
+        dest.buff[j+3] = 0xff;
+        k += RGB_PIXEL_SIZE;
+        j += RGB_PIXEL_SIZE;
+      }
+    }
+  }
+}
+
+// Seeds of spans for floodFill, kept between calls
+let g_floodStack = new Int32Array(1024);
+
+/**
+ * fill the 4-connected area of a field that has the same value as x,y with
+ * color, one horizontal span at a time
+ * @param {Uint8Array} data - indexed pixel data of the field
+ * @param {Number} pitch - bytes per row of data
+ * @param {Number} offset - index of the field's upper-left pixel in data
+ * @param {Number} width, height - size of the field
+ * @param {Number} x, y - where to start, integer
+ * @param {Number} color - value to fill with
+ * @param {Int32Array} bounds - set to [minX, minY, maxX, maxY] of the pixels
+ *     filled, where maxX < minX if there were none
+ */
+function floodFill(data, pitch, offset, width, height, x, y, color, bounds) {
+  bounds[0] = width;
+  bounds[1] = height;
+  bounds[2] = -1;
+  bounds[3] = -1;
+  if (x < 0 || x >= width || y < 0 || y >= height) {
+    return;
+  }
+  color = color & 0xff;
+  let target = data[offset + y * pitch + x];
+  if (target == color) {
+    return;
+  }
+
+  let stack = g_floodStack;
+  let top = 0;
+  stack[top++] = x;
+  stack[top++] = y;
+  while (top > 0) {
+    let sy = stack[--top];
+    let sx = stack[--top];
+    let row = offset + sy * pitch;
+    if (data[row + sx] != target) {
+      continue;
+    }
+    // Extend the span in both directions, then fill it
+    let x0 = sx;
+    let x1 = sx;
+    while (x0 > 0 && data[row + x0 - 1] == target) {
+      x0--;
+    }
+    while (x1 < width - 1 && data[row + x1 + 1] == target) {
+      x1++;
+    }
+    data.fill(color, row + x0, row + x1 + 1);
+    bounds[0] = Math.min(bounds[0], x0);
+    bounds[1] = Math.min(bounds[1], sy);
+    bounds[2] = Math.max(bounds[2], x1);
+    bounds[3] = Math.max(bounds[3], sy);
+    // Seed each run of matching pixels in the rows above and below
+    for (let ny = sy - 1; ny <= sy + 1; ny += 2) {
+      if (ny < 0 || ny >= height) {
+        continue;
+      }
+      let nrow = offset + ny * pitch;
+      let inRun = false;
+      for (let nx = x0; nx <= x1; nx++) {
+        let match = data[nrow + nx] == target;
+        if (match && !inRun) {
+          if (top + 2 > stack.length) {
+            let grow = new Int32Array(stack.length * 2);
+            grow.set(stack);
+            stack = grow;
+            g_floodStack = stack;
+          }
+          stack[top++] = nx;
+          stack[top++] = ny;
+        }
+        inRun = match;
+      }
+    }
+  }
+}
+
+/**
+ * write color to each range of pixels, clipped to the field, see
+ * algorithm.Ranges. A range is a row of [x0, x1, y0, y1], either with
+ * x0 == x1 or y0 == y1, and includes both ends
+ * @param {Uint8Array} data - indexed pixel data of the field
+ * @param {Number} pitch - bytes per row of data
+ * @param {Number} offset - index of the field's upper-left pixel in data
+ * @param {Number} width, height - size of the field
+ * @param {Int32Array} ranges - 4 values per range
+ * @param {Number} numRanges - number of ranges to write
+ * @param {Number} color - value to write
+ * @param {Int32Array} bounds - set to [minX, minY, maxX, maxY] of the pixels
+ *     written, where maxX < minX if there were none
+ */
+function fillRanges(data, pitch, offset, width, height, ranges, numRanges,
+                    color, bounds) {
+  let minX = width, minY = height, maxX = -1, maxY = -1;
+  for (let n = 0; n < numRanges; n++) {
+    let x0 = ranges[n*4+0];
+    let x1 = ranges[n*4+1];
+    let y0 = ranges[n*4+2];
+    let y1 = ranges[n*4+3];
+    if (x0 > x1) {
+      let tmp = x0;
+      x0 = x1;
+      x1 = tmp;
+    }
+    if (y0 > y1) {
+      let tmp = y0;
+      y0 = y1;
+      y1 = tmp;
+    }
+    if (x0 == x1) {
+      // Vertical
+      if (x0 < 0 || x0 >= width) {
+        continue;
+      }
+      y0 = Math.max(y0, 0);
+      y1 = Math.min(y1, height - 1);
+      for (let y = y0; y <= y1; y++) {
+        data[offset + y * pitch + x0] = color;
+      }
+    } else if (y0 == y1) {
+      // Horizontal
+      if (y0 < 0 || y0 >= height) {
+        continue;
+      }
+      x0 = Math.max(x0, 0);
+      x1 = Math.min(x1, width - 1);
+      if (x0 <= x1) {
+        let row = offset + y0 * pitch;
+        data.fill(color, row + x0, row + x1 + 1);
+      }
+    } else {
+      continue;
+    }
+    if (x0 <= x1 && y0 <= y1) {
+      minX = Math.min(minX, x0);
+      minY = Math.min(minY, y0);
+      maxX = Math.max(maxX, x1);
+      maxY = Math.max(maxY, y1);
+    }
+  }
+  bounds[0] = minX;
+  bounds[1] = minY;
+  bounds[2] = maxX;
+  bounds[3] = maxY;
+}
+
+/**
+ * enlarge an RGBA surface so each pixel becomes a zoom by zoom block
+ * @param {Uint8Array} source - RGBA pixel data
+ * @param {Number} sourcePitch - bytes per row of source
+ * @param {Number} width, height - size of source, in pixels
+ * @param {Uint8Array} target - RGBA pixel data, zoom times the size
+ * @param {Number} targetPitch - bytes per row of target
+ * @param {Number} zoom - integer scale, 1 or more
+ */
+function scaleNearest(source, sourcePitch, width, height, target, targetPitch,
+                      zoom) {
+  let rowBytes = width * zoom * RGB_PIXEL_SIZE;
+  for (let y = 0; y < height; y++) {
+    let s = y * sourcePitch;
+    let first = y * zoom * targetPitch;
+    let t = first;
+    for (let x = 0; x < width; x++) {
+      let r = source[s+0], g = source[s+1], b = source[s+2], a = source[s+3];
+      for (let j = 0; j < zoom; j++) {
+        target[t+0] = r;
+        target[t+1] = g;
+        target[t+2] = b;
+        target[t+3] = a;
+        t += RGB_PIXEL_SIZE;
+      }
+      s += RGB_PIXEL_SIZE;
+    }
+    // The rest of the block are copies of its first row
+    for (let i = 1; i < zoom; i++) {
+      target.copyWithin(first + i * targetPitch, first, first + rowBytes);
+    }
+  }
+}
+
+/**
+ * enlarge like scaleNearest, then darken like a CRT. The last row of each
+ * block is a scanline at half brightness. With shadowMask, each column
+ * keeps one of red, green, or blue in turn, and the other two lose a quarter
+ * @param {Uint8Array} source - RGBA pixel data
+ * @param {Number} sourcePitch - bytes per row of source
+ * @param {Number} width, height - size of source, in pixels
+ * @param {Uint8Array} target - RGBA pixel data, zoom times the size
+ * @param {Number} targetPitch - bytes per row of target
+ * @param {Number} zoom - integer scale, 1 or more
+ * @param {Boolean} shadowMask - whether to also apply the aperture mask
+ */
+function scaleScanlines(source, sourcePitch, width, height, target,
+                        targetPitch, zoom, shadowMask) {
+  scaleNearest(source, sourcePitch, width, height, target, targetPitch, zoom);
+  let targetWidth = width * zoom;
+  for (let y = 0; y < height * zoom; y++) {
+    let isScanline = zoom >= 2 && y % zoom == zoom - 1;
+    if (!isScanline && !shadowMask) {
+      continue;
+    }
+    let row = y * targetPitch;
+    for (let x = 0; x < targetWidth; x++) {
+      let t = row + x * RGB_PIXEL_SIZE;
+      for (let k = 0; k < 3; k++) {
+        let c = target[t+k];
+        if (shadowMask && k != x % 3) {
+          c -= c >> 2;
+        }
+        if (isScanline) {
+          c >>= 1;
+        }
+        target[t+k] = c;
+      }
+    }
+  }
+}
+
+// Fixed point of scaleSharpBilinear, positions are 16.16 and weights are
+// out of 256
+const POS_ONE = 65536;
+const POS_HALF = 32768;
+const WEIGHT_ONE = 256;
+
+// Tables of scaleSharpBilinear, kept between calls
+let g_sharpCols = null;
+let g_sharpRows = null;
+
+// For each target column or row, the two source pixels it is between, and
+// the weight of the second one
+function buildSharpAxis(axis, sourceSize, targetSize) {
+  if (!axis || axis.first.length < targetSize) {
+    axis = {first: new Int32Array(targetSize),
+            second: new Int32Array(targetSize),
+            weight: new Int32Array(targetSize)};
+  }
+  let sharpness = Math.max(1, Math.floor(targetSize / sourceSize));
+  for (let t = 0; t < targetSize; t++) {
+    // Center of the target pixel, in source pixels, less half a pixel
+    let pos = Math.floor((2 * t + 1) * sourceSize * POS_ONE /
+                         (2 * targetSize)) - POS_HALF;
+    let base = Math.floor(pos / POS_ONE);
+    let frac = pos - base * POS_ONE;
+    // Blend across a span that is 1/sharpness of a source pixel
+    frac = (frac - POS_HALF) * sharpness + POS_HALF;
+    frac = Math.min(Math.max(frac, 0), POS_ONE);
+    axis.first[t] = Math.min(Math.max(base, 0), sourceSize - 1);
+    axis.second[t] = Math.min(Math.max(base + 1, 0), sourceSize - 1);
+    axis.weight[t] = (frac + WEIGHT_ONE / 2) >> 8;
+  }
+  return axis;
+}
+
+/**
+ * enlarge an RGBA surface to any size, with bilinear filtering only at the
+ * edges between source pixels, so that they stay sharp at sizes that are
+ * not a whole multiple
+ * @param {Uint8Array} source - RGBA pixel data
+ * @param {Number} sourcePitch - bytes per row of source
+ * @param {Number} sourceWidth, sourceHeight - size of source, in pixels
+ * @param {Uint8Array} target - RGBA pixel data
+ * @param {Number} targetPitch - bytes per row of target
+ * @param {Number} targetWidth, targetHeight - size of target, in pixels
+ */
+function scaleSharpBilinear(source, sourcePitch, sourceWidth, sourceHeight,
+                            target, targetPitch, targetWidth, targetHeight) {
+  if (sourceWidth <= 0 || sourceHeight <= 0) {
+    return;
+  }
+  let cols = g_sharpCols = buildSharpAxis(g_sharpCols, sourceWidth,
+                                          targetWidth);
+  let rows = g_sharpRows = buildSharpAxis(g_sharpRows, sourceHeight,
+                                          targetHeight);
+  for (let y = 0; y < targetHeight; y++) {
+    let upper = rows.first[y] * sourcePitch;
+    let lower = rows.second[y] * sourcePitch;
+    let wy = rows.weight[y];
+    let out = y * targetPitch;
+    for (let x = 0; x < targetWidth; x++) {
+      let a = cols.first[x] * RGB_PIXEL_SIZE;
+      let b = cols.second[x] * RGB_PIXEL_SIZE;
+      let wx = cols.weight[x];
+      for (let k = 0; k < RGB_PIXEL_SIZE; k++) {
+        let top = source[upper+a+k] * (WEIGHT_ONE - wx) +
+                  source[upper+b+k] * wx;
+        let bottom = source[lower+a+k] * (WEIGHT_ONE - wx) +
+                     source[lower+b+k] * wx;
+        target[out + x * RGB_PIXEL_SIZE + k] =
+            (top * (WEIGHT_ONE - wy) + bottom * wy + POS_HALF) >> 16;
+      }
+    }
+  }
+}
+
+// floor(x / 255) for 0 <= x <= 255*255, without a division
+function div255(x) {
+  return (x + 1 + (x >> 8)) >> 8;
+}
+
+function chooseImpl(name, jsImpl) {
+  if (nativeAddon && nativeAddon[name]) {
+    return nativeAddon[name];
+  }
+  return jsImpl;
+}
+
+module.exports.rasterizeLayer = chooseImpl('rasterizeLayer', rasterizeLayer);
+module.exports.rasterizeCells = chooseImpl('rasterizeCells', rasterizeCells);
+module.exports.rasterizeTiles = chooseImpl('rasterizeTiles', rasterizeTiles);
+module.exports.compositeSurfaces = chooseImpl('compositeSurfaces',
+                                             compositeSurfaces);
+module.exports.floodFill = chooseImpl('floodFill', floodFill);
+module.exports.fillRanges = chooseImpl('fillRanges', fillRanges);
+module.exports.scaleNearest = chooseImpl('scaleNearest', scaleNearest);
+module.exports.scaleScanlines = chooseImpl('scaleScanlines', scaleScanlines);
+module.exports.scaleSharpBilinear = chooseImpl('scaleSharpBilinear',
+                                              scaleSharpBilinear);
+// Copying indexes needs no lookup table, so these are only js
+module.exports.indexLayer = indexLayer;
+module.exports.indexTiles = indexTiles;
+module.exports.buildPaletteLUT = buildPaletteLUT;
+module.exports.placeRegion = placeRegion;
+module.exports.pixelView = pixelView;
+module.exports.hasNative = function(name) {
+  return !!(nativeAddon && nativeAddon[name]);
+}
+// js implementations, for tests and benchmarks
+module.exports.js = {
+  rasterizeLayer: rasterizeLayer,
+  rasterizeCells: rasterizeCells,
+  rasterizeTiles: rasterizeTiles,
+  compositeSurfaces: compositeSurfaces,
+  floodFill: floodFill,
+  fillRanges: fillRanges,
+  scaleNearest: scaleNearest,
+  scaleScanlines: scaleScanlines,
+  scaleSharpBilinear: scaleSharpBilinear,
+};
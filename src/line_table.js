@@ -0,0 +1,131 @@
+const component = require('./component.js');
+
+
+// A LineTable holds parameters for each scanline of a layer, which the
+// renderer applies as it rasterizes, without calling back into js. This
+// covers the effects that interrupts are most often used for, such as
+// parallax, wavy water, and pseudo-3d roads.
+//
+// scrollX[y] and scrollY[y] are added to the layer's scroll on scanline y.
+// Each scanline may also write colors into the layer's palette, which take
+// effect from that scanline down until the end of the frame. The palette
+// itself is not modified, so every frame starts from its original colors.
+// Writes only affect colors that go through the palette's lookup table, not
+// colorspaces whose colors fall outside of it.
+class LineTable extends component.Component {
+  constructor(height, opt) {
+    super();
+    opt = opt || {};
+    height = Math.floor(height);
+    if (!(height > 0)) {
+      throw new Error(`LineTable needs a height > 0, got ${height}`);
+    }
+    let channels = opt.colorChannels == null ? 1 :
+                   Math.floor(opt.colorChannels);
+    if (!(channels >= 0)) {
+      throw new Error(`LineTable colorChannels must be >= 0, got ${channels}`);
+    }
+    this.height = height;
+    this.colorChannels = channels;
+    this.scrollX = new Int32Array(height);
+    this.scrollY = new Int32Array(height);
+    // Palette index written by each channel of each scanline, or -1
+    this.colorIndex = new Int16Array(height * channels).fill(-1);
+    // Rgb value written, as 0xRRGGBB
+    this.colorValue = new Int32Array(height * channels);
+    // Number of channels that write a color, and a count of changes to them
+    this._numColors = 0;
+    this._colorVersion = 0;
+    return this;
+  }
+
+  kind() {
+    return 'linetable';
+  }
+
+  clear() {
+    this.scrollX.fill(0);
+    this.scrollY.fill(0);
+    this.colorIndex.fill(-1);
+    this.colorValue.fill(0);
+    this._numColors = 0;
+    this._colorVersion++;
+  }
+
+  setScroll(line, x, y) {
+    this._assertLine(line);
+    this.scrollX[line] = Math.floor(x) || 0;
+    this.scrollY[line] = Math.floor(y) || 0;
+  }
+
+  setColor(line, index, rgb, channel) {
+    this._assertLine(line);
+    channel = channel || 0;
+    if (!(channel >= 0 && channel < this.colorChannels)) {
+      throw new Error(`LineTable channel must be < ${this.colorChannels}, ` +
+                      `got ${channel}`);
+    }
+    if (!(index >= 0 && index < 256)) {
+      throw new Error(`LineTable color index must be 0 to 255, got ${index}`);
+    }
+    let k = line * this.colorChannels + channel;
+    if (this.colorIndex[k] < 0) {
+      this._numColors++;
+    }
+    this.colorIndex[k] = index;
+    this.colorValue[k] = rgb;
+    this._colorVersion++;
+  }
+
+  clearColor(line, channel) {
+    this._assertLine(line);
+    let k = line * this.colorChannels + (channel || 0);
+    if (this.colorIndex[k] >= 0) {
+      this._numColors--;
+    }
+    this.colorIndex[k] = -1;
+    this._colorVersion++;
+  }
+
+  // Whether any scanline writes colors
+  hasColors() {
+    return this._numColors > 0;
+  }
+
+  // Whether the scanline writes any colors
+  hasColorsAt(line) {
+    let k = line * this.colorChannels;
+    for (let c = 0; c < this.colorChannels; c++) {
+      if (this.colorIndex[k + c] >= 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Write the colors of the scanline into a compiled lookup table
+  applyColorsAt(line, bytes) {
+    let k = line * this.colorChannels;
+    for (let c = 0; c < this.colorChannels; c++) {
+      let index = this.colorIndex[k + c];
+      if (index < 0) {
+        continue;
+      }
+      let v = this.colorValue[k + c];
+      let t = index * 4;
+      bytes[t+0] = (v >> 16) & 0xff;
+      bytes[t+1] = (v >> 8) & 0xff;
+      bytes[t+2] = v & 0xff;
+      bytes[t+3] = 0xff;
+    }
+  }
+
+  _assertLine(line) {
+    if (!(line >= 0 && line < this.height) || line !== Math.floor(line)) {
+      throw new Error(`invalid scanline number: ${line}`);
+    }
+  }
+}
+
+
+module.exports.LineTable = LineTable;
@@ -0,0 +1,10 @@
+// Load the native addon if it has been built. In a browser, or if node-gyp
+// has not been run, this is null, and callers should use a js fallback.
+let addon = null;
+try {
+  addon = require('../build/Release/native');
+} catch (e) {
+  addon = null;
+}
+
+module.exports = addon;
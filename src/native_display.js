@@ -1,4 +1,5 @@
 const baseDisplay = require('./base_display.js');
+const videoSink = require('./video_sink.js');
 
 class NativeDisplay extends baseDisplay.BaseDisplay {
   constructor(backend) {
@@ -44,6 +45,42 @@ class NativeDisplay extends baseDisplay.BaseDisplay {
     this._b.config('instrumentation', inst);
   }
 
+  // Render each frame into its own set of surfaces, so the next frame can
+  // render while the backend presents the previous one
+  setPipelineDepth(depth) {
+    this._renderer.setSurfaceSets(depth);
+    this._b.config('pipeline', depth);
+  }
+
+  // Rasterize straight into the backend's textures, instead of into the
+  // renderer's surfaces which are then copied to them
+  setZeroCopy(enable) {
+    this._b.config('zerocopy', enable);
+  }
+
+  // Have the renderer output indexed layers where it can, which the backend
+  // expands through their palettes as it uploads them
+  setIndexedOutput(enable) {
+    if (!this.getBackendFeatures().indexedOutput) {
+      return;
+    }
+    this._renderer.setIndexedOutput(enable);
+    this._b.config('indexed', enable);
+  }
+
+  setHardwareScroll(enable) {
+    if (!this.getBackendFeatures().hardwareScroll) {
+      return;
+    }
+    this._renderer.setHardwareScroll(enable);
+    this._b.config('hwscroll', enable);
+  }
+
+  setFrameRate(rate, pacing) {
+    this._b.config('rate', rate);
+    this._b.config('pacing', pacing);
+  }
+
   setVeryVerboseTiming(timing) {
     this._b.config('vv', timing);
   }
@@ -54,6 +91,12 @@ class NativeDisplay extends baseDisplay.BaseDisplay {
   }
 
   appLoop(loopID, execNextFrame) {
+    if (this._b.registerSurfaces) {
+      // Backend keeps the surfaces, and is told when they are reallocated
+      this._renderer.setOnSurfacesChanged((surfaces) => {
+        this._b.registerSurfaces(surfaces);
+      });
+    }
     this._b.beginRender(this.width, this.height, this._renderer);
     return this._b.runAppLoop(loopID, execNextFrame);
   }
@@ -61,10 +104,9 @@ class NativeDisplay extends baseDisplay.BaseDisplay {
   forwardNativeEvents(eventManager) {
     this._eventManager = eventManager;
     this._b.eventReceiver((name, nativeEvent) => {
-      if (name == 'keypress' || name == 'keydown' || name == 'keyup') {
-        this._eventManager.getNativeKey(name, nativeEvent);
-      } else if (name == 'click') {
-        this._eventManager.getNativeClick(name, nativeEvent);
+      if (name == 'batch') {
+        // Every event since the last frame, packed into an Int32Array
+        this._eventManager.getNativeBatch(nativeEvent);
       } else {
         throw new Error(`unknown event name "${name}"`);
       }
@@ -75,6 +117,23 @@ class NativeDisplay extends baseDisplay.BaseDisplay {
     return this._b.insteadWriteBuffer(buffer);
   }
 
+  // Read back every presented frame into a raw video stream
+  streamTo(target, opt) {
+    if (!this._b.streamTo) {
+      throw new Error(`display "${this.name()}" cannot stream video`);
+    }
+    let sink = new videoSink.VideoSink(target, opt);
+    this._b.streamTo(sink.nativeSink());
+  }
+
+  getStats() {
+    return this._b.getStats ? this._b.getStats() : null;
+  }
+
+  getTrace() {
+    return this._b.getTrace ? this._b.getTrace() : null;
+  }
+
   getBackendFeatures() {
     let features = {};
     let featureList = this._b.getFeatureList() || [];
@@ -9,6 +9,13 @@ const weak = require('./weak.js');
 
 let verbose = new verboseLogger.Logger();
 
+const RGB_PIXEL_SIZE = 4;
+const LUT_SIZE = 256;
+
+// Every compiled lut gets a new serial, even across palettes, so that
+// equal serials always mean equal tables
+let g_lutSerial = 0;
+
 
 /**
  * Palette is the map of RGB data to 8-bit colors, and entries for reordering
@@ -31,6 +38,8 @@ class Palette extends component.Component {
     this._entries = null;
     this._system = null;
     this._pieceSize = opt.pieceSize || null;
+    this._version = 0;
+    this._compiled = null;
     if (opt.rgbmap) {
       this._rgbmap = toIntList(opt.rgbmap);
     }
@@ -53,6 +62,7 @@ class Palette extends component.Component {
     }
     this._entries = null;
     this._rgbmap = toIntList(values);
+    this._changed();
   }
 
   /**
@@ -75,6 +85,7 @@ class Palette extends component.Component {
       }
     }
     this._rgbmap.push(rgbval);
+    this._changed();
     return len;
   }
 
@@ -93,6 +104,7 @@ class Palette extends component.Component {
   setEntries(vals) {
     if (types.isNumber(vals)) {
       this._entries = [...Array(Math.floor(vals)).keys()].slice();
+      this._changed();
       return;
     }
 
@@ -102,6 +114,7 @@ class Palette extends component.Component {
         entries.push(Math.floor(v));
       }
       this._entries = entries;
+      this._changed();
       return;
     }
 
@@ -131,6 +144,7 @@ class Palette extends component.Component {
     for (let i = 0; i < this._entries.length; i++) {
       this._entries[i] = v;
     }
+    this._changed();
   }
 
   find(subject) {
@@ -206,6 +220,7 @@ class Palette extends component.Component {
     for (let i = 0; i < this._entries.length; i++) {
       this._entries[i] = i;
     }
+    this._changed();
   }
 
   assign(assoc) {
@@ -214,6 +229,7 @@ class Palette extends component.Component {
     for (let key of keys) {
       this._entries[key] = toNum(assoc[key]);
     }
+    this._changed();
   }
 
   put(n, v) {
@@ -223,6 +239,7 @@ class Palette extends component.Component {
       throw new Error(`TODO`);
     }
     this._entries[n] = v;
+    this._changed();
   }
 
   /**
@@ -278,12 +295,61 @@ class Palette extends component.Component {
       n = this._entries[Math.floor(n) % this._entries.length];
     }
     let v = +rgbmap[Math.floor(n) % rgbmap.length];
-    outtuple[0] = (v / 0x10000) % 0x100;
-    outtuple[1] = (v / 0x100)   % 0x100;
-    outtuple[2] = (v / 0x1)     % 0x100;
+    outtuple[0] = (v >> 16) & 0xff;
+    outtuple[1] = (v >> 8) & 0xff;
+    outtuple[2] = v & 0xff;
     outtuple[3] = 0xff;
   }
 
+  /**
+   * compile the palette into a lookup table, from each of the 256 color
+   * indexes to packed rgba in memory order. The table is only rebuilt after
+   * the palette changes, or when given a different rgbmap
+   * @param {Array} rgbmap - rgbmap to look up colors in
+   * @returns {object} lut, a Uint32Array, bytes, a Uint8Array view of it,
+   *     and serial, which changes whenever the table is rebuilt
+   */
+  compile(rgbmap) {
+    let compiled = this._compiled;
+    if (compiled && compiled.version == this._version &&
+        compiled.rgbmap === rgbmap && compiled.rgbmapLen == rgbmap.length) {
+      return compiled;
+    }
+    if (!compiled) {
+      let lut = new Uint32Array(LUT_SIZE);
+      compiled = {
+        lut: lut,
+        bytes: new Uint8Array(lut.buffer),
+      };
+      this._compiled = compiled;
+    }
+    let bytes = compiled.bytes;
+    let entries = this._entries;
+    for (let c = 0; c < LUT_SIZE; c++) {
+      let n = c;
+      if (entries) {
+        n = entries[c % entries.length];
+      }
+      let v = +rgbmap[Math.floor(n) % rgbmap.length];
+      let k = c * RGB_PIXEL_SIZE;
+      bytes[k+0] = (v >> 16) & 0xff;
+      bytes[k+1] = (v >> 8) & 0xff;
+      bytes[k+2] = v & 0xff;
+      bytes[k+3] = 0xff;
+    }
+    compiled.version = this._version;
+    compiled.rgbmap = rgbmap;
+    compiled.rgbmapLen = rgbmap.length;
+    compiled.serial = ++g_lutSerial;
+    return compiled;
+  }
+
+  // Entries or the rgbmap changed, so the compiled lut is stale. Code that
+  // assigns to `_entries` or `_rgbmap` directly must call this
+  _changed() {
+    this._version++;
+  }
+
   giveFeatures(refScene) {
     // palette.cycle needs `scene.tick`
     if (!types.isWeakRef(refScene)) {
@@ -381,6 +447,7 @@ class Palette extends component.Component {
     // concat them together and build this palette
     replace = replace.concat(follow);
     this._entries = replace;
+    this._changed();
   }
 
   relocateColorTo(c, pieceNum, optSize) {
@@ -401,12 +468,14 @@ class Palette extends component.Component {
       return;
     }
     this._entries = [...Array(Math.floor(this._rgbmap.length)).keys()].slice();
+    this._changed();
   }
 
   ensureRGBMap() {
     if (this.isPending()) {
       verbose.log(`creating default rgbMap`, 4);
       this._rgbmap = rgbMap.rgb_map_quick.slice();
+      this._changed();
     }
   }
 
@@ -415,6 +484,7 @@ class Palette extends component.Component {
       verbose.log(`creating empty and expanding rgbMap`, 4);
       this._rgbmap = [];
       this.expandable = true;
+      this._changed();
     }
   }
 
@@ -550,6 +620,7 @@ class Palette extends component.Component {
       }
       this._entries[index] = r;
     }
+    this._changed();
   }
 }
 
@@ -584,6 +655,7 @@ class PaletteEntry {
     this.cval = n;
     this.rgb = new rgbColor.RGBColor(pal._rgbmap[n]);
     pal._entries[this.idx] = n;
+    pal._changed();
   }
 
   hex() {
@@ -0,0 +1,42 @@
+const nativeAddon = require('./native_addon.js');
+
+// Writes frames to png files. With the native addon, frames are encoded
+// on a pool of worker threads, and written in the order they arrive.
+// Otherwise each frame is encoded and written before write() returns.
+class PngSink {
+  constructor(fsacc, opt) {
+    opt = opt || {};
+    this._fsacc = fsacc;
+    this._native = null;
+    if (nativeAddon && nativeAddon.PngSink) {
+      this._native = new nativeAddon.PngSink(opt.workers || 0,
+                                             opt.maxInFlight || 0);
+    }
+  }
+
+  isNative() {
+    return !!this._native;
+  }
+
+  // The surface can be reused as soon as this returns
+  write(filename, surface) {
+    if (this._native) {
+      this._native.write(filename, surface);
+      return;
+    }
+    this._fsacc.saveTo(filename, [surface]);
+  }
+
+  // Wait for every frame to be written
+  finish() {
+    if (!this._native) {
+      return;
+    }
+    let error = this._native.finish();
+    if (error) {
+      throw new Error(`saving frames failed: ${error}`);
+    }
+  }
+}
+
+module.exports.PngSink = PngSink;
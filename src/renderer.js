@@ -1,8 +1,12 @@
 const algorithm = require('./algorithm.js');
 const component = require('./component.js');
 const compositor = require('./compositor.js');
+const damage = require('./damage.js');
 const rgbColor = require('./rgb_color.js');
 const field = require('./field.js');
+const kernels = require('./kernels.js');
+const spriteEngine = require('./sprite_engine.js');
+const tileCache = require('./tile_cache.js');
 const tiles = require('./tiles.js');
 const palette = require('./palette.js');
 const colorspace = require('./colorspace.js');
@@ -11,6 +15,22 @@ const verboseLogger = require('./verbose_logger.js');
 
 let verbose = new verboseLogger.Logger();
 
+// Most rects that surface.dirtyPacked can hold, more means the entire surface
+const MAX_PACKED_RECTS = 64;
+
+// Most sets of surfaces that a display can pipeline
+const MAX_SURFACE_SETS = 3;
+
+// Largest field, in pixels, that a display may be asked to pan across, the
+// texture size that every backend is expected to support
+const MAX_PAN_SIZE = 4096;
+
+// How a layer's surface is combined with the layers below it. 'alpha' is
+// the usual blending, 'add' and 'multiply' apply to the color channels, and
+// 'none' copies it over them
+const BLEND_MODES = ['alpha', 'add', 'multiply', 'none'];
+
+const RGB_PIXEL_SIZE = 4;
 const R_INDEX = 0;
 const G_INDEX = 1;
 const B_INDEX = 2;
@@ -27,8 +47,10 @@ class Renderer {
 
   clearExceptInitCallback() {
     let preserve = this._renderEventCallback;
+    let preserveSurfaces = this._surfacesChangedCallback;
     this.clear();
     this._renderEventCallback = preserve;
+    this._surfacesChangedCallback = preserveSurfaces;
   }
 
   _init() {
@@ -40,10 +62,24 @@ class Renderer {
     this.haveRenderedFieldOnce = false;
     this._inspector = null;
     this._renderEventCallback = null;
+    this._surfacesChangedCallback = null;
+    this._registeredBuffs = [];
     this._renderWidth = null;
     this._renderHeight = null;
     this._create = null;
-    this._comp = null;
+    this._comps = [];
+    this._numSurfaceSets = 1;
+    this._surfaceSets = null;
+    this._pendingDamage = null;
+    this._setIndex = -1;
+    this._layerState = null;
+    this._prevSpriteRects = [];
+    this._trackDamage = true;
+    this._useTileCache = true;
+    this._indexedOutput = false;
+    this._hardwareScroll = false;
+    this._spriteEngine = new spriteEngine.SpriteEngine();
+    this._frameSerial = 0;
     this.requirements = {};
   }
 
@@ -71,7 +107,9 @@ class Renderer {
   _createLayer(item) {
     let layer = {};
     this._assertObjectKeys(item, ['field', 'size', 'scroll', 'palette-rgbmap',
-                                  'tileset', 'palette', 'colorspace']);
+                                  'tileset', 'tileflips', 'palette',
+                                  'colorspace', 'linetable', 'visible',
+                                  'blend']);
 
     verbose.log(`renderer.connect components: ${Object.keys(item)}`, 5);
 
@@ -87,13 +125,33 @@ class Renderer {
     if (item.colorspace && !types.isColorspace(item.colorspace)) {
       throw new Error(`layer.colorspace must be a Colorspace`);
     }
+    if (item.tileflips && !types.isField(item.tileflips)) {
+      throw new Error(`layer.tileflips must be a Field`);
+    }
+    // Flips are read for every entry of the tilemap
+    if (item.tileflips && item.tileset &&
+        (item.tileflips.width < item.field.width ||
+         item.tileflips.height < item.field.height)) {
+      throw new Error(`layer.tileflips is ${item.tileflips.width}x` +
+                      `${item.tileflips.height}, smaller than the tilemap ` +
+                      `${item.field.width}x${item.field.height}`);
+    }
+    if (item.linetable && !types.isLineTable(item.linetable)) {
+      throw new Error(`layer.linetable must be a LineTable`);
+    }
+    assertBlendMode(item.blend);
 
     layer.field    = item.field;
     layer.size     = item.size;
     layer.scroll   = item.scroll;
     layer.tileset  = item.tileset;
+    layer.tileflips = item.tileflips;
     layer.palette  = item.palette;
     layer.colorspace = item.colorspace;
+    layer.linetable = item.linetable;
+    layer.visible = item.visible !== false;
+    layer.blend = item.blend || 'alpha';
+    layer.lineLut = null;
     this.isConnected = true;
     return layer;
   }
@@ -110,6 +168,35 @@ class Renderer {
 
   flushBuffer() {
     this._surfs = null;
+    this._surfaceSets = null;
+    this._pendingDamage = null;
+    this._setIndex = -1;
+    this._layerState = null;
+  }
+
+  disableDamageTracking() {
+    this._trackDamage = false;
+  }
+
+  // Rasterize tiled layers from the tileset each time, without keeping
+  // tiles that were already converted to RGBA
+  disableTileCache() {
+    this._useTileCache = false;
+  }
+
+  // Hits and misses of the tile caches of all layers, and how many tiles
+  // they hold
+  getTileCacheStats() {
+    let stats = {hits: 0, misses: 0, entries: 0};
+    for (let layer of this._layers || []) {
+      if (layer.tileCache) {
+        let s = layer.tileCache.stats();
+        stats.hits += s.hits;
+        stats.misses += s.misses;
+        stats.entries += s.entries;
+      }
+    }
+    return stats;
   }
 
   getFirstField() {
@@ -133,6 +220,22 @@ class Renderer {
     this._layers[layerNum][compName] = obj;
   }
 
+  // A hidden layer is not rasterized, and displays leave it out
+  setLayerVisible(layerNum, visible) {
+    if (!this._layers || !this._layers[layerNum]) {
+      return;
+    }
+    this._layers[layerNum].visible = !!visible;
+  }
+
+  setLayerBlend(layerNum, blend) {
+    assertBlendMode(blend);
+    if (!this._layers || !this._layers[layerNum]) {
+      return;
+    }
+    this._layers[layerNum].blend = blend || 'alpha';
+  }
+
   getInspector() {
     if (this._inspector == null) {
       this._inspector = new Inspector(this);
@@ -143,13 +246,65 @@ class Renderer {
   setRenderSize(width, height) {
     this._renderWidth = width;
     this._renderHeight = height;
+    this._layerState = null;
   }
 
   setOnRenderEvent(callback) {
     this._renderEventCallback = callback;
   }
 
-  render() {
+  // The callback receives the list of surfaces that render() returns,
+  // whenever they are allocated again. Displays can keep the surfaces
+  // instead of reading them from every call to render()
+  setOnSurfacesChanged(callback) {
+    this._surfacesChangedCallback = callback;
+    this._registeredBuffs = [];
+  }
+
+  // Keep more than one set of surfaces, so that a display can still be
+  // uploading or presenting one set while the next frame renders into
+  // another. Each set only rasterizes what changed since it was last used
+  setSurfaceSets(num) {
+    if (!types.isNumber(num) || num < 1 || num > MAX_SURFACE_SETS ||
+        Math.floor(num) != num) {
+      throw new Error(`setSurfaceSets: invalid number of sets ${num}`);
+    }
+    this._numSurfaceSets = num;
+    this._comps = [];
+    this._registeredBuffs = [];
+    this.flushBuffer();
+  }
+
+  getSurfaceSets() {
+    return this._numSurfaceSets;
+  }
+
+  // Output layers as a byte per pixel, which are indexes into the surface's
+  // palette, so that the display expands them to RGBA as it uploads them.
+  // Only layers whose colors all come from one lookup table for the entire
+  // frame can be indexed, others are still RGBA, see _surfaceFormat
+  setIndexedOutput(enable) {
+    this._indexedOutput = !!enable;
+    this._registeredBuffs = [];
+    this.flushBuffer();
+  }
+
+  // Give layers that are larger than the display a surface that holds their
+  // entire field, which only rasterizes when the field changes. The display
+  // scrolls by panning across it, starting at surface.pan, which wraps. See
+  // _panSize for the layers that can do this
+  setHardwareScroll(enable) {
+    this._hardwareScroll = !!enable;
+    this._registeredBuffs = [];
+    this.flushBuffer();
+  }
+
+  // Render into the given set of surfaces, which the display must no longer
+  // be reading from. Without a set index, the sets are used in turn.
+  // Targets, if given, are a {buff, pitch} for each layer, memory that the
+  // display lends for this frame only, such as a locked texture. Those layers
+  // are rasterized into the targets instead of their surfaces
+  render(optSetIndex, optTargets) {
     let world = this._world || {};
 
     let bottomPalette = world.palette;
@@ -165,77 +320,221 @@ class Renderer {
       this._renderHeight = bottomField.height;
     }
 
+    let setIndex = this._useSurfaceSet(optSetIndex);
+    this._allocSurfaces();
+    let bound = this._bindTargets(optTargets);
     this._renderScene(world);
+    this._spriteEngine.endFrame();
     this._maybeGridToSurface(world.grid);
     if (this._renderEventCallback) {
       this._renderEventCallback();
     }
+    this._unbindTargets(bound);
 
     // the renderer will return multiple RGB surfaces
     // by default, it allows the display to perform hardware compositing
     // by setting this option, the renderer will do software compositing
     if (this.requirements.forceSoftwareCompositor) {
-      if (this._comp == null) {
-        this._comp = new compositor.Compositor();
+      if (this._comps[setIndex] == null) {
+        this._comps[setIndex] = new compositor.Compositor();
       }
-      let combined = this._comp.combine(this._surfs,
+      let combined = this._comps[setIndex].combine(this._surfs,
                                         this._renderWidth,
                                         this._renderHeight,
                                         1);
       combined.grid = null;
+      combined[0].dirty = this._combineDirtyRects(this._surfs);
+      packDirtyRects(combined[0]);
+      combined.setIndex = setIndex;
+      this._maybeNotifySurfacesChanged(combined, setIndex);
       return combined;
     }
 
+    this._surfs.setIndex = setIndex;
+    this._maybeNotifySurfacesChanged(this._surfs, setIndex, bound);
     return this._surfs;
   }
 
-  _renderScene(world) {
+  _useSurfaceSet(optSetIndex) {
+    let num = this._numSurfaceSets;
+    if (this._surfaceSets == null) {
+      this._surfaceSets = new Array(num).fill(null);
+      this._pendingDamage = new Array(num).fill(null);
+    }
+    let index;
+    if (optSetIndex === undefined || optSetIndex === null) {
+      index = (this._setIndex + 1) % num;
+    } else if (types.isNumber(optSetIndex) && optSetIndex >= 0 &&
+               optSetIndex < num && Math.floor(optSetIndex) == optSetIndex) {
+      index = optSetIndex;
+    } else {
+      throw new Error(`render: invalid surface set ${optSetIndex}`);
+    }
+    this._setIndex = index;
+    this._surfs = this._surfaceSets[index];
+    return index;
+  }
+
+  // Damage is relative to the previous frame, but a set of surfaces was last
+  // rendered some frames ago. Every other set is owed this frame's damage,
+  // and the current set pays back everything it was owed
+  _accumulateDamage(damage) {
+    if (this._numSurfaceSets == 1) {
+      return damage;
+    }
+    let pending = this._pendingDamage;
+    let current = this._setIndex;
+    let raster = mergeDamage(pending[current], damage);
+    for (let s = 0; s < pending.length; s++) {
+      if (s != current) {
+        pending[s] = mergeDamage(pending[s], damage);
+      }
+    }
+    pending[current] = damage.map(() => []);
+    return raster;
+  }
+
+  _maybeNotifySurfacesChanged(surfaceList, setIndex, optBound) {
+    if (!this._surfacesChangedCallback) {
+      return;
+    }
+    let buffs = surfaceList.map((surf) => surf.buff);
+    buffs.push(surfaceList.grid ? surfaceList.grid.buff : null);
+    let prev = this._registeredBuffs[setIndex];
+    if (prev && prev.length == buffs.length &&
+        prev.every((buff, i) => buff === buffs[i])) {
+      return;
+    }
+    this._registeredBuffs[setIndex] = buffs;
+    // The display takes back the targets it lent once it has new surfaces,
+    // so this frame has to be in the surfaces themselves
+    this._copyFromTargets(optBound);
+    this._surfacesChangedCallback(surfaceList);
+  }
+
+  // Allocate rendering results for each layer
+  _allocSurfaces() {
+    if (this._surfs != null) {
+      return;
+    }
     let width = this._renderWidth;
     let height = this._renderHeight;
+    let numPoints = width * height;
+    let numLayers = this._layers.length;
+    this._surfs = new Array(numLayers);
+    for (let i = 0; i < numLayers; i++) {
+      this._surfs[i] = {};
+      let surface = this._surfs[i];
+      surface.width = width;
+      surface.height = height;
+      surface.buff = new Uint8Array(numPoints * 4);
+      surface.pitch = width * 4;
+      surface.format = 'rgba';
+      surface.palette = null;
+      surface.pan = null;
+      surface.visible = true;
+      surface.blend = 'alpha';
+    }
+    this._surfaceSets[this._setIndex] = this._surfs;
+    this._layerState = null;
+  }
 
-    // Allocate rendering results for each layer
-    if (this._surfs == null) {
-      let numPoints = width * height;
-      let numLayers = this._layers.length;
-      this._surfs = new Array(numLayers);
-      for (let i = 0; i < numLayers; i++) {
-        this._surfs[i] = {};
-        let surface = this._surfs[i];
-        surface.width = width;
-        surface.height = height;
-        surface.buff = new Uint8Array(numPoints * 4);
-        surface.pitch = width * 4;
+  // Point surfaces at the targets for this frame. Their contents are not
+  // known, so the entire frame is rasterized. A target that does not fit its
+  // surface was lent for surfaces that have since been allocated again, or
+  // was already taken back, and the surface is rasterized as usual
+  _bindTargets(targets) {
+    if (targets == null) {
+      return null;
+    }
+    if (this.requirements.forceSoftwareCompositor || this._indexedOutput ||
+        this._hardwareScroll) {
+      throw new Error(`render: targets need hardware compositing of RGBA, ` +
+                      `at the size of the display`);
+    }
+    let bound = [];
+    let num = Math.min(targets.length, this._surfs.length);
+    for (let i = 0; i < num; i++) {
+      let target = targets[i];
+      if (!target) {
+        continue;
+      }
+      let surf = this._surfs[i];
+      if (!(target.pitch >= surf.width * 4) ||
+          !(target.buff.length >= target.pitch * surf.height)) {
+        continue;
       }
+      bound.push({surf: surf, buff: surf.buff, pitch: surf.pitch,
+                  target: target.buff, targetPitch: target.pitch});
+      surf.buff = target.buff;
+      surf.pitch = target.pitch;
+    }
+    this._layerState = null;
+    return bound;
+  }
+
+  // Give surfaces their own buffers back. Those were not drawn to, so the
+  // next frame that uses them rasterizes everything
+  _unbindTargets(bound) {
+    if (bound == null) {
+      return;
+    }
+    for (let b of bound) {
+      b.surf.buff = b.buff;
+      b.surf.pitch = b.pitch;
+      b.surf.dirty = null;
+      packDirtyRects(b.surf);
     }
+    this._layerState = null;
+  }
+
+  // Copy what was rasterized into the targets to the surfaces they stood in
+  // for, after _unbindTargets
+  _copyFromTargets(bound) {
+    if (bound == null) {
+      return;
+    }
+    for (let b of bound) {
+      let rowSize = b.surf.width * 4;
+      for (let y = 0; y < b.surf.height; y++) {
+        let start = y * b.targetPitch;
+        b.buff.set(b.target.subarray(start, start + rowSize), y * b.pitch);
+      }
+    }
+  }
+
+  _renderScene(world) {
+    let width = this._renderWidth;
+    let height = this._renderHeight;
 
     if (this._world.grid && !this._world.grid.buff) {
       this._renderGrid(this._world.grid);
     }
 
+    this._frameSerial++;
+    this._resolveFields();
+    this._spriteEngine.beginFrame();
+    this._layoutSurfaces(world);
+
+    // Find which parts of each layer have changed since the last render,
+    // and pass them along with the surfaces
+    let damage = this._collectDamage(world);
+    for (let i = 0; i < this._surfs.length; i++) {
+      this._surfs[i].dirty = damage[i];
+      packDirtyRects(this._surfs[i]);
+    }
+    let raster = this._accumulateDamage(damage);
+
     // If no interrupts, render everything at once.
     if (!world.interrupts) {
-      this._renderScreenSection(world, 0, 0, width, height);
+      this._renderScreenSection(world, 0, 0, width, height, raster);
       this._maybeHandleComponentsAndInspect(null, 0, height);
+      this._updateSurfacePalettes();
       return;
     }
 
-    // Otherwise, collect IRQs per each scanline
-    let perIRQs = [];
-    for (let k = 0; k < world.interrupts.length; k++) {
-      let row = world.interrupts.get(k);
-      if (types.isArray(row.scanline)) {
-        let lineRange = row.scanline;
-        // TODO: Asset it is a pair of integers
-        for (let j = lineRange[0]; j < lineRange[1]+1; j++) {
-          perIRQs.push({scanline: j, irq: row.irq});
-        }
-        continue;
-      } else if (types.isNumber(row.scanline)) {
-        perIRQs.push({scanline: row.scanline, irq: row.irq});
-      } else {
-        throw new Error(`invalid scanline number: ${row.scanline}`);
-      }
-    }
+    // Otherwise, walk the compiled schedule of irqs
+    let schedule = world.interrupts.compile();
 
     // Track the x-position at each scanline of the bottom layer
     // TODO: generalize to multiple layers
@@ -244,22 +543,24 @@ class Renderer {
 
     // Per region rendering
     let renderBegin = 0;
-    for (let k = 0; k < perIRQs.length + 1; k++) {
+    for (let k = 0; k < schedule.count + 1; k++) {
       // Render a region up until the given scanline
       let scanLine;
-      if (k < perIRQs.length) {
-        scanLine = Math.min(perIRQs[k].scanline, height);
+      if (k < schedule.count) {
+        scanLine = Math.min(schedule.lines[k], height);
       } else {
         scanLine = height;
       }
       if (scanLine > renderBegin) {
         xposTrack[renderBegin] = bottomLayer.scroll.x;
+        // Interrupts may have changed fields, resolve them again
+        this._resolveFields();
         this._renderScreenSection(world, 0, renderBegin, width, scanLine);
         this._maybeHandleComponentsAndInspect(k, renderBegin, scanLine);
       }
       // Execute the irq that interrupts rasterization
-      if (k < perIRQs.length) {
-        perIRQs[k].irq(scanLine);
+      if (k < schedule.count) {
+        schedule.irqs[k](scanLine);
       }
       // Resume rendering at the given scanline
       renderBegin = scanLine;
@@ -269,69 +570,405 @@ class Renderer {
     world.interrupts.xposTrack = xposTrack;
   }
 
-  _renderScreenSection(world, left, top, right, bottom) {
+  // Pick the format and size of each layer's surface for this frame,
+  // allocating its buffer again if they changed
+  _layoutSurfaces(world) {
+    for (let i = 0; i < this._surfs.length; i++) {
+      let surf = this._surfs[i];
+      surf.visible = this._layers[i].visible;
+      surf.blend = this._layers[i].blend;
+      let format = this._surfaceFormat(world, i);
+      let panSize = this._panSize(world, i);
+      let width = panSize ? panSize[0] : this._renderWidth;
+      let height = panSize ? panSize[1] : this._renderHeight;
+      if (surf.format == format && surf.width == width &&
+          surf.height == height && !surf.pan == !panSize) {
+        continue;
+      }
+      let numPoints = width * height;
+      if (format == 'index8') {
+        surf.buff = new Uint8Array(numPoints);
+        surf.pitch = width;
+        surf.palette = new Uint32Array(256);
+      } else {
+        surf.buff = new Uint8Array(numPoints * 4);
+        surf.pitch = width * 4;
+        surf.palette = null;
+      }
+      surf.width = width;
+      surf.height = height;
+      surf.pan = panSize ? new Int32Array(2) : null;
+      surf.format = format;
+      if (this._layerState) {
+        this._layerState[i] = null;
+      }
+    }
+  }
+
+  // A layer is indexed when every color it outputs comes from its palette's
+  // lookup table. Colorspaces, palette writes by line tables, and mixed
+  // sprites don't, and interrupts may change the palette mid-frame
+  _surfaceFormat(world, i) {
+    let layer = this._layers[i];
+    if (!this._indexedOutput || this.requirements.forceSoftwareCompositor ||
+        world.interrupts || layer.colorspace ||
+        (layer.linetable && layer.linetable.hasColors())) {
+      return 'rgba';
+    }
+    if (i == this._layers.length - 1 && world.spritelist &&
+        world.spritelist.enabled && world.spritelist.items.length > 0) {
+      let chardat = world.spritelist.chardat || layer.tileset;
+      if (chardat) {
+        this._spriteEngine.prepare(world.spritelist, chardat,
+                                   this._renderWidth, this._renderHeight);
+        if (!this._spriteEngine.fitsIndexes()) {
+          return 'rgba';
+        }
+      }
+    }
+    return 'index8';
+  }
+
+  // Size of the layer's entire field in pixels, if the display can pan
+  // across it, otherwise null. The field has to cover the display, so that
+  // it wraps, and be drawn the same way at any scroll, so the layer can't
+  // have interrupts, line tables, or colorspaces, or be below sprites
+  _panSize(world, i) {
+    let layer = this._layers[i];
+    if (!this._hardwareScroll || this.requirements.forceSoftwareCompositor ||
+        world.interrupts || layer.linetable || layer.colorspace) {
+      return null;
+    }
+    if (i == this._layers.length - 1 && world.spritelist &&
+        world.spritelist.enabled && world.spritelist.items.length > 0) {
+      return null;
+    }
+    let width = layer.field.width;
+    let height = layer.field.height;
+    if (layer.tileset) {
+      width *= layer.tileset.tileWidth;
+      height *= layer.tileset.tileHeight;
+    }
+    if (!this._isWrapped(width, height) ||
+        width > MAX_PAN_SIZE || height > MAX_PAN_SIZE) {
+      return null;
+    }
+    return [width, height];
+  }
+
+  // Indexed surfaces carry the lookup table that they were rendered with,
+  // where index 0 is transparent above the bottom layer
+  _updateSurfacePalettes() {
+    for (let i = 0; i < this._surfs.length; i++) {
+      let surf = this._surfs[i];
+      if (surf.format != 'index8') {
+        continue;
+      }
+      surf.palette.set(this._compileLayerPalette(this._layers[i]).lut);
+      if (i > 0) {
+        new Uint8Array(surf.palette.buffer, 0, 4)[3] = 0x00;
+      }
+    }
+  }
+
+  _resolveFields() {
     // If any layers have fields with pending changes, resolve them
     for (let layer of this._layers) {
       layer.field.fullyResolve();
     }
+  }
 
+  _renderScreenSection(world, left, top, right, bottom, damage) {
     for (let i = 0; i < this._layers.length; i++) {
-      this._renderLayerRegion(this._layers[i], this._surfs[i], world, i == 0,
-                              left, top, right, bottom);
+      let rects = damage ? damage[i] : null;
+      if (!this._surfs[i].visible) {
+        continue;
+      }
+      if (this._surfs[i].pan) {
+        this._renderPanLayer(this._layers[i], this._surfs[i], world, i == 0,
+                             rects);
+        continue;
+      }
+      if (rects == null) {
+        this._renderLayer(this._layers[i], this._surfs[i], world, i == 0,
+                          left, top, right, bottom);
+        continue;
+      }
+      // Only rasterize the parts of the layer that changed
+      for (let r of rects) {
+        this._renderLayer(this._layers[i], this._surfs[i], world, i == 0,
+                          r.x, r.y, r.x + r.w, r.y + r.h);
+      }
     }
     let lastSurface = this._surfs[this._surfs.length - 1];
-    this._renderSprites(world, lastSurface, left, top, right, bottom);
+    if (lastSurface.visible) {
+      this._renderSprites(world, lastSurface, left, top, right, bottom);
+    }
+  }
+
+  // Rasterize the layer's entire field without scroll, or the rects of it
+  // that changed, then point the surface's pan at the scroll
+  _renderPanLayer(layer, surf, world, isBg, rects) {
+    let scrollX = Math.floor((layer.scroll && layer.scroll.x) || 0);
+    let scrollY = Math.floor((layer.scroll && layer.scroll.y) || 0);
+    if (rects == null) {
+      rects = [{x: 0, y: 0, w: surf.width, h: surf.height}];
+    }
+    for (let r of rects) {
+      this._renderLayerRegion(layer, surf, world, isBg,
+                              r.x, r.y, r.x + r.w, r.y + r.h,
+                              -scrollX, -scrollY, null);
+    }
+    surf.pan[0] = ((scrollX % surf.width) + surf.width) % surf.width;
+    surf.pan[1] = ((scrollY % surf.height) + surf.height) % surf.height;
+  }
+
+  _renderLayer(layer, surf, world, isBg, left, top, right, bottom) {
+    let table = layer.linetable;
+    if (!table) {
+      this._renderLayerRegion(layer, surf, world, isBg,
+                              left, top, right, bottom, 0, 0, null);
+      return;
+    }
+
+    // Palette writes from the scanlines above the region still apply
+    let lineLut = null;
+    let tableEnd = Math.min(bottom, table.height);
+    if (table.hasColors()) {
+      lineLut = this._beginLineLut(layer, table, Math.min(top, table.height));
+    }
+
+    // Split the region into runs of scanlines that share the same scroll
+    // offsets, and have no palette writes after their first scanline
+    let y = top;
+    while (y < tableEnd) {
+      if (lineLut) {
+        table.applyColorsAt(y, lineLut.bytes);
+      }
+      let offsetX = table.scrollX[y];
+      let offsetY = table.scrollY[y];
+      let end = y + 1;
+      while (end < tableEnd && table.scrollX[end] == offsetX &&
+             table.scrollY[end] == offsetY &&
+             !(lineLut && table.hasColorsAt(end))) {
+        end++;
+      }
+      this._renderLayerRegion(layer, surf, world, isBg,
+                              left, y, right, end, offsetX, offsetY, lineLut);
+      y = end;
+    }
+    if (lineLut) {
+      lineLut.line = Math.max(lineLut.line, tableEnd);
+    }
+    if (y < bottom) {
+      // Scanlines past the end of the table have no offsets
+      this._renderLayerRegion(layer, surf, world, isBg,
+                              left, y, right, bottom, 0, 0, lineLut);
+    }
   }
 
-  _renderLayerRegion(layer, surf, world, isBg, left, top, right, bottom) {
+  // Copy of the layer's lookup table, for palette writes by its line table,
+  // with the writes of every scanline above `line` applied. Regions of a
+  // frame mostly arrive from the top down, so the table is carried from one
+  // region to the next. It starts over from the palette in a new frame, for
+  // a region above the last one, or once the palette or the table changed
+  _beginLineLut(layer, table, line) {
+    let compiled = this._compileLayerPalette(layer);
+    let lineLut = layer.lineLut;
+    if (!lineLut) {
+      let lut = new Uint32Array(256);
+      lineLut = {lut: lut, bytes: new Uint8Array(lut.buffer)};
+      layer.lineLut = lineLut;
+    }
+    if (lineLut.frame !== this._frameSerial ||
+        lineLut.compiled !== compiled ||
+        lineLut.paletteVersion !== compiled.version ||
+        lineLut.tableVersion !== table._colorVersion ||
+        lineLut.line > line) {
+      lineLut.lut.set(compiled.lut);
+      lineLut.frame = this._frameSerial;
+      lineLut.compiled = compiled;
+      lineLut.paletteVersion = compiled.version;
+      lineLut.tableVersion = table._colorVersion;
+      lineLut.line = 0;
+    }
+    for (let y = lineLut.line; y < line; y++) {
+      table.applyColorsAt(y, lineLut.bytes);
+    }
+    lineLut.line = Math.max(lineLut.line, line);
+    return lineLut;
+  }
+
+  // Pixels of the layer's tilemap with its tiles drawn in. Kept until any
+  // field or the tileset changes, so that a frame rendered one interrupt
+  // region at a time only expands the tilemap once
+  _expandTilemap(layer) {
+    let map = layer.field;
+    let tileset = layer.tileset;
+    let flips = layer.tileflips;
+    let tileWidth = tileset.tileWidth;
+    let tileHeight = tileset.tileHeight;
+    let prev = layer.expandedTilemap;
+    if (prev && prev.damageSerial == damage.latestSerial() &&
+        prev.map === map.data && prev.mapPitch == map.pitch &&
+        prev.flips === (flips ? flips.data : null) &&
+        prev.tileset === tileset && prev.tiles === tileset.data &&
+        prev.numTiles == tileset.data.length &&
+        prev.tilesetVersion == tileset._version &&
+        prev.width == map.width * tileWidth &&
+        prev.height == map.height * tileHeight) {
+      return prev;
+    }
+
+    let sourceWidth = map.width * tileWidth;
+    let sourceHeight = map.height * tileHeight;
+    let source = new Uint8Array(sourceWidth * sourceHeight);
+    for (let yTile = 0; yTile < map.height; yTile++) {
+      for (let xTile = 0; xTile < map.width; xTile++) {
+        let k = yTile*map.pitch + xTile;
+        let c = map.data[k];
+        let t = tileset.get(c);
+        if (t === undefined) {
+          continue;
+        }
+        let flip = 0;
+        if (flips) {
+          flip = flips.data[yTile*flips.pitch + xTile];
+        }
+        for (let i = 0; i < t.height; i++) {
+          for (let j = 0; j < t.width; j++) {
+            let y = yTile * tileHeight + i;
+            let x = xTile * tileWidth + j;
+            let n = y * sourceWidth + x;
+            source[n] = t.get((flip & 1) ? t.width - 1 - j : j,
+                              (flip & 2) ? t.height - 1 - i : i);
+          }
+        }
+      }
+    }
+    // Taken after expanding, since reading a tile may prepare its data
+    layer.expandedTilemap = {
+      data: source, width: sourceWidth, height: sourceHeight,
+      damageSerial: damage.latestSerial(),
+      map: map.data, mapPitch: map.pitch,
+      flips: flips ? flips.data : null,
+      tileset: tileset, tiles: tileset.data, numTiles: tileset.data.length,
+      tilesetVersion: tileset._version,
+    };
+    return layer.expandedTilemap;
+  }
+
+  // Copy the layer's indexes, its colors are resolved by the display
+  _indexLayerRegion(layer, surf, scrollX, scrollY, left, top, right, bottom) {
+    let field = layer.field;
+    let tileset = layer.tileset;
+    if (tileset != null) {
+      let flips = layer.tileflips;
+      kernels.indexTiles(tileset.data, field.data, field.pitch,
+                         field.width, field.height,
+                         flips ? flips.data : null, flips ? flips.pitch : 0,
+                         tileset.tileWidth, tileset.tileHeight,
+                         scrollX, scrollY,
+                         this._isWrapped(field.width * tileset.tileWidth,
+                                         field.height * tileset.tileHeight),
+                         surf.buff, surf.pitch, left, top, right, bottom);
+      return;
+    }
+    kernels.indexLayer(field.data, field.pitch, field.width, field.height,
+                       scrollX, scrollY,
+                       this._isWrapped(field.width, field.height),
+                       surf.buff, surf.pitch, left, top, right, bottom);
+  }
+
+  _renderLayerRegion(layer, surf, world, isBg, left, top, right, bottom,
+                     offsetX, offsetY, lineLut) {
 
     let source = layer.field.data;
     let sourcePitch = layer.field.pitch;
     let sourceWidth = layer.field.width;
     let sourceHeight = layer.field.height;
 
-    if (layer.tileset != null) {
-      // Calculate the size
-      let tileSize = layer.tileset.tileWidth * layer.tileset.tileHeight;
-      let numPoints = layer.field.height * layer.field.width;
-      sourceWidth = layer.field.width * layer.tileset.tileWidth;
-      sourceHeight = layer.field.height * layer.tileset.tileHeight;
-      sourcePitch = layer.tileset.tileWidth * layer.field.width;
-      source = new Uint8Array(numPoints * tileSize);
-
-      for (let yTile = 0; yTile < layer.field.height; yTile++) {
-        for (let xTile = 0; xTile < layer.field.width; xTile++) {
-          let k = yTile*layer.field.pitch + xTile;
-          let c = layer.field.data[k];
-          let t = layer.tileset.get(c);
-          if (t === undefined) {
-            continue;
-          }
-          for (let i = 0; i < t.height; i++) {
-            for (let j = 0; j < t.width; j++) {
-              let y = yTile * layer.tileset.tileHeight + i;
-              let x = xTile * layer.tileset.tileWidth + j;
-              let n = y * sourceWidth + x;
-              source[n] = t.get(j, i);
-            }
-          }
-        }
+    let scrollY = Math.floor((layer.scroll && layer.scroll.y) || 0) + offsetY;
+    let scrollX = Math.floor((layer.scroll && layer.scroll.x) || 0) + offsetX;
+
+    if (surf.format == 'index8') {
+      this._indexLayerRegion(layer, surf, scrollX, scrollY,
+                             left, top, right, bottom);
+      return;
+    }
+
+    let cells = layer.colorspace ? layer.colorspace.compile() : null;
+    // Tiles cached by the TileCache use the palette's colors, so palette
+    // writes by a line table need the uncached path
+    if (layer.tileset != null && this._useTileCache && !lineLut &&
+        this._hasCellPerTile(layer.tileset, cells)) {
+      // Copy the rows of tiles that were already converted to RGBA
+      let tileset = layer.tileset;
+      let isWrapped = this._isWrapped(layer.field.width * tileset.tileWidth,
+                                      layer.field.height * tileset.tileHeight);
+      if (!layer.tileCache) {
+        layer.tileCache = new tileCache.TileCache();
       }
+      layer.tileCache.render(tileset, layer.field, layer.tileflips, cells,
+                             this._compileLayerPalette(layer), isBg,
+                             isWrapped, scrollX, scrollY, surf,
+                             left, top, right, bottom);
+      return;
     }
 
-    let rgbtuple = new Uint8Array(4);
+    if (layer.tileset != null && !layer.colorspace) {
+      // Only visit the tiles in view, reading their pixels directly
+      let tileset = layer.tileset;
+      let isWrapped = this._isWrapped(layer.field.width * tileset.tileWidth,
+                                      layer.field.height * tileset.tileHeight);
+      let flips = layer.tileflips;
+      let compiled = lineLut || this._compileLayerPalette(layer);
+      kernels.rasterizeTiles(tileset.data, layer.field.data, layer.field.pitch,
+                             layer.field.width, layer.field.height,
+                             flips ? flips.data : null, flips ? flips.pitch : 0,
+                             tileset.tileWidth, tileset.tileHeight,
+                             scrollX, scrollY, isWrapped, isBg,
+                             compiled.lut, surf.buff, surf.pitch,
+                             left, top, right, bottom);
+      return;
+    }
+
+    if (layer.tileset != null) {
+      // Colorspaces apply to the pixels, so expand the tilemap first
+      let expanded = this._expandTilemap(layer);
+      source = expanded.data;
+      sourceWidth = expanded.width;
+      sourceHeight = expanded.height;
+      sourcePitch = expanded.width;
+    }
 
     let targetPitch = surf.pitch;
 
-    let scrollY = Math.floor((layer.scroll && layer.scroll.y) || 0);
-    let scrollX = Math.floor((layer.scroll && layer.scroll.x) || 0);
+    let isWrapped = this._isWrapped(sourceWidth, sourceHeight);
 
-    // TODO: allow layers aside from the bottom to enable wrap
-    let isWrapped = false;
-    if (sourceWidth >= this._renderWidth &&
-        sourceHeight >= this._renderHeight) {
-      isWrapped = true;
+    if (!layer.colorspace) {
+      // Each index maps to a single color, so rasterize using a lookup table
+      let compiled = lineLut || this._compileLayerPalette(layer);
+      kernels.rasterizeLayer(source, sourcePitch, sourceWidth, sourceHeight,
+                             scrollX, scrollY, isWrapped, isBg,
+                             compiled.lut, surf.buff, targetPitch,
+                             left, top, right, bottom);
+      return;
     }
+
+    if (cells.fitsLUT) {
+      // Each cell maps indexes to colors its own way, resolve it once per
+      // cell then use the lookup table
+      let compiled = lineLut || this._compileLayerPalette(layer);
+      kernels.rasterizeCells(source, sourcePitch, sourceWidth, sourceHeight,
+                             scrollX, scrollY, isWrapped, isBg,
+                             compiled.lut, cells, surf.buff, targetPitch,
+                             left, top, right, bottom);
+      return;
+    }
+
+    // Colors are outside of the lookup table, convert one pixel at a time
+    let rgbtuple = new Uint8Array(4);
     let numPlacements = 1;
 
     if (isWrapped) {
@@ -398,15 +1035,7 @@ class Renderer {
           let s = y*sourcePitch + x;
           let t = i*targetPitch + j*4;
           let c = source[s];
-          if (layer.colorspace) {
-            let cell = layer.colorspace.getCellAtPixel(x, y);
-            let attr = cell.attr;
-            if (Array.isArray(attr)) {
-              c = attr[c % attr.length];
-            } else {
-              c = layer.colorspace.realizeIndexedColor(c, x, y);
-            }
-          }
+          c = layer.colorspace.realizeIndexedColor(c, x, y);
           if (!this._toColor(layer, c, rgbtuple)) {
             surf.buff[t+3] = 0x00;
             continue;
@@ -425,93 +1054,272 @@ class Renderer {
     }
   }
 
-  _renderSprites(world, surf, _left, _top, right, bottom) {
-    // TODO: fix me
-    let layer = this._layers[this._layers.length - 1];
-    let targetPitch = surf.pitch;
-    let rgbtuple = new Uint8Array(4);
-    let scrollY = Math.floor((layer.scroll && layer.scroll.y) || 0);
-    let scrollX = Math.floor((layer.scroll && layer.scroll.x) || 0);
+  // Whether each tile has a single colorspace cell, or there is no colorspace
+  _hasCellPerTile(tileset, cells) {
+    if (!cells) {
+      return true;
+    }
+    return (cells.fitsLUT && cells.cellWidth == tileset.tileWidth &&
+            cells.cellHeight == tileset.tileHeight);
+  }
 
-    if (!world.spritelist || !world.spritelist.enabled) {
-      return;
+  _isWrapped(sourceWidth, sourceHeight) {
+    // TODO: allow layers aside from the bottom to enable wrap
+    return (sourceWidth >= this._renderWidth &&
+            sourceHeight >= this._renderHeight);
+  }
+
+  // The palette's lookup table, rebuilt only when the palette has changed
+  _compileLayerPalette(layer) {
+    let palette = layer.palette || this._world.palette;
+    return palette.compile(this._rgbmap);
+  }
+
+  // Returns, for each layer, a list of rects that need to be rasterized
+  // again, or null if the whole layer does
+  _collectDamage(world) {
+    let numLayers = this._layers.length;
+    if (!this._trackDamage) {
+      // Leave the damage for whichever renderer is tracking it
+      return new Array(numLayers).fill(null);
     }
-    if (world.spritelist.items.length == 0) {
-      return;
+    if (this._layerState == null) {
+      this._layerState = new Array(numLayers);
     }
+    let spriteRects = this._collectSpriteRects(world);
+    let damage = new Array(numLayers);
+    for (let i = 0; i < numLayers; i++) {
+      let layer = this._layers[i];
+      let field = layer.field;
+      // Always take the field's damage, so that it doesn't accumulate
+      let taken = field.takeDamage();
+      let prev = this._layerState[i];
+      if (!this._surfs[i].visible) {
+        // Not rasterized while hidden, so it renders in full once shown.
+        // Only the frame that hides it changes what is displayed
+        this._layerState[i] = {hidden: true};
+        damage[i] = (prev && prev.hidden) ? [] : null;
+        continue;
+      }
+      let state = {
+        field: field,
+        data: field.data,
+        width: field.width,
+        height: field.height,
+        scrollX: Math.floor((layer.scroll && layer.scroll.x) || 0),
+        scrollY: Math.floor((layer.scroll && layer.scroll.y) || 0),
+        lutSerial: null,
+      };
+      this._layerState[i] = state;
+      damage[i] = null;
 
-    let chardat = world.spritelist.chardat || layer.tileset;
-    if (!chardat) {
-      throw new Error('cannot render sprites without character data')
+      if (this._surfs[i].pan) {
+        damage[i] = this._collectPanDamage(layer, this._surfs[i], taken,
+                                           prev, state);
+        continue;
+      }
+
+      // Tiles, colorspaces, line tables, and interrupts change the output in
+      // ways that are not tracked, so always render the entire layer
+      if (world.interrupts || layer.tileset ||
+          layer.colorspace || layer.linetable) {
+        continue;
+      }
+      // Indexed surfaces don't change with the palette, the display expands
+      // them with the new one
+      if (this._surfs[i].format != 'index8') {
+        state.lutSerial = this._compileLayerPalette(layer).serial;
+      }
+      if (!prev || !taken || taken.isFull || prev.field !== field ||
+          prev.data !== field.data || prev.width != field.width ||
+          prev.height != field.height || prev.scrollX != state.scrollX ||
+          prev.scrollY != state.scrollY || prev.lutSerial != state.lutSerial) {
+        continue;
+      }
+
+      let rects = this._fieldRectsToScreen(taken.rects, field,
+                                           state.scrollX, state.scrollY);
+      if (i == numLayers - 1) {
+        // Sprites are drawn onto the top layer, erase where they were
+        // and redraw where they are
+        rects = rects.concat(this._prevSpriteRects, spriteRects);
+      }
+      damage[i] = rects;
     }
+    this._prevSpriteRects = spriteRects;
+    return damage;
+  }
 
-    // draw back-to-front so that sprite[i] is above sprite[j] where i < j
-    for (let k = world.spritelist.items.length - 1; k >= 0; k--) {
-      let spr = world.spritelist.items[k];
+  // Damage of a layer whose surface holds its entire field, in the field's
+  // own pixels, so scrolling damages nothing. For a tiled layer, that is the
+  // map entries that changed, and wherever the tiles with new pixels are
+  _collectPanDamage(layer, surf, taken, prev, state) {
+    let field = layer.field;
+    let tileset = layer.tileset;
+    let flips = layer.tileflips || null;
+    let tileWidth = tileset ? tileset.tileWidth : 1;
+    let tileHeight = tileset ? tileset.tileHeight : 1;
+    state.tiles = tileset ? tileset.data.slice() : null;
+    state.tileSerials = tileset ? tileSerials(tileset) : null;
+    state.flips = flips;
+    state.tileWidth = tileWidth;
+    state.tileHeight = tileHeight;
+    if (surf.format != 'index8') {
+      state.lutSerial = this._compileLayerPalette(layer).serial;
+    }
+    let flipsTaken = flips ? flips.takeDamage() : null;
+    let changedTiles = tileset ? changedTileIds(state, prev) : [];
+
+    if (!prev || !prev.tiles != !state.tiles || !taken || taken.isFull ||
+        prev.field !== field || prev.data !== field.data ||
+        prev.width != field.width || prev.height != field.height ||
+        prev.flips !== flips || (flips && (!flipsTaken || flipsTaken.isFull)) ||
+        prev.tileWidth != tileWidth || prev.tileHeight != tileHeight ||
+        prev.lutSerial != state.lutSerial) {
+      return null;
+    }
 
-      if (spr.a) {
-        throw new Error(`deprecated: sprite.a, use sprite.p`);
+    let rects = [];
+    let add = (x, y, w, h) => {
+      let x0 = Math.max(x, 0);
+      let y0 = Math.max(y, 0);
+      let x1 = Math.min(x + w, field.width);
+      let y1 = Math.min(y + h, field.height);
+      if (x0 < x1 && y0 < y1) {
+        rects.push({x: x0 * tileWidth, y: y0 * tileHeight,
+                    w: (x1 - x0) * tileWidth, h: (y1 - y0) * tileHeight});
       }
+    };
+    for (let r of taken.rects) {
+      add(r.x, r.y, r.w, r.h);
+    }
+    for (let r of (flipsTaken ? flipsTaken.rects : [])) {
+      add(r.x, r.y, r.w, r.h);
+    }
+    if (changedTiles.length > 0) {
+      // Runs of map entries in each row that show a changed tile
+      let changed = new Set(changedTiles);
+      for (let y = 0; y < field.height; y++) {
+        let run = -1;
+        for (let x = 0; x <= field.width; x++) {
+          let hit = x < field.width &&
+                    changed.has(field.data[y * field.pitch + x]);
+          if (hit && run < 0) {
+            run = x;
+          } else if (!hit && run >= 0) {
+            add(run, y, x - run, 1);
+            run = -1;
+          }
+        }
+      }
+    }
+    return rects;
+  }
 
+  _collectSpriteRects(world) {
+    let rects = [];
+    if (!world.spritelist || !world.spritelist.enabled) {
+      return rects;
+    }
+    let layer = this._layers[this._layers.length - 1];
+    let chardat = world.spritelist.chardat || layer.tileset;
+    if (!chardat) {
+      return rects;
+    }
+    for (let spr of world.spritelist.items) {
       let sx = Math.floor(spr.x);
       let sy = Math.floor(spr.y);
-      // ensure size of sprite is set
-      if (sx === null || sx === undefined || sx < 0 || sx >= right) {
+      if (spr.i || !(sx >= 0) || !(sy >= 0)) {
         continue;
       }
-      if (sy === null || sy === undefined || sy < 0 || sy >= bottom) {
+      let obj = chardat.get(spr.c);
+      if (!obj) {
         continue;
       }
-      // invisible flag
-      if (spr.i) {
+      this._addClippedRect(rects, sx, sy, obj.width, obj.height);
+    }
+    return rects;
+  }
+
+  // Convert rects in field data coordinates to rects on the surface
+  _fieldRectsToScreen(rects, field, scrollX, scrollY) {
+    let sourceWidth = field.width;
+    let sourceHeight = field.height;
+    let isWrapped = this._isWrapped(sourceWidth, sourceHeight);
+    let result = [];
+    for (let r of rects) {
+      let x0 = Math.max(r.x, 0);
+      let y0 = Math.max(r.y, 0);
+      let x1 = Math.min(r.x + r.w, sourceWidth);
+      let y1 = Math.min(r.y + r.h, sourceHeight);
+      if (x0 >= x1 || y0 >= y1) {
         continue;
       }
-      // the character object
-      let obj = chardat.get(spr.c);
-      if (!obj) {
+      if (!isWrapped) {
+        this._addClippedRect(result, x0 - scrollX, y0 - scrollY,
+                             x1 - x0, y1 - y0);
         continue;
       }
-      for (let py = 0; py < obj.height; py++) {
-        for (let px = 0; px < obj.width; px++) {
-          let x = px + sx;
-          let y = py + sy;
-          if (x >= right || y >= bottom) {
-            continue;
-          }
-          // behind flag
-          if (spr.b === 0) {
-            let lx = (x + scrollX + layer.field.width) % layer.field.width;
-            let ly = (y + scrollY + layer.field.height) % layer.field.height;
-            let v = layer.field.get(lx, ly);
-            if (v > 0) {
-              continue;
-            }
-          }
-          let t = y*targetPitch + x*4;
-          // color value for this pixel
-          let rx = spr.h ? obj.width  - px - 1 : px;
-          let ry = spr.v ? obj.height - py - 1 : py;
-          let c = obj.get(rx, ry);
-          if (c > 0) {
-            if (spr.p != null) {
-              c += spr.p;
-            }
-            this._toColor(layer, c, rgbtuple);
-            if (spr.m) {
-              surf.buff[t+0] += rgbtuple[R_INDEX];
-              surf.buff[t+1] += rgbtuple[G_INDEX];
-              surf.buff[t+2] += rgbtuple[B_INDEX];
-              surf.buff[t+3] = 0xff;
-            } else {
-              surf.buff[t+0] = rgbtuple[R_INDEX];
-              surf.buff[t+1] = rgbtuple[G_INDEX];
-              surf.buff[t+2] = rgbtuple[B_INDEX];
-              surf.buff[t+3] = 0xff;
-            }
-          }
+      // A wrapped rect may be split across the edges of the source
+      let sx = (((x0 - scrollX) % sourceWidth) + sourceWidth) % sourceWidth;
+      let sy = (((y0 - scrollY) % sourceHeight) + sourceHeight) % sourceHeight;
+      for (let [top, height] of splitSpan(sy, y1 - y0, sourceHeight)) {
+        for (let [left, width] of splitSpan(sx, x1 - x0, sourceWidth)) {
+          this._addClippedRect(result, left, top, width, height);
         }
       }
     }
+    return result;
+  }
+
+  _addClippedRect(rects, x, y, w, h) {
+    let x0 = Math.max(x, 0);
+    let y0 = Math.max(y, 0);
+    let x1 = Math.min(x + w, this._renderWidth);
+    let y1 = Math.min(y + h, this._renderHeight);
+    if (x0 < x1 && y0 < y1) {
+      rects.push({x: x0, y: y0, w: x1 - x0, h: y1 - y0});
+    }
+  }
+
+  _combineDirtyRects(surfs) {
+    let rects = [];
+    for (let surf of surfs) {
+      if (surf.dirty == null) {
+        return null;
+      }
+      rects = rects.concat(surf.dirty);
+    }
+    return rects;
+  }
+
+  _renderSprites(world, surf, left, top, right, bottom) {
+    // TODO: fix me
+    let layer = this._layers[this._layers.length - 1];
+    let scrollY = Math.floor((layer.scroll && layer.scroll.y) || 0);
+    let scrollX = Math.floor((layer.scroll && layer.scroll.x) || 0);
+
+    if (!world.spritelist || !world.spritelist.enabled) {
+      return;
+    }
+    if (world.spritelist.items.length == 0) {
+      return;
+    }
+
+    let chardat = world.spritelist.chardat || layer.tileset;
+    if (!chardat) {
+      throw new Error('cannot render sprites without character data')
+    }
+
+    // Sprites are bucketed by scanline once per frame, then each region only
+    // draws the rows inside of it
+    let engine = this._spriteEngine;
+    engine.prepare(world.spritelist, chardat,
+                   this._renderWidth, this._renderHeight);
+    let compiled = this._compileLayerPalette(layer);
+    engine.render(surf, compiled.bytes,
+                  (c, rgbtuple) => this._toColor(layer, c, rgbtuple),
+                  layer.field, scrollX, scrollY, left, top, right, bottom);
   }
 
   _maybeHandleComponentsAndInspect(numSplit, top, bottom) {
@@ -661,6 +1469,7 @@ class Renderer {
 
         if (!this.innerFieldRenderer) {
           this.innerFieldRenderer = new Renderer();
+          this.innerFieldRenderer.disableDamageTracking();
           let components = [{
             field: myField,
             palette: myPalette,
@@ -790,12 +1599,105 @@ class Renderer {
     if (palette == null) {
       palette = this._world.palette;
     }
+    if (c >= 0 && c < 256 && c === Math.floor(c)) {
+      let bytes = palette.compile(this._rgbmap).bytes;
+      let k = c * RGB_PIXEL_SIZE;
+      rgbtuple[R_INDEX] = bytes[k+0];
+      rgbtuple[G_INDEX] = bytes[k+1];
+      rgbtuple[B_INDEX] = bytes[k+2];
+      rgbtuple[3] = 0xff;
+      return true;
+    }
     palette.getRGBUsing(c, rgbtuple, this._rgbmap);
     return true;
   }
 }
 
 
+function assertBlendMode(blend) {
+  if (blend != null && !BLEND_MODES.includes(blend)) {
+    throw new Error(`blend must be one of ${BLEND_MODES.join(', ')}, ` +
+                    `got ${blend}`);
+  }
+}
+
+
+// Copy surface.dirty into surface.dirtyPacked, an Int32Array that native
+// code can read directly. It holds the number of rects, followed by x, y, w,
+// h for each one. A count of -1 means the entire surface
+function packDirtyRects(surface) {
+  if (!surface.dirtyPacked) {
+    surface.dirtyPacked = new Int32Array(1 + MAX_PACKED_RECTS * 4);
+  }
+  let packed = surface.dirtyPacked;
+  let rects = surface.dirty;
+  if (rects == null || rects.length > MAX_PACKED_RECTS) {
+    packed[0] = -1;
+    return;
+  }
+  packed[0] = rects.length;
+  for (let i = 0; i < rects.length; i++) {
+    packed[1 + i*4 + 0] = rects[i].x;
+    packed[1 + i*4 + 1] = rects[i].y;
+    packed[1 + i*4 + 2] = rects[i].w;
+    packed[1 + i*4 + 3] = rects[i].h;
+  }
+}
+
+
+// Damage serial of each tile, see Field.damageSerial
+function tileSerials(tileset) {
+  let tiles = tileset.data;
+  let serials = new Array(tiles.length);
+  for (let id = 0; id < tiles.length; id++) {
+    let t = tiles[id];
+    serials[id] = (t && t.damageSerial) ? t.damageSerial() : 0;
+  }
+  return serials;
+}
+
+// Ids of the tiles that are different, or had their pixels modified, since
+// the layer's previous state. Tile damage is compared by serial rather than
+// taken, so every layer on the tileset sees the same edits
+function changedTileIds(state, prev) {
+  let prevTiles = (prev && prev.tiles) || [];
+  let prevSerials = (prev && prev.tileSerials) || [];
+  let changed = [];
+  let count = Math.max(state.tiles.length, prevTiles.length);
+  for (let id = 0; id < count; id++) {
+    if (state.tiles[id] !== prevTiles[id] ||
+        state.tileSerials[id] !== prevSerials[id]) {
+      changed.push(id);
+    }
+  }
+  return changed;
+}
+
+// Combine two lists of per-layer damage. A null list, or a null entry for a
+// layer, means everything is damaged
+function mergeDamage(a, b) {
+  if (a == null || b == null) {
+    return null;
+  }
+  return a.map((rects, i) => {
+    if (rects == null || b[i] == null) {
+      return null;
+    }
+    let merged = rects.concat(b[i]);
+    return merged.length > MAX_PACKED_RECTS ? null : merged;
+  });
+}
+
+
+// Split the span [begin, begin+length) where it wraps around at size
+function splitSpan(begin, length, size) {
+  if (begin + length <= size) {
+    return [[begin, length]];
+  }
+  return [[begin, size - begin], [0, begin + length - size]];
+}
+
+
 class Inspector {
   constructor(owner) {
     this._owner = owner;
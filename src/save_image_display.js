@@ -1,13 +1,8 @@
 const baseDisplay = require('./base_display.js');
 const compositor = require('./compositor.js');
-const GIFEncoder = require('gif-encoder-2');
-const { createWriteStream, readdirSync } = require('fs');
-const { createCanvas, loadImage, ImageData } = require('canvas')
-const fs = require('fs');
-const os = require('os');
-const path = require('path');
-const util = require('util');
-const randstr = require('randomstring');
+const gifWriter = require('./gif_writer.js');
+const pngSink = require('./png_sink.js');
+const videoSink = require('./video_sink.js');
 
 
 class SaveImageDisplay extends baseDisplay.BaseDisplay {
@@ -16,9 +11,19 @@ class SaveImageDisplay extends baseDisplay.BaseDisplay {
     this.targetPath = targetPath;
     this._numFrames = numFrames;
     this.isGif = this.targetPath.endsWith('gif');
+    // Raw video, with no header, for piping to an encoder
+    this.rawFormat = null;
+    if (this.targetPath.endsWith('.rgba')) {
+      this.rawFormat = 'rgba';
+    } else if (this.targetPath.endsWith('.rgb')) {
+      this.rawFormat = 'rgb24';
+    }
     this._fsacc = fsacc;
     this._zoomLevel = 1;
+    this._zoomFilter = 'nearest';
     this._slowdown = null;
+    this._palette = null;
+    this._stream = null;
   }
 
   name() {
@@ -26,7 +31,11 @@ class SaveImageDisplay extends baseDisplay.BaseDisplay {
   }
 
   initialize() {
-    this._tmpdir = path.join(os.tmpdir(), 'raster-save-' + randstr.generate(8));
+  }
+
+  // Also write every frame to a raw video stream
+  streamTo(target, opt) {
+    this._stream = new videoSink.VideoSink(target, opt);
   }
 
   beginExec(refExec) {
@@ -35,24 +44,20 @@ class SaveImageDisplay extends baseDisplay.BaseDisplay {
     let scene = exec.refOwner.deref();
     this._slowdown = scene.slowdown ?? 1.0;
     scene.slowdown = null;
+    this._palette = scene.palette;
   }
 
   appLoop(runID, execNextFrame) {
     let width = this._width;
     let height = this._height;
 
-    try {
-      fs.mkdirSync(this._tmpdir);
-    } catch (e) {
-    }
-
     let hasTemplate = false;
 
     let numFrames = this._numFrames;
     if (!numFrames || numFrames < 0) {
       numFrames = 60;
     }
-    if (!this.isGif) {
+    if (!this.isGif && !this.rawFormat) {
       if (this._numFrames > 1) {
         if (!this.targetPath.includes('%02d')) {
           throw new Error(`saving a png to multiple frames requires template string, use "%02d" for --save`)
@@ -63,73 +68,69 @@ class SaveImageDisplay extends baseDisplay.BaseDisplay {
       }
     }
 
-    // Render each frame, and write to a file in a tmp directory.
-    let bufferList = [];
-    let doneCount = 0;
+    // Render each frame. Pngs go straight to their final path, while the
+    // sink encodes earlier frames in the background. Gif frames and raw
+    // video are streamed to the file as they are rendered
+    let sink = null;
+    let gif = null;
+    let streams = this._stream ? [this._stream] : [];
+    if (this.isGif) {
+      gif = this.createGif(width*this._zoomLevel, height*this._zoomLevel,
+                           this.targetPath);
+    } else if (this.rawFormat) {
+      streams.push(new videoSink.VideoSink(this.targetPath,
+                                           {format: this.rawFormat}));
+    } else {
+      sink = new pngSink.PngSink(this._fsacc);
+    }
+    let comp = new compositor.Compositor();
     for (let count = 0; count < numFrames; count++) {
       // TODO: Is this
       if (!this.isRunning()) {
         break;
       }
       execNextFrame();
-      let frameNum = leftPad(count, 3, '0');
-      let outFile = `${this._tmpdir}/${frameNum}.png`;
       let surfaces = this._renderer.render();
 
-      let comp = new compositor.Compositor();
       let combined = comp.combine(surfaces, this._width, this._height,
-                                  this._zoomLevel);
-      this._fsacc.saveTo(outFile, combined);
-      bufferList.push(combined[0].buff);
+                                  this._zoomLevel, this._zoomFilter);
+      for (let video of streams) {
+        video.write(combined[0]);
+      }
+      if (this.isGif) {
+        gif.addFrame(combined[0]);
+      } else if (this.rawFormat) {
+        // Only written to the video stream
+      } else if (hasTemplate) {
+        let param = leftPad(count, 2, '0');
+        sink.write(this.targetPath.replace('%02d', param), combined[0]);
+      } else {
+        sink.write(this.targetPath, combined[0]);
+      }
       this._renderer.flushBuffer();
     }
 
-    // Wait for each frame to render.
+    for (let video of streams) {
+      video.finish();
+    }
     if (this.isGif) {
-      // Actually write the gif.
-      this.createGif(width*this._zoomLevel, height*this._zoomLevel,
-                     bufferList, this.targetPath);
-    } else if (!hasTemplate) {
-      // Copy the first frame to our target path.
-      let infile = `${this._tmpdir}/000.png`;
-      let outfile = this.targetPath;
-      fs.copyFileSync(infile, outfile);
-    } else {
-      // Multiple frames
-      for (let count = 0; count < numFrames; count++) {
-        let frameNum = leftPad(count, 3, '0');
-        let param = leftPad(count, 2, '0');
-        let infile = `${this._tmpdir}/${frameNum}.png`;
-        let outfile = this.targetPath.replace('%02d', param);
-        fs.copyFileSync(infile, outfile);
-      }
+      gif.finish();
+      console.log(`wrote ${this.targetPath}`);
+    } else if (sink) {
+      sink.finish();
     }
   }
 
-  createGif(width, height, frames, outName) {
-    const encoder = new GIFEncoder(width, height, 'octree', false, frames.length);
-
-    const writeStream = createWriteStream(outName);
-    // when stream closes GIF is created so resolve promise
-    writeStream.on('close', () => {
-      console.log(`wrote ${outName}`);
-    })
-
-    encoder.createReadStream().pipe(writeStream);
-    encoder.setDelay(16.667 * this._slowdown);
-    encoder.start();
-
-    let canvas = createCanvas(width, height);
-    let ctx = canvas.getContext('2d');
-
-    for (let i = 0; i < frames.length; i++) {
-      let f = frames[i];
-      let carr = new Uint8ClampedArray(f);
-      let image = new ImageData(carr, width, height);
-      ctx.putImageData(image, 0, 0);
-      encoder.addFrame(ctx);
+  createGif(width, height, outName) {
+    // Seed the color table with the palette, so that indexed scenes map
+    // each pixel straight to its palette entry
+    let seedColors = [];
+    if (this._palette && this._palette._rgbmap) {
+      seedColors = this._palette._rgbmap;
     }
-    encoder.finish();
+    let delayCs = Math.round(16.667 * this._slowdown / 10);
+    return new gifWriter.GifWriter(outName, width, height, seedColors,
+                                   delayCs);
   }
 }
 
@@ -19,6 +19,7 @@ const sprites = require('./sprites.js');
 const compositor = require('./compositor.js');
 const colorspace = require('./colorspace.js');
 const interrupts = require('./interrupts.js');
+const lineTable = require('./line_table.js');
 const rgbColor = require('./rgb_color.js');
 const types = require('./types.js');
 const weak = require('./weak.js');
@@ -45,8 +46,10 @@ class Scene {
     this.palette = null;
     this.scroll = {};
     this.tileset = null;
+    this.tileflips = null;
     this.colorspace = null;
     this.interrupts = null;
+    this.linetable = null;
     this.spritelist = new sprites.Spritelist(0);
 
     this._font = null;
@@ -69,6 +72,7 @@ class Scene {
     this._initConfig();
     this.time = 0.0;
     this.tick = 0;
+    this.missedFrames = 0;
     this.TAU = 6.283185307179586;
     this.TURN = this.TAU;
     this.PI = this.TAU / 2;
@@ -301,10 +305,15 @@ class Scene {
     this._eventManager = null;
     this.time = 0.0;
     this.tick = 0;
+    this.missedFrames = 0;
     this.scroll = {};
     this.tileset = null;
+    this.tileflips = null;
     this.colorspace = null;
     this.interrupts = null;
+    this.linetable = null;
+    this.visible = null;
+    this.blend = null;
     this.spritelist.clear();
     this.rgbBuffer = null;
     this._initPalette();
@@ -316,9 +325,17 @@ class Scene {
   _initConfig() {
     this.config = {
       zoomScale: 1,
+      zoomFilter: 'nearest',
       titleText: '',
       translateCenter: false,
       gridUnit: null,
+      pipelineDepth: 1,
+      zeroCopy: false,
+      indexedOutput: false,
+      hardwareScroll: false,
+      frameRate: 60,
+      pacing: 'catchup',
+      videoStream: null,
     };
   }
 
@@ -330,6 +347,63 @@ class Scene {
     this.config.zoomScale = scale;
   }
 
+  setZoomFilter(filter) {
+    if (!algorithm.isZoomFilter(filter)) {
+      throw new Error(`setZoomFilter: unknown filter "${filter}"`);
+    }
+    this.config.zoomFilter = filter;
+  }
+
+  setFrameRate(rate, opt) {
+    if (![30, 50, 60, 120].includes(rate)) {
+      throw new Error(`setFrameRate: rate must be 30, 50, 60 or 120, got ${rate}`);
+    }
+    let pacing = (opt || {}).pacing || 'catchup';
+    if (pacing != 'catchup' && pacing != 'skip') {
+      throw new Error(`setFrameRate: unknown pacing "${pacing}"`);
+    }
+    this.config.frameRate = rate;
+    this.config.pacing = pacing;
+  }
+
+  getFrameStats() {
+    return this.display.getStats ? this.display.getStats() : null;
+  }
+
+  getFrameTrace() {
+    return this.display.getTrace ? this.display.getTrace() : null;
+  }
+
+  getTileCacheStats() {
+    return this._renderer.getTileCacheStats();
+  }
+
+  setVideoStream(target, opt) {
+    if (!types.isString(target) && !types.isNumber(target)) {
+      throw new Error(`setVideoStream: target must be a path or fd, got ${target}`);
+    }
+    this.config.videoStream = {target: target, opt: opt || {}};
+  }
+
+  setPipeline(depth) {
+    if (!types.isNumber(depth) || depth < 1 || depth > 3) {
+      throw new Error(`setPipeline: depth must be 1, 2 or 3, got ${depth}`);
+    }
+    this.config.pipelineDepth = depth;
+  }
+
+  setZeroCopy(enable) {
+    this.config.zeroCopy = !!enable;
+  }
+
+  setIndexedOutput(enable) {
+    this.config.indexedOutput = !!enable;
+  }
+
+  setHardwareScroll(enable) {
+    this.config.hardwareScroll = !!enable;
+  }
+
   setGrid(unit, opt) {
     let enable = !!unit;
     if (opt && opt.enable !== undefined) {
@@ -551,10 +625,38 @@ class Scene {
     this.display.setSceneSize(this.width, this.height);
     this.display.setRenderer(this._renderer);
     this.display.setZoom(this.config.zoomScale);
+    if (this.display.setZoomFilter) {
+      this.display.setZoomFilter(this.config.zoomFilter);
+    }
+    if (this.config.pipelineDepth > 1 && this.display.setPipelineDepth) {
+      this.display.setPipelineDepth(this.config.pipelineDepth);
+    }
+    if (this.config.zeroCopy && this.display.setZeroCopy) {
+      this.display.setZeroCopy(true);
+    }
+    if (this.config.indexedOutput && this.display.setIndexedOutput) {
+      this.display.setIndexedOutput(true);
+    }
+    if (this.config.hardwareScroll && this.display.setHardwareScroll) {
+      this.display.setHardwareScroll(true);
+    }
+
+    if (this.display.setFrameRate) {
+      this.display.setFrameRate(this.config.frameRate, this.config.pacing);
+    }
+
+    if (this.config.videoStream) {
+      if (!this.display.streamTo) {
+        throw new Error(`setVideoStream: display "${_displayName}" cannot stream video`);
+      }
+      let stream = this.config.videoStream;
+      this.display.streamTo(stream.target, stream.opt);
+    }
 
     this._ensureEvents();
     this._ensureExecutor();
     this._executor.setLifetime(this._numFrames, postRunFunc);
+    this._executor.setFrameRate(this.config.frameRate, this.config.pacing);
 
     this.then(() => {
       try {
@@ -601,7 +703,8 @@ class Scene {
     let surfs = this.renderPrimaryField();
     let comp = new compositor.Compositor();
     let combined = comp.combine(surfs, surfs[0].width, surfs[0].height,
-                                this.config.zoomScale);
+                                this.config.zoomScale,
+                                this.config.zoomFilter);
     this._fsacc.saveTo(savepath, combined);
   }
 
@@ -805,6 +908,7 @@ class Scene {
     }
     // Assign the palette to the scene
     this.palette._entries = items;
+    this.palette._changed();
     this.palette.giveFeatures(new weak.Ref(this));
     return this.palette;
   }
@@ -858,7 +962,9 @@ class Scene {
           pl.data[k] = recolor[c];
         }
       }
+      pl.addDamage(0, 0, pl.width, pl.height);
     }
+    this.palette._changed();
     return this.palette;
   }
 
@@ -877,6 +983,7 @@ class Scene {
         items.push(i);
       }
       this.palette._entries = items;
+      this.palette._changed();
     }
   }
 
@@ -990,6 +1097,7 @@ class Scene {
     }
     palette.agreeWithThem(coverageLook);
     palette._rgbmap = this.palette._rgbmap;
+    palette._changed();
     return palette;
   }
 
@@ -1044,6 +1152,12 @@ class Scene {
         build.tileset = this._banks.tileset[index];
       }
       build.scroll = this._banks.scroll[i];
+      if (layer.visible != null) {
+        build.visible = !!layer.visible;
+      }
+      if (layer.blend != null) {
+        build.blend = layer.blend;
+      }
       this._layering[i] = build;
     }
     this._ensureBankableScroll();
@@ -1114,6 +1228,9 @@ class Scene {
         // When buliding tileset from the current field, replace that
         // field with the generated pattern table.
         this.field = result.pattern;
+        if (result.flips) {
+          this.tileflips = result.flips;
+        }
       }
     } else {
       // Some other tileset-like thing: Tileset | Field | Number
@@ -1148,8 +1265,10 @@ class Scene {
     } else if (types.isField(param)) {
       // Field
       let build = new tiles.Tileset(detail);
-      let pattern = build.add(param, {dups: !!detail.dups}).toField();
-      return {tileset: build, pattern: pattern};
+      let table = build.add(param, {dups: !!detail.dups,
+                                    flips: !!detail.flips});
+      return {tileset: build, pattern: table.toField(),
+              flips: table.flipsToField()};
     } else if (types.isNumber(param)) {
       // Number
       let addon = {num: param};
@@ -1161,6 +1280,16 @@ class Scene {
     }
   }
 
+  // Field with the flips of each tile in the tilemap, 1 is horizontal
+  // and 2 is vertical
+  useTileFlips(pl) {
+    if (!types.isField(pl)) {
+      throw new Error(`useTileFlips requires a Field`);
+    }
+    this.tileflips = pl;
+    return this.tileflips;
+  }
+
   useColorspace(pl, sizeInfo) {
     if (!this.palette) {
       // TODO: Colorspace without a palette just slices up colorMap
@@ -1184,6 +1313,49 @@ class Scene {
     return this.interrupts;
   }
 
+  // Per-scanline scroll offsets and palette writes for a layer, see
+  // LineTable. The param is a LineTable or options to make one, and
+  // `opt.layer` picks which layer to attach it to
+  useLineTable(conf, opt) {
+    conf = conf || {};
+    opt = opt || conf;
+    let index = opt.layer || 0;
+    let layers = this._layering || [this];
+    if (!layers[index]) {
+      throw new Error(`useLineTable layer ${index} does not exist`);
+    }
+    let table = conf;
+    if (!types.isLineTable(conf)) {
+      if (!types.isObject(conf)) {
+        throw new Error(`useLineTable param must be options or a LineTable`);
+      }
+      if (!conf.height && !this.height) {
+        this._setDisplaySize();
+      }
+      table = new lineTable.LineTable(conf.height || this.height, conf);
+    }
+    layers[index].linetable = table;
+    return table;
+  }
+
+  setLayerVisible(index, visible) {
+    let layers = this._layering || [this];
+    if (!layers[index]) {
+      throw new Error(`setLayerVisible layer ${index} does not exist`);
+    }
+    layers[index].visible = !!visible;
+    this._renderer.setLayerVisible(index, visible);
+  }
+
+  setLayerBlend(index, blend) {
+    let layers = this._layering || [this];
+    if (!layers[index]) {
+      throw new Error(`setLayerBlend layer ${index} does not exist`);
+    }
+    this._renderer.setLayerBlend(index, blend);
+    layers[index].blend = blend;
+  }
+
   provide() {
     // TODO: test directly, see what is provided for various (multilayer) setups
     let provision = [];
@@ -1223,12 +1395,24 @@ class Scene {
     if (components.tileset) {
       res.tileset = components.tileset;
     }
+    if (components.tileflips) {
+      res.tileflips = components.tileflips;
+    }
     if (components.palette) {
       res.palette = components.palette;
     }
     if (components.colorspace) {
       res.colorspace = components.colorspace;
     }
+    if (components.linetable) {
+      res.linetable = components.linetable;
+    }
+    if (components.visible != null) {
+      res.visible = components.visible;
+    }
+    if (components.blend != null) {
+      res.blend = components.blend;
+    }
     res.size = this._calculatePixelSize(res);
     // TODO: this is bad, forcing the layerSize to match the sceneSize
     // This confuses a number of concepts and doesn't match the semantics
@@ -0,0 +1,341 @@
+const RGB_PIXEL_SIZE = 4;
+
+const FLAG_FLIP_H = 1;
+const FLAG_FLIP_V = 2;
+const FLAG_BEHIND = 4;
+const FLAG_MIX = 8;
+
+// Number of values kept for each sprite, to tell whether the list changed
+const SNAP_SIZE = 10;
+
+// Draws a spritelist onto the top layer's surface, one region at a time.
+//
+// Sprites are evaluated once per frame: each visible sprite is bucketed into
+// the scanlines it covers, and its character is decoded into a plain array
+// of rows. Rendering a region only visits the sprites on its own scanlines,
+// clipped to the region. If an interrupt changes the spritelist, it is
+// evaluated again for the scanlines below.
+//
+// With a line limit, only that many sprites are drawn on each scanline, in
+// order of priority, like the NES (8) or Mega Drive (20). Sprites past the
+// limit are dropped from that scanline alone, and the list's overflow flag
+// is set.
+class SpriteEngine {
+  constructor() {
+    this._frame = 0;
+    this._builtFrame = -1;
+    this._items = null;
+    this._chardat = null;
+    this._lineLimit = 0;
+    this._height = 0;
+    this._width = 0;
+    this._snap = [];
+    this._numEntries = 0;
+    this._fitsIndexes = true;
+    this._entX = new Int32Array(0);
+    this._entY = new Int32Array(0);
+    this._entFlags = new Int32Array(0);
+    this._entP = [];
+    this._entChar = [];
+    this._lineStarts = new Int32Array(1);
+    this._lineFill = new Int32Array(0);
+    this._lineItems = new Int32Array(0);
+    this._chars = new Map();
+    this._rgbtuple = new Uint8Array(RGB_PIXEL_SIZE);
+  }
+
+  // Called at the start of each frame, so the sprites and their characters
+  // are evaluated again
+  beginFrame() {
+    this._frame++;
+  }
+
+  /**
+   * evaluate the spritelist, unless it was already this frame and has not
+   * changed since
+   * @param {Spritelist} spritelist - sprites to draw
+   * @param {object} chardat - characters of the sprites, has get(c)
+   * @param {Number} width, height - size of the surface
+   */
+  prepare(spritelist, chardat, width, height) {
+    let items = spritelist.items;
+    let lineLimit = Math.floor(spritelist.lineLimit) || 0;
+    if (this._builtFrame == this._frame && this._items === items &&
+        this._chardat === chardat && this._lineLimit == lineLimit &&
+        this._width == width && this._height == height &&
+        this._sameSnapshot(items, chardat)) {
+      return;
+    }
+    this._items = items;
+    this._chardat = chardat;
+    this._lineLimit = lineLimit;
+    this._width = width;
+    this._height = height;
+    this._build(spritelist, chardat);
+    this._builtFrame = this._frame;
+  }
+
+  // Whether every pixel of the sprites is a single index of the palette, so
+  // they can be drawn onto an indexed surface. Valid after prepare
+  fitsIndexes() {
+    return this._fitsIndexes;
+  }
+
+  /**
+   * draw the sprites that are inside of a region of the surface
+   * @param {Surface} surf - surface of the top layer, RGBA or indexed
+   * @param {Uint8Array} bytes - compiled palette, see Palette.compile
+   * @param {Function} toColor - (c, rgbtuple) for colors outside of bytes
+   * @param {Field} behind - field that sprites with b == 0 are behind
+   * @param {Number} scrollX, scrollY - scroll of that field
+   * @param {Number} left, top, right, bottom - region of surf to draw
+   */
+  render(surf, bytes, toColor, behind, scrollX, scrollY,
+         left, top, right, bottom) {
+    let buff = surf.buff;
+    let pitch = surf.pitch;
+    let rgbtuple = this._rgbtuple;
+    let indexed = surf.format == 'index8';
+    let fdata = null, fpitch = 0, fwidth = 0, fheight = 0, foffs = 0;
+    if (behind) {
+      fdata = behind.data;
+      fpitch = behind.pitch;
+      fwidth = behind.width;
+      fheight = behind.height;
+      foffs = behind.offsetTop * behind.pitch + behind.offsetLeft || 0;
+    }
+    top = Math.max(top, 0);
+    bottom = Math.min(bottom, this._height);
+    for (let y = top; y < bottom; y++) {
+      // Draw back to front, so that sprite[i] is above sprite[j] where i < j
+      for (let n = this._lineStarts[y + 1] - 1; n >= this._lineStarts[y]; n--) {
+        let e = this._lineItems[n];
+        let ch = this._entChar[e];
+        let sx = this._entX[e];
+        let x0 = Math.max(sx, left);
+        let x1 = Math.min(sx + ch.width, right);
+        if (x0 >= x1) {
+          continue;
+        }
+        let flags = this._entFlags[e];
+        let p = this._entP[e];
+        let ry = y - this._entY[e];
+        if (flags & FLAG_FLIP_V) {
+          ry = ch.height - 1 - ry;
+        }
+        let row = ry * ch.width;
+        let flipH = (flags & FLAG_FLIP_H) != 0;
+        let ly = (y + scrollY + fheight) % fheight;
+        for (let x = x0; x < x1; x++) {
+          let px = x - sx;
+          let c = ch.pixels[row + (flipH ? ch.width - 1 - px : px)];
+          if (c == 0) {
+            continue;
+          }
+          if ((flags & FLAG_BEHIND) && fdata) {
+            let lx = (x + scrollX + fwidth) % fwidth;
+            if (lx >= 0 && ly >= 0 && fdata[foffs + ly * fpitch + lx] > 0) {
+              continue;
+            }
+          }
+          if (p != null) {
+            c += p;
+          }
+          if (indexed) {
+            buff[y * pitch + x] = c;
+            continue;
+          }
+          let src = bytes;
+          let k = c * RGB_PIXEL_SIZE;
+          if (!(c < 256 && c === Math.floor(c))) {
+            toColor(c, rgbtuple);
+            src = rgbtuple;
+            k = 0;
+          }
+          let t = y * pitch + x * RGB_PIXEL_SIZE;
+          if (flags & FLAG_MIX) {
+            buff[t+0] += src[k+0];
+            buff[t+1] += src[k+1];
+            buff[t+2] += src[k+2];
+          } else {
+            buff[t+0] = src[k+0];
+            buff[t+1] = src[k+1];
+            buff[t+2] = src[k+2];
+          }
+          buff[t+3] = 0xff;
+        }
+      }
+    }
+  }
+
+  _sameSnapshot(items, chardat) {
+    let snap = this._snap;
+    if (snap.length != items.length * SNAP_SIZE) {
+      return false;
+    }
+    for (let k = 0; k < items.length; k++) {
+      let spr = items[k];
+      let s = k * SNAP_SIZE;
+      if (snap[s+0] !== spr.x || snap[s+1] !== spr.y ||
+          snap[s+2] !== spr.c || snap[s+3] !== spr.p ||
+          snap[s+4] !== spr.i || snap[s+5] !== spr.h ||
+          snap[s+6] !== spr.v || snap[s+7] !== spr.b ||
+          snap[s+8] !== spr.m || snap[s+9] !== chardat.get(spr.c)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  _build(spritelist, chardat) {
+    let items = spritelist.items;
+    let width = this._width;
+    let height = this._height;
+    let lineLimit = this._lineLimit;
+    let snap = this._snap;
+    snap.length = items.length * SNAP_SIZE;
+    this._ensureCapacity(items.length, height);
+
+    // Find the visible sprites, in order of priority
+    let numEntries = 0;
+    let fitsIndexes = true;
+    for (let k = 0; k < items.length; k++) {
+      let spr = items[k];
+      if (spr.a) {
+        throw new Error(`deprecated: sprite.a, use sprite.p`);
+      }
+      let obj = chardat.get(spr.c);
+      let s = k * SNAP_SIZE;
+      snap[s+0] = spr.x;
+      snap[s+1] = spr.y;
+      snap[s+2] = spr.c;
+      snap[s+3] = spr.p;
+      snap[s+4] = spr.i;
+      snap[s+5] = spr.h;
+      snap[s+6] = spr.v;
+      snap[s+7] = spr.b;
+      snap[s+8] = spr.m;
+      snap[s+9] = obj;
+
+      let sx = Math.floor(spr.x);
+      let sy = Math.floor(spr.y);
+      if (!(sx >= 0) || sx >= width || !(sy >= 0) || sy >= height) {
+        continue;
+      }
+      // invisible flag
+      if (spr.i || !obj) {
+        continue;
+      }
+      let ch = this._decodeChar(obj);
+      if (ch.width <= 0 || ch.height <= 0) {
+        continue;
+      }
+      let e = numEntries++;
+      this._entX[e] = sx;
+      this._entY[e] = sy;
+      this._entFlags[e] = (spr.h ? FLAG_FLIP_H : 0) |
+                          (spr.v ? FLAG_FLIP_V : 0) |
+                          (spr.b === 0 ? FLAG_BEHIND : 0) |
+                          (spr.m ? FLAG_MIX : 0);
+      this._entP[e] = spr.p;
+      this._entChar[e] = ch;
+      // Mixed colors, and palettes past the end of the lookup table, need RGBA
+      let p = spr.p;
+      if (spr.m || (p != null && !(p === Math.floor(p) && p >= 0 &&
+                                   ch.maxIndex + p < 256))) {
+        fitsIndexes = false;
+      }
+    }
+    this._numEntries = numEntries;
+    this._fitsIndexes = fitsIndexes;
+
+    // Bucket them by scanline, a counting sort. Both passes visit sprites
+    // in the same order, so they agree on which ones are past the limit
+    let starts = this._lineStarts;
+    let fill = this._lineFill;
+    starts.fill(0, 0, height + 1);
+    let overflow = false;
+    for (let e = 0; e < numEntries; e++) {
+      let y1 = Math.min(this._entY[e] + this._entChar[e].height, height);
+      for (let y = this._entY[e]; y < y1; y++) {
+        if (lineLimit > 0 && starts[y + 1] >= lineLimit) {
+          overflow = true;
+          continue;
+        }
+        starts[y + 1]++;
+      }
+    }
+    for (let y = 0; y < height; y++) {
+      starts[y + 1] += starts[y];
+    }
+    if (this._lineItems.length < starts[height]) {
+      this._lineItems = new Int32Array(starts[height] * 2);
+    }
+    fill.set(starts.subarray(0, height));
+    for (let e = 0; e < numEntries; e++) {
+      let y1 = Math.min(this._entY[e] + this._entChar[e].height, height);
+      for (let y = this._entY[e]; y < y1; y++) {
+        if (fill[y] < starts[y + 1]) {
+          this._lineItems[fill[y]++] = e;
+        }
+      }
+    }
+    spritelist.overflow = overflow;
+  }
+
+  _ensureCapacity(numItems, height) {
+    if (this._entX.length < numItems) {
+      this._entX = new Int32Array(numItems);
+      this._entY = new Int32Array(numItems);
+      this._entFlags = new Int32Array(numItems);
+    }
+    if (this._lineStarts.length < height + 1) {
+      this._lineStarts = new Int32Array(height + 1);
+      this._lineFill = new Int32Array(height);
+    }
+    this._entP.length = numItems;
+    this._entChar.length = numItems;
+  }
+
+  // Rows of the character, read once per frame, so that it may change
+  // between frames
+  _decodeChar(obj) {
+    let ch = this._chars.get(obj);
+    if (ch && ch.frame == this._frame) {
+      return ch;
+    }
+    let width = Math.floor(obj.width) || 0;
+    let height = Math.floor(obj.height) || 0;
+    if (!ch) {
+      ch = {pixels: null, width: 0, height: 0, maxIndex: 0, frame: 0};
+      this._chars.set(obj, ch);
+    }
+    if (!ch.pixels || ch.pixels.length != width * height) {
+      ch.pixels = new Uint8Array(width * height);
+    }
+    ch.width = width;
+    ch.height = height;
+    ch.frame = this._frame;
+    let maxIndex = 0;
+    for (let y = 0; y < height; y++) {
+      for (let x = 0; x < width; x++) {
+        let k = y * width + x;
+        ch.pixels[k] = obj.get(x, y) || 0;
+        maxIndex = Math.max(maxIndex, ch.pixels[k]);
+      }
+    }
+    ch.maxIndex = maxIndex;
+    return ch;
+  }
+
+  // Forget characters that were not used this frame
+  endFrame() {
+    for (let [obj, ch] of this._chars) {
+      if (ch.frame != this._frame) {
+        this._chars.delete(obj);
+      }
+    }
+  }
+}
+
+module.exports.SpriteEngine = SpriteEngine;
@@ -32,9 +32,24 @@ class Spritelist {
     this.length = items.length;
     this.chardat = chardat;
     this.enabled = true;
+    // Most sprites drawn on a single scanline, 0 for no limit
+    this.lineLimit = 0;
+    // Set by the renderer when the last frame had more sprites on a
+    // scanline than the limit
+    this.overflow = false;
     return this;
   }
 
+  // Limit how many sprites are drawn on each scanline, like the NES (8) or
+  // Mega Drive (20). Lower indexes have priority, the rest are not drawn on
+  // that scanline
+  setLineLimit(num) {
+    if (!types.isNumber(num) || num < 0) {
+      throw new Error(`setLineLimit needs a number >= 0, got ${num}`);
+    }
+    this.lineLimit = Math.floor(num);
+  }
+
   clear() {
     this.items = new Array(0);
     this.length = 0;
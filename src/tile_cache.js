@@ -0,0 +1,335 @@
+const damage = require('./damage.js');
+const kernels = require('./kernels.js');
+const nativeAddon = require('./native_addon.js');
+
+const RGB_PIXEL_SIZE = 4;
+const ALPHA_OFFSET = 3;
+const TILE_FLIP_H = 1;
+const TILE_FLIP_V = 2;
+const ATTR_RANGE = 0x100000000;
+
+// Tiles of a layer that have already been converted to RGBA, keyed by tile
+// id and the colorspace attribute that resolved their colors, so rendering
+// copies their rows instead of looking up every pixel.
+//
+// Everything is dropped when the palette, the colorspace's entry lists, or
+// the size of the tiles change. A single tile's entries are dropped when the
+// tileset has a different tile at its id, or when the tile's pixels change.
+// Pixel changes are seen through the tile's damage serial, so the damage
+// itself is left for every other cache of the same tileset.
+//
+// Checking every tile is skipped when no field has been modified and the
+// tileset has not had a tile put since the last check, so that rendering a
+// frame one interrupt region at a time only checks the tiles once.
+//
+// The native addon's TileCache keeps the same entries on its side.
+class TileCache {
+  constructor() {
+    this._native = null;
+    if (nativeAddon && nativeAddon.TileCache) {
+      this._native = new nativeAddon.TileCache();
+    }
+    this._entries = new Map();
+    // Entries without a colorspace, by tile id, to skip hashing the key
+    this._plain = [];
+    this._numPlain = 0;
+    this._hits = 0;
+    this._misses = 0;
+    // Tile at each id when its entries were made, and its damage serial
+    this._tiles = [];
+    this._serials = [];
+    this._state = null;
+  }
+
+  /**
+   * render a region of a tiled layer, same output as kernels.rasterizeTiles,
+   * or when given cells, as rasterizeCells on the expanded tilemap
+   * @param {Tileset} tileset - tiles to draw
+   * @param {Field} tilemap - tile id of each map entry
+   * @param {Field} flips - optional, flips of each map entry
+   * @param {object} cells - optional, see Colorspace.compile, one cell per
+   *     map entry
+   * @param {object} compiled - compiled palette, see Palette.compile
+   * @param {boolean} isBg - if false, index 0 is transparent
+   * @param {boolean} isWrapped - whether the map repeats in both directions
+   * @param {Number} scrollX, scrollY - scroll, integer
+   * @param {Surface} surf - RGBA surface to write to
+   * @param {Number} left, top, right, bottom - region of surf to render
+   */
+  render(tileset, tilemap, flips, cells, compiled, isBg, isWrapped,
+         scrollX, scrollY, surf, left, top, right, bottom) {
+    this._validate(tileset, cells, compiled, isBg);
+    let tiles = tileset.data;
+    let flipsData = flips ? flips.data : null;
+    let flipsPitch = flips ? flips.pitch : 0;
+    if (this._native) {
+      this._native.render(tiles, tilemap.data, tilemap.pitch, tilemap.width,
+                          tilemap.height, flipsData, flipsPitch,
+                          tileset.tileWidth, tileset.tileHeight, cells,
+                          scrollX, scrollY, isWrapped, isBg, compiled.lut,
+                          surf.buff, surf.pitch, left, top, right, bottom);
+      return;
+    }
+    this._render(tiles, tilemap.data, tilemap.pitch, tilemap.width,
+                 tilemap.height, flipsData, flipsPitch, tileset.tileWidth,
+                 tileset.tileHeight, cells, scrollX, scrollY, isWrapped, isBg,
+                 compiled.lut, surf.buff, surf.pitch,
+                 left, top, right, bottom);
+  }
+
+  // {hits, misses, entries}
+  stats() {
+    if (this._native) {
+      return this._native.stats();
+    }
+    return {hits: this._hits, misses: this._misses,
+            entries: this._entries.size + this._numPlain};
+  }
+
+  clear() {
+    if (this._native) {
+      this._native.clear();
+    }
+    this._entries.clear();
+    this._plain = [];
+    this._numPlain = 0;
+    this._tiles = [];
+    this._serials = [];
+  }
+
+  _removeTile(id) {
+    if (this._native) {
+      this._native.removeTile(id);
+      return;
+    }
+    if (this._plain[id]) {
+      this._plain[id] = null;
+      this._numPlain--;
+    }
+    for (let key of this._entries.keys()) {
+      if (Math.floor(key / ATTR_RANGE) == id) {
+        this._entries.delete(key);
+      }
+    }
+  }
+
+  _validate(tileset, cells, compiled, isBg) {
+    let state = this._state;
+    let tiles = tileset.data;
+    let latest = damage.latestSerial();
+    if (state && state.tileset === tileset && state.tiles === tiles &&
+        state.numTiles == tiles.length &&
+        state.tilesetVersion == tileset._version &&
+        state.damageSerial == latest && state.cells === cells &&
+        state.lutSerial == compiled.serial && state.isBg == isBg &&
+        state.tileWidth == tileset.tileWidth &&
+        state.tileHeight == tileset.tileHeight) {
+      return;
+    }
+    if (!state || state.lutSerial != compiled.serial || state.isBg != isBg ||
+        state.tileWidth != tileset.tileWidth ||
+        state.tileHeight != tileset.tileHeight ||
+        !sameCellColors(state.cells, cells)) {
+      this.clear();
+      this._state = {
+        lutSerial: compiled.serial,
+        isBg: isBg,
+        tileWidth: tileset.tileWidth,
+        tileHeight: tileset.tileHeight,
+        cells: cells,
+      };
+    }
+    state = this._state;
+    state.cells = cells;
+    state.tileset = tileset;
+    state.tiles = tiles;
+    state.numTiles = tiles.length;
+    state.tilesetVersion = tileset._version;
+    state.damageSerial = latest;
+
+    let count = Math.max(tiles.length, this._tiles.length);
+    for (let id = 0; id < count; id++) {
+      let t = tiles[id];
+      let serial = (t && t.damageSerial) ? t.damageSerial() : 0;
+      if (t !== this._tiles[id] || serial !== this._serials[id]) {
+        this._removeTile(id);
+        this._tiles[id] = t;
+        this._serials[id] = serial;
+      }
+    }
+  }
+
+  _lookup(tiles, id, attr, tileWidth, tileHeight, cells, isBg, lut) {
+    let key = id * ATTR_RANGE + (attr >>> 0);
+    let pixels = cells ? this._entries.get(key) : this._plain[id];
+    if (pixels) {
+      this._hits++;
+      return pixels;
+    }
+    this._misses++;
+
+    // Colors of the tile, as in rasterizeCells
+    let colors = lut;
+    let size = 256;
+    if (cells) {
+      colors = new Uint32Array(256);
+      if (attr >= 0) {
+        size = cells.pieceSize;
+        if (size <= 0 || (attr + 1) * size > 256) {
+          return null;
+        }
+        colors.set(lut.subarray(attr * size, (attr + 1) * size));
+      } else {
+        let start = cells.listStarts[-1 - attr];
+        size = cells.listStarts[-attr] - start;
+        if (size <= 0 || size > 256) {
+          return null;
+        }
+        for (let m = 0; m < size; m++) {
+          let e = cells.lists[start + m];
+          if (e < 0 || e >= 256) {
+            return null;
+          }
+          colors[m] = lut[e];
+        }
+      }
+    }
+    // Upper layers treat index 0 as transparent, keeping its rgb value
+    let zeroColor = new Uint32Array([colors[0]]);
+    if (!isBg) {
+      new Uint8Array(zeroColor.buffer)[ALPHA_OFFSET] = 0x00;
+    }
+    let zero = zeroColor[0];
+
+    pixels = new Uint32Array(tileWidth * tileHeight);
+    let tile = tiles[id];
+    for (let y = 0; y < tileHeight; y++) {
+      let t = y * tileWidth;
+      if (!tile || !tile.data) {
+        // Missing tiles are index 0
+        pixels.fill(zero, t, t + tileWidth);
+        continue;
+      }
+      let s = y * tile.pitch;
+      for (let x = 0; x < tileWidth; x++) {
+        let c = tile.data[s + x];
+        pixels[t + x] = c == 0 ? zero : colors[c % size];
+      }
+    }
+    if (cells) {
+      this._entries.set(key, pixels);
+    } else {
+      this._plain[id] = pixels;
+      this._numPlain++;
+    }
+    return pixels;
+  }
+
+  _render(tiles, tilemap, mapPitch, mapWidth, mapHeight, flips, flipsPitch,
+          tileWidth, tileHeight, cells, scrollX, scrollY, isWrapped, isBg,
+          lut, target, targetPitch, left, top, right, bottom) {
+    let sourceWidth = mapWidth * tileWidth;
+    let sourceHeight = mapHeight * tileHeight;
+    if (sourceWidth <= 0 || sourceHeight <= 0) {
+      return;
+    }
+
+    let dest = kernels.pixelView(target);
+    let destPitch = targetPitch / RGB_PIXEL_SIZE;
+    let place = kernels.placeRegion(sourceWidth, sourceHeight,
+                                    scrollX, scrollY, isWrapped,
+                                    target, targetPitch,
+                                    left, top, right, bottom);
+    scrollX = place.scrollX;
+    scrollY = place.scrollY;
+
+    // Walk the region one block at a time, each block is the part of a
+    // single tile that is inside of the region
+    let rowEnd = place.rowEnd, colEnd = place.colEnd;
+    let i = place.rowBegin;
+    while (i < rowEnd) {
+      let y = (i + scrollY) % sourceHeight;
+      let mapY = Math.floor(y / tileHeight);
+      let innerY = y % tileHeight;
+      let numRows = Math.min(rowEnd - i, tileHeight - innerY);
+      let j = place.colBegin;
+      while (j < colEnd) {
+        let x = (j + scrollX) % sourceWidth;
+        let mapX = Math.floor(x / tileWidth);
+        let innerX = x % tileWidth;
+        let numCols = Math.min(colEnd - j, tileWidth - innerX);
+
+        let id = tilemap[mapY * mapPitch + mapX];
+        let pixels = null;
+        if (!cells) {
+          pixels = this._lookup(tiles, id, 0, tileWidth, tileHeight,
+                                null, isBg, lut);
+        } else if (mapX < cells.pitch && mapY < cells.height) {
+          let attr = cells.attrs[mapY * cells.pitch + mapX];
+          pixels = this._lookup(tiles, id, attr, tileWidth, tileHeight,
+                                cells, isBg, lut);
+        }
+        let flip = flips ? flips[mapY * flipsPitch + mapX] : 0;
+        for (let r = 0; r < numRows; r++) {
+          let t = (i + r) * destPitch + j;
+          if (!pixels) {
+            // Tile has no colors
+            let a = (i + r) * targetPitch + j * RGB_PIXEL_SIZE + ALPHA_OFFSET;
+            for (let k = 0; k < numCols; k++) {
+              target[a + k * RGB_PIXEL_SIZE] = 0x00;
+            }
+            continue;
+          }
+          let ty = innerY + r;
+          if (flip & TILE_FLIP_V) {
+            ty = tileHeight - 1 - ty;
+          }
+          let s = ty * tileWidth;
+          if (flip & TILE_FLIP_H) {
+            s += tileWidth - 1 - innerX;
+            for (let k = 0; k < numCols; k++) {
+              dest[t + k] = pixels[s - k];
+            }
+          } else {
+            // Blocks are at most a tile wide, copying directly is cheaper
+            // than making a subarray for each row
+            s += innerX;
+            for (let k = 0; k < numCols; k++) {
+              dest[t + k] = pixels[s + k];
+            }
+          }
+        }
+        j += numCols;
+      }
+      i += numRows;
+    }
+  }
+}
+
+// Whether two compiled colorspaces resolve each attribute to the same colors
+function sameCellColors(a, b) {
+  if (a == null || b == null) {
+    return a == b;
+  }
+  if (a.pieceSize != b.pieceSize) {
+    return false;
+  }
+  if (a.lists === b.lists && a.listStarts === b.listStarts) {
+    return true;
+  }
+  return sameArray(a.lists, b.lists) && sameArray(a.listStarts, b.listStarts);
+}
+
+function sameArray(a, b) {
+  if (a.length != b.length) {
+    return false;
+  }
+  for (let k = 0; k < a.length; k++) {
+    if (a[k] != b[k]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+module.exports.TileCache = TileCache;
@@ -6,6 +6,9 @@ const palette = require('./palette.js');
 const rgbmap = require('./rgb_map.js');
 const visualizer = require('./visualizer.js');
 
+const TILE_FLIP_H = 1;
+const TILE_FLIP_V = 2;
+
 class Tileset extends component.Component {
   // call with Tileset({tile_width: 8, tile_height: 8})
   //        or Tileset(tile, {tile_width: 8, tile_height: 8})
@@ -62,7 +65,11 @@ class Tileset extends component.Component {
     this.tileWidth = sizeInfo.tile_width;
     this.tileHeight = sizeInfo.tile_height;
     this.data = [];
-    this._lookupContents = {};
+    // Changes whenever put replaces a tile
+    this._version = 0;
+    // Ids of tiles by the hash of their contents. Each candidate is
+    // compared byte for byte, so stale ids are harmless
+    this._lookupContents = new Map();
 
     if (sizeInfo.num) {
       this._constructNumTiles(sizeInfo.num);
@@ -111,7 +118,7 @@ class Tileset extends component.Component {
 
   clear() {
     this.data = [];
-    this._lookupContents = {};
+    this._lookupContents = new Map();
   }
 
   isEmpty() {
@@ -131,7 +138,12 @@ class Tileset extends component.Component {
     if (!types.isTile(t)) {
       throw new Error(`can only put Tile to tileset`);
     }
+    if (t.width != this.tileWidth || t.height != this.tileHeight) {
+      throw new Error(`tile must be ${this.tileWidth}x${this.tileHeight}, ` +
+                      `got ${t.width}x${t.height}`);
+    }
     this.data[i] = t;
+    this._version++;
   }
 
   get length() {
@@ -182,26 +194,27 @@ class Tileset extends component.Component {
     let allowDups = opt.dups || false;
 
     let pitch = tile.pitch;
-    let key = this._makeKey(tile.data, pitch);
+    let hash = this._hashTile(tile.data, 0, pitch, 0);
     let tileID;
 
     if (!allowDups) {
-      tileID = this._lookupContents[key];
-      if (tileID != null) {
+      tileID = this._findTile(hash, tile.data, 0, pitch, 0);
+      if (tileID >= 0) {
         return tileID;
       }
     }
 
     tileID = this.data.length;
     this.data.push(tile.clone());
-    this._lookupContents[key] = tileID;
+    this._rememberTile(hash, tileID);
     return tileID;
   }
 
   /**
    * carve up the field into tiles, add them to this tileset
    * @param {Field} f - the field to create tiles from
-   * @param {object} opt - {dups,retain}
+   * @param {object} opt - {dups,retain,flips}, with flips, a tile that is
+   *     a flipped copy of another one reuses it, see PatternTable.flips
    * @return {PatternTable} the pattern table for the added tiles
    */
   _addField(f, opt) {
@@ -215,10 +228,13 @@ class Tileset extends component.Component {
       throw new Error(`Tileset's tile_width is larger than source data`);
     }
     let allowDups = opt.dups || false;
+    let findFlips = !allowDups && !!opt.flips;
 
     f.fullyResolve();
     let pitch = f.pitch;
-    let source = f.data.slice();
+    // New tiles are views of a copy of the field, only made once the
+    // field has a tile that is not a duplicate
+    let source = null;
 
     // TODO: add a test for when rounding happens
     let numTilesX = Math.floor(f.width / this.tileWidth);
@@ -226,30 +242,45 @@ class Tileset extends component.Component {
 
     let patternData = new Array(numTilesX * numTilesY);
     let patternPitch = numTilesX;
+    let patternFlips = findFlips ? new Array(patternData.length).fill(0) : null;
 
     for (let tileY = 0; tileY < numTilesY; tileY++) {
       for (let tileX = 0; tileX < numTilesX; tileX++) {
-        let tileData = this._sliceTileData(tileX, tileY, source, f.pitch);
-        let tileID;
-        if (allowDups) {
+        let offset = tileX * this.tileWidth + pitch * tileY * this.tileHeight;
+        let k = tileX + tileY * patternPitch;
+        let tileID = -1;
+        let hash;
+        if (!allowDups) {
+          hash = this._hashTile(f.data, offset, pitch, 0);
+          tileID = this._findTile(hash, f.data, offset, pitch, 0);
+          for (let flip = 1; findFlips && tileID < 0 && flip <= 3; flip++) {
+            let other = this._hashTile(f.data, offset, pitch, flip);
+            tileID = this._findTile(other, f.data, offset, pitch, flip);
+            if (tileID >= 0) {
+              patternFlips[k] = flip;
+            }
+          }
+        }
+        if (tileID < 0) {
+          // tile is not a duplicate, it is a new tile
+          if (source == null) {
+            source = f.data.slice();
+          }
+          let tileData = this._sliceTileData(tileX, tileY, source, pitch);
           tileID = this.data.length;
           this.data.push(this._createTileObject(tileData, pitch));
-        } else {
-          let key = this._makeKey(tileData, pitch);
-          tileID = this._lookupContents[key];
-          if (tileID == null) {
-            // tile is not a duplicate, it is a new tile
-            tileID = this.data.length;
-            this._lookupContents[key] = tileID;
-            this.data.push(this._createTileObject(tileData, pitch));
+          if (!allowDups) {
+            this._rememberTile(hash, tileID);
           }
         }
-        let k = tileX + tileY * patternPitch;
         patternData[k] = tileID;
       }
     }
 
-    return new PatternTable(patternData, patternPitch, numTilesX, numTilesY);
+    let table = new PatternTable(patternData, patternPitch,
+                                 numTilesX, numTilesY);
+    table.flips = patternFlips;
+    return table;
   }
 
   all() {
@@ -265,14 +296,70 @@ class Tileset extends component.Component {
     return obj;
   }
 
-  _makeKey(data, pitch) {
-    let build = [];
-    let start = 0;
+  // 53 bits of the contents of a tile, from two 32-bit lanes. With flip,
+  // the tile is read as if it were flipped, see TILE_FLIP_H and TILE_FLIP_V
+  _hashTile(data, offset, pitch, flip) {
+    let h1 = 0x811c9dc5;
+    let h2 = 0x9e3779b9;
+    for (let y = 0; y < this.tileHeight; y++) {
+      let ty = (flip & TILE_FLIP_V) ? this.tileHeight - 1 - y : y;
+      let s = offset + ty * pitch;
+      if (flip & TILE_FLIP_H) {
+        for (let x = this.tileWidth - 1; x >= 0; x--) {
+          let c = data[s + x];
+          h1 = Math.imul(h1 ^ c, 0x01000193);
+          h2 = Math.imul(h2 ^ (h2 >>> 15) ^ c, 0x5bd1e995);
+        }
+      } else {
+        for (let x = 0; x < this.tileWidth; x++) {
+          let c = data[s + x];
+          h1 = Math.imul(h1 ^ c, 0x01000193);
+          h2 = Math.imul(h2 ^ (h2 >>> 15) ^ c, 0x5bd1e995);
+        }
+      }
+    }
+    h2 ^= h2 >>> 13;
+    return (h1 >>> 0) * 0x200000 + (h2 >>> 11);
+  }
+
+  // Id of the most recent tile that has these contents, read with flip,
+  // or -1 if there is none
+  _findTile(hash, data, offset, pitch, flip) {
+    let ids = this._lookupContents.get(hash);
+    if (!ids) {
+      return -1;
+    }
+    for (let n = ids.length - 1; n >= 0; n--) {
+      let t = this.data[ids[n]];
+      if (t && t.data && this._sameTile(t, data, offset, pitch, flip)) {
+        return ids[n];
+      }
+    }
+    return -1;
+  }
+
+  _sameTile(tile, data, offset, pitch, flip) {
     for (let y = 0; y < this.tileHeight; y++) {
-      build = build.concat(data.slice(start, start+this.tileWidth));
-      start += pitch;
+      let ty = (flip & TILE_FLIP_V) ? this.tileHeight - 1 - y : y;
+      let s = offset + ty * pitch;
+      let t = y * tile.pitch;
+      for (let x = 0; x < this.tileWidth; x++) {
+        let tx = (flip & TILE_FLIP_H) ? this.tileWidth - 1 - x : x;
+        if (tile.data[t + x] != data[s + tx]) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  _rememberTile(hash, tileID) {
+    let ids = this._lookupContents.get(hash);
+    if (ids) {
+      ids.push(tileID);
+    } else {
+      this._lookupContents.set(hash, [tileID]);
     }
-    return build.toString();
   }
 
   _sliceTileData(tileX, tileY, sourceData, pitch) {
@@ -369,6 +456,8 @@ class Tile extends field.Field {
     make.height = this.height;
     make.pitch = this.pitch;
     make.data = this.data;
+    // Clones share data, so writes to either one damage the same buffer
+    make._damage = this._damage;
     return make;
   }
 
@@ -416,6 +505,7 @@ class Tile extends field.Field {
       for (let k = 0; k < this.data.length; k++) {
         this.data[k] = Math.floor(v);
       }
+      this.addDamage(0, 0, this.width, this.height);
       return;
     }
     throw new Error(`tile.fill needs array or number, got ${v}`);
@@ -430,6 +520,8 @@ class PatternTable {
     this.pitch = pitch;
     this.width = width;
     this.height = height;
+    // When tiles were added with {flips: true}, the flips of each entry
+    this.flips = null;
   }
 
   get(x, y) {
@@ -464,6 +556,17 @@ class PatternTable {
     return pl;
   }
 
+  // Field of the flips of each entry, for useTileFlips, or null
+  flipsToField() {
+    if (!this.flips) {
+      return null;
+    }
+    let pl = new field.Field();
+    pl.setSize(this.width, this.height);
+    pl.fill(this.flips);
+    return pl;
+  }
+
 }
 
 module.exports.Tile = Tile;
@@ -7,6 +7,7 @@ const tiles = require('./tiles.js');
 const colorspace = require('./colorspace.js');
 const palette = require('./palette.js');
 const interrupts = require('./interrupts.js');
+const lineTable = require('./line_table.js');
 const sprites = require('./sprites.js');
 const weak = require('./weak.js');
 
@@ -76,6 +77,11 @@ function isInterrupts(obj) {
   return obj instanceof interrupts.Interrupts;
 }
 
+function isLineTable(obj) {
+  if (!obj) { return false; }
+  return obj instanceof lineTable.LineTable;
+}
+
 function isTileset(obj) {
   if (!obj) { return false; }
   return obj instanceof tiles.Tileset;
@@ -164,6 +170,7 @@ module.exports.isArray = isArray;
 module.exports.isNumArray = isNumArray;
 module.exports.is2dNumArray = is2dNumArray;
 module.exports.isInterrupts = isInterrupts;
+module.exports.isLineTable = isLineTable;
 module.exports.isString = isString;
 module.exports.isFunction = isFunction;
 module.exports.isObject = isObject;
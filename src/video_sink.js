@@ -0,0 +1,103 @@
+const fs = require('fs');
+const nativeAddon = require('./native_addon.js');
+
+const RGB_PIXEL_SIZE = 4;
+const FORMATS = {'rgba': 4, 'rgb24': 3};
+
+// Streams raw video frames, with no header, to a path or a file descriptor.
+// The path may be a named pipe, such as one read by `ffmpeg -f rawvideo`.
+// With the native addon, frames are copied into a small pool of buffers and
+// written by a background thread, and write() only blocks when the pool is
+// full. Otherwise each frame is written before write() returns.
+class VideoSink {
+  constructor(target, opt) {
+    opt = opt || {};
+    this.format = opt.format || 'rgba';
+    if (!FORMATS[this.format]) {
+      throw new Error(`VideoSink: unknown format "${this.format}"`);
+    }
+    this._native = null;
+    this._fd = null;
+    this._ownsFd = false;
+    this._frame = null;
+    this._numFrames = 0;
+    if (nativeAddon && nativeAddon.VideoSink) {
+      this._native = new nativeAddon.VideoSink(target, this.format,
+                                               opt.buffers || 0);
+      return;
+    }
+    if (typeof target == 'number') {
+      this._fd = target;
+    } else {
+      this._fd = fs.openSync(target, 'w');
+      this._ownsFd = true;
+    }
+  }
+
+  // The native sink, which a native backend can send frames to directly
+  nativeSink() {
+    return this._native;
+  }
+
+  // The surface can be reused as soon as this returns
+  write(surface) {
+    if (this._native) {
+      if (!this._native.write(surface)) {
+        throw new Error(`writing video failed: ${this._native.finish()}`);
+      }
+      return;
+    }
+    let bpp = FORMATS[this.format];
+    let rowSize = surface.width * bpp;
+    let size = rowSize * surface.height;
+    if (!this._frame || this._frame.length != size) {
+      this._frame = Buffer.alloc(size);
+    }
+    let frame = this._frame;
+    let buff = surface.buff;
+    for (let y = 0; y < surface.height; y++) {
+      let s = y * surface.pitch;
+      let t = y * rowSize;
+      if (bpp == RGB_PIXEL_SIZE) {
+        frame.set(buff.subarray(s, s + rowSize), t);
+        continue;
+      }
+      for (let x = 0; x < surface.width; x++) {
+        frame[t + x*3 + 0] = buff[s + x*RGB_PIXEL_SIZE + 0];
+        frame[t + x*3 + 1] = buff[s + x*RGB_PIXEL_SIZE + 1];
+        frame[t + x*3 + 2] = buff[s + x*RGB_PIXEL_SIZE + 2];
+      }
+    }
+    // Pipes may take part of a frame at a time
+    let offset = 0;
+    while (offset < size) {
+      offset += fs.writeSync(this._fd, frame, offset, size - offset);
+    }
+    this._numFrames++;
+  }
+
+  // {frames, stalls}, stalls counts the frames that waited for the writer
+  stats() {
+    if (this._native) {
+      return this._native.stats();
+    }
+    return {frames: this._numFrames, stalls: 0};
+  }
+
+  // Wait for every frame to be written, then close
+  finish() {
+    if (this._native) {
+      let error = this._native.finish();
+      if (error) {
+        throw new Error(`writing video failed: ${error}`);
+      }
+      return;
+    }
+    if (this._ownsFd) {
+      fs.closeSync(this._fd);
+      this._ownsFd = false;
+    }
+  }
+}
+
+module.exports.VideoSink = VideoSink;
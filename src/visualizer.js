@@ -133,6 +133,7 @@ class Visualizer {
     let pal = new palette.Palette();
     pal._rgbmap = origPalette._rgbmap.slice();
     pal._rgbmap.push(0x444444);
+    pal._changed();
     let bgColor = pal._rgbmap.length - 1;
 
     let target = drawable.newDrawableField();
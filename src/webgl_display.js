@@ -295,7 +295,7 @@ void main() {
       width: this._width,
       height: this._height,
     };
-    this._eventManager.getNativeClick(event);
+    this._eventManager.getNativeMouse('click', event);
   }
 
   waitForContentLoad(cb) {
@@ -328,6 +328,29 @@ describe('Colorspace', function() {
   });
 
 
+  it('compile', function() {
+    let source = [[0, [4, 5]],
+                  [2, 1]];
+    let colors = new colorspace.Colorspace(source, {cell_width: 8,
+                                                    cell_height: 8,
+                                                    piece_size: 6});
+    let cells = colors.compile();
+    assert.deepEqual(Array.from(cells.attrs), [0, -1, 2, 1]);
+    assert.deepEqual(Array.from(cells.lists), [4, 5]);
+    assert.deepEqual(Array.from(cells.listStarts), [0, 2]);
+    assert.equal(cells.fitsLUT, true);
+    assert.deepEqual(colors.get(1, 0), [4, 5]);
+    // Only compiled again after a change
+    assert.strictEqual(colors.compile(), cells);
+    colors.put(0, 1, [7, 300]);
+    cells = colors.compile();
+    assert.deepEqual(Array.from(cells.attrs), [0, -1, -2, 1]);
+    assert.deepEqual(Array.from(cells.lists), [4, 5, 7, 300]);
+    assert.equal(cells.fitsLUT, false);
+    assert.equal(colors.realizeIndexedColor(3, 2, 9), 300);
+    assert.equal(colors.realizeIndexedColor(3, 9, 9), 9);
+  });
+
   it('visualize', function() {
     let tmpdir = util.mkTmpDir();
     let tmpout = tmpdir + '/actual.png';
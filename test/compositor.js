@@ -1,5 +1,6 @@
 var assert = require('assert');
 var ra = require('../src/lib.js');
+var compositor = require('../src/compositor.js');
 
 
 describe('Compositor', function() {
@@ -37,4 +38,29 @@ describe('Compositor', function() {
     let surfaces = ra.renderPrimaryField();
     assert.equal(1, surfaces.length);
   });
+
+  it('zoom filters', function() {
+    ra.resetState();
+    ra.setSize(4, 4);
+    ra.usePalette('pico8');
+    ra.fillColor(7);
+    let surfs = ra.renderPrimaryField();
+
+    let comp = new compositor.Compositor();
+    let nearest = comp.combine(surfs, 4, 4, 3)[0];
+    assert.equal(nearest.width, 12);
+    let white = Array.from(nearest.buff.slice(0, 4));
+    let j = 2 * nearest.pitch;
+    assert.deepEqual(Array.from(nearest.buff.slice(j, j + 4)), white);
+
+    // The same surface is reused for each frame
+    let crt = comp.combine(surfs, 4, 4, 3, 'scanlines')[0];
+    assert.strictEqual(crt, nearest);
+    assert.deepEqual(Array.from(crt.buff.slice(0, 4)), white);
+    let half = white.slice(0, 3).map((c) => c >> 1).concat([0xff]);
+    assert.deepEqual(Array.from(crt.buff.slice(j, j + 4)), half);
+
+    assert.throws(() => { ra.setZoomFilter('blur') },
+                  /setZoomFilter: unknown filter "blur"/);
+  });
 });
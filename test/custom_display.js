@@ -103,6 +103,32 @@ describe('Display', function() {
     assert.equal(ra.config.gridUnit, 12);
   });
 
+  it('native frame stats', function() {
+    ra.resetState();
+
+    let stats = {frames: 2, frameUs: {p50: 16600, p95: 16700, p99: 16800}};
+    let backend = {
+      initialize() {},
+      name() { return 'sdl'; },
+      getStats() { return stats; },
+      getTrace() { return '{"traceEvents":[]}'; },
+    };
+    ra.useDisplay(new nativeDisplay.NativeDisplay(backend));
+    assert.deepEqual(ra.getFrameStats(), stats);
+    assert.equal(ra.getFrameTrace(), '{"traceEvents":[]}');
+
+    // Older backends do not measure frames
+    ra.useDisplay(new nativeDisplay.NativeDisplay({
+      initialize() {},
+      name() { return 'rpi'; },
+    }));
+    assert.equal(ra.getFrameStats(), null);
+    assert.equal(ra.getFrameTrace(), null);
+
+    ra.useDisplay(new MyDisplay());
+    assert.equal(ra.getFrameStats(), null);
+  });
+
   it('each display', function() {
     ra.resetState();
 
@@ -0,0 +1,100 @@
+var assert = require('assert');
+var ra = require('../src/lib.js');
+var renderer = require('../src/renderer.js');
+
+function renderWithoutDamage() {
+  let r = new renderer.Renderer();
+  r.disableDamageTracking();
+  r.connect(ra.provide());
+  return r.render();
+}
+
+describe('Damage', function() {
+  it('put only dirties that pixel', function() {
+    ra.resetState();
+    ra.usePalette('pico8');
+    ra.setSize(8, 8);
+    ra._renderer.connect(ra.provide());
+
+    let surfaces = ra._renderer.render();
+    assert.equal(surfaces[0].dirty, null);
+
+    ra.setColor(3);
+    ra.drawDot(2, 5);
+    surfaces = ra._renderer.render();
+    assert.deepEqual(surfaces[0].dirty, [{x: 2, y: 5, w: 1, h: 1}]);
+
+    surfaces = ra._renderer.render();
+    assert.deepEqual(surfaces[0].dirty, []);
+  });
+
+  it('dirty rect is scrolled and wrapped', function() {
+    ra.resetState();
+    ra.usePalette('pico8');
+    ra.setSize(8, 8);
+    ra.setScrollX(6);
+    ra._renderer.connect(ra.provide());
+    ra._renderer.render();
+
+    ra.setColor(3);
+    ra.fillRect(5, 1, 2, 2);
+    let surfaces = ra._renderer.render();
+    assert.deepEqual(surfaces[0].dirty, [{x: 7, y: 1, w: 1, h: 2},
+                                         {x: 0, y: 1, w: 1, h: 2}]);
+  });
+
+  it('scroll and palette change dirty everything', function() {
+    ra.resetState();
+    ra.usePalette('pico8');
+    ra.setSize(8, 8);
+    ra._renderer.connect(ra.provide());
+    ra._renderer.render();
+
+    ra.setScrollY(2);
+    let surfaces = ra._renderer.render();
+    assert.equal(surfaces[0].dirty, null);
+
+    ra.palette.entry(0).setColor(4);
+    surfaces = ra._renderer.render();
+    assert.equal(surfaces[0].dirty, null);
+  });
+
+  it('partial render matches full render', function() {
+    ra.resetState();
+    ra.usePalette('pico8');
+    ra.setSize(16, 12);
+    ra._renderer.connect(ra.provide());
+    ra._renderer.render();
+
+    ra.setColor(8);
+    ra.drawLine(1, 1, 14, 9);
+    ra.setColor(11);
+    ra.fillCircle(6, 4, 3);
+    ra._renderer.render();
+
+    let sel = ra.field.select(9, 2, 4, 4);
+    sel.setColor(2);
+    sel.fillRect(1, 1, 2, 2);
+    ra.setColor(12);
+    ra.drawDot(15, 11);
+
+    let actual = ra._renderer.render();
+    let expect = renderWithoutDamage();
+    assert.deepEqual(actual[0].buff, expect[0].buff);
+  });
+
+  it('fill pattern dirties the field', function() {
+    ra.resetState();
+    ra.usePalette('pico8');
+    ra.setSize(8, 8);
+    ra._renderer.connect(ra.provide());
+    ra._renderer.render();
+
+    let sel = ra.field.select(2, 1, 4, 3);
+    sel.fillPattern([[3, 4], [5, 6]]);
+    let actual = ra._renderer.render();
+    assert.deepEqual(actual[0].dirty, [{x: 2, y: 1, w: 4, h: 3}]);
+    let expect = renderWithoutDamage();
+    assert.deepEqual(actual[0].buff, expect[0].buff);
+  });
+});
@@ -0,0 +1,44 @@
+var assert = require('assert');
+var eventManager = require('../src/event_manager.js');
+
+describe('EventManager', function() {
+  it('native batch', function() {
+    let manager = new eventManager.EventManager();
+    let got = [];
+    for (let name of ['keydown', 'keyup', 'click', 'mouseup', 'mousemove']) {
+      manager.listenFor(name, null, (e) => { got.push([name, e]) });
+    }
+    // type, code, x, y, timestamp for each event
+    manager.getNativeBatch(new Int32Array([
+      1, 0x41, 0, 0, 100,
+      5, 0, 6, 7, 101,
+      1, 0x41, 0, 0, 102,
+      3, 1, 6, 7, 103,
+      4, 1, 8, 2, 104,
+      2, 0x8050, 0, 0, 105,
+    ]));
+    assert.deepEqual(got, [
+      ['keydown', {code: 0x41, key: 'A', timestamp: 100}],
+      ['mousemove', {x: 6, y: 7, button: 0, timestamp: 101}],
+      // the key is already down
+      ['click', {x: 6, y: 7, button: 1, timestamp: 103}],
+      ['mouseup', {x: 8, y: 2, button: 1, timestamp: 104}],
+      ['keyup', {code: 0x8050, key: 'ArrowLeft', timestamp: 105}],
+    ]);
+
+    assert.throws(() => { manager.getNativeBatch(new Int32Array(5).fill(9)) },
+                  /unknown native event type 9/);
+  });
+
+  it('mouse region', function() {
+    let manager = new eventManager.EventManager();
+    let got = [];
+    let region = {x: 10, y: 10, w: 4, h: 4, name: 'box'};
+    manager.listenFor('mousemove', region, (e) => { got.push(e) });
+    manager.getNativeBatch(new Int32Array([
+      5, 0, 3, 3, 1,
+      5, 0, 12, 11, 2,
+    ]));
+    assert.deepEqual(got, [{x: 2, y: 1, button: 0, timestamp: 2}]);
+  });
+});
@@ -24,4 +24,13 @@ describe('Flood', function() {
     ra.fillFlood({x: 8, y: 8});
     util.renderCompareTo(ra, 'test/testdata/odd_filled.png');
   });
+
+  it('same color', function() {
+    ra.resetState();
+    ra.setSize({w: 16, h: 16});
+    ra.fillColor(3);
+    ra.setColor(3);
+    ra.fillFlood({x: 8, y: 8});
+    assert.equal(ra.field.get(8, 8), 3);
+  });
 });
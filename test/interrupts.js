@@ -1,5 +1,6 @@
 var util = require('./util.js');
 var ra = require('../src/lib.js');
+var assert = require('assert');
 
 describe('Interrupts', function() {
 
@@ -55,6 +56,100 @@ describe('Interrupts', function() {
   });
 
 
+  it('compiled schedule', function() {
+    ra.resetState();
+    let first = () => {};
+    let second = () => {};
+    let interrupts = ra.useInterrupts([
+      {scanline:     3, irq: first},
+      {scanline: [5,7], irq: second},
+    ]);
+
+    let schedule = interrupts.compile();
+    assert.equal(schedule.count, 4);
+    assert.deepEqual(Array.from(schedule.lines), [3, 5, 6, 7]);
+    assert.deepEqual(schedule.irqs, [first, second, second, second]);
+    // Unchanged, so the same schedule is reused
+    assert.strictEqual(interrupts.compile(), schedule);
+
+    // Editing a scanline makes a new schedule
+    interrupts.get(1).scanline = [5,6];
+    schedule = interrupts.compile();
+    assert.deepEqual(Array.from(schedule.lines), [3, 5, 6]);
+
+    interrupts.shiftDown(4, {startIndex: 0, endIndex: 1});
+    schedule = interrupts.compile();
+    assert.deepEqual(Array.from(schedule.lines), [4, 5, 6]);
+
+    interrupts.arr = [{scanline: 1, irq: first}];
+    schedule = interrupts.compile();
+    assert.deepEqual(Array.from(schedule.lines), [1]);
+    assert.equal(interrupts.length, 1);
+
+    // Scanlines are kept as given, even when not integers or beyond int32
+    interrupts.arr = [
+      {scanline: 2.5, irq: first},
+      {scanline: [3.5, 4.5], irq: second},
+      {scanline: 3e9, irq: first},
+    ];
+    schedule = interrupts.compile();
+    assert.deepEqual(Array.from(schedule.lines), [2.5, 3.5, 4.5, 3e9]);
+  });
+
+
+  it('irq edits a tile', function() {
+    let render = function(useCache, useColors, editAt) {
+      ra.resetState();
+      ra.usePalette({rgbmap:[
+        0x000000, 0x565656, 0x664019, 0x858585, 0xa5a5a5, 0xc0c0c0,
+        0xffffff, 0xffb973, 0xff7373, 0xff3333, 0xff9933, 0xf1ff73,
+      ]});
+      ra.palette.setEntries([0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11]);
+      if (useColors) {
+        ra.useColorspace([[0, 1, 0, 1], [1, 0, 1, 0],
+                          [0, 1, 0, 1], [1, 0, 1, 0]],
+                         {cell_width: 4, cell_height: 4, piece_size: 6});
+      }
+      ra.setSize(16, 16);
+      if (!useCache) {
+        ra._renderer.disableTileCache();
+      }
+      let tiles = ra.loadImage('test/testdata/tiles.png');
+      let tileset = new ra.Tileset(tiles, {tile_width: 4, tile_height: 4});
+      let field = new ra.Field();
+      field.setSize(4);
+      field.fill([1, 1, 1, 1,
+                  1, 1, 1, 1,
+                  1, 1, 1, 1,
+                  1, 1, 1, 1]);
+      ra.useField(field);
+      ra.useTileset(tileset);
+      let edit = () => { tileset.get(1).put(0, 0, 5); };
+      if (editAt == 0) {
+        edit();
+      } else if (editAt > 0) {
+        ra.useInterrupts([{scanline: editAt, irq: edit}]);
+      }
+      let surf = ra.renderPrimaryField()[0];
+      return Buffer.from(surf.buff);
+    };
+    for (let useCache of [true, false]) {
+      for (let useColors of [false, true]) {
+        let before = render(useCache, useColors, -1);
+        let after = render(useCache, useColors, 0);
+        let split = render(useCache, useColors, 8);
+        let pitch = split.length / 16;
+        assert.notDeepEqual(before.subarray(8 * pitch),
+                            after.subarray(8 * pitch));
+        // Rows above the irq are drawn before the edit, the rest after it
+        assert.deepEqual(split.subarray(0, 8 * pitch),
+                         before.subarray(0, 8 * pitch));
+        assert.deepEqual(split.subarray(8 * pitch), after.subarray(8 * pitch));
+      }
+    }
+  });
+
+
   it('visualize', function() {
     let tmpdir = util.mkTmpDir();
     let tmpout = tmpdir + '/actual.png';
@@ -0,0 +1,447 @@
+var assert = require('assert');
+var algorithm = require('../src/algorithm.js');
+var kernels = require('../src/kernels.js');
+
+function makeLUT() {
+  // Index n becomes the color (n, n+1, n+2)
+  return kernels.buildPaletteLUT(function(c, rgbtuple) {
+    rgbtuple[0] = c;
+    rgbtuple[1] = c + 1;
+    rgbtuple[2] = c + 2;
+  });
+}
+
+function makeSource(width, height) {
+  let source = new Uint8Array(width * height);
+  for (let k = 0; k < source.length; k++) {
+    source[k] = k + 1;
+  }
+  return source;
+}
+
+function makeLayer(width, height, seed) {
+  let surf = algorithm.makeSurface(width, height);
+  for (let k = 0; k < surf.buff.length; k++) {
+    surf.buff[k] = (k * 37 + seed * 101) % 256;
+  }
+  // Include runs of opaque and transparent pixels
+  for (let k = 3; k < surf.buff.length / 2; k += 4) {
+    surf.buff[k] = (seed % 2) ? 0xff : 0x00;
+  }
+  return surf;
+}
+
+// Expand an indexed surface into RGBA, as displays do. Transparent pixels
+// become all zero, since their rgb value is never seen
+function expandIndexes(buff, pitch, width, height, lut, isBg) {
+  let bytes = new Uint8Array(lut.buffer);
+  let out = new Uint8Array(width * height * 4);
+  for (let y = 0; y < height; y++) {
+    for (let x = 0; x < width; x++) {
+      let c = buff[y * pitch + x];
+      let t = (y * width + x) * 4;
+      if (c == 0 && !isBg) {
+        continue;
+      }
+      out.set(bytes.subarray(c * 4, c * 4 + 4), t);
+    }
+  }
+  return out;
+}
+
+function clearTransparent(buff) {
+  for (let k = 0; k < buff.length; k += 4) {
+    if (buff[k + 3] == 0) {
+      buff.fill(0, k, k + 4);
+    }
+  }
+  return buff;
+}
+
+function pixelAt(buff, pitch, x, y) {
+  let t = y * pitch + x * 4;
+  return Array.from(buff.slice(t, t + 4));
+}
+
+describe('Kernels', function() {
+  it('rasterize layer', function() {
+    let source = makeSource(4, 4);
+    let target = new Uint8Array(4 * 4 * 4);
+    kernels.rasterizeLayer(source, 4, 4, 4, 0, 0, true, true, makeLUT(),
+                           target, 16, 0, 0, 4, 4);
+    assert.deepEqual(pixelAt(target, 16, 0, 0), [1, 2, 3, 0xff]);
+    assert.deepEqual(pixelAt(target, 16, 3, 2), [12, 13, 14, 0xff]);
+  });
+
+  it('rasterize layer wrapped with scroll', function() {
+    let source = makeSource(4, 4);
+    let target = new Uint8Array(4 * 4 * 4);
+    kernels.rasterizeLayer(source, 4, 4, 4, -1, 5, true, true, makeLUT(),
+                           target, 16, 0, 0, 4, 4);
+    // Target (0,0) is source (3,1)
+    assert.deepEqual(pixelAt(target, 16, 0, 0), [8, 9, 10, 0xff]);
+    // Target (1,3) is source (0,0)
+    assert.deepEqual(pixelAt(target, 16, 1, 3), [1, 2, 3, 0xff]);
+  });
+
+  it('rasterize layer placed once', function() {
+    let source = makeSource(2, 2);
+    let target = new Uint8Array(4 * 4 * 4).fill(0x80);
+    kernels.rasterizeLayer(source, 2, 2, 2, -1, -1, false, true, makeLUT(),
+                           target, 16, 0, 0, 4, 4);
+    // Above the source, only alpha is cleared
+    assert.deepEqual(pixelAt(target, 16, 1, 0), [0x80, 0x80, 0x80, 0]);
+    assert.deepEqual(pixelAt(target, 16, 1, 1), [1, 2, 3, 0xff]);
+    assert.deepEqual(pixelAt(target, 16, 2, 2), [4, 5, 6, 0xff]);
+    // Outside of the source, untouched
+    assert.deepEqual(pixelAt(target, 16, 0, 1), [0x80, 0x80, 0x80, 0x80]);
+    assert.deepEqual(pixelAt(target, 16, 3, 3), [0x80, 0x80, 0x80, 0x80]);
+  });
+
+  it('rasterize upper layer index 0 is transparent', function() {
+    let source = new Uint8Array([0, 1, 1, 0]);
+    let target = new Uint8Array(2 * 2 * 4);
+    let lut = makeLUT();
+    kernels.rasterizeLayer(source, 2, 2, 2, 0, 0, true, false, lut,
+                           target, 8, 0, 0, 2, 2);
+    assert.deepEqual(pixelAt(target, 8, 0, 0), [0, 1, 2, 0]);
+    assert.deepEqual(pixelAt(target, 8, 1, 0), [1, 2, 3, 0xff]);
+    // The lookup table itself is not modified
+    assert.equal(new Uint8Array(lut.buffer)[3], 0xff);
+  });
+
+  it('native rasterize layer matches js', function() {
+    if (!kernels.hasNative('rasterizeLayer')) {
+      this.skip();
+    }
+    let source = makeSource(13, 7);
+    let lut = makeLUT();
+    let cases = [[3, -2, true, true], [-20, 9, true, false],
+                 [2, -3, false, false], [-5, 1, false, true]];
+    for (let [scrollX, scrollY, isWrapped, isBg] of cases) {
+      let expect = new Uint8Array(16 * 12 * 4);
+      let actual = new Uint8Array(16 * 12 * 4);
+      kernels.js.rasterizeLayer(source, 13, 13, 7, scrollX, scrollY,
+                                isWrapped, isBg, lut, expect, 64,
+                                1, 2, 15, 11);
+      kernels.rasterizeLayer(source, 13, 13, 7, scrollX, scrollY,
+                             isWrapped, isBg, lut, actual, 64,
+                             1, 2, 15, 11);
+      assert.deepEqual(actual, expect);
+    }
+  });
+
+  it('rasterize cells', function() {
+    // 2x2 cells, the left ones use pieces of 4, the right ones entry lists
+    let cells = {
+      attrs: new Int32Array([1, -1, 0, -2]),
+      pitch: 2, height: 2, cellWidth: 2, cellHeight: 2, pieceSize: 4,
+      lists: new Int32Array([9, 8, 30]),
+      listStarts: new Int32Array([0, 2, 3]),
+    };
+    let source = makeSource(4, 4);
+    let target = new Uint8Array(4 * 4 * 4);
+    kernels.rasterizeCells(source, 4, 4, 4, 0, 0, true, false, makeLUT(),
+                           cells, target, 16, 0, 0, 4, 4);
+    // Source index 2 in piece 1 is 4 + 2
+    assert.deepEqual(pixelAt(target, 16, 1, 0), [6, 7, 8, 0xff]);
+    // Source index 3 in the list [9, 8] is 8
+    assert.deepEqual(pixelAt(target, 16, 2, 0), [8, 9, 10, 0xff]);
+    // Source index 9 in piece 0 is 1
+    assert.deepEqual(pixelAt(target, 16, 0, 2), [1, 2, 3, 0xff]);
+    assert.deepEqual(pixelAt(target, 16, 3, 3), [30, 31, 32, 0xff]);
+  });
+
+  it('native rasterize cells matches js', function() {
+    if (!kernels.hasNative('rasterizeCells')) {
+      this.skip();
+    }
+    let source = makeSource(13, 7);
+    source[20] = 0;
+    let cells = {
+      attrs: new Int32Array([0, 3, -1, 1, 2, -2, -1, 0, 5, 1, -3, 2]),
+      pitch: 4, height: 3, cellWidth: 4, cellHeight: 3, pieceSize: 6,
+      lists: new Int32Array([17, 3, 250, 0, 1, 2, 3, 4]),
+      listStarts: new Int32Array([0, 3, 4, 8]),
+    };
+    let lut = makeLUT();
+    let cases = [[3, -2, true, true], [-20, 9, true, false],
+                 [2, -3, false, false], [-5, 1, false, true]];
+    for (let [scrollX, scrollY, isWrapped, isBg] of cases) {
+      let expect = new Uint8Array(16 * 12 * 4);
+      let actual = new Uint8Array(16 * 12 * 4);
+      kernels.js.rasterizeCells(source, 13, 13, 7, scrollX, scrollY,
+                                isWrapped, isBg, lut, cells, expect, 64,
+                                1, 2, 15, 11);
+      kernels.rasterizeCells(source, 13, 13, 7, scrollX, scrollY,
+                             isWrapped, isBg, lut, cells, actual, 64,
+                             1, 2, 15, 11);
+      assert.deepEqual(actual, expect);
+    }
+  });
+
+  it('rasterize tiles', function() {
+    // 2x2 tiles, tile 0 is 1,2 over 3,4 and tile 1 is 5,6 over 7,8
+    let tiles = [{data: new Uint8Array([1, 2, 3, 4]), pitch: 2},
+                 {data: new Uint8Array([5, 6, 0, 7, 8, 0]), pitch: 3}];
+    let tilemap = new Uint8Array([1, 0,
+                                  0, 2]);
+    let flips = new Uint8Array([0, 1,
+                                2, 0]);
+    let target = new Uint8Array(4 * 4 * 4);
+    kernels.rasterizeTiles(tiles, tilemap, 2, 2, 2, flips, 2, 2, 2,
+                           0, 0, true, true, makeLUT(),
+                           target, 16, 0, 0, 4, 4);
+    assert.deepEqual(pixelAt(target, 16, 1, 0), [6, 7, 8, 0xff]);
+    // Horizontally flipped
+    assert.deepEqual(pixelAt(target, 16, 2, 0), [2, 3, 4, 0xff]);
+    assert.deepEqual(pixelAt(target, 16, 3, 1), [3, 4, 5, 0xff]);
+    // Vertically flipped
+    assert.deepEqual(pixelAt(target, 16, 0, 2), [3, 4, 5, 0xff]);
+    assert.deepEqual(pixelAt(target, 16, 1, 3), [2, 3, 4, 0xff]);
+    // Tile 2 does not exist, so it is index 0
+    assert.deepEqual(pixelAt(target, 16, 3, 3), [0, 1, 2, 0xff]);
+  });
+
+  it('native rasterize tiles matches js', function() {
+    if (!kernels.hasNative('rasterizeTiles')) {
+      this.skip();
+    }
+    let tiles = [];
+    for (let i = 0; i < 5; i++) {
+      tiles.push({data: makeSource(3, 4).map((v) => v * (i + 1)), pitch: 3});
+    }
+    tiles[3] = undefined;
+    let tilemap = makeSource(5, 3).map((v) => v % 6);
+    let flips = makeSource(5, 3).map((v) => v % 4);
+    let lut = makeLUT();
+    let cases = [[3, -2, true, true], [-20, 9, true, false],
+                 [2, -3, false, false], [-5, 1, false, true]];
+    for (let [scrollX, scrollY, isWrapped, isBg] of cases) {
+      let expect = new Uint8Array(16 * 12 * 4);
+      let actual = new Uint8Array(16 * 12 * 4);
+      kernels.js.rasterizeTiles(tiles, tilemap, 5, 5, 3, flips, 5, 3, 4,
+                                scrollX, scrollY, isWrapped, isBg, lut,
+                                expect, 64, 1, 2, 15, 11);
+      kernels.rasterizeTiles(tiles, tilemap, 5, 5, 3, flips, 5, 3, 4,
+                             scrollX, scrollY, isWrapped, isBg, lut,
+                             actual, 64, 1, 2, 15, 11);
+      assert.deepEqual(actual, expect);
+    }
+  });
+
+  it('index layer and tiles match rasterize', function() {
+    let source = makeSource(9, 7);
+    let tiles = [];
+    for (let i = 0; i < 5; i++) {
+      tiles.push({data: makeSource(3, 4).map((v) => v * (i + 1)), pitch: 3});
+    }
+    tiles[3] = undefined;
+    let tilemap = makeSource(5, 3).map((v) => v % 6);
+    let flips = makeSource(5, 3).map((v) => v % 4);
+    let lut = makeLUT();
+    // Indexes don't depend on the layer, only their expansion does, and
+    // pixels outside of the region are left as they were
+    let isBg = false;
+    let cases = [[3, -2, true], [-20, 9, true], [2, -3, false], [-5, 1, false]];
+    for (let [scrollX, scrollY, isWrapped] of cases) {
+      let expect = new Uint8Array(16 * 12 * 4);
+      let indexed = new Uint8Array(20 * 12);
+      kernels.rasterizeLayer(source, 9, 9, 7, scrollX, scrollY, isWrapped,
+                             isBg, lut, expect, 64, 1, 2, 15, 11);
+      kernels.indexLayer(source, 9, 9, 7, scrollX, scrollY, isWrapped,
+                         indexed, 20, 1, 2, 15, 11);
+      assert.deepEqual(expandIndexes(indexed, 20, 16, 12, lut, isBg),
+                       clearTransparent(expect));
+
+      expect = new Uint8Array(16 * 12 * 4);
+      indexed = new Uint8Array(20 * 12);
+      kernels.rasterizeTiles(tiles, tilemap, 5, 5, 3, flips, 5, 3, 4,
+                             scrollX, scrollY, isWrapped, isBg, lut,
+                             expect, 64, 1, 2, 15, 11);
+      kernels.indexTiles(tiles, tilemap, 5, 5, 3, flips, 5, 3, 4,
+                         scrollX, scrollY, isWrapped,
+                         indexed, 20, 1, 2, 15, 11);
+      assert.deepEqual(expandIndexes(indexed, 20, 16, 12, lut, isBg),
+                       clearTransparent(expect));
+    }
+  });
+
+  it('composite surfaces matches merge', function() {
+    let layers = [makeLayer(7, 5, 0), makeLayer(7, 5, 1), makeLayer(7, 5, 2)];
+    let expect = makeLayer(7, 5, 3);
+    let actual = makeLayer(7, 5, 3);
+    for (let layer of layers) {
+      algorithm.mergeIntoSurface(expect, layer);
+    }
+    kernels.compositeSurfaces(actual, layers);
+    assert.deepEqual(actual.buff, expect.buff);
+  });
+
+  it('native composite surfaces matches js', function() {
+    if (!kernels.hasNative('compositeSurfaces')) {
+      this.skip();
+    }
+    for (let numLayers = 0; numLayers <= 4; numLayers++) {
+      let layers = [];
+      for (let i = 0; i < numLayers; i++) {
+        layers.push(makeLayer(21, 9, i));
+      }
+      let expect = makeLayer(21, 9, 5);
+      let actual = makeLayer(21, 9, 5);
+      kernels.js.compositeSurfaces(expect, layers);
+      kernels.compositeSurfaces(actual, layers);
+      assert.deepEqual(actual.buff, expect.buff);
+    }
+  });
+
+  it('flood fill', function() {
+    // 0 is open, 1 is a wall that splits the field in two
+    let data = new Uint8Array([
+      0, 0, 1, 0,
+      0, 1, 0, 0,
+      1, 0, 0, 0,
+    ]);
+    let bounds = new Int32Array(4);
+    kernels.floodFill(data, 4, 0, 4, 3, 3, 2, 5, bounds);
+    assert.deepEqual(Array.from(data), [
+      0, 0, 1, 5,
+      0, 1, 5, 5,
+      1, 5, 5, 5,
+    ]);
+    assert.deepEqual(Array.from(bounds), [1, 0, 3, 2]);
+    // Already the same color, nothing to do
+    kernels.floodFill(data, 4, 0, 4, 3, 3, 2, 5, bounds);
+    assert.deepEqual(Array.from(bounds), [4, 3, -1, -1]);
+  });
+
+  it('fill ranges', function() {
+    let data = new Uint8Array(2 + 5 * 4);
+    let ranges = new Int32Array([
+      -2, 1, 1, 1,   // horizontal, clipped on the left
+       3, 3, 3, -1,  // vertical, reversed and clipped on the top
+       9, 9, 0, 0,   // outside
+    ]);
+    let bounds = new Int32Array(4);
+    kernels.fillRanges(data, 5, 2, 4, 4, ranges, 3, 7, bounds);
+    assert.deepEqual(Array.from(data.subarray(2)), [
+      0, 0, 0, 7, 0,
+      7, 7, 0, 7, 0,
+      0, 0, 0, 7, 0,
+      0, 0, 0, 7, 0,
+    ]);
+    assert.deepEqual(Array.from(bounds), [0, 0, 3, 3]);
+  });
+
+  it('native fill kernels match js', function() {
+    if (!kernels.hasNative('floodFill') || !kernels.hasNative('fillRanges')) {
+      this.skip();
+    }
+    let ranges = new Int32Array([0, 20, 3, 3, 5, 5, -4, 30, 12, 2, 9, 9]);
+    for (let seed = 0; seed < 8; seed++) {
+      let expect = new Uint8Array(19 * 13);
+      for (let k = 0; k < expect.length; k++) {
+        expect[k] = ((k * 7 + seed) % 11) < 4 ? 1 : 0;
+      }
+      let actual = expect.slice();
+      let expectBounds = new Int32Array(4);
+      let actualBounds = new Int32Array(4);
+      kernels.js.floodFill(expect, 19, 1, 17, 12, seed, 6, 9, expectBounds);
+      kernels.floodFill(actual, 19, 1, 17, 12, seed, 6, 9, actualBounds);
+      assert.deepEqual(actual, expect);
+      assert.deepEqual(actualBounds, expectBounds);
+      kernels.js.fillRanges(expect, 19, 1, 17, 12, ranges, 3, seed,
+                            expectBounds);
+      kernels.fillRanges(actual, 19, 1, 17, 12, ranges, 3, seed,
+                         actualBounds);
+      assert.deepEqual(actual, expect);
+      assert.deepEqual(actualBounds, expectBounds);
+    }
+  });
+
+  it('scale nearest', function() {
+    let source = makeLayer(5, 3, 1);
+    for (let zoom = 1; zoom <= 4; zoom++) {
+      let target = algorithm.makeSurface(5 * zoom, 3 * zoom);
+      kernels.scaleNearest(source.buff, source.pitch, 5, 3,
+                           target.buff, target.pitch, zoom);
+      for (let y = 0; y < 3 * zoom; y++) {
+        for (let x = 0; x < 5 * zoom; x++) {
+          let k = Math.floor(y / zoom) * source.pitch +
+                  Math.floor(x / zoom) * 4;
+          let j = y * target.pitch + x * 4;
+          assert.deepEqual(target.buff.slice(j, j + 4),
+                           source.buff.slice(k, k + 4));
+        }
+      }
+    }
+  });
+
+  it('scale scanlines', function() {
+    let source = new Uint8Array([10, 20, 30, 0xff]);
+    let target = algorithm.makeSurface(4, 4);
+    kernels.scaleScanlines(source, 4, 1, 1, target.buff, target.pitch, 4,
+                           true);
+    let row = (y) => Array.from(target.buff.slice(y * 16, y * 16 + 16));
+    assert.deepEqual(row(0), [10, 15, 23, 0xff,  8, 20, 23, 0xff,
+                               8, 15, 30, 0xff, 10, 15, 23, 0xff]);
+    assert.deepEqual(row(3), [ 5,  7, 11, 0xff,  4, 10, 11, 0xff,
+                               4,  7, 15, 0xff,  5,  7, 11, 0xff]);
+    // Without the shadow mask, only the scanline is darker
+    kernels.scaleScanlines(source, 4, 1, 1, target.buff, target.pitch, 4,
+                           false);
+    assert.deepEqual(row(2).slice(0, 4), [10, 20, 30, 0xff]);
+    assert.deepEqual(row(3).slice(0, 4), [5, 10, 15, 0xff]);
+  });
+
+  it('scale sharp bilinear', function() {
+    // At a whole multiple, it is the same as nearest
+    let source = makeLayer(5, 3, 1);
+    let expect = algorithm.makeSurface(15, 9);
+    let actual = algorithm.makeSurface(15, 9);
+    kernels.scaleNearest(source.buff, source.pitch, 5, 3,
+                         expect.buff, expect.pitch, 3);
+    kernels.scaleSharpBilinear(source.buff, source.pitch, 5, 3,
+                               actual.buff, actual.pitch, 15, 9);
+    assert.deepEqual(actual.buff, expect.buff);
+    // Otherwise, only the pixels on the edges are blended
+    let pair = new Uint8Array([0, 0, 0, 0xff, 200, 100, 40, 0xff]);
+    let wide = algorithm.makeSurface(5, 1);
+    kernels.scaleSharpBilinear(pair, 8, 2, 1, wide.buff, wide.pitch, 5, 1);
+    assert.deepEqual(Array.from(wide.buff), [
+        0,   0,  0, 0xff,    0,   0,  0, 0xff,  100, 50, 20, 0xff,
+      200, 100, 40, 0xff,  200, 100, 40, 0xff]);
+  });
+
+  it('native scale kernels match js', function() {
+    if (!kernels.hasNative('scaleNearest') ||
+        !kernels.hasNative('scaleScanlines') ||
+        !kernels.hasNative('scaleSharpBilinear')) {
+      this.skip();
+    }
+    for (let zoom = 1; zoom <= 5; zoom++) {
+      let source = makeLayer(9, 4, zoom);
+      let expect = algorithm.makeSurface(9 * zoom, 4 * zoom);
+      let actual = algorithm.makeSurface(9 * zoom, 4 * zoom);
+      kernels.js.scaleNearest(source.buff, source.pitch, 9, 4,
+                              expect.buff, expect.pitch, zoom);
+      kernels.scaleNearest(source.buff, source.pitch, 9, 4,
+                           actual.buff, actual.pitch, zoom);
+      assert.deepEqual(actual.buff, expect.buff);
+      kernels.js.scaleScanlines(source.buff, source.pitch, 9, 4,
+                                expect.buff, expect.pitch, zoom, true);
+      kernels.scaleScanlines(source.buff, source.pitch, 9, 4,
+                             actual.buff, actual.pitch, zoom, true);
+      assert.deepEqual(actual.buff, expect.buff);
+      let sharpExpect = algorithm.makeSurface(9 * zoom + 5, 4 * zoom + 3);
+      let sharpActual = algorithm.makeSurface(9 * zoom + 5, 4 * zoom + 3);
+      kernels.js.scaleSharpBilinear(source.buff, source.pitch, 9, 4,
+                                    sharpExpect.buff, sharpExpect.pitch,
+                                    sharpExpect.width, sharpExpect.height);
+      kernels.scaleSharpBilinear(source.buff, source.pitch, 9, 4,
+                                 sharpActual.buff, sharpActual.pitch,
+                                 sharpActual.width, sharpActual.height);
+      assert.deepEqual(sharpActual.buff, sharpExpect.buff);
+    }
+  });
+});
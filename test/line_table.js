@@ -0,0 +1,159 @@
+var util = require('./util.js');
+var ra = require('../src/lib.js');
+var assert = require('assert');
+
+function renderBuffer() {
+  let surf = ra.renderPrimaryField()[0];
+  return {pitch: surf.pitch, buff: Buffer.from(surf.buff)};
+}
+
+function pixel(surf, x, y) {
+  let k = y * surf.pitch + x * 4;
+  return Array.from(surf.buff.slice(k, k + 3));
+}
+
+describe('LineTable', function() {
+
+  it('scroll matches interrupts', function() {
+    ra.resetState();
+    ra.usePalette('pico8');
+    ra.setSize(8, 8);
+    let img = ra.loadImage('test/testdata/small-fruit.png');
+    ra.paste(img);
+
+    ra.useInterrupts([
+      {scanline: [0, 7], irq: (ln) => {
+        ra.setScrollX(ln % 5);
+        ra.setScrollY(ln >= 4 ? 2 : 0);
+      }},
+    ]);
+    let expect = renderBuffer();
+
+    ra.resetState();
+    ra.usePalette('pico8');
+    ra.setSize(8, 8);
+    ra.paste(img);
+    let table = ra.useLineTable();
+    for (let y = 0; y < 8; y++) {
+      table.setScroll(y, y % 5, y >= 4 ? 2 : 0);
+    }
+    let actual = renderBuffer();
+    assert.ok(expect.buff.equals(actual.buff));
+  });
+
+  it('scroll of tiled layer', function() {
+    ra.resetState();
+    ra.usePalette('pico8');
+    ra.setSize(32, 32);
+    let img = ra.loadImage('test/testdata/small-fruit.png');
+    ra.paste(img);
+    ra.useTileset({tile_width: 8, tile_height: 8, dups: true});
+
+    ra.useInterrupts([
+      {scanline: [0, 31], irq: (ln) => { ra.setScrollX(31 - ln) }},
+    ]);
+    let expect = renderBuffer();
+
+    ra.useInterrupts([]);
+    let table = ra.useLineTable();
+    for (let y = 0; y < 32; y++) {
+      table.setScroll(y, 31 - y, 0);
+    }
+    ra.setScrollX(0);
+    let actual = renderBuffer();
+    assert.ok(expect.buff.equals(actual.buff));
+  });
+
+  it('palette writes', function() {
+    ra.resetState();
+    ra.usePalette('pico8');
+    ra.setSize(8, 8);
+    ra.fillColor(3);
+    let before = pixel(renderBuffer(), 0, 0);
+
+    ra.resetState();
+    ra.usePalette('pico8');
+    ra.setSize(8, 8);
+    ra.fillColor(3);
+    let table = ra.useLineTable({colorChannels: 2});
+    table.setColor(4, 3, 0xff0000);
+    table.setColor(6, 3, 0x00ff00, 1);
+
+    let surf = renderBuffer();
+    assert.deepEqual(pixel(surf, 0, 3), before);
+    assert.deepEqual(pixel(surf, 0, 4), [0xff, 0x00, 0x00]);
+    assert.deepEqual(pixel(surf, 7, 5), [0xff, 0x00, 0x00]);
+    assert.deepEqual(pixel(surf, 0, 6), [0x00, 0xff, 0x00]);
+    assert.deepEqual(pixel(surf, 0, 7), [0x00, 0xff, 0x00]);
+
+    // The palette itself is not changed, so each frame starts over
+    table.clear();
+    surf = renderBuffer();
+    assert.deepEqual(pixel(surf, 0, 7), before);
+  });
+
+  it('palette writes across interrupt regions', function() {
+    ra.resetState();
+    ra.usePalette('pico8');
+    ra.setSize(8, 8);
+    ra.fillColor(3);
+    let before = pixel(renderBuffer(), 0, 0);
+
+    ra.resetState();
+    ra.usePalette('pico8');
+    ra.setSize(8, 8);
+    ra.fillColor(3);
+    let table = ra.useLineTable();
+    table.setColor(2, 3, 0xff0000);
+    table.setColor(5, 3, 0x00ff00);
+    let edit = false;
+    ra.useInterrupts([
+      {scanline: [0, 7], irq: (ln) => {
+        if (edit && ln == 3) {
+          table.clearColor(5);
+        }
+      }},
+    ]);
+    let surf = renderBuffer();
+    let rows = [0, 1, 2, 3, 4, 5, 6, 7].map((y) => pixel(surf, 0, y));
+    let red = [0xff, 0x00, 0x00];
+    let green = [0x00, 0xff, 0x00];
+    assert.deepEqual(rows, [before, before, red, red, red,
+                            green, green, green]);
+
+    // An irq that edits the table is seen by the regions below it
+    edit = true;
+    surf = renderBuffer();
+    rows = [0, 1, 2, 3, 4, 5, 6, 7].map((y) => pixel(surf, 0, y));
+    assert.deepEqual(rows, [before, before, red, red, red, red, red, red]);
+  });
+
+  it('count color writes', function() {
+    ra.resetState();
+    let table = ra.useLineTable({height: 4, colorChannels: 2});
+    assert.ok(!table.hasColors());
+    table.setColor(1, 3, 0xff0000);
+    table.setColor(1, 4, 0x00ff00);
+    table.setColor(2, 3, 0xff0000, 1);
+    table.clearColor(1);
+    assert.ok(table.hasColors());
+    table.clearColor(2, 1);
+    table.clearColor(2, 1);
+    assert.ok(!table.hasColors());
+    table.setColor(0, 3, 0xff0000);
+    table.clear();
+    assert.ok(!table.hasColors());
+  });
+
+  it('invalid', function() {
+    ra.resetState();
+    let table = ra.useLineTable({height: 4});
+    assert.throws(() => { table.setScroll(4, 0, 0) },
+                  /invalid scanline number: 4/);
+    assert.throws(() => { table.setColor(0, 256, 0) },
+                  /color index must be 0 to 255, got 256/);
+    assert.throws(() => { ra.useLineTable({}, {layer: 1}) },
+                  /useLineTable layer 1 does not exist/);
+  });
+
+});
@@ -50,6 +50,44 @@ describe('Palette', function() {
     assert.equal(actual, expect);
   });
 
+  it('compile', () => {
+    let pal = new palette.Palette();
+    pal.setRGBMap([0x000000, 0x102030, 0x405060, 0x708090]);
+    let rgbmap = pal._rgbmap;
+
+    let compiled = pal.compile(rgbmap);
+    assert.deepEqual(Array.from(compiled.bytes.slice(0, 12)),
+                     [0x00, 0x00, 0x00, 0xff,
+                      0x10, 0x20, 0x30, 0xff,
+                      0x40, 0x50, 0x60, 0xff]);
+    // Indexes past the rgbmap wrap around
+    assert.deepEqual(Array.from(compiled.bytes.slice(16, 20)),
+                     [0x00, 0x00, 0x00, 0xff]);
+
+    // Unchanged palette reuses the table
+    let serial = compiled.serial;
+    assert.equal(pal.compile(rgbmap).serial, serial);
+
+    // Any change rebuilds it
+    pal.setEntries([3, 2, 1, 0]);
+    compiled = pal.compile(rgbmap);
+    assert.notEqual(compiled.serial, serial);
+    assert.deepEqual(Array.from(compiled.bytes.slice(0, 4)),
+                     [0x70, 0x80, 0x90, 0xff]);
+
+    serial = compiled.serial;
+    pal.entry(1).setColor(3);
+    compiled = pal.compile(rgbmap);
+    assert.notEqual(compiled.serial, serial);
+    assert.deepEqual(Array.from(compiled.bytes.slice(4, 8)),
+                     [0x70, 0x80, 0x90, 0xff]);
+
+    serial = compiled.serial;
+    pal.addRGBMap(0xffffff);
+    compiled = pal.compile(rgbmap);
+    assert.notEqual(compiled.serial, serial);
+  });
+
   it('findNearPieces', () => {
     const pieceSize = 4;
 
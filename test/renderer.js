@@ -74,3 +74,364 @@ describe('Render components', function() {
     util.ensureFilesMatch(tmptiles, 'test/testdata/tiles_made.png');
   });
 });
+
+describe('Renderer surfaces', function() {
+  it('notify when surfaces change', function() {
+    ra.resetState();
+    ra.setSize(8, 8);
+
+    let renderer = ra._renderer;
+    renderer.connect(ra.provide());
+    let got = [];
+    renderer.setOnSurfacesChanged((surfaces) => {
+      got.push(surfaces);
+    });
+
+    let first = renderer.render();
+    assert.equal(got.length, 1);
+    assert.equal(got[0][0].buff, first[0].buff);
+    // Packed dirty rects, first render changes the entire surface
+    assert.equal(got[0][0].dirtyPacked[0], -1);
+
+    renderer.render();
+    assert.equal(got.length, 1);
+    assert.equal(got[0][0].dirtyPacked[0], 0);
+
+    renderer.flushBuffer();
+    let second = renderer.render();
+    assert.equal(got.length, 2);
+    assert.equal(got[1][0].buff, second[0].buff);
+    assert.notEqual(first[0].buff, second[0].buff);
+  });
+
+  it('render into surface sets', function() {
+    ra.resetState();
+    ra.setSize(8, 8);
+    ra.fillColor(0);
+
+    let renderer = ra._renderer;
+    renderer.connect(ra.provide());
+    renderer.setSurfaceSets(2);
+    let got = [];
+    renderer.setOnSurfacesChanged((surfaces) => {
+      got.push(surfaces.setIndex);
+    });
+
+    let first = renderer.render();
+    let second = renderer.render();
+    assert.deepEqual(got, [0, 1]);
+    assert.equal(first.setIndex, 0);
+    assert.equal(second.setIndex, 1);
+    assert.notEqual(first[0].buff, second[0].buff);
+
+    // Set 1 was rendered before either dot, so it must draw both
+    ra.setColor(7);
+    ra.drawDot(1, 1);
+    renderer.render(0);
+    ra.drawDot(5, 5);
+    renderer.render(1);
+    assert.deepEqual(second[0].dirty, [{x: 5, y: 5, w: 1, h: 1}]);
+
+    let pixel = (surf, x, y) => {
+      let k = y * surf.pitch + x * 4;
+      return Array.from(surf.buff.slice(k, k + 4));
+    };
+    assert.notDeepEqual(pixel(second[0], 1, 1), pixel(second[0], 0, 0));
+    assert.deepEqual(pixel(second[0], 1, 1), pixel(second[0], 5, 5));
+    assert.deepEqual(pixel(first[0], 1, 1), pixel(second[0], 1, 1));
+
+    assert.throws(() => {
+      renderer.render(2);
+    }, /invalid surface set 2/);
+  });
+
+  it('render into targets', function() {
+    ra.resetState();
+    ra.usePalette('pico8');
+    ra.setSize(8, 8);
+    ra.fillColor(1);
+    ra.setColor(7);
+    ra.drawDot(2, 3);
+
+    let renderer = ra._renderer;
+    renderer.connect(ra.provide());
+    let expect = renderer.render();
+    let own = expect[0].buff;
+    expect = Buffer.from(own);
+
+    // A wider pitch, like a locked texture that pads its rows
+    let pitch = 40;
+    let target = {buff: new Uint8Array(pitch * 8).fill(0xcc), pitch: pitch};
+    ra.drawDot(2, 3);
+    let surfs = renderer.render(null, [target]);
+    assert.equal(surfs[0].buff, own);
+    assert.equal(surfs[0].pitch, 32);
+    for (let y = 0; y < 8; y++) {
+      let row = Buffer.from(target.buff.subarray(y * pitch, y * pitch + 32));
+      assert.ok(row.equals(expect.subarray(y * 32, y * 32 + 32)));
+      assert.equal(target.buff[y * pitch + 32], 0xcc);
+    }
+
+    // Own buffers missed that frame, so the next one draws everything
+    ra.drawDot(5, 5);
+    surfs = renderer.render();
+    assert.equal(surfs[0].dirty, null);
+
+    // A target that does not fit, lent for surfaces of another size, is
+    // left alone, and the surface is rasterized instead
+    let small = {buff: new Uint8Array(32 * 7).fill(0xcc), pitch: 32};
+    ra.drawDot(6, 6);
+    surfs = renderer.render(null, [small]);
+    assert.ok(small.buff.every((v) => v == 0xcc));
+    assert.deepEqual(surfs[0].buff.slice(6 * 32 + 6 * 4, 6 * 32 + 7 * 4),
+                     surfs[0].buff.slice(3 * 32 + 2 * 4, 3 * 32 + 3 * 4));
+
+    // Surfaces given to the display in a frame that used targets hold that
+    // frame, the display stops lending the targets once it has them
+    let given = null;
+    renderer.setOnSurfacesChanged((list) => {
+      given = Buffer.from(list[0].buff);
+    });
+    target.buff.fill(0xcc);
+    ra.drawDot(4, 1);
+    renderer.render(null, [target]);
+    for (let y = 0; y < 8; y++) {
+      let row = Buffer.from(target.buff.subarray(y * pitch, y * pitch + 32));
+      assert.ok(row.equals(given.subarray(y * 32, y * 32 + 32)));
+    }
+    assert.ok(given.equals(Buffer.from(own)));
+  });
+
+  it('indexed output', function() {
+    ra.resetState();
+    ra.usePalette('quick');
+    let img = ra.loadImage('test/testdata/tiles.png');
+    let tileset = new ra.Tileset(img, {tile_width: 4, tile_height: 4});
+    let upper = new ra.DrawableField();
+    upper.setSize(4, 1);
+    let lower = new ra.DrawableField();
+    lower.setSize(16, 16);
+    ra.setSize(16, 16);
+    ra.useField([lower, upper]);
+    ra.useTileset([tileset]);
+    upper.fillPattern([[2, 2, 6, 2]]);
+    lower.fillColor(32);
+    lower.setColor(42);
+    lower.fillCircle({x: 2, y: 2, r: 6});
+    ra.useLayering([{layer: 0, field: 0}, {layer: 1, field: 1, tileset: 0}]);
+    ra.setComponent('scroll', 1);
+    ra.setScrollY(-12);
+    let sprites = new ra.Spritelist(2, tileset);
+    ra.useSpritelist(sprites);
+    sprites[0].x = 3;
+    sprites[0].y = 5;
+    sprites[0].c = 6;
+    sprites[1].x = 9;
+    sprites[1].y = 1;
+    sprites[1].c = 2;
+    sprites[1].h = 1;
+
+    // Pixels that are transparent show nothing, whatever their rgb value
+    let visible = (buff) => {
+      buff = Buffer.from(buff);
+      for (let k = 0; k < buff.length; k += 4) {
+        if (buff[k + 3] == 0) {
+          buff.fill(0, k, k + 4);
+        }
+      }
+      return buff;
+    };
+    let expand = (surf) => {
+      let bytes = new Uint8Array(surf.palette.buffer);
+      let out = Buffer.alloc(surf.width * surf.height * 4);
+      for (let k = 0; k < surf.width * surf.height; k++) {
+        let c = surf.buff[k];
+        out.set(bytes.subarray(c * 4, c * 4 + 4), k * 4);
+      }
+      return visible(out);
+    };
+
+    let renderer = ra._renderer;
+    renderer.connect(ra.provide());
+    let expect = renderer.render().map((surf) => visible(surf.buff));
+
+    renderer.setIndexedOutput(true);
+    let surfs = renderer.render();
+    assert.deepEqual(surfs.map((surf) => surf.format), ['index8', 'index8']);
+    assert.equal(surfs[0].buff.length, 16 * 16);
+    assert.ok(expand(surfs[0]).equals(expect[0]));
+    assert.ok(expand(surfs[1]).equals(expect[1]));
+
+    // Changing the palette only changes the surface's palette
+    let before = surfs[0].palette.slice();
+    ra.palette.entry(32).setColor(5);
+    ra.palette.entry(42).setColor(7);
+    surfs = renderer.render();
+    assert.notDeepEqual(surfs[0].palette, before);
+    assert.deepEqual(surfs[0].dirty, []);
+
+    // Mixed sprites add up colors, so their layer is RGBA
+    sprites[1].m = 1;
+    surfs = renderer.render();
+    assert.deepEqual(surfs.map((surf) => surf.format), ['index8', 'rgba']);
+  });
+
+  it('hardware scroll', function() {
+    ra.resetState();
+    ra.usePalette('quick');
+    let img = ra.loadImage('test/testdata/tiles.png');
+    let tileset = new ra.Tileset(img, {tile_width: 4, tile_height: 4});
+    let upper = new ra.DrawableField();
+    upper.setSize(6, 6);
+    let lower = new ra.DrawableField();
+    lower.setSize(40, 24);
+    ra.useField([lower, upper]);
+    ra.useTileset([tileset]);
+    upper.fillPattern([[2, 0, 6], [0, 3, 0]]);
+    lower.fillColor(32);
+    lower.setColor(42);
+    lower.fillCircle({x: 30, y: 20, r: 6});
+    ra.useLayering([{layer: 0, field: 0}, {layer: 1, field: 1, tileset: 0}]);
+    let scrollTo = (x0, y0, x1, y1) => {
+      ra.setComponent('scroll', 0);
+      ra.setScrollX(x0);
+      ra.setScrollY(y0);
+      ra.setComponent('scroll', 1);
+      ra.setScrollX(x1);
+      ra.setScrollY(y1);
+    };
+    scrollTo(27, -5, 13, 30);
+
+    // What the display shows, panning across the surface with wrapping
+    let view = (surf) => {
+      let out = Buffer.alloc(16 * 16 * 4);
+      for (let y = 0; y < 16; y++) {
+        for (let x = 0; x < 16; x++) {
+          let sx = (surf.pan[0] + x) % surf.width;
+          let sy = (surf.pan[1] + y) % surf.height;
+          let k = sy * surf.pitch + sx * 4;
+          out.set(surf.buff.subarray(k, k + 4), (y * 16 + x) * 4);
+        }
+      }
+      return out;
+    };
+
+    let renderer = ra._renderer;
+    renderer.connect(ra.provide());
+    renderer.setRenderSize(16, 16);
+    let expect = renderer.render().map((surf) => Buffer.from(surf.buff));
+
+    renderer.setHardwareScroll(true);
+    let surfs = renderer.render();
+    assert.deepEqual(surfs.map((surf) => [surf.width, surf.height]),
+                     [[40, 24], [24, 24]]);
+    assert.ok(view(surfs[0]).equals(expect[0]));
+    assert.ok(view(surfs[1]).equals(expect[1]));
+
+    // Scrolling only moves the pan
+    scrollTo(-3, 11, 1, 2);
+    surfs = renderer.render();
+    assert.deepEqual(surfs.map((surf) => surf.dirty), [[], []]);
+    assert.deepEqual(Array.from(surfs[0].pan), [37, 11]);
+    assert.deepEqual(Array.from(surfs[1].pan), [1, 2]);
+
+    // Damage is in the field's pixels, tiles cover their whole cell
+    lower.fillRect(35, 2, 3, 4);
+    upper.put(4, 5, 6);
+    surfs = renderer.render();
+    assert.deepEqual(surfs[0].dirty, [{x: 35, y: 2, w: 3, h: 4}]);
+    assert.deepEqual(surfs[1].dirty, [{x: 16, y: 20, w: 4, h: 4}]);
+    expect = Buffer.from(surfs[0].buff);
+    renderer.setHardwareScroll(false);
+    renderer.setHardwareScroll(true);
+    assert.ok(Buffer.from(renderer.render()[0].buff).equals(expect));
+
+    // A layer smaller than the display doesn't wrap, so it is drawn as usual
+    upper.setSize(3, 3);
+    surfs = renderer.render();
+    assert.equal(surfs[1].pan, null);
+    assert.equal(surfs[1].width, 16);
+  });
+
+  it('hardware scroll with a shared tileset', function() {
+    ra.resetState();
+    ra.usePalette('quick');
+    let img = ra.loadImage('test/testdata/tiles.png');
+    let tileset = new ra.Tileset(img, {tile_width: 4, tile_height: 4});
+    let lower = new ra.DrawableField();
+    lower.setSize(6, 6);
+    lower.fillPattern([[1, 2, 3], [4, 1, 5]]);
+    let upper = new ra.DrawableField();
+    upper.setSize(6, 6);
+    upper.fillPattern([[0, 1], [6, 0]]);
+    ra.useField([lower, upper]);
+    ra.useTileset([tileset]);
+    ra.useLayering([{layer: 0, field: 0, tileset: 0},
+                    {layer: 1, field: 1, tileset: 0}]);
+
+    let renderer = ra._renderer;
+    renderer.connect(ra.provide());
+    renderer.setRenderSize(16, 16);
+    renderer.setHardwareScroll(true);
+    renderer.render();
+
+    // Both layers show tile 1, so both are damaged by editing it
+    tileset.get(1).put(1, 2, 0);
+    let surfs = renderer.render();
+    assert.ok(surfs[0].dirty.length > 0);
+    assert.ok(surfs[1].dirty.length > 0);
+    let actual = surfs.map((surf) => Buffer.from(surf.buff));
+    renderer.setHardwareScroll(false);
+    renderer.setHardwareScroll(true);
+    let expect = renderer.render();
+    assert.ok(actual[0].equals(Buffer.from(expect[0].buff)));
+    assert.ok(actual[1].equals(Buffer.from(expect[1].buff)));
+  });
+
+  it('hidden layers and blend modes', function() {
+    ra.resetState();
+    ra.usePalette('pico8');
+    let upper = new ra.DrawableField();
+    upper.setSize(8, 8);
+    let lower = new ra.DrawableField();
+    lower.setSize(8, 8);
+    ra.useField([lower, upper]);
+    lower.fillColor(1);
+    upper.fillColor(0);
+    upper.setColor(7);
+    upper.fillRect(2, 2, 3, 3);
+    ra.useLayering([{layer: 0, field: 0},
+                    {layer: 1, field: 1, blend: 'add'}]);
+
+    let renderer = ra._renderer;
+    renderer.connect(ra.provide());
+    let surfs = renderer.render();
+    assert.deepEqual(surfs.map((surf) => surf.blend), ['alpha', 'add']);
+    let shown = Buffer.from(surfs[1].buff);
+
+    // Hiding a layer changes the display once, then it is not rasterized
+    ra.setLayerVisible(1, false);
+    upper.fillRect(0, 0, 1, 1);
+    surfs = renderer.render();
+    assert.equal(surfs[1].visible, false);
+    assert.equal(surfs[1].dirty, null);
+    assert.ok(Buffer.from(surfs[1].buff).equals(shown));
+    surfs = renderer.render();
+    assert.deepEqual(surfs[1].dirty, []);
+
+    // Showing it again renders all of it
+    ra.setLayerVisible(1, true);
+    surfs = renderer.render();
+    assert.equal(surfs[1].visible, true);
+    assert.equal(surfs[1].dirty, null);
+    assert.ok(!Buffer.from(surfs[1].buff).equals(shown));
+
+    ra.setLayerBlend(1, 'multiply');
+    surfs = renderer.render();
+    assert.equal(surfs[1].blend, 'multiply');
+    assert.throws(() => { ra.setLayerBlend(1, 'screen') },
+                  /blend must be one of alpha, add, multiply, none, got screen/);
+    assert.throws(() => { ra.setLayerVisible(2, false) },
+                  /setLayerVisible layer 2 does not exist/);
+  });
+});
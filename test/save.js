@@ -1,5 +1,7 @@
 var assert = require('assert');
 var child_process = require('child_process');
+var fs = require('fs');
+var PNG = require('pngjs').PNG;
 var util = require('./util.js');
 
 describe('Save', function() {
@@ -40,6 +42,27 @@ describe('Save', function() {
     });
   });
 
+  it('raw video', function(success) {
+    let tmpdir = util.mkTmpDir();
+    let tmpout = tmpdir + '/actual.rgba';
+    let script = 'test/testdata/scripts/spin.js';
+    let cmd = `node ${script} --save ${tmpout} --num-frames 4`;
+    child_process.exec(cmd, function(error, stdout, stderr) {
+      if (error) {
+        throw error;
+      }
+      // Frames are back to back, with no header
+      let actual = fs.readFileSync(tmpout);
+      let frame00 = PNG.sync.read(fs.readFileSync('test/testdata/spin-frame00.png'));
+      let frame03 = PNG.sync.read(fs.readFileSync('test/testdata/spin-frame03.png'));
+      let size = frame00.data.length;
+      assert.equal(actual.length, size * 4);
+      assert.deepEqual(actual.subarray(0, size), frame00.data);
+      assert.deepEqual(actual.subarray(size * 3), frame03.data);
+      success();
+    });
+  });
+
   it('late grid', function(success) {
     let tmpdir = util.mkTmpDir();
     let tmpout = tmpdir + '/actual.png';
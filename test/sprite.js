@@ -152,6 +152,67 @@ describe('Sprite', function() {
     util.renderCompareTo(ra, 'test/testdata/some-sprites.png');
   });
 
+  it('line limit', function() {
+    let render = function(limit) {
+      ra.resetState();
+      ra.setSize(8, 8);
+      ra.spritelist.createChar({num: 3, x: 2, y: 2}, (field, i)=> {
+        field.fill(i+40);
+      });
+      ra.spritelist.set(0, {x: 0, y: 1, c: 0});
+      ra.spritelist.set(1, {x: 2, y: 2, c: 1});
+      ra.spritelist.set(2, {x: 4, y: 2, c: 2});
+      if (limit != null) {
+        ra.spritelist.setLineLimit(limit);
+      }
+      let surf = ra.renderPrimaryField()[0];
+      return function(x, y) {
+        let k = y * surf.pitch + x * 4;
+        return Array.from(surf.buff.slice(k, k + 3));
+      };
+    };
+    let all = render(null);
+    assert.equal(ra.spritelist.overflow, false);
+    let color = function(c) {
+      let bytes = ra.palette.compile(ra._renderer._rgbmap).bytes;
+      return Array.from(bytes.slice(c * 4, c * 4 + 3));
+    };
+    assert.deepEqual(all(4, 2), color(42));
+
+    // Line 2 has all three sprites, so the last one is dropped from it
+    let limited = render(2);
+    assert.equal(ra.spritelist.overflow, true);
+    assert.deepEqual(limited(0, 2), color(40));
+    assert.deepEqual(limited(2, 2), color(41));
+    assert.deepEqual(limited(4, 2), all(4, 1));
+    assert.deepEqual(limited(4, 3), color(42));
+
+    assert.throws(function() {
+      ra.spritelist.setLineLimit(-1);
+    }, /setLineLimit needs a number >= 0/);
+  });
+
+  it('sprites moved by interrupts', function() {
+    ra.resetState();
+    ra.setSize(8, 8);
+    ra.spritelist.createChar({num: 1, x: 2, y: 8}, (field, i)=> {
+      field.fill(40);
+    });
+    ra.spritelist.set(0, {x: 0, y: 0, c: 0});
+    ra.useInterrupts([
+      {scanline: 4, irq: () => { ra.spritelist[0].x = 4; }},
+    ]);
+    let surf = ra.renderPrimaryField()[0];
+    let pixel = function(x, y) {
+      let k = y * surf.pitch + x * 4;
+      return Array.from(surf.buff.slice(k, k + 3));
+    };
+    // The top half keeps the sprite where it was when drawn
+    assert.deepEqual(pixel(0, 3), pixel(4, 4));
+    assert.deepEqual(pixel(4, 3), pixel(0, 4));
+    assert.notDeepEqual(pixel(0, 3), pixel(4, 3));
+  });
+
   it('behind layer', function() {
     ra.resetState();
 
@@ -36,6 +36,211 @@ describe('Tileset', function() {
     util.renderCompareTo(ra, 'test/testdata/map_of_tiles.png');
   });
 
+  it('tile flips', function() {
+    let render = function(flips) {
+      ra.resetState();
+
+      let field = new ra.Field();
+      field.setSize(4);
+
+      let tiles = ra.loadImage('test/testdata/tiles.png');
+      ra.useTileset(tiles, {tile_width: 4, tile_height: 4});
+      ra.useField(field);
+      if (flips) {
+        ra.useTileFlips(flips);
+      }
+
+      field.fill([2, 6, 1, 3,
+                  6, 7, 7, 7,
+                  5, 5, 1, 0,
+                  6, 4, 2, 2]);
+      return ra.renderPrimaryField()[0];
+    };
+    let expect = render(null);
+
+    let flips = new ra.Field();
+    flips.setSize(4);
+    flips.put(0, 0, 1);
+    flips.put(1, 0, 2);
+    flips.put(2, 0, 3);
+    let actual = render(flips);
+
+    let pixel = function(surf, x, y) {
+      let k = y * surf.pitch + x * 4;
+      return Array.from(surf.buff.slice(k, k + 4));
+    };
+    for (let y = 0; y < 4; y++) {
+      for (let x = 0; x < 4; x++) {
+        assert.deepEqual(pixel(actual, x, y), pixel(expect, 3 - x, y));
+        assert.deepEqual(pixel(actual, 4 + x, y),
+                         pixel(expect, 4 + x, 3 - y));
+        assert.deepEqual(pixel(actual, 8 + x, y),
+                         pixel(expect, 8 + 3 - x, 3 - y));
+        assert.deepEqual(pixel(actual, 12 + x, y),
+                         pixel(expect, 12 + x, y));
+      }
+    }
+  });
+
+  it('tile flips and tiles must cover the map', function() {
+    ra.resetState();
+    let field = new ra.Field();
+    field.setSize(4);
+    let tiles = ra.loadImage('test/testdata/tiles.png');
+    let tileset = ra.useTileset(tiles, {tile_width: 4, tile_height: 4});
+    ra.useField(field);
+
+    let flips = new ra.Field();
+    flips.setSize(3, 4);
+    ra.useTileFlips(flips);
+    assert.throws(() => { ra.renderPrimaryField() },
+                  /layer.tileflips is 3x4, smaller than the tilemap 4x4/);
+
+    let small = new ra.Tile();
+    small.setSize(2, 4);
+    assert.throws(() => { tileset.put(1, small) },
+                  /tile must be 4x4, got 2x4/);
+  });
+
+  it('tile cache', function() {
+    ra.resetState();
+
+    let field = new ra.Field();
+    field.setSize(4);
+
+    let tiles = ra.loadImage('test/testdata/tiles.png');
+    let tileset = ra.useTileset(tiles, {tile_width: 4, tile_height: 4});
+    ra.useField(field);
+
+    field.fill([2, 6, 1, 3,
+                6, 7, 7, 7,
+                5, 5, 1, 0,
+                6, 4, 2, 2]);
+
+    // Each tile id is converted once, the rest are copied
+    util.renderCompareTo(ra, 'test/testdata/map_of_tiles.png');
+    let stats = ra.getTileCacheStats();
+    assert.equal(stats.misses, 8);
+    assert.equal(stats.entries, 8);
+    let first = stats.hits;
+
+    util.renderCompareTo(ra, 'test/testdata/map_of_tiles.png');
+    stats = ra.getTileCacheStats();
+    assert.equal(stats.misses, 8);
+    assert.equal(stats.hits, first + 16);
+
+    // Changing a tile only converts that tile again
+    tileset.get(3).put(0, 0, 0);
+    ra.renderPrimaryField();
+    stats = ra.getTileCacheStats();
+    assert.equal(stats.misses, 9);
+    assert.equal(stats.entries, 8);
+  });
+
+  it('tile cache with attributes', function() {
+    let render = function(useCache) {
+      ra.resetState();
+      if (!useCache) {
+        ra._renderer.disableTileCache();
+      }
+
+      ra.usePalette({rgbmap:[
+        0x000000, 0x565656, 0x664019, 0x858585, 0xa5a5a5, 0xc0c0c0,
+        0xffffff, 0xffb973, 0xff7373, 0xff3333, 0xff9933, 0xf1ff73,
+        0x2b6619, 0x4abf26, 0xbbffa6, 0x63ff33, 0xd9ffed, 0x2687bf,
+        0x7033ff, 0x66194f, 0xffa6e4, 0xff33c2
+      ]});
+      ra.usePalette({entries:[17,16,14,15,13,12,
+                               0,11, 7,10, 9, 2,
+                               6, 5, 4, 3, 1, 0,
+                              18,20, 8, 5,21,19]});
+
+      let colors = new ra.Field();
+      colors.setSize(4);
+      colors.fill([0,1,1,1,
+                   1,3,3,3,
+                   2,2,1,0,
+                   1,3,0,0]);
+      ra.useColorspace(colors, {cell_width: 4, cell_height: 4,
+                                piece_size: 6});
+
+      let tiles = ra.loadImage('test/testdata/tiles.png');
+      ra.useTileset(tiles, {tile_width: 4, tile_height: 4});
+
+      let field = new ra.Field();
+      field.setSize(4);
+      ra.useField(field);
+      field.fill([2, 6, 1, 3,
+                  6, 7, 7, 7,
+                  5, 5, 1, 0,
+                  6, 4, 2, 2]);
+
+      // Render after each change, so that the cache has stale entries
+      let frames = [];
+      let take = function() {
+        let surf = ra.renderPrimaryField()[0];
+        frames.push(Buffer.from(surf.buff).toString('hex'));
+      };
+      take();
+      ra.colorspace.put(1, 0, 3);
+      ra.colorspace.put(2, 2, [4, 9, 13]);
+      take();
+      ra.palette.entry(7).setColor(0x33);
+      take();
+      ra.colorspace.put(2, 2, [4, 8, 13]);
+      take();
+      return frames;
+    };
+    let expect = render(false);
+    assert.deepEqual(render(true), expect);
+    assert(ra.getTileCacheStats().hits > 0);
+  });
+
+  it('tile cache shared by layers', function() {
+    let render = function(useCache) {
+      ra.resetState();
+      ra.usePalette('quick');
+      // Sizing clears the renderer's options, so disable the cache after
+      ra.setSize(16, 16);
+      if (!useCache) {
+        ra._renderer.disableTileCache();
+      }
+      let tiles = ra.loadImage('test/testdata/tiles.png');
+      let tileset = new ra.Tileset(tiles, {tile_width: 4, tile_height: 4});
+      let lower = new ra.Field();
+      lower.setSize(4);
+      lower.fill([1, 2, 3, 4,
+                  1, 1, 1, 1,
+                  2, 2, 2, 2,
+                  5, 6, 7, 1]);
+      let upper = new ra.Field();
+      upper.setSize(4);
+      upper.fill([0, 1, 0, 1,
+                  1, 0, 1, 0,
+                  6, 1, 0, 3,
+                  1, 1, 1, 1]);
+      ra.useField([lower, upper]);
+      ra.useTileset([tileset]);
+      ra.useLayering([{layer: 0, field: 0, tileset: 0},
+                      {layer: 1, field: 1, tileset: 0}]);
+
+      // Each layer has its own cache, both have to see the edit
+      let frames = [];
+      let take = function() {
+        for (let surf of ra.renderPrimaryField()) {
+          frames.push(Buffer.from(surf.buff).toString('hex'));
+        }
+      };
+      take();
+      tileset.get(1).put(0, 0, 0);
+      take();
+      return frames;
+    };
+    let expect = render(false);
+    assert.notEqual(expect[1], expect[3]);
+    assert.deepEqual(render(true), expect);
+  });
+
   it('draw tiles', function() {
     ra.resetState();
 
@@ -430,6 +635,58 @@ describe('Tileset', function() {
     assert.deepEqual(4, ra.field.height);
   });
 
+  it('build from field with flips', function() {
+    let render = function(flips) {
+      ra.resetState();
+      ra.setSize(24, 16, {fieldOnly: true});
+      let img = ra.loadImage('test/testdata/map_of_tiles.png');
+      ra.paste(img);
+      // Flipped copies of the first three tiles
+      for (let y = 0; y < 4; y++) {
+        for (let x = 0; x < 4; x++) {
+          ra.field.put(16 + x, y, ra.field.get(3 - x, y));
+          ra.field.put(20 + x, y, ra.field.get(4 + x, 3 - y));
+          ra.field.put(16 + x, 4 + y, ra.field.get(8 + 3 - x, 3 - y));
+        }
+      }
+      if (flips == null) {
+        return {surf: ra.renderPrimaryField()[0]};
+      }
+      let tiles = ra.useTileset({tile_width: 4, tile_height: 4, flips: flips});
+      return {surf: ra.renderPrimaryField()[0], tiles: tiles};
+    };
+    let expect = render(null).surf;
+
+    let actual = render(false);
+    assert.equal(actual.tiles.length, 12);
+    assert.equal(ra.tileflips, null);
+    assert.deepEqual(actual.surf.buff, expect.buff);
+
+    actual = render(true);
+    assert.equal(actual.tiles.length, 9);
+    assert.deepEqual(ra.field.toArrays()[0], [0, 1, 2, 3, 0, 1]);
+    assert.deepEqual(ra.tileflips.toArrays()[0], [0, 0, 0, 0, 1, 2]);
+    assert.deepEqual(ra.tileflips.toArrays()[1], [0, 0, 0, 0, 3, 0]);
+    assert.deepEqual(actual.surf.buff, expect.buff);
+  });
+
+  it('dedup checks contents', function() {
+    let tiles = new ra.Tileset({tile_width: 2, tile_height: 2});
+    let f = new ra.Field();
+    f.setSize(6, 2);
+    f.fill([1, 2, 1, 2, 2, 1,
+            3, 4, 3, 4, 4, 3]);
+    let table = tiles.add(f);
+    assert.deepEqual(table.data, [0, 0, 1]);
+    assert.equal(table.flips, null);
+
+    // A tile that changes after being added no longer matches
+    tiles.get(0).put(0, 0, 9);
+    table = tiles.add(f);
+    assert.deepEqual(table.data, [2, 2, 1]);
+    assert.equal(tiles.length, 3);
+  });
+
   it('cant construct from string', function() {
     assert.throws(function() {
       ra.useTileset('abc', {tile_width: 4, tile_height: 4});
@@ -20,4 +20,42 @@ describe('Time', () => {
       });
     });
   });
+
+  it('frames dropped by native pacing', () => {
+    ra.resetState();
+    ra.setSize(8, 8);
+    ra.setFrameRate(30, {pacing: 'skip'});
+    ra._ensureExecutor();
+    let exec = ra._executor;
+    exec.setFrameRate(ra.config.frameRate, ra.config.pacing);
+
+    let calls = 0;
+    let draw = () => { calls++; };
+    assert(exec._execNextFrame(draw, 0));
+    assert.equal(ra.tick, 1);
+    assert.equal(ra.missedFrames, 0);
+
+    // Two frames were skipped, time still passes for them
+    assert(exec._execNextFrame(draw, 2));
+    assert.equal(calls, 2);
+    assert.equal(ra.tick, 4);
+    assert.equal(ra.missedFrames, 2);
+    assert(Math.abs(ra.time - 4/30) < 0.00001);
+
+    // Catching up only counts them
+    exec.setFrameRate(30, 'catchup');
+    assert(exec._execNextFrame(draw, 1));
+    assert.equal(ra.tick, 5);
+    assert.equal(ra.missedFrames, 3);
+  });
+
+  it('frame rate must be supported', () => {
+    ra.resetState();
+    assert.throws(() => {
+      ra.setFrameRate(45);
+    }, /rate must be 30, 50, 60 or 120/);
+    assert.throws(() => {
+      ra.setFrameRate(60, {pacing: 'drop'});
+    }, /unknown pacing "drop"/);
+  });
 });
@@ -0,0 +1,71 @@
+// Compare the speed of compositing layers using the old per-pixel merge, the
+// js kernel, and the native kernel if the addon has been built.
+//
+//   node tools/bench_compositor.js [iterations]
+const algorithm = require('../src/algorithm.js');
+const kernels = require('../src/kernels.js');
+
+const SIZES = [[64, 32], [320, 240], [640, 480]];
+const MAX_LAYERS = 4;
+
+function makeLayer(width, height, seed) {
+  let surf = algorithm.makeSurface(width, height);
+  // Mix of opaque, transparent, and translucent pixels
+  for (let k = 0; k < surf.buff.length; k += 4) {
+    let n = (k / 4 + seed * 7) % 16;
+    surf.buff[k+0] = n * 16;
+    surf.buff[k+1] = 0xff - n * 16;
+    surf.buff[k+2] = seed * 60;
+    surf.buff[k+3] = n < 8 ? 0xff : n < 14 ? 0x00 : 0x80;
+  }
+  return surf;
+}
+
+function measure(iterations, fn) {
+  // Warm up, so the jit has compiled the js paths
+  for (let n = 0; n < 10; n++) {
+    fn();
+  }
+  let start = process.hrtime.bigint();
+  for (let n = 0; n < iterations; n++) {
+    fn();
+  }
+  let elapsed = Number(process.hrtime.bigint() - start);
+  return elapsed / iterations / 1000;
+}
+
+function main() {
+  let iterations = parseInt(process.argv[2], 10) || 100;
+  let impls = {
+    merge: (dest, layers) => {
+      for (let layer of layers) {
+        algorithm.mergeIntoSurface(dest, layer);
+      }
+    },
+    js: kernels.js.compositeSurfaces,
+  };
+  if (kernels.hasNative('compositeSurfaces')) {
+    impls.native = kernels.compositeSurfaces;
+  }
+
+  let names = Object.keys(impls);
+  console.log(['size', 'layers'].concat(names.map((n) => `${n} (us)`))
+              .join('\t'));
+  for (let [width, height] of SIZES) {
+    for (let numLayers = 1; numLayers <= MAX_LAYERS; numLayers++) {
+      let layers = [];
+      for (let i = 0; i < numLayers; i++) {
+        layers.push(makeLayer(width, height, i));
+      }
+      let dest = algorithm.makeSurface(width, height);
+      let row = [`${width}x${height}`, numLayers];
+      for (let name of names) {
+        let fn = impls[name];
+        row.push(measure(iterations, () => fn(dest, layers)).toFixed(1));
+      }
+      console.log(row.join('\t'));
+    }
+  }
+}
+
+main();